@@ -1,5 +1,6 @@
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <chrono>
 #include "CryptoWebSocketClient.h"
@@ -10,7 +11,7 @@ int main() {
     CryptoWebSocketClient client;
     
     // 设置消息接收回调
-    client.setMessageCallback([](const std::string& message) {
+    client.setMessageCallback([](std::string_view message) {
         std::cout << "收到解密消息: " << message << std::endl;
     });
     
@@ -0,0 +1,109 @@
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "CryptoClientHub.h"
+#include "CryptoWebSocketServer.h"
+#include "Logger.h"
+
+// 多连接客户端示例：本地启动一个回显服务端，集线器在少量线程上建立大量加密会话，
+// 向所有会话广播一条消息并统计回显，最后打印进程的线程数
+//
+// 用法: client_hub [--sessions N] [--threads N] [--uri tcp://127.0.0.1:9400]
+
+namespace {
+
+const std::chrono::seconds kWaitTimeout(60);
+
+// 从 /proc 读取当前进程的线程数
+std::string processThreads() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 8, "Threads:") == 0) {
+            return line.substr(8);
+        }
+    }
+    return " ?";
+}
+
+template <typename Predicate>
+bool waitFor(Predicate predicate) {
+    auto deadline = std::chrono::steady_clock::now() + kWaitTimeout;
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t sessionCount = 1000;
+    size_t threadCount = 4;
+    std::string uri = "tcp://127.0.0.1:9400";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--sessions") {
+            sessionCount = std::stoul(argv[i + 1]);
+        } else if (arg == "--threads") {
+            threadCount = std::stoul(argv[i + 1]);
+        } else if (arg == "--uri") {
+            uri = argv[i + 1];
+        } else {
+            std::cerr << "用法: " << argv[0] << " [--sessions N] [--threads N] [--uri URI]" << std::endl;
+            return 1;
+        }
+    }
+    Logger::setLevel(LogLevel::WARNING);
+
+    CryptoWebSocketServer server;
+    server.setMessageCallback([&server](websocketpp::connection_hdl hdl, std::string_view message) {
+        server.sendEncryptedMessage(hdl, "echo: " + std::string(message));
+    });
+    if (!server.start(uri)) {
+        CRYPTOLINK_LOG_ERROR("服务端启动失败: " << uri);
+        return 1;
+    }
+    std::thread serverThread([&server]() {
+        server.run();
+    });
+
+    std::atomic<size_t> established(0);
+    std::atomic<size_t> replies(0);
+    {
+        CryptoClientHub hub(threadCount);
+        hub.setHandshakeCallback([&established](CryptoClientHub::SessionId) {
+            ++established;
+        });
+        hub.setMessageCallback([&replies](CryptoClientHub::SessionId, std::string_view) {
+            ++replies;
+        });
+
+        // 所有会话共用一个身份，只在第一次 connect 时生成一次
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < sessionCount; ++i) {
+            hub.connect(uri);
+        }
+        bool ready = waitFor([&]() { return established.load() >= sessionCount; });
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "已握手会话: " << established.load() << " / " << sessionCount
+                  << "，耗时 " << elapsed << " 秒，事件循环线程: " << hub.threadCount()
+                  << "，进程线程数:" << processThreads() << std::endl;
+
+        if (ready) {
+            size_t sent = hub.broadcastEncryptedMessage("hello");
+            waitFor([&]() { return replies.load() >= sent; });
+            std::cout << "广播 " << sent << " 个会话，收到回显 " << replies.load() << std::endl;
+        }
+    }
+
+    server.stop();
+    serverThread.join();
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "AsyncClient.h"
+#include "AsyncServer.h"
+#include "CryptoWebSocketClient.h"
+#include "CryptoWebSocketServer.h"
+#include "Logger.h"
+
+// 协程接口示例：服务端每个会话一个协程回显消息，客户端以请求-应答方式顺序发送
+//   需要以 -DCRYPTOLINK_ENABLE_COROUTINES=ON 构建
+//
+// 用法: coroutine_echo [消息数]
+
+namespace {
+
+Task<> echoSession(AsyncSession session) {
+    while (auto message = co_await session.receive()) {
+        // 视图在下一次 co_await 之前有效，这里直接用它构造回复
+        co_await session.send("echo: " + std::string(*message));
+    }
+}
+
+Task<> acceptLoop(AsyncServer& server) {
+    while (auto session = co_await server.accept()) {
+        echoSession(std::move(*session)).detach();
+    }
+}
+
+Task<int> runClient(AsyncClient& client, const std::string& uri, int count) {
+    if (!co_await client.connect(uri)) {
+        CRYPTOLINK_LOG_ERROR("连接失败: " << uri);
+        co_return 0;
+    }
+    if (!co_await client.handshake()) {
+        CRYPTOLINK_LOG_ERROR("握手失败");
+        co_return 0;
+    }
+
+    int replies = 0;
+    for (int i = 0; i < count; ++i) {
+        if (!co_await client.send("message #" + std::to_string(i))) {
+            break;
+        }
+        auto reply = co_await client.receive();
+        if (!reply) {
+            break;
+        }
+        if (i == 0 || i + 1 == count) {
+            std::cout << "收到: " << *reply << std::endl;
+        }
+        ++replies;
+    }
+    co_return replies;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int count = argc > 1 ? std::stoi(argv[1]) : 1000;
+    const std::string endpoint = "tcp://127.0.0.1:9012";
+
+    Logger::setLevel(LogLevel::WARNING);
+
+    CryptoWebSocketServer server;
+    AsyncServer asyncServer(server);
+    if (!server.start(endpoint)) {
+        std::cerr << "服务器启动失败！" << std::endl;
+        return -1;
+    }
+    // 在主线程上运行到第一次 accept，之后由事件循环线程恢复
+    acceptLoop(asyncServer).detach();
+    server.run();
+
+    CryptoWebSocketClient client;
+    AsyncClient asyncClient(client);
+
+    auto start = std::chrono::steady_clock::now();
+    int replies = syncWait(runClient(asyncClient, endpoint, count));
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "完成 " << replies << "/" << count << " 次请求-应答，耗时 " << elapsed << " ms" << std::endl;
+
+    client.stop();
+    server.stop();
+    // 事件循环停止后结束仍在等待的 accept 和会话协程
+    asyncServer.close();
+
+    return replies == count ? 0 : 1;
+}
@@ -1,7 +1,39 @@
 #include <iostream>
-#include <cassert>
 #include "RSAKey.h"
 #include "AESKey.h"
+#include "ChannelMux.h"
+#include "CryptoWebSocketClient.h"
+#include "CryptoWebSocketServer.h"
+#include "DatagramCipher.h"
+#include "FileTransfer.h"
+#include "PeerRelay.h"
+#include "PskHandshake.h"
+#include "RpcSession.h"
+#include "SegmentCipher.h"
+#include "TopicIndex.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Release 构建定义了 NDEBUG，assert 不做任何检查；这里的检查总是生效，失败时抛出异常由 main 报告并返回非零
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": 检查失败: " #condition); \
+        } \
+    } while (0)
 
 void testRSAEncryption() {
     std::cout << "测试 RSA 加密/解密..." << std::endl;
@@ -9,26 +41,26 @@ void testRSAEncryption() {
     RSAKey rsa1, rsa2;
     
     // 生成密钥对
-    assert(rsa1.generateKeyPair());
-    assert(rsa2.generateKeyPair());
+    CHECK(rsa1.generateKeyPair());
+    CHECK(rsa2.generateKeyPair());
     
     // 交换公钥
     std::string publicKey1 = rsa1.getLocalPublicKey();
     std::string publicKey2 = rsa2.getLocalPublicKey();
     
-    assert(!publicKey1.empty());
-    assert(!publicKey2.empty());
+    CHECK(!publicKey1.empty());
+    CHECK(!publicKey2.empty());
     
-    assert(rsa1.setRemotePublicKey(publicKey2));
-    assert(rsa2.setRemotePublicKey(publicKey1));
+    CHECK(rsa1.setRemotePublicKey(publicKey2));
+    CHECK(rsa2.setRemotePublicKey(publicKey1));
     
     // 测试加密/解密
     std::string plaintext = "Hello, RSA World!";
     std::string encrypted = rsa1.encryptWithRemotePublic(plaintext);
     std::string decrypted = rsa2.decryptWithLocalPrivate(encrypted);
     
-    assert(!encrypted.empty());
-    assert(decrypted == plaintext);
+    CHECK(!encrypted.empty());
+    CHECK(decrypted == plaintext);
     
     std::cout << "RSA 测试通过！" << std::endl;
 }
@@ -39,29 +71,29 @@ void testAESEncryption() {
     AESKey aes1, aes2;
     
     // 生成密钥
-    assert(aes1.generateRawKey());
-    assert(aes2.generateRawKey());
+    CHECK(aes1.generateRawKey());
+    CHECK(aes2.generateRawKey());
     
     // 模拟密钥交换
     std::string key1 = aes1.getLocalKey();
-    assert(!key1.empty());
+    CHECK(!key1.empty());
     
     // 解析密钥格式 key:iv
     size_t colonPos = key1.find(':');
-    assert(colonPos != std::string::npos);
+    CHECK(colonPos != std::string::npos);
     
     std::string keyPart = key1.substr(0, colonPos);
     std::string ivPart = key1.substr(colonPos + 1);
     
-    assert(aes2.setRemotePublicKey(keyPart, ivPart));
+    CHECK(aes2.setRemotePublicKey(keyPart, ivPart));
     
     // 测试加密/解密
     std::string plaintext = "Hello, AES World! 这是一个测试消息。";
     std::string encrypted = aes1.encryptWithLocal(plaintext);
     std::string decrypted = aes2.decryptWithRemote(encrypted);
     
-    assert(!encrypted.empty());
-    assert(decrypted == plaintext);
+    CHECK(!encrypted.empty());
+    CHECK(decrypted == plaintext);
     
     std::cout << "AES 测试通过！" << std::endl;
 }
@@ -72,29 +104,849 @@ void testRSASignature() {
     RSAKey rsa1, rsa2;
     
     // 生成密钥对并交换公钥
-    assert(rsa1.generateKeyPair());
-    assert(rsa2.generateKeyPair());
+    CHECK(rsa1.generateKeyPair());
+    CHECK(rsa2.generateKeyPair());
     
     std::string publicKey1 = rsa1.getLocalPublicKey();
     std::string publicKey2 = rsa2.getLocalPublicKey();
     
-    assert(rsa1.setRemotePublicKey(publicKey2));
-    assert(rsa2.setRemotePublicKey(publicKey1));
+    CHECK(rsa1.setRemotePublicKey(publicKey2));
+    CHECK(rsa2.setRemotePublicKey(publicKey1));
     
     // 测试签名和验证
     std::string data = "Important message to sign";
     std::string signature = rsa1.signWithLocalPrivate(data);
     
-    assert(!signature.empty());
-    assert(rsa2.verifyWithRemotePublic(data, signature));
+    CHECK(!signature.empty());
+    CHECK(rsa2.verifyWithRemotePublic(data, signature));
     
     // 测试篡改检测
     std::string tamperedData = "Tampered message";
-    assert(!rsa2.verifyWithRemotePublic(tamperedData, signature));
+    CHECK(!rsa2.verifyWithRemotePublic(tamperedData, signature));
     
     std::cout << "RSA 签名测试通过！" << std::endl;
 }
 
+void testTopicIndex() {
+    std::cout << "测试主题订阅索引..." << std::endl;
+    
+    TopicIndex index;
+    std::vector<TopicIndex::SubscriberId> matched;
+    auto matches = [&](const std::string& topic) {
+        matched.clear();
+        index.match(topic, matched);
+        std::sort(matched.begin(), matched.end());
+        return matched;
+    };
+    
+    // 精确主题和通配符
+    CHECK(index.subscribe(1, "a/b"));
+    CHECK(index.subscribe(2, "a/+"));
+    CHECK(index.subscribe(3, "a/#"));
+    CHECK(!index.subscribe(3, "a/#"));
+    CHECK(!index.subscribe(4, "a/#/x"));
+    CHECK(!index.subscribe(4, "a/b+"));
+    CHECK(index.subscriptionCount() == 3);
+    
+    CHECK(matches("a/b") == std::vector<TopicIndex::SubscriberId>({1, 2, 3}));
+    CHECK(matches("a/c") == std::vector<TopicIndex::SubscriberId>({2, 3}));
+    CHECK(matches("a") == std::vector<TopicIndex::SubscriberId>({3}));
+    CHECK(matches("a/b/c") == std::vector<TopicIndex::SubscriberId>({3}));
+    CHECK(matches("b/a").empty());
+    
+    // 非法模式不能取消到合法的订阅上
+    CHECK(!index.unsubscribe(3, "a/#/x"));
+    CHECK(!index.unsubscribe(2, "a/+/#/"));
+    CHECK(index.subscriptionCount() == 3);
+    
+    CHECK(index.unsubscribe(3, "a/#"));
+    CHECK(!index.unsubscribe(3, "a/#"));
+    CHECK(!index.unsubscribe(1, "a/+"));
+    CHECK(matches("a/b/c").empty());
+    CHECK(matches("a/b") == std::vector<TopicIndex::SubscriberId>({1, 2}));
+    
+    index.removeSubscriber(2);
+    CHECK(matches("a/b") == std::vector<TopicIndex::SubscriberId>({1}));
+    CHECK(index.subscriptionCount() == 1);
+    
+    std::cout << "主题订阅索引测试通过！" << std::endl;
+}
+
+void testChannelMux() {
+    std::cout << "测试通道复用与流量控制..." << std::endl;
+    
+    // 两端的记录先排队再投递，避免在发送方持锁时重入对端
+    std::deque<std::pair<bool, std::string>> wire;     // (发往 B, 记录头 + 负载)
+    size_t largestFragment = 0;
+    auto makeSender = [&](bool toB) {
+        return [&wire, &largestFragment, toB](std::string_view header, std::string_view payload) {
+            if (static_cast<uint8_t>(header[0]) == ChannelMux::CHANNEL_DATA) {
+                largestFragment = std::max(largestFragment, payload.size());
+            }
+            wire.emplace_back(toB, std::string(header) + std::string(payload));
+            return true;
+        };
+    };
+    ChannelMux a(makeSender(true), true);
+    ChannelMux b(makeSender(false), false);
+    auto deliver = [&]() {
+        while (!wire.empty()) {
+            auto record = std::move(wire.front());
+            wire.pop_front();
+            std::string_view data(record.second);
+            (record.first ? b : a).handleRecord(data.substr(0, ChannelMux::kHeaderSize),
+                                                data.substr(ChannelMux::kHeaderSize));
+        }
+    };
+    
+    std::vector<std::string> received;
+    bool closed = false;
+    b.setDataHandler([&](ChannelMux::ChannelId, std::string_view message) {
+        received.emplace_back(message);
+    });
+    b.setCloseHandler([&](ChannelMux::ChannelId) {
+        closed = true;
+    });
+    
+    ChannelMux::ChannelId channel = a.openChannel();
+    CHECK(channel == 1);
+    deliver();
+    CHECK(b.isOpen(channel));
+    
+    // 超出初始窗口的部分排队，对端归还信用后继续发送，重组后整条交付
+    std::string large(600 * 1024, '\0');
+    for (size_t i = 0; i < large.size(); ++i) {
+        large[i] = static_cast<char>(i * 31 + 7);
+    }
+    CHECK(a.send(channel, large));
+    CHECK(a.pendingBytes(channel) == large.size() - ChannelMux::kInitialWindow);
+    CHECK(a.send(channel, "small"));
+    deliver();
+    CHECK(a.pendingBytes(channel) == 0);
+    CHECK(largestFragment <= ChannelMux::kMaxFragment);
+    CHECK(received.size() == 2);
+    CHECK(received[0] == large);
+    CHECK(received[1] == "small");
+    
+    // 超过上限的消息发送端直接拒绝
+    CHECK(!a.send(channel, std::string(ChannelMux::kMaxMessageSize + 1, 'x')));
+    
+    // 对端绕过上限持续发送中间分片时，重组缓冲区不会无限增长，通道被关闭
+    char header[ChannelMux::kHeaderSize] = {ChannelMux::CHANNEL_DATA, 0, 0, 0, 0, static_cast<char>(channel)};
+    const std::string fragment(ChannelMux::kMaxFragment, 'y');
+    size_t accepted = 0;
+    while (b.handleRecord(std::string_view(header, sizeof(header)), fragment)) {
+        accepted += fragment.size();
+        CHECK(accepted <= ChannelMux::kMaxMessageSize);
+    }
+    CHECK(accepted == ChannelMux::kMaxMessageSize);
+    CHECK(closed);
+    CHECK(!b.isOpen(channel));
+    deliver();
+    CHECK(a.channelCount() == 0);
+    
+    // 对端只能用自己一侧奇偶的通道号，不能抢占本端将要分配的通道号
+    char open[ChannelMux::kHeaderSize] = {ChannelMux::CHANNEL_OPEN, 0, 0, 0, 0, 2};
+    CHECK(!b.handleRecord(std::string_view(open, sizeof(open)), std::string_view()));
+    open[5] = 0;
+    CHECK(!b.handleRecord(std::string_view(open, sizeof(open)), std::string_view()));
+    CHECK(b.channelCount() == 0);
+    
+    // 通道数达到上限后，对端的 CHANNEL_OPEN 收到 CHANNEL_CLOSE，本端也不能再打开
+    for (size_t i = 0; i < ChannelMux::kMaxChannels; ++i) {
+        CHECK(a.openChannel() != 0);
+    }
+    CHECK(a.openChannel() == 0);
+    deliver();
+    CHECK(b.channelCount() == ChannelMux::kMaxChannels);
+    CHECK(b.openChannel() == 0);
+    ChannelMux c(makeSender(false), false);
+    for (size_t i = 0; i < ChannelMux::kMaxChannels; ++i) {
+        CHECK(c.openChannel() != 0);
+    }
+    wire.clear();
+    const ChannelMux::ChannelId extra = 2 * ChannelMux::kMaxChannels + 1;
+    for (int i = 5; i >= 2; --i) {
+        open[i] = static_cast<char>((extra >> (8 * (5 - i))) & 0xff);
+    }
+    CHECK(!c.handleRecord(std::string_view(open, sizeof(open)), std::string_view()));
+    CHECK(wire.size() == 1 && static_cast<uint8_t>(wire.front().second[0]) == ChannelMux::CHANNEL_CLOSE);
+    wire.clear();
+    
+    std::cout << "通道复用测试通过！" << std::endl;
+}
+
+void testSegmentLimits() {
+    std::cout << "测试分段消息的接收上限..." << std::endl;
+    
+    CryptoPP::SecByteBlock keyA(32), keyB(32);
+    for (size_t i = 0; i < 32; ++i) {
+        keyA[i] = static_cast<CryptoPP::byte>(i);
+        keyB[i] = static_cast<CryptoPP::byte>(0x80 + i);
+    }
+    SegmentCipher sender(CipherSuite::AES_256_GCM, keyA, keyB, []() {});
+    SegmentCipher receiver(CipherSuite::AES_256_GCM, keyB, keyA, []() {});
+    receiver.setReceiveLimit(2 * 1024 * 1024);
+    
+    // 接收消息在工作线程上解密，最后一段到达后不等待，由 collectIncoming 取出
+    uint8_t type = 0;
+    std::string_view opened;
+    auto received = [&]() {
+        while (!receiver.collectIncoming(type, opened)) {
+            std::this_thread::yield();
+        }
+    };
+    
+    auto sealed = [&](const std::string& plaintext) {
+        CHECK(sender.seal(4, SendPriority::NORMAL, BufferPool::local().copyFrom(plaintext.data(), plaintext.size())));
+        SegmentCipher::SealedMessage message;
+        while (!sender.collect(message)) {
+            std::this_thread::yield();
+        }
+        return message;
+    };
+    
+    // 收到对端的上限之前不分段，之后只分段不超过上限的消息
+    CHECK(!sender.accepts(1024 * 1024));
+    PooledBuffer limit = receiver.limitPayload();
+    CHECK(sender.handleLimit(limit.view()));
+    CHECK(sender.accepts(2 * 1024 * 1024));
+    CHECK(!sender.accepts(2 * 1024 * 1024 + 1));
+    
+    std::string plaintext(1536 * 1024, '\0');
+    for (size_t i = 0; i < plaintext.size(); ++i) {
+        plaintext[i] = static_cast<char>(i * 131 + 17);
+    }
+    SegmentCipher::SealedMessage message = sealed(plaintext);
+    CHECK(receiver.handleBegin(message.begin.view()));
+    for (const PooledBuffer& segment : message.segments) {
+        CHECK(receiver.handleSegment(segment.view()));
+    }
+    received();
+    CHECK(type == 4 && opened == plaintext);
+    
+    // 完成的消息不再接受它的段
+    CHECK(!receiver.handleSegment(message.segments[0].view()));
+    
+    // 超过接收上限的消息被拒绝，拒绝记录带回消息号，之后的段直接丢弃
+    std::string large(3 * 1024 * 1024, 'x');
+    message = sealed(large);
+    CHECK(!receiver.handleBegin(message.begin.view()));
+    PooledBuffer reject = SegmentCipher::rejectFor(message.begin.view());
+    CHECK(reject.size() == 2);
+    CHECK(sender.handleReject(reject.view()));
+    for (const PooledBuffer& segment : message.segments) {
+        CHECK(!receiver.handleSegment(segment.view()));
+    }
+    CHECK(!receiver.collectIncoming(type, opened));
+    CHECK(!SegmentCipher::rejectFor("short"));
+    
+    // 拒绝不影响之后的消息
+    message = sealed(plaintext);
+    CHECK(receiver.handleBegin(message.begin.view()));
+    for (const PooledBuffer& segment : message.segments) {
+        CHECK(receiver.handleSegment(segment.view()));
+    }
+    received();
+    CHECK(opened == plaintext);
+    
+    std::cout << "分段消息接收上限测试通过！" << std::endl;
+}
+
+void testSegmentOrdering() {
+    std::cout << "测试分段消息的乱序、重复和篡改..." << std::endl;
+    
+    CryptoPP::SecByteBlock keyA(32), keyB(32);
+    for (size_t i = 0; i < 32; ++i) {
+        keyA[i] = static_cast<CryptoPP::byte>(0x40 + i);
+        keyB[i] = static_cast<CryptoPP::byte>(0xc0 + i);
+    }
+    SegmentCipher sender(CipherSuite::AES_256_GCM, keyA, keyB, []() {});
+    SegmentCipher receiver(CipherSuite::AES_256_GCM, keyB, keyA, []() {});
+    
+    uint8_t type = 0;
+    std::string_view opened;
+    auto received = [&]() {
+        while (!receiver.collectIncoming(type, opened)) {
+            std::this_thread::yield();
+        }
+    };
+    auto sealed = [&](const std::string& plaintext) {
+        CHECK(sender.seal(7, SendPriority::BULK, BufferPool::local().copyFrom(plaintext.data(), plaintext.size())));
+        SegmentCipher::SealedMessage message;
+        while (!sender.collect(message)) {
+            std::this_thread::yield();
+        }
+        return message;
+    };
+    
+    std::string first(1024 * 1024 + 333, '\0');
+    for (size_t i = 0; i < first.size(); ++i) {
+        first[i] = static_cast<char>(i * 7 + 3);
+    }
+    const std::string second(SegmentCipher::kSegmentSize * 2 + 1, 'y');
+    
+    // SEGMENT_BEGIN 之前的段不被接受
+    SegmentCipher::SealedMessage message = sealed(first);
+    CHECK(message.segments.size() == 5);
+    CHECK(!receiver.handleSegment(message.segments[0].view()));
+    
+    // 段倒序到达也能拼回原消息
+    CHECK(receiver.handleBegin(message.begin.view()));
+    for (size_t i = message.segments.size(); i-- > 0;) {
+        CHECK(receiver.handleSegment(message.segments[i].view()));
+    }
+    received();
+    CHECK(type == 7 && opened == first);
+    
+    // 重复的段丢弃整条消息，之后的段不再接受
+    message = sealed(first);
+    CHECK(receiver.handleBegin(message.begin.view()));
+    CHECK(receiver.handleSegment(message.segments[1].view()));
+    CHECK(!receiver.handleSegment(message.segments[1].view()));
+    CHECK(!receiver.handleSegment(message.segments[0].view()));
+    CHECK(!receiver.collectIncoming(type, opened));
+    
+    // 篡改一段后整条消息被丢弃，不影响之后的消息
+    message = sealed(first);
+    CHECK(receiver.handleBegin(message.begin.view()));
+    for (size_t i = 0; i < message.segments.size(); ++i) {
+        std::string record = message.segments[i].toString();
+        if (i == 2) {
+            record[SegmentCipher::kHeaderSize + 10] ^= 1;
+        }
+        CHECK(receiver.handleSegment(record));
+    }
+    SegmentCipher::SealedMessage next = sealed(second);
+    CHECK(receiver.handleBegin(next.begin.view()));
+    for (const PooledBuffer& segment : next.segments) {
+        CHECK(receiver.handleSegment(segment.view()));
+    }
+    received();
+    CHECK(opened == second);
+    CHECK(!receiver.collectIncoming(type, opened));
+    
+    std::cout << "分段消息乱序与篡改测试通过！" << std::endl;
+}
+
+void testDatagramCipher() {
+    std::cout << "测试数据报的重放窗口..." << std::endl;
+    
+    auto directionalKey = [](char fill) {
+        DirectionalKey key;
+        const std::string bytes(32, fill);
+        key.key.Assign(reinterpret_cast<const CryptoPP::byte*>(bytes.data()), bytes.size());
+        key.salt.Assign(reinterpret_cast<const CryptoPP::byte*>(bytes.data()), 4);
+        return key;
+    };
+    const DirectionalKey keyA = directionalKey('a');
+    const DirectionalKey keyB = directionalKey('b');
+    DatagramCipher sender(CipherSuite::AES_256_GCM, 7, keyA, keyB);
+    DatagramCipher receiver(CipherSuite::AES_256_GCM, 7, keyB, keyA);
+    DatagramCipher ordered(CipherSuite::AES_256_GCM, 7, keyB, keyA, DatagramCipher::Delivery::ORDERED);
+    DatagramCipher otherConnection(CipherSuite::AES_256_GCM, 8, keyB, keyA);
+    
+    // 第 i 个数据报的序号是 i + 1
+    std::vector<std::string> datagrams;
+    for (int i = 0; i < 3200; ++i) {
+        datagrams.push_back(sender.seal("d" + std::to_string(i), BufferPool::local()).toString());
+    }
+    bool newest = false;
+    auto open = [&](DatagramCipher& cipher, std::string datagram) {
+        std::string_view payload;
+        return cipher.open(&datagram[0], datagram.size(), payload, newest);
+    };
+    
+    uint64_t connectionId = 0;
+    CHECK(DatagramCipher::readConnectionId(datagrams[0].data(), datagrams[0].size(), connectionId) && connectionId == 7);
+    CHECK(!DatagramCipher::readConnectionId(datagrams[0].data(), DatagramCipher::kConnectionIdSize - 1, connectionId));
+    
+    // 迟到的数据报照常交付但不是最新的，重复的被丢弃
+    CHECK(open(receiver, datagrams[1]) && newest);
+    CHECK(open(receiver, datagrams[0]) && !newest);
+    CHECK(!open(receiver, datagrams[0]));
+    CHECK(!open(receiver, datagrams[1]));
+    
+    // 序号 0 不会被发出，收到时拒绝
+    std::string zero = datagrams[2];
+    std::fill(zero.begin() + DatagramCipher::kConnectionIdSize, zero.begin() + DatagramCipher::kHeaderSize, '\0');
+    CHECK(!open(receiver, zero));
+    
+    // 连接号不同的数据报在解密前拒绝，不影响本连接的窗口
+    CHECK(!open(otherConnection, datagrams[2]));
+    CHECK(open(receiver, datagrams[2]));
+    
+    // 窗口边界：落后最新序号 kReplayWindow - 1 的还能接受，落后 kReplayWindow 的视为重放
+    CHECK(open(receiver, datagrams[1500]) && newest);
+    CHECK(open(receiver, datagrams[1500 - (DatagramCipher::kReplayWindow - 1)]) && !newest);
+    CHECK(!open(receiver, datagrams[1500 - DatagramCipher::kReplayWindow]));
+    
+    // 序号跳过整个窗口后，窗口内没有见过的序号都能接受，跳过之前的已经过期
+    CHECK(open(receiver, datagrams[3000]) && newest);
+    CHECK(open(receiver, datagrams[2999]));
+    CHECK(open(receiver, datagrams[1500 + DatagramCipher::kReplayWindow]));
+    CHECK(open(receiver, datagrams[2000]));
+    CHECK(!open(receiver, datagrams[1500]));
+    
+    // 被篡改的数据报校验失败，不会占用它的序号
+    std::string tampered = datagrams[3100];
+    tampered[DatagramCipher::kHeaderSize + 1] ^= 1;
+    CHECK(!open(receiver, tampered));
+    CHECK(open(receiver, datagrams[3100]) && newest);
+    
+    // 按序交付时迟到的数据报直接丢弃
+    CHECK(open(ordered, datagrams[10]));
+    CHECK(!open(ordered, datagrams[9]));
+    CHECK(!open(ordered, datagrams[10]));
+    CHECK(open(ordered, datagrams[12]));
+    CHECK(!open(ordered, datagrams[11]));
+    
+    std::cout << "数据报重放窗口测试通过！" << std::endl;
+}
+
+void testRpcSession() {
+    std::cout << "测试请求/应答调用..." << std::endl;
+    
+    // 两个会话的记录经过队列互相投递，代替连接
+    struct Record {
+        RpcSession* to;
+        uint8_t type;
+        std::string payload;
+    };
+    std::deque<Record> wire;
+    RpcSession* callerEnd = nullptr;
+    RpcSession* serverEnd = nullptr;
+    RpcSession caller([&](RpcSession::RecordType type, SendPriority, PooledBuffer payload) {
+        wire.push_back({serverEnd, type, payload.toString()});
+        return true;
+    });
+    RpcSession server([&](RpcSession::RecordType type, SendPriority, PooledBuffer payload) {
+        wire.push_back({callerEnd, type, payload.toString()});
+        return true;
+    });
+    callerEnd = &caller;
+    serverEnd = &server;
+    auto deliver = [&]() {
+        while (!wire.empty()) {
+            Record record = std::move(wire.front());
+            wire.pop_front();
+            CHECK(record.to->handleRecord(record.type, record.payload));
+        }
+    };
+    
+    std::vector<std::pair<RpcSession::Status, std::string>> results;
+    auto collect = [&](RpcSession::Status status, std::string_view payload) {
+        results.emplace_back(status, std::string(payload));
+    };
+    
+    // 没有处理函数时以 NOT_FOUND 应答
+    CHECK(caller.call("echo", "x", collect, std::chrono::milliseconds(0)) != 0);
+    caller.poll(std::chrono::steady_clock::now());
+    deliver();
+    CHECK(results.size() == 1 && results[0].first == RpcSession::Status::NOT_FOUND);
+    
+    std::vector<RpcSession::Responder> held;
+    server.setRequestHandler([&](std::string_view method, std::string_view request, RpcSession::Responder responder) {
+        if (method == "echo") {
+            responder.reply(request);
+            CHECK(!responder.reply("again"));
+        } else if (method == "fail") {
+            responder.fail("bad request");
+        } else if (method == "hold") {
+            held.push_back(responder);
+        }
+        // 其他方法不应答，句柄销毁时自动以 ERROR 应答
+    });
+    
+    // 应答按调用号对应，错误带回错误信息，丢掉的句柄自动应答
+    results.clear();
+    CHECK(caller.call("echo", "hello", collect, std::chrono::milliseconds(0)) != 0);
+    CHECK(caller.call("fail", "", collect, std::chrono::milliseconds(0)) != 0);
+    CHECK(caller.call("drop", "", collect, std::chrono::milliseconds(0)) != 0);
+    deliver();
+    CHECK(results.size() == 3);
+    CHECK(results[0].first == RpcSession::Status::OK && results[0].second == "hello");
+    CHECK(results[1].first == RpcSession::Status::ERROR && results[1].second == "bad request");
+    CHECK(results[2].first == RpcSession::Status::ERROR);
+    CHECK(caller.pendingCount() == 0);
+    
+    // 截止时间过后本端以 DEADLINE_EXCEEDED 结束并通知对端，对端之后的应答不再发出
+    results.clear();
+    CHECK(caller.call("hold", "", collect, std::chrono::milliseconds(1)) != 0);
+    deliver();
+    CHECK(held.size() == 1 && results.empty());
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    CHECK(caller.poll(std::chrono::steady_clock::now()) == std::chrono::steady_clock::time_point::max());
+    CHECK(results.size() == 1 && results[0].first == RpcSession::Status::DEADLINE_EXCEEDED);
+    deliver();
+    CHECK(held[0].isCancelled());
+    CHECK(!held[0].reply("late"));
+    CHECK(wire.empty());
+    
+    // 取消的调用在下一次 poll 时结束，对端的句柄看到取消
+    results.clear();
+    held.clear();
+    const RpcSession::CallId id = caller.call("hold", "", collect, std::chrono::milliseconds(0));
+    CHECK(id != 0);
+    deliver();
+    CHECK(held.size() == 1 && !held[0].isCancelled());
+    caller.cancel(id);
+    CHECK(results.empty());
+    caller.poll(std::chrono::steady_clock::now());
+    CHECK(results.size() == 1 && results[0].first == RpcSession::Status::CANCELLED);
+    deliver();
+    CHECK(held[0].isCancelled() && !held[0].reply("late"));
+    held.clear();
+    CHECK(wire.empty());
+    
+    // 断开时在途调用恰好结束一次，正在处理的请求视为已取消
+    results.clear();
+    CHECK(caller.call("hold", "", collect, std::chrono::milliseconds(0)) != 0);
+    CHECK(caller.call("hold", "", collect, std::chrono::milliseconds(60000)) != 0);
+    deliver();
+    CHECK(held.size() == 2);
+    caller.disconnect();
+    server.disconnect();
+    CHECK(results.size() == 2);
+    CHECK(results[0].first == RpcSession::Status::DISCONNECTED && results[1].first == RpcSession::Status::DISCONNECTED);
+    CHECK(held[0].isCancelled() && !held[0].reply("late"));
+    held.clear();
+    deliver();
+    CHECK(results.size() == 2 && caller.pendingCount() == 0);
+    
+    std::cout << "请求/应答调用测试通过！" << std::endl;
+}
+
+void testPeerRelayEpochs() {
+    std::cout << "测试中继消息的纪元和序号..." << std::endl;
+    
+    // 只收集发出的 RELAY_DATA，登记和查询记录不需要服务端处理
+    std::deque<std::string> frames;
+    PeerRelay alice([&](PeerRelay::RecordType type, SendPriority, PooledBuffer payload) {
+        if (type == PeerRelay::RELAY_DATA) {
+            frames.push_back(payload.toString());
+        }
+        return true;
+    });
+    PeerRelay bob([](PeerRelay::RecordType, SendPriority, PooledBuffer) {
+        return true;
+    });
+    std::vector<std::string> delivered;
+    bob.setMessageHandler([&](std::string_view peer, std::string_view message) {
+        CHECK(peer == "alice");
+        delivered.emplace_back(message);
+    });
+    
+    CHECK(alice.enable("alice") && bob.enable("bob"));
+    CHECK(alice.setPeerKey("bob", bob.publicKey()));
+    CHECK(bob.setPeerKey("alice", alice.publicKey()));
+    alice.connected();
+    bob.connected();
+    
+    // 服务端转发时把路由名字改写为发送方
+    auto sendFrame = [&](const std::string& message) {
+        CHECK(alice.send("bob", message));
+        CHECK(frames.size() == 1);
+        std::string frame = frames.front();
+        frames.pop_front();
+        return frame;
+    };
+    auto deliver = [&](const std::string& frame) {
+        std::string_view name, sealed;
+        CHECK(PeerRelay::decodeFrame(frame, name, sealed) && name == "bob");
+        std::string forwarded = PeerRelay::encodeFrame("alice", sealed).toString();
+        const size_t before = delivered.size();
+        bob.handleFrame(forwarded);
+        return delivered.size() > before;
+    };
+    
+    std::vector<std::string> first;
+    for (int i = 0; i < 5; ++i) {
+        first.push_back(sendFrame("e1-" + std::to_string(i)));
+    }
+    
+    // 同一纪元内序号必须严格递增
+    CHECK(deliver(first[0]) && delivered.back() == "e1-0");
+    CHECK(!deliver(first[0]));
+    CHECK(deliver(first[2]));
+    CHECK(!deliver(first[1]));
+    
+    // 重新启用开始新纪元，保留的旧纪元仍按序号接受
+    CHECK(alice.enable("alice"));
+    CHECK(deliver(sendFrame("e2")));
+    CHECK(deliver(first[3]) && delivered.back() == "e1-3");
+    
+    // 旧纪元被挤出保留状态后，即使序号更大也不再接受
+    for (int i = 3; i <= 5; ++i) {
+        CHECK(alice.enable("alice"));
+        CHECK(deliver(sendFrame("e" + std::to_string(i))));
+    }
+    CHECK(!deliver(first[4]));
+    CHECK(delivered.size() == 7);
+    
+    std::cout << "中继纪元测试通过！" << std::endl;
+}
+
+void testFileResume() {
+    std::cout << "测试文件传输的断点续传..." << std::endl;
+    
+    const std::string directory = "/tmp/crypto_test-" + std::to_string(getpid()) + "-files";
+    const std::string receiveDirectory = directory + "/received";
+    CHECK(mkdir(directory.c_str(), 0700) == 0 && mkdir(receiveDirectory.c_str(), 0700) == 0);
+    const std::string source = directory + "/source.bin";
+    const uint64_t chunkCount = 65;
+    std::string content((chunkCount - 1) * FileTransfer::kChunkSize + 100, '\0');
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<char>(i * 13 + i / 7);
+    }
+    {
+        std::ofstream out(source, std::ios::binary);
+        out.write(content.data(), content.size());
+    }
+    
+    // 记录经过队列投递，断线时丢弃在途的记录
+    struct Record {
+        bool toReceiver;
+        uint8_t type;
+        std::string payload;
+    };
+    std::deque<Record> wire;
+    FileTransfer sender([&](FileTransfer::RecordType type, SendPriority, PooledBuffer payload) {
+        wire.push_back({true, type, payload.toString()});
+        return true;
+    });
+    auto makeReceiver = [&]() {
+        auto receiver = std::make_unique<FileTransfer>([&](FileTransfer::RecordType type, SendPriority, PooledBuffer payload) {
+            wire.push_back({false, type, payload.toString()});
+            return true;
+        });
+        receiver->setReceiveDirectory(receiveDirectory);
+        receiver->setPeerKey("alice");
+        return receiver;
+    };
+    std::unique_ptr<FileTransfer> receiver = makeReceiver();
+    
+    int sent = 0;
+    int received = 0;
+    std::string receivedPath;
+    sender.setSentHandler([&](FileTransfer::TransferId, const std::string&, bool completed) {
+        CHECK(completed);
+        ++sent;
+    });
+    auto onReceived = [&](FileTransfer::TransferId, const std::string& path, bool completed) {
+        CHECK(completed);
+        receivedPath = path;
+        ++received;
+    };
+    receiver->setReceivedHandler(onReceived);
+    
+    // 收到的块序号：传输号(8) 之后的 8 字节
+    std::vector<uint64_t> chunks;
+    auto deliver = [&](size_t limit) {
+        for (size_t i = 0; i < limit && !wire.empty(); ++i) {
+            Record record = std::move(wire.front());
+            wire.pop_front();
+            if (record.type == FileTransfer::FILE_CHUNK) {
+                uint64_t index = 0;
+                for (size_t j = 0; j < 8; ++j) {
+                    index = (index << 8) | static_cast<uint8_t>(record.payload[FileTransfer::kIdSize + j]);
+                }
+                chunks.push_back(index);
+            }
+            (record.toReceiver ? *receiver : sender).handleRecord(record.type, record.payload);
+        }
+    };
+    
+    const FileTransfer::TransferId id = sender.sendFile(source, SendPriority::BULK);
+    CHECK(id != 0 && id == FileTransfer::transferIdFor(source));
+    
+    // 请求、应答和前 38 块送达后断线，发送端保留传输，接收端的部分文件留在磁盘上
+    deliver(40);
+    CHECK(chunks.size() == 38 && received == 0);
+    wire.clear();
+    sender.disconnect(true);
+    receiver->disconnect(true);
+    CHECK(sender.outgoingCount() == 1 && receiver->incomingCount() == 0);
+    
+    // 新连接上重新发出请求，接收端从部分文件已有的块数续传
+    chunks.clear();
+    receiver = makeReceiver();
+    receiver->setReceivedHandler(onReceived);
+    sender.resume();
+    deliver(SIZE_MAX);
+    CHECK(sent == 1 && received == 1);
+    CHECK(!chunks.empty() && chunks.front() == 38 && chunks.size() == chunkCount - 38);
+    CHECK(receivedPath == receiveDirectory + "/source.bin");
+    std::ifstream in(receivedPath, std::ios::binary);
+    const std::string copy((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CHECK(copy == content);
+    CHECK(sender.outgoingCount() == 0 && receiver->incomingCount() == 0);
+    
+    std::remove(receivedPath.c_str());
+    std::remove(source.c_str());
+    rmdir(receiveDirectory.c_str());
+    rmdir(directory.c_str());
+    
+    std::cout << "文件断点续传测试通过！" << std::endl;
+}
+
+void testPskHandshake() {
+    std::cout << "测试预共享密钥握手..." << std::endl;
+    
+    const std::string key(32, '\x5a');
+    const std::string offer = cipherSuitesToString({CipherSuite::AES_256_GCM, CipherSuite::CHACHA20_POLY1305});
+    const std::string clientNonce = PskHandshake::makeNonce();
+    const std::string serverNonce = PskHandshake::makeNonce();
+    CHECK(clientNonce.size() == PskHandshake::kNonceSize && clientNonce != serverNonce);
+    
+    // 双方输入相同时派生出相同的材料，两个确认值互不相同
+    PskHandshake::Derived client, server;
+    CHECK(PskHandshake::derive(key, "id", offer, CipherSuite::AES_256_GCM, clientNonce, serverNonce, client));
+    CHECK(PskHandshake::derive(key, "id", offer, CipherSuite::AES_256_GCM, clientNonce, serverNonce, server));
+    CHECK(client.secret == server.secret);
+    CHECK(client.secret.size() == PskHandshake::kSecretSize);
+    CHECK(client.clientConfirm.size() == PskHandshake::kConfirmSize);
+    CHECK(PskHandshake::confirmEquals(client.serverConfirm, server.serverConfirm));
+    CHECK(!PskHandshake::confirmEquals(client.clientConfirm, client.serverConfirm));
+    CHECK(!PskHandshake::confirmEquals(client.serverConfirm, client.serverConfirm.substr(1)));
+    
+    // 密钥、身份、套件列表、选中的套件或随机数任何一项不同，确认值都不同
+    PskHandshake::Derived other;
+    CHECK(PskHandshake::derive(std::string(32, '\x5b'), "id", offer, CipherSuite::AES_256_GCM, clientNonce, serverNonce, other));
+    CHECK(!PskHandshake::confirmEquals(other.serverConfirm, server.serverConfirm));
+    CHECK(PskHandshake::derive(key, "id2", offer, CipherSuite::AES_256_GCM, clientNonce, serverNonce, other));
+    CHECK(!PskHandshake::confirmEquals(other.serverConfirm, server.serverConfirm));
+    CHECK(PskHandshake::derive(key, "id", cipherSuitesToString({CipherSuite::AES_256_GCM}), CipherSuite::AES_256_GCM,
+                               clientNonce, serverNonce, other));
+    CHECK(!PskHandshake::confirmEquals(other.serverConfirm, server.serverConfirm));
+    CHECK(PskHandshake::derive(key, "id", offer, CipherSuite::CHACHA20_POLY1305, clientNonce, serverNonce, other));
+    CHECK(!PskHandshake::confirmEquals(other.serverConfirm, server.serverConfirm));
+    CHECK(PskHandshake::derive(key, "id", offer, CipherSuite::AES_256_GCM, serverNonce, clientNonce, other));
+    CHECK(!PskHandshake::confirmEquals(other.serverConfirm, server.serverConfirm));
+    
+    // 密钥过短或随机数长度不对时拒绝派生
+    CHECK(!PskHandshake::derive(std::string(PskHandshake::kMinKeySize - 1, 'k'), "id", offer, CipherSuite::AES_256_GCM,
+                                clientNonce, serverNonce, other));
+    CHECK(!PskHandshake::derive(key, "id", offer, CipherSuite::AES_256_GCM, clientNonce.substr(1), serverNonce, other));
+    
+    // 编码后解析回原值，字段数、随机数和确认值长度不对时拒绝
+    std::string identity, nonce, parsedOffer, confirm;
+    CipherSuite suite = CipherSuite::NONE;
+    CHECK(PskHandshake::parseHello(PskHandshake::encodeHello("id", clientNonce, offer), identity, nonce, parsedOffer));
+    CHECK(identity == "id" && nonce == clientNonce && parsedOffer == offer);
+    CHECK(!PskHandshake::parseHello(PskHandshake::encodeHello("id", clientNonce.substr(1), offer), identity, nonce, parsedOffer));
+    CHECK(!PskHandshake::parseHello(PskHandshake::encodeHello("id", clientNonce, offer) + ":x", identity, nonce, parsedOffer));
+    CHECK(!PskHandshake::parseHello("aWQ=", identity, nonce, parsedOffer));
+    
+    const std::string accept = PskHandshake::encodeAccept(serverNonce, CipherSuite::AES_256_GCM, server.serverConfirm);
+    CHECK(PskHandshake::parseAccept(accept, nonce, suite, confirm));
+    CHECK(nonce == serverNonce && suite == CipherSuite::AES_256_GCM && confirm == server.serverConfirm);
+    CHECK(!PskHandshake::parseAccept(PskHandshake::encodeAccept(serverNonce, CipherSuite::AES_256_GCM, "short"), nonce, suite, confirm));
+    CHECK(!PskHandshake::parseAccept(accept.substr(0, accept.rfind(':')), nonce, suite, confirm));
+    
+    CHECK(PskHandshake::parseFinished(PskHandshake::encodeFinished(client.clientConfirm), confirm));
+    CHECK(confirm == client.clientConfirm);
+    CHECK(!PskHandshake::parseFinished(PskHandshake::encodeFinished("short"), confirm));
+    
+    CHECK(PskHandshake::aeadSuites({CipherSuite::AES_256_CBC, CipherSuite::AES_256_GCM}) ==
+          std::vector<CipherSuite>({CipherSuite::AES_256_GCM}));
+    
+    std::cout << "预共享密钥握手测试通过！" << std::endl;
+}
+
+// 等待条件成立，最多 5 秒
+bool waitUntil(const std::function<bool()>& condition) {
+    for (int i = 0; i < 500 && !condition(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return condition();
+}
+
+void testMixedHandshake() {
+    std::cout << "测试混用两种握手消息..." << std::endl;
+    
+    // 与 CryptoWebSocketServer / CryptoWebSocketClient 的握手消息类型一致
+    const int kPublicKeyRequest = 1;
+    const int kCipherSuiteSelect = 5;
+    const int kPskHello = 27;
+    const std::string key = "0123456789abcdef0123";
+    auto handshakeMessage = [](int type, const std::string& data) {
+        return "{\"type\":" + std::to_string(type) + ",\"data\":\"" + data + "\"}";
+    };
+    const std::string uri = "unix:///tmp/crypto_test-" + std::to_string(getpid()) + ".sock";
+    
+    // 服务端：PSK 握手开始后又收到 RSA 公钥请求，断开连接
+    {
+        CryptoWebSocketServer server;
+        server.addPreSharedKey("id", key);
+        CHECK(server.start(uri));
+        server.run();
+        
+        std::string address;
+        std::unique_ptr<Transport> raw = Transport::create(uri, false, address);
+        CHECK(raw);
+        std::atomic<bool> closed(false);
+        Transport::Handlers handlers;
+        handlers.onOpen = [&](Transport::Handle hdl) {
+            const std::string offer = cipherSuitesToString({CipherSuite::AES_256_GCM});
+            const std::string hello = handshakeMessage(kPskHello, PskHandshake::encodeHello("id", PskHandshake::makeNonce(), offer));
+            const std::string request = handshakeMessage(kPublicKeyRequest, offer);
+            raw->send(hdl, hello.data(), hello.size(), Transport::FrameType::TEXT);
+            raw->send(hdl, request.data(), request.size(), Transport::FrameType::TEXT);
+        };
+        handlers.onClose = [&](Transport::Handle) {
+            closed = true;
+        };
+        raw->setHandlers(std::move(handlers));
+        CHECK(raw->connect(address));
+        std::thread loop([&]() {
+            raw->run();
+        });
+        bool ok = waitUntil([&]() { return closed.load(); });
+        raw->stop();
+        loop.join();
+        server.stop();
+        CHECK(ok);
+    }
+    
+    // 客户端：配置了 PSK 时收到 RSA 握手的套件选择，断开连接而不是继续握手
+    {
+        std::string address;
+        std::unique_ptr<Transport> raw = Transport::create(uri, true, address);
+        CHECK(raw);
+        std::atomic<bool> closed(false);
+        Transport::Handlers handlers;
+        handlers.onMessage = [&](Transport::Handle hdl, Transport::FrameType, std::string&) {
+            const std::string selection = handshakeMessage(kCipherSuiteSelect, cipherSuitesToString({CipherSuite::AES_256_GCM}));
+            raw->send(hdl, selection.data(), selection.size(), Transport::FrameType::TEXT);
+        };
+        handlers.onClose = [&](Transport::Handle) {
+            closed = true;
+        };
+        raw->setHandlers(std::move(handlers));
+        CHECK(raw->listen(address));
+        std::thread loop([&]() {
+            raw->run();
+        });
+        
+        CryptoWebSocketClient client;
+        CHECK(client.setPreSharedKey("id", key));
+        std::atomic<bool> completed(false);
+        client.setHandshakeCallback([&]() {
+            completed = true;
+        });
+        CHECK(client.connect(uri));
+        client.run();
+        bool ok = waitUntil([&]() { return closed.load(); });
+        client.stop();
+        raw->stop();
+        loop.join();
+        CHECK(ok && !completed);
+    }
+    
+    std::cout << "混用握手消息测试通过！" << std::endl;
+}
+
 int main() {
     std::cout << "=== CryptoLink 加密功能测试 ===" << std::endl;
     
@@ -102,6 +954,16 @@ int main() {
         testAESEncryption();
         testRSAEncryption();
         testRSASignature();
+        testTopicIndex();
+        testChannelMux();
+        testSegmentLimits();
+        testSegmentOrdering();
+        testDatagramCipher();
+        testRpcSession();
+        testPeerRelayEpochs();
+        testFileResume();
+        testPskHandshake();
+        testMixedHandshake();
         
         std::cout << "\\n所有测试通过！加密库工作正常。" << std::endl;
         return 0;
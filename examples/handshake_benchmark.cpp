@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "CryptoWebSocketServer.h"
+#include "CryptoWebSocketClient.h"
+#include "RSAKey.h"
+#include "AESKey.h"
+#include "CipherSuite.h"
+#include "PskHandshake.h"
+#include "Logger.h"
+#include "SessionCipher.h"
+
+// 握手吞吐基准
+//   inproc   ：不经过网络，按握手协议的顺序在同一线程内执行双方的全部密码学运算，衡量纯计算开销
+//   loopback ：同进程内启动真实的服务端，客户端经本机回环完成完整握手（含建连、分帧和 JSON 编解码）
+//
+// 用法: handshake_benchmark [--mode inproc|loopback|all] [--bits 2048,3072,4096] [--count N]
+//                           [--threads N] [--transport tcp|unix|ws] [--port N] [--psk on|off]
+
+namespace {
+
+struct Options {
+    std::string mode = "all";
+    std::vector<unsigned int> keySizes = {2048, 3072, 4096};
+    size_t count = 20;
+    size_t threads = 1;
+    std::string transport = "tcp";
+    uint16_t port = 9300;
+    bool psk = true;
+};
+
+// 密钥交换后端：RSA 按模数位数区分；PSK 不做非对称运算，rsaKeySize 只用于构造服务端的长期密钥
+struct KeyExchange {
+    std::string name;
+    unsigned int rsaKeySize;
+    bool psk;
+};
+
+const char kBenchPskIdentity[] = "handshake-benchmark";
+const std::string kBenchPsk(32, '\x5a');
+
+struct Result {
+    std::vector<double> latenciesUs;
+    size_t failures = 0;
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+};
+
+// 基准运行期间只保留错误日志，丢弃服务端和客户端每次握手打印的日志
+class QuietLogs {
+public:
+    QuietLogs() : saved(Logger::getLevel()) { Logger::setLevel(LogLevel::ERROR); }
+    ~QuietLogs() { Logger::setLevel(saved); }
+
+private:
+    LogLevel saved;
+};
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void report(const std::string& label, Result& result) {
+    std::sort(result.latenciesUs.begin(), result.latenciesUs.end());
+    const size_t completed = result.latenciesUs.size();
+    const double throughput = result.wallSeconds > 0 ? completed / result.wallSeconds : 0;
+    const double perCore = result.cpuSeconds > 0 ? completed / result.cpuSeconds : 0;
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::left << std::setw(28) << label << std::right
+              << std::setw(8) << completed
+              << std::setw(8) << result.failures
+              << std::setw(12) << throughput
+              << std::setw(12) << perCore
+              << std::setw(11) << percentile(result.latenciesUs, 50) / 1000.0
+              << std::setw(11) << percentile(result.latenciesUs, 90) / 1000.0
+              << std::setw(11) << percentile(result.latenciesUs, 99) / 1000.0
+              << std::setw(11) << (completed ? result.latenciesUs.back() / 1000.0 : 0.0)
+              << std::endl;
+}
+
+void printHeader() {
+    std::cout << std::left << std::setw(28) << "场景" << std::right
+              << std::setw(8) << "完成"
+              << std::setw(8) << "失败"
+              << std::setw(12) << "次/秒"
+              << std::setw(12) << "次/核·秒"
+              << std::setw(11) << "p50(ms)"
+              << std::setw(11) << "p90(ms)"
+              << std::setw(11) << "p99(ms)"
+              << std::setw(11) << "max(ms)"
+              << std::endl;
+}
+
+// 单线程内完成 count 次握手，运算顺序与 CryptoWebSocketServer / CryptoWebSocketClient 一致
+void inprocWorker(const KeyExchange& exchange, size_t count, std::vector<double>& latencies, size_t& failures) {
+    // 长期密钥在构造服务端/客户端时生成，不计入握手开销
+    RSAKey serverKey(exchange.rsaKeySize);
+    RSAKey clientKey(exchange.rsaKeySize);
+    AESKey clientSessionKey;
+    serverKey.generateKeyPair();
+    clientKey.generateKeyPair();
+    clientSessionKey.generateRawKey();
+
+    const std::vector<CipherSuite> serverPreference = preferredCipherSuites();
+    const std::string offer = cipherSuitesToString(preferredCipherSuites());
+    const std::string serverPublicKey = serverKey.getLocalPublicKey();
+
+    for (size_t i = 0; i < count; ++i) {
+        auto start = std::chrono::steady_clock::now();
+
+        // 服务端 onOpen：为会话创建保存客户端公钥的 RSA 对象，生成 AES 密钥
+        RSAKey sessionKey(exchange.rsaKeySize);
+        AESKey sessionAES;
+        sessionAES.generateRawKey();
+
+        // 服务端 PUBLIC_KEY_REQUEST：协商加密套件，协商记录混入密钥派生，回复套件选择和公钥
+        CipherSuite suite = negotiateCipherSuite(serverPreference, parseCipherSuites(offer));
+        SessionCipherSlot serverCipher;
+        serverCipher.selectSuite(suite, cipherSuiteTranscript(offer, suite));
+        const std::string selection = cipherSuitesToString({suite});
+
+        // 客户端 CIPHER_SUITE_SELECT：核对选择在自己提供的列表中，生成同样的协商记录
+        const std::vector<CipherSuite> offered = parseCipherSuites(offer);
+        const std::vector<CipherSuite> selected = parseCipherSuites(selection);
+        bool ok = selected.size() == 1 && std::find(offered.begin(), offered.end(), selected.front()) != offered.end();
+        SessionCipherSlot clientCipher;
+        clientCipher.selectSuite(selected.front(), cipherSuiteTranscript(offer, selected.front()));
+
+        // 客户端 PUBLIC_KEY_RESPONSE：设置服务端公钥，用它加密 "key:iv:协商记录"
+        clientKey.setRemotePublicKey(serverPublicKey);
+        std::string clientPublicKey = clientKey.getLocalPublicKey();
+        std::string sessionSecret = clientSessionKey.getLocalKey();
+        std::string encryptedSecret = clientKey.encryptWithRemotePublic(sessionSecret + ":" + clientCipher.getTranscript());
+        ok = ok && clientCipher.initialize(sessionSecret, true);
+
+        // 服务端 PUBLIC_KEY_RESPONSE / SESSION_KEY：记录客户端公钥，解密会话密钥并核对协商记录
+        sessionKey.setRemotePublicKey(clientPublicKey);
+        std::string decryptedSecret = serverKey.decryptWithLocalPrivate(encryptedSecret);
+        size_t colonPos = decryptedSecret.find(':');
+        size_t transcriptPos = colonPos == std::string::npos ? std::string::npos : decryptedSecret.find(':', colonPos + 1);
+        ok = ok && transcriptPos != std::string::npos &&
+             decryptedSecret.substr(transcriptPos + 1) == serverCipher.getTranscript();
+        if (ok) {
+            const std::string key = decryptedSecret.substr(0, colonPos);
+            const std::string iv = decryptedSecret.substr(colonPos + 1, transcriptPos - colonPos - 1);
+            ok = sessionAES.setRemotePublicKey(key, iv) && serverCipher.initialize(key + ":" + iv, false);
+        }
+
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if (ok) {
+            latencies.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+        } else {
+            ++failures;
+        }
+    }
+}
+
+// 单线程内完成 count 次 PSK 握手，运算顺序与 PSK_HELLO / PSK_ACCEPT / PSK_FINISHED 的处理一致
+void inprocPskWorker(size_t count, std::vector<double>& latencies, size_t& failures) {
+    const std::vector<CipherSuite> serverPreference = PskHandshake::aeadSuites(preferredCipherSuites());
+    const std::string offer = cipherSuitesToString(PskHandshake::aeadSuites(preferredCipherSuites()));
+
+    for (size_t i = 0; i < count; ++i) {
+        auto start = std::chrono::steady_clock::now();
+
+        // 客户端：问候中带身份、随机数和套件列表
+        const std::string clientNonce = PskHandshake::makeNonce();
+        const std::string hello = PskHandshake::encodeHello(kBenchPskIdentity, clientNonce, offer);
+
+        // 服务端 PSK_HELLO：协商套件，派生会话密钥材料并初始化加密器
+        std::string identity;
+        std::string receivedNonce;
+        std::string receivedOffer;
+        bool ok = PskHandshake::parseHello(hello, identity, receivedNonce, receivedOffer);
+        CipherSuite suite = negotiateCipherSuite(serverPreference, parseCipherSuites(receivedOffer));
+        const std::string serverNonce = PskHandshake::makeNonce();
+        PskHandshake::Derived serverDerived;
+        SessionCipherSlot serverCipher;
+        serverCipher.selectSuite(suite);
+        ok = ok && PskHandshake::derive(kBenchPsk, identity, receivedOffer, suite, receivedNonce, serverNonce, serverDerived) &&
+             serverCipher.initialize(serverDerived.secret, false);
+        const std::string accept = PskHandshake::encodeAccept(serverNonce, suite, serverDerived.serverConfirm);
+
+        // 客户端 PSK_ACCEPT：派生同样的材料，校验服务端确认值
+        std::string acceptedNonce;
+        std::string serverConfirm;
+        CipherSuite acceptedSuite = CipherSuite::NONE;
+        PskHandshake::Derived clientDerived;
+        SessionCipherSlot clientCipher;
+        ok = ok && PskHandshake::parseAccept(accept, acceptedNonce, acceptedSuite, serverConfirm) &&
+             PskHandshake::derive(kBenchPsk, kBenchPskIdentity, offer, acceptedSuite, clientNonce, acceptedNonce, clientDerived) &&
+             PskHandshake::confirmEquals(serverConfirm, clientDerived.serverConfirm);
+        clientCipher.selectSuite(acceptedSuite);
+        ok = ok && clientCipher.initialize(clientDerived.secret, true);
+
+        // 服务端 PSK_FINISHED：校验客户端确认值
+        std::string clientConfirm;
+        ok = ok && PskHandshake::parseFinished(PskHandshake::encodeFinished(clientDerived.clientConfirm), clientConfirm) &&
+             PskHandshake::confirmEquals(clientConfirm, serverDerived.clientConfirm);
+
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if (ok) {
+            latencies.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+        } else {
+            ++failures;
+        }
+    }
+}
+
+Result runInproc(const KeyExchange& exchange, const Options& options) {
+    Result result;
+    std::vector<std::vector<double>> latencies(options.threads);
+    std::vector<size_t> failures(options.threads, 0);
+
+    std::clock_t cpuStart = std::clock();
+    auto wallStart = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < options.threads; ++t) {
+        workers.emplace_back([&, t]() {
+            if (exchange.psk) {
+                inprocPskWorker(options.count, latencies[t], failures[t]);
+            } else {
+                inprocWorker(exchange, options.count, latencies[t], failures[t]);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    result.cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    for (size_t t = 0; t < options.threads; ++t) {
+        result.latenciesUs.insert(result.latenciesUs.end(), latencies[t].begin(), latencies[t].end());
+        result.failures += failures[t];
+    }
+    return result;
+}
+
+// 客户端每次重新建连并握手，握手完成后立即断开
+void loopbackWorker(CryptoWebSocketClient& client, const std::string& uri, size_t count,
+                    std::vector<double>& latencies, size_t& failures) {
+    std::mutex mutex;
+    std::condition_variable handshakeDone;
+    bool done = false;
+    client.setHandshakeCallback([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        handshakeDone.notify_one();
+    });
+
+    for (size_t i = 0; i < count; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = client.connect(uri);
+        if (ok) {
+            client.run();
+            std::unique_lock<std::mutex> lock(mutex);
+            ok = handshakeDone.wait_for(lock, std::chrono::seconds(30), [&]() { return done; });
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        if (ok) {
+            latencies.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+        } else {
+            ++failures;
+        }
+
+        client.disconnect();
+        client.stop();
+    }
+}
+
+Result runLoopback(const KeyExchange& exchange, const Options& options) {
+    Result result;
+
+    std::string listenUri;
+    std::string connectUri;
+    if (options.transport == "unix") {
+        listenUri = connectUri = "unix:///tmp/cryptolink-handshake-bench-" + std::to_string(getpid()) + ".sock";
+    } else {
+        std::string scheme = options.transport == "ws" ? "ws" : "tcp";
+        listenUri = connectUri = scheme + "://127.0.0.1:" + std::to_string(options.port);
+    }
+
+    QuietLogs quiet;
+
+    // 握手超时放宽，避免大密钥下排队的连接被回收
+    CryptoWebSocketServer server(exchange.rsaKeySize);
+    SessionTimeouts timeouts;
+    timeouts.handshakeTimeout = std::chrono::milliseconds(0);
+    server.setSessionTimeouts(timeouts);
+    if (exchange.psk) {
+        server.addPreSharedKey(kBenchPskIdentity, kBenchPsk);
+    }
+    if (!server.start(listenUri)) {
+        result.failures = options.count * options.threads;
+        return result;
+    }
+    server.run();
+
+    // 客户端共享进程内的身份密钥，生成放在计时之外；PSK 客户端不需要身份
+    std::shared_future<std::string> identity;
+    if (!exchange.psk) {
+        identity = CryptoWebSocketClient::sharedIdentity(exchange.rsaKeySize);
+        identity.wait();
+    }
+    std::vector<std::unique_ptr<CryptoWebSocketClient>> clients;
+    for (size_t t = 0; t < options.threads; ++t) {
+        clients.push_back(std::make_unique<CryptoWebSocketClient>(exchange.rsaKeySize));
+        if (exchange.psk) {
+            clients.back()->setPreSharedKey(kBenchPskIdentity, kBenchPsk);
+        } else {
+            clients.back()->setIdentity(identity);
+        }
+    }
+
+    std::vector<std::vector<double>> latencies(options.threads);
+    std::vector<size_t> failures(options.threads, 0);
+
+    std::clock_t cpuStart = std::clock();
+    auto wallStart = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < options.threads; ++t) {
+        workers.emplace_back([&, t]() {
+            loopbackWorker(*clients[t], connectUri, options.count, latencies[t], failures[t]);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    result.cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    for (size_t t = 0; t < options.threads; ++t) {
+        result.latenciesUs.insert(result.latenciesUs.end(), latencies[t].begin(), latencies[t].end());
+        result.failures += failures[t];
+    }
+
+    server.stop();
+    return result;
+}
+
+std::vector<unsigned int> parseKeySizes(const std::string& text) {
+    std::vector<unsigned int> sizes;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            sizes.push_back(static_cast<unsigned int>(std::stoul(item)));
+        }
+    }
+    return sizes;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--mode") {
+            options.mode = value;
+        } else if (arg == "--bits") {
+            options.keySizes = parseKeySizes(value);
+        } else if (arg == "--count") {
+            options.count = std::stoul(value);
+        } else if (arg == "--threads") {
+            options.threads = std::max<size_t>(1, std::stoul(value));
+        } else if (arg == "--transport") {
+            options.transport = value;
+        } else if (arg == "--port") {
+            options.port = static_cast<uint16_t>(std::stoul(value));
+        } else if (arg == "--psk") {
+            options.psk = value != "off";
+        } else {
+            return false;
+        }
+    }
+    return options.mode == "inproc" || options.mode == "loopback" || options.mode == "all";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "用法: " << argv[0]
+                  << " [--mode inproc|loopback|all] [--bits 2048,3072,4096] [--count N]"
+                  << " [--threads N] [--transport tcp|unix|ws] [--port N] [--psk on|off]" << std::endl;
+        return 1;
+    }
+
+    std::vector<KeyExchange> exchanges;
+    for (unsigned int bits : options.keySizes) {
+        exchanges.push_back({"RSA-" + std::to_string(bits), bits, false});
+    }
+    if (options.psk) {
+        exchanges.push_back({"PSK", RSAKey::kDefaultKeySize, true});
+    }
+
+    std::cout << "=== 握手吞吐基准 ===" << std::endl;
+    std::cout << "每线程握手次数: " << options.count << "，并发线程: " << options.threads
+              << "，加密套件: " << cipherSuiteName(preferredCipherSuites().front()) << std::endl;
+    std::cout << "次/核·秒 = 完成次数 / 进程 CPU 时间；回环模式包含同进程内服务端和客户端双方的 CPU" << std::endl;
+    std::cout << std::endl;
+    printHeader();
+
+    for (const KeyExchange& exchange : exchanges) {
+        if (options.mode != "loopback") {
+            Result result = runInproc(exchange, options);
+            report(exchange.name + " inproc", result);
+        }
+        if (options.mode != "inproc") {
+            Result result = runLoopback(exchange, options);
+            report(exchange.name + " loopback/" + options.transport, result);
+        }
+    }
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <chrono>
 #include "CryptoWebSocketServer.h"
@@ -10,11 +11,12 @@ int main() {
     CryptoWebSocketServer server;
     
     // 设置消息接收回调
-    server.setMessageCallback([&server](websocketpp::connection_hdl hdl, const std::string& message) {
+    // 回调参数为 string_view 时明文直接指向接收缓冲区，无需拷贝
+    server.setMessageCallback([&server](websocketpp::connection_hdl hdl, std::string_view message) {
         std::cout << "收到客户端解密消息: " << message << std::endl;
         
         // 回显消息
-        std::string response = "服务端回复: " + message;
+        std::string response = "服务端回复: " + std::string(message);
         server.sendEncryptedMessage(hdl, response);
     });
     
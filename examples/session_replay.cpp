@@ -0,0 +1,385 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include "CryptoWebSocketServer.h"
+#include "CryptoWebSocketClient.h"
+#include "LatencyProbe.h"
+#include "Logger.h"
+#include "SessionRecorder.h"
+#include "TopicIndex.h"
+
+// 会话录制重放：把 CryptoWebSocketServer::startRecording 录下的流量按原来的节奏（或加速）重放到本地服务端
+//   录制中客户端发给服务端的消息由同进程内的客户端重新发送，服务端发出的消息由本地服务端重新发送；
+//   录制了明文时按原内容发送，否则按原长度填充。订阅变更只有录制了明文时才能重放
+//
+// 用法: session_replay <录制文件> [--speed 倍数] [--from 秒] [--skip-idle 秒] [--transport tcp|unix|ws] [--port N] [--bits N]
+//   --speed 默认 1（原速），0 表示不等待、尽快重放
+//   时间轴从第一个事件开始，追加录制的各段首尾相接；--from 跳过时间轴上这之前的事件，
+//   --skip-idle 把超过这么长的空闲缩短到这么长，默认 0 表示保留原来的空闲
+
+namespace {
+
+// 与 CryptoWebSocketServer / CryptoWebSocketClient 的记录类型一致
+const uint8_t kEncryptedData = 4;
+const uint8_t kSubscribe = 6;
+const uint8_t kUnsubscribe = 7;
+const uint8_t kPublish = 8;
+const uint8_t kSignedData = 13;
+const uint8_t kStampedData = 17;
+
+// 重放客户端握手后先发这条消息，本地服务端据此把连接对应到录制中的会话
+const std::string kHelloPrefix = "#cryptolink-replay-session:";
+
+const std::chrono::seconds kHandshakeTimeout(30);
+
+struct Options {
+    std::string path;
+    double speed = 1;
+    double from = 0;
+    double skipIdle = 0;
+    std::string transport = "tcp";
+    uint16_t port = 9400;
+    unsigned int rsaKeySize = RSAKey::kDefaultKeySize;
+};
+
+struct Stats {
+    size_t sessions = 0;
+    size_t failedSessions = 0;
+    size_t inbound = 0;
+    size_t outbound = 0;
+    size_t skipped = 0;
+    uint64_t inboundBytes = 0;
+    uint64_t outboundBytes = 0;
+    double maxLagMs = 0;
+    std::atomic<uint64_t> serverReceived{0};
+    std::atomic<uint64_t> clientsReceived{0};
+};
+
+class Replayer {
+public:
+    Replayer(const Options& options, const std::string& uri) : options(options), uri(uri) {
+        identity = CryptoWebSocketClient::sharedIdentity(options.rsaKeySize);
+    }
+
+    // 在本地服务端的事件循环上调用
+    void onServerMessage(websocketpp::connection_hdl hdl, std::string_view message) {
+        if (message.substr(0, kHelloPrefix.size()) == kHelloPrefix) {
+            uint64_t session = std::stoull(std::string(message.substr(kHelloPrefix.size())));
+            std::lock_guard<std::mutex> lock(mutex);
+            handles[session] = hdl;
+            mapped.notify_all();
+            return;
+        }
+        stats.serverReceived.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void replay(SessionRecorder::Reader& reader, CryptoWebSocketServer& server) {
+        filler.assign(1024 * 1024, 'x');
+        const bool payloads = reader.hasPayloads();
+        auto start = std::chrono::steady_clock::now();
+
+        const uint64_t from = toMicros(options.from);
+        const uint64_t idleLimit = toMicros(options.skipIdle);
+        uint64_t timeline = 0;
+        uint64_t last = 0;
+        bool first = true;
+
+        SessionRecorder::Event event;
+        while (reader.next(event)) {
+            // 录制中的时刻相对文件头，换算成从第一个事件开始、去掉段间和过长空闲的时间轴
+            uint64_t gap = first || event.time < last ? 0 : event.time - last;
+            if (idleLimit > 0) {
+                gap = std::min(gap, idleLimit);
+            }
+            first = false;
+            last = std::max(last, event.time);
+
+            if (event.type == SessionRecorder::SEGMENT) {
+                // 上一段录制结束时服务端已经退出，没有 CLOSE 的会话到此为止
+                for (auto& pair : sessions) {
+                    closeSession(pair.first);
+                }
+                continue;
+            }
+            timeline += gap;
+            if (timeline < from) {
+                continue;
+            }
+            waitUntil(start, timeline - from);
+
+            if (event.type == SessionRecorder::CLOSE) {
+                closeSession(event.session);
+                continue;
+            }
+
+            // 开始录制前已经建立的会话没有 OPEN 事件，在第一条消息处建立
+            Session* session = findOrOpen(event.session);
+            if (!session || event.type == SessionRecorder::OPEN) {
+                continue;
+            }
+
+            std::string_view message = payloads ? event.payload : std::string_view();
+            size_t length = event.length;
+            if (event.recordType == kStampedData) {
+                // 发送时刻由重放时的发送方重新打上
+                length -= std::min<size_t>(length, LatencyProbe::kStampSize);
+                message = message.substr(std::min(message.size(), LatencyProbe::kStampSize));
+            }
+
+            if (event.type == SessionRecorder::INBOUND) {
+                replayInbound(*session, event, message, length, payloads);
+            } else if (event.type == SessionRecorder::OUTBOUND) {
+                replayOutbound(server, *session, event, message, length);
+            }
+        }
+
+        for (auto& pair : sessions) {
+            pair.second->client->disconnect();
+            pair.second->client->stop();
+        }
+    }
+
+    Stats stats;
+
+private:
+    struct Session {
+        std::unique_ptr<CryptoWebSocketClient> client;
+        websocketpp::connection_hdl hdl;
+    };
+
+    const Options& options;
+    std::string uri;
+    std::shared_future<std::string> identity;
+    std::map<uint64_t, std::unique_ptr<Session>> sessions;
+    std::string filler;
+
+    std::mutex mutex;
+    std::condition_variable mapped;
+    std::map<uint64_t, websocketpp::connection_hdl> handles;
+
+    static uint64_t toMicros(double seconds) {
+        return seconds > 0 ? static_cast<uint64_t>(seconds * 1000000) : 0;
+    }
+
+    void waitUntil(std::chrono::steady_clock::time_point start, uint64_t time) {
+        if (options.speed <= 0) {
+            return;
+        }
+        auto due = start + std::chrono::microseconds(static_cast<int64_t>(time / options.speed));
+        auto now = std::chrono::steady_clock::now();
+        if (due > now) {
+            std::this_thread::sleep_until(due);
+        } else {
+            stats.maxLagMs = std::max(stats.maxLagMs, std::chrono::duration<double, std::milli>(now - due).count());
+        }
+    }
+
+    std::string makeMessage(std::string_view recorded, size_t length) {
+        if (recorded.size() == length) {
+            return std::string(recorded);
+        }
+        std::string message;
+        message.reserve(length);
+        while (message.size() < length) {
+            message.append(filler, 0, std::min(filler.size(), length - message.size()));
+        }
+        return message;
+    }
+
+    // 建立重放客户端，等到握手完成、本地服务端收到会话映射后才继续，失败的会话不再重试
+    Session* findOrOpen(uint64_t id) {
+        auto it = sessions.find(id);
+        if (it != sessions.end()) {
+            return it->second->client ? it->second.get() : nullptr;
+        }
+
+        auto session = std::make_unique<Session>();
+        Session* raw = session.get();
+        sessions[id] = std::move(session);
+        ++stats.sessions;
+
+        auto client = std::make_unique<CryptoWebSocketClient>(options.rsaKeySize);
+        client->setIdentity(identity);
+        CryptoWebSocketClient* clientPtr = client.get();
+        client->setHandshakeCallback([clientPtr, id]() {
+            clientPtr->sendEncryptedMessage(kHelloPrefix + std::to_string(id), SendPriority::CONTROL);
+        });
+        client->setMessageCallback([this](std::string_view) {
+            stats.clientsReceived.fetch_add(1, std::memory_order_relaxed);
+        });
+
+        bool ok = client->connect(uri);
+        if (ok) {
+            client->run();
+            std::unique_lock<std::mutex> lock(mutex);
+            ok = mapped.wait_for(lock, kHandshakeTimeout, [&]() { return handles.count(id) > 0; });
+            if (ok) {
+                raw->hdl = handles[id];
+            }
+        }
+        if (!ok) {
+            ++stats.failedSessions;
+            client->stop();
+            return nullptr;
+        }
+        raw->client = std::move(client);
+        return raw;
+    }
+
+    void closeSession(uint64_t id) {
+        auto it = sessions.find(id);
+        if (it != sessions.end() && it->second->client) {
+            it->second->client->disconnect();
+            it->second->client->stop();
+            it->second->client.reset();
+        }
+    }
+
+    void replayInbound(Session& session, const SessionRecorder::Event& event, std::string_view message,
+                       size_t length, bool payloads) {
+        bool sent = false;
+        switch (event.recordType) {
+            case kSubscribe:
+            case kUnsubscribe:
+                if (payloads) {
+                    const std::string pattern(message);
+                    sent = event.recordType == kSubscribe ? session.client->subscribe(pattern)
+                                                          : session.client->unsubscribe(pattern);
+                }
+                break;
+            case kPublish: {
+                std::string_view topic;
+                std::string_view body;
+                if (payloads && TopicIndex::decodePublication(message, topic, body)) {
+                    sent = session.client->publish(std::string(topic), body, event.priority);
+                } else {
+                    sent = session.client->sendEncryptedMessage(makeMessage(message, length), event.priority);
+                }
+                break;
+            }
+            default:
+                // 通道数据、文件块等其余应用记录按原长度作为普通消息发送
+                sent = session.client->sendEncryptedMessage(makeMessage(message, length), event.priority);
+                break;
+        }
+        if (sent) {
+            ++stats.inbound;
+            stats.inboundBytes += length;
+        } else {
+            ++stats.skipped;
+        }
+    }
+
+    void replayOutbound(CryptoWebSocketServer& server, Session& session, const SessionRecorder::Event& event,
+                        std::string_view message, size_t length) {
+        std::string_view topic;
+        std::string_view body;
+        if (event.recordType == kPublish && TopicIndex::decodePublication(message, topic, body)) {
+            message = body;
+            length = body.size();
+        }
+
+        const std::string data = makeMessage(message, length);
+        bool sent = event.recordType == kSignedData ? server.sendSignedMessage(session.hdl, data, event.priority)
+                                                    : server.sendEncryptedMessage(session.hdl, data, event.priority);
+        if (sent) {
+            ++stats.outbound;
+            stats.outboundBytes += length;
+        } else {
+            ++stats.skipped;
+        }
+    }
+};
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    if (argc < 2) {
+        return false;
+    }
+    options.path = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--speed") {
+            options.speed = std::stod(value);
+        } else if (arg == "--from") {
+            options.from = std::stod(value);
+        } else if (arg == "--skip-idle") {
+            options.skipIdle = std::stod(value);
+        } else if (arg == "--transport") {
+            options.transport = value;
+        } else if (arg == "--port") {
+            options.port = static_cast<uint16_t>(std::stoul(value));
+        } else if (arg == "--bits") {
+            options.rsaKeySize = static_cast<unsigned int>(std::stoul(value));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "用法: " << argv[0]
+                  << " <录制文件> [--speed 倍数] [--from 秒] [--skip-idle 秒] [--transport tcp|unix|ws] [--port N] [--bits N]"
+                  << std::endl;
+        return 1;
+    }
+
+    SessionRecorder::Reader reader;
+    if (!reader.open(options.path)) {
+        return 1;
+    }
+
+    std::string uri;
+    if (options.transport == "unix") {
+        uri = "unix:///tmp/cryptolink-replay-" + std::to_string(getpid()) + ".sock";
+    } else {
+        std::string scheme = options.transport == "ws" ? "ws" : "tcp";
+        uri = scheme + "://127.0.0.1:" + std::to_string(options.port);
+    }
+
+    // 重放期间只保留告警，逐连接的日志会干扰计时
+    Logger::setLevel(LogLevel::WARNING);
+
+    Replayer replayer(options, uri);
+    CryptoWebSocketServer server(options.rsaKeySize);
+    server.setMessageCallback([&replayer](websocketpp::connection_hdl hdl, std::string_view message) {
+        replayer.onServerMessage(hdl, message);
+    });
+    if (!server.start(uri)) {
+        return 1;
+    }
+    server.run();
+
+    auto start = std::chrono::steady_clock::now();
+    replayer.replay(reader, server);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    server.stop();
+
+    const Stats& stats = replayer.stats;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "重放耗时: " << seconds << " 秒（速度 " << options.speed << "x）" << std::endl;
+    std::cout << "会话: " << stats.sessions << "，建立失败 " << stats.failedSessions << std::endl;
+    std::cout << "客户端 -> 服务端: " << stats.inbound << " 条，" << stats.inboundBytes / 1024.0 << " KB"
+              << "，服务端收到 " << stats.serverReceived.load() << " 条" << std::endl;
+    std::cout << "服务端 -> 客户端: " << stats.outbound << " 条，" << stats.outboundBytes / 1024.0 << " KB"
+              << "，客户端收到 " << stats.clientsReceived.load() << " 条" << std::endl;
+    std::cout << "跳过: " << stats.skipped << " 条，最大调度滞后 " << stats.maxLagMs << " ms" << std::endl;
+    return 0;
+}
@@ -1,7 +1,18 @@
 #include <iostream>
-#include <cassert>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
 #include "RSAKey.h"
+#include "Ed25519Key.h"
 #include "AESKey.h"
+#include "MerkleBatch.h"
+
+// 批量签名和验证的结果必须正确，失败时抛出异常由 main 返回非零（Release 构建中 assert 不生效）
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        throw std::runtime_error(what);
+    }
+}
 
 void testRSASignatureVerification() {
     std::cout << "=== RSA 数字签名验证测试 ===" << std::endl;
@@ -117,6 +128,120 @@ void testKeyExchange() {
     }
 }
 
+void testMerkleBatchSigning() {
+    std::cout << "\n=== Merkle 批量签名测试 ===" << std::endl;
+    
+    RSAKey signerKey, verifierKey;
+    check(signerKey.generateKeyPair() && verifierKey.generateKeyPair(), "密钥对生成失败");
+    verifierKey.setRemotePublicKey(signerKey.getLocalPublicKey());
+    
+    const size_t kMessages = 4096;
+    std::vector<std::string> messages;
+    for (size_t i = 0; i < kMessages; ++i) {
+        messages.push_back("审计记录 #" + std::to_string(i));
+    }
+    
+    // 逐条 RSA 签名作为对照
+    const size_t kSingleSamples = 50;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kSingleSamples; ++i) {
+        signerKey.signWithLocalPrivate(messages[i]);
+    }
+    double singleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "逐条签名: " << static_cast<size_t>(kSingleSamples / singleSeconds) << " 条/秒" << std::endl;
+    
+    // 整批只签一次根
+    MerkleBatchSigner signer(signerKey);
+    std::vector<PooledBuffer> payloads;
+    start = std::chrono::steady_clock::now();
+    for (const std::string& message : messages) {
+        signer.add(message);
+    }
+    check(signer.sign(), "Merkle 根签名失败");
+    for (size_t i = 0; i < kMessages; ++i) {
+        payloads.push_back(signer.encode(i, messages[i], BufferPool::local()));
+    }
+    double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "批量签名: " << static_cast<size_t>(kMessages / batchSeconds) << " 条/秒（每批 " << kMessages << " 条）" << std::endl;
+    
+    // 逐条验证，同一批次只做一次公钥验证
+    MerkleBatchVerifier verifier(verifierKey);
+    size_t valid = 0;
+    for (size_t i = 0; i < kMessages; ++i) {
+        std::string_view message;
+        if (verifier.verify(payloads[i].view(), message) && message == messages[i]) {
+            ++valid;
+        }
+    }
+    std::cout << (valid == kMessages ? "✅" : "❌") << " 验证通过 " << valid << "/" << kMessages
+              << "，公钥验证次数: " << verifier.getSignatureVerifications() << std::endl;
+    check(valid == kMessages, "Merkle 批量签名的消息验证失败");
+    check(verifier.getSignatureVerifications() == 1, "同一批次的根签名被重复验证");
+    
+    // 篡改任意一条消息都会使证明失效
+    std::string tampered(payloads[7].view());
+    tampered.back() ^= 0x01;
+    std::string_view message;
+    const bool detected = !verifier.verify(tampered, message);
+    std::cout << (detected ? "✅ 篡改检测成功" : "❌ 篡改检测失败") << std::endl;
+    check(detected, "Merkle 批量签名未检测出篡改");
+}
+
+void testEd25519Signing() {
+    std::cout << "\n=== Ed25519 签名与批量验证测试 ===" << std::endl;
+    
+    Ed25519Key signerKey, verifierKey;
+    check(signerKey.generateKeyPair() && verifierKey.generateKeyPair(), "Ed25519 密钥对生成失败");
+    verifierKey.setRemotePublicKey(signerKey.getLocalPublicKey());
+    
+    const size_t kMessages = 4096;
+    std::vector<std::string> messages;
+    std::vector<std::string> signatures;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kMessages; ++i) {
+        messages.push_back("入站记录 #" + std::to_string(i));
+        signatures.push_back(signerKey.signWithLocalPrivate(messages.back()));
+    }
+    double signSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "签名: " << static_cast<size_t>(kMessages / signSeconds) << " 条/秒" << std::endl;
+    
+    // 单线程逐条验证作为对照
+    size_t valid = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kMessages; ++i) {
+        if (verifierKey.verifyWithRemotePublic(messages[i], signatures[i])) {
+            ++valid;
+        }
+    }
+    double verifySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << (valid == kMessages ? "✅" : "❌") << " 逐条验证 " << valid << "/" << kMessages << "，"
+              << static_cast<size_t>(kMessages / verifySeconds) << " 条/秒" << std::endl;
+    check(valid == kMessages, "Ed25519 逐条验证失败");
+    
+    // 批量验证，混入一条被篡改的签名
+    std::string publicKey = signerKey.getLocalPublicKey();
+    std::string tampered = signatures[7];
+    tampered[0] = (tampered[0] == 'A') ? 'B' : 'A';
+    std::vector<Ed25519Key::SignatureCheck> checks;
+    for (size_t i = 0; i < kMessages; ++i) {
+        checks.push_back({messages[i], i == 7 ? tampered : signatures[i], publicKey});
+    }
+    
+    std::vector<uint8_t> results;
+    start = std::chrono::steady_clock::now();
+    bool allValid = Ed25519Key::verifyBatch(checks, results);
+    double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t batchValid = 0;
+    for (uint8_t result : results) {
+        batchValid += result;
+    }
+    std::cout << "批量验证: " << static_cast<size_t>(kMessages / batchSeconds) << " 条/秒，通过 "
+              << batchValid << "/" << kMessages << std::endl;
+    const bool detected = !allValid && results.size() == kMessages && !results[7] && batchValid == kMessages - 1;
+    std::cout << (detected ? "✅ 篡改检测成功" : "❌ 篡改检测失败") << std::endl;
+    check(detected, "Ed25519 批量验证未准确找出被篡改的签名");
+}
+
 int main() {
     std::cout << "=== CryptoLink 数字签名与密钥交换测试 ===" << std::endl;
     std::cout << std::endl;
@@ -124,6 +249,8 @@ int main() {
     try {
         testRSASignatureVerification();
         testKeyExchange();
+        testMerkleBatchSigning();
+        testEd25519Signing();
         
         std::cout << "\n🎯 测试总结:" << std::endl;
         std::cout << "✅ 数字签名框架已实现" << std::endl;
@@ -2,10 +2,13 @@
 #define AES_KEY_H
 
 #include "SymmetricalEncryptionInterface.h"
+#include "BufferPool.h"
 #include <cryptopp/aes.h>
 #include <cryptopp/modes.h>
 #include <cryptopp/osrng.h>
 #include <cryptopp/base64.h>
+#include <cryptopp/secblock.h>
+#include <string_view>
 
 using namespace CryptoPP;
 
@@ -21,6 +24,18 @@ public:
     std::string decryptWithRemote(const std::string& ciphertext) override;
     bool setRemotePublicKey(const std::string& keyString, const std::string& iv) override;
     std::string getLocalKey() override;
+    
+    // 解密旧版本 JSON 消息中的 Base64 密文，明文使用缓冲池分配
+    PooledBuffer decryptWithLocal(std::string_view ciphertext, BufferPool& pool);
+    PooledBuffer decryptWithRemote(std::string_view ciphertext, BufferPool& pool);
+    
+    // 二进制记录：缓冲区开头预留 headroom 字节给调用方写记录头，其后是原始密文（不做Base64）
+    PooledBuffer encryptWithLocalRaw(std::string_view plaintext, size_t headroom, BufferPool& pool);
+    PooledBuffer encryptWithRemoteRaw(std::string_view plaintext, size_t headroom, BufferPool& pool);
+    
+    // 原地解密原始密文，成功时 length 更新为明文长度（明文不会比密文长）
+    bool decryptWithLocalInPlace(char* data, size_t& length);
+    bool decryptWithRemoteInPlace(char* data, size_t& length);
 
 private:
     std::string localKey;
@@ -28,6 +43,12 @@ private:
     std::string remoteKey;
     std::string remoteIV;
     
+    // 解码后的原始密钥，避免每条消息重复Base64解码
+    SecByteBlock localKeyRaw;
+    SecByteBlock localIVRaw;
+    SecByteBlock remoteKeyRaw;
+    SecByteBlock remoteIVRaw;
+    
     AutoSeededRandomPool rng;
     
     // 辅助函数：将密钥转换为字符串格式（Base64）
@@ -43,10 +64,19 @@ private:
     std::string base64Decode(const std::string& data) const;
     
     // 辅助函数：AES加密
-    std::string aesEncrypt(const std::string& plaintext, const std::string& key, const std::string& iv) const;
+    std::string aesEncrypt(const std::string& plaintext, const SecByteBlock& key, const SecByteBlock& iv) const;
     
     // 辅助函数：AES解密
-    std::string aesDecrypt(const std::string& ciphertext, const std::string& key, const std::string& iv) const;
+    std::string aesDecrypt(const std::string& ciphertext, const SecByteBlock& key, const SecByteBlock& iv) const;
+    
+    // 辅助函数：AES解密，输出写入缓冲池
+    PooledBuffer aesDecrypt(std::string_view ciphertext, const SecByteBlock& key, const SecByteBlock& iv, BufferPool& pool) const;
+    
+    // 辅助函数：AES加密为原始密文，前面预留记录头空间
+    PooledBuffer aesEncryptRaw(std::string_view plaintext, size_t headroom, const SecByteBlock& key, const SecByteBlock& iv, BufferPool& pool) const;
+    
+    // 辅助函数：AES原地解密并去除填充
+    bool aesDecryptInPlace(char* data, size_t& length, const SecByteBlock& key, const SecByteBlock& iv) const;
 };
 
 #endif // AES_KEY_H
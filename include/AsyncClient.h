@@ -0,0 +1,144 @@
+#ifndef ASYNC_CLIENT_H
+#define ASYNC_CLIENT_H
+
+#ifdef CRYPTOLINK_HAVE_COROUTINES
+
+#include "CryptoWebSocketClient.h"
+#include "MessageInbox.h"
+#include "Task.h"
+#include <chrono>
+#include <coroutine>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 客户端的协程接口（需要以 CRYPTOLINK_ENABLE_COROUTINES 构建）
+//
+//   AsyncClient async(client);
+//   if (co_await async.connect("tcp://127.0.0.1:9002") && co_await async.handshake()) {
+//       co_await async.send("ping");
+//       auto reply = co_await async.receive();
+//   }
+//
+// 接管客户端的连接、握手和消息回调；等待操作都在传输线程上恢复，
+// 因此第一次等待之后协程运行在传输线程上，同一客户端上的多个协程之间不需要加锁
+// 在传输线程上 co_await connect（断开后重新连接）时，停止旧线程和建立新连接改在临时线程上进行，
+// 协程由新的传输线程恢复；连接在发起时就失败的情况下在该临时线程上恢复
+class AsyncClient {
+public:
+    explicit AsyncClient(CryptoWebSocketClient& client);
+    ~AsyncClient();
+
+    AsyncClient(const AsyncClient&) = delete;
+    AsyncClient& operator=(const AsyncClient&) = delete;
+
+    // 等待连接状态变化，结果为 true 表示达到了目标状态
+    class StateAwaiter {
+    public:
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        bool await_resume() const { return result; }
+
+    private:
+        friend class AsyncClient;
+
+        StateAwaiter(AsyncClient& owner, bool waitHandshake, std::string uri)
+            : owner(owner), waitHandshake(waitHandshake), uri(std::move(uri)) {}
+
+        // 停止旧连接并发起新连接，返回 false 表示已经失败且本对象未被恢复
+        bool startConnect();
+
+        AsyncClient& owner;
+        bool waitHandshake;
+        std::string uri;
+        std::coroutine_handle<> handle;
+        bool result = false;
+    };
+
+    // 消息放入发送队列后让出，由传输线程在处理完已排队的发送后恢复
+    class SendAwaiter {
+    public:
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<> handle);
+        bool await_resume() const { return result; }
+
+    private:
+        friend class AsyncClient;
+
+        SendAwaiter(CryptoWebSocketClient& client, std::string message, SendPriority priority)
+            : client(client), message(std::move(message)), priority(priority) {}
+
+        CryptoWebSocketClient& client;
+        std::string message;
+        SendPriority priority;
+        bool result = false;
+    };
+
+    // 调用结束后在传输线程上恢复
+    class CallAwaiter {
+    public:
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        RpcResult await_resume() { return std::move(result); }
+
+    private:
+        friend class AsyncClient;
+
+        CallAwaiter(CryptoWebSocketClient& client, std::string method, std::string request,
+                    std::chrono::milliseconds timeout, SendPriority priority)
+            : client(client), method(std::move(method)), request(std::move(request)),
+              timeout(timeout), priority(priority) {}
+
+        CryptoWebSocketClient& client;
+        std::string method;
+        std::string request;
+        std::chrono::milliseconds timeout;
+        SendPriority priority;
+        RpcResult result;
+    };
+
+    // 建立连接并启动传输线程，连接建立时返回 true，失败时返回 false
+    StateAwaiter connect(const std::string& uri);
+
+    // 等待握手完成，连接断开时返回 false
+    StateAwaiter handshake();
+
+    // 发送加密消息，未连接或握手未完成时返回 false
+    SendAwaiter send(std::string message, SendPriority priority = SendPriority::NORMAL);
+
+    // 调用服务端注册的方法，多个协程可以同时在同一连接上调用，各自在应答到达时恢复
+    CallAwaiter call(std::string method, std::string request,
+                     std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                     SendPriority priority = SendPriority::NORMAL);
+
+    // 接收下一条消息，视图在下一次 co_await 之前有效；连接断开后返回空
+    MessageInbox::ReceiveAwaiter receive() { return inbox.receive(); }
+
+private:
+    enum class State {
+        IDLE,
+        CONNECTING,
+        OPEN,
+        ESTABLISHED,
+        CLOSED
+    };
+
+    CryptoWebSocketClient& client;
+    MessageInbox inbox;
+
+    std::mutex mutex;
+    State state;
+    std::vector<StateAwaiter*> openWaiters;
+    std::vector<StateAwaiter*> handshakeWaiters;
+
+    // 在传输线程上调用
+    void onConnect(bool connected);
+    void onHandshake();
+
+    // 解锁后恢复等待者
+    static void resumeAll(std::vector<StateAwaiter*>& waiters, bool result);
+};
+
+#endif // CRYPTOLINK_HAVE_COROUTINES
+
+#endif // ASYNC_CLIENT_H
@@ -0,0 +1,124 @@
+#ifndef ASYNC_SERVER_H
+#define ASYNC_SERVER_H
+
+#ifdef CRYPTOLINK_HAVE_COROUTINES
+
+#include "CryptoWebSocketServer.h"
+#include "MessageInbox.h"
+#include "Task.h"
+#include <coroutine>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+// 一个已完成握手的会话，可以复制，所有副本共用同一个接收队列
+class AsyncSession {
+public:
+    // 消息放入发送队列后让出，由事件循环在处理完已排队的发送后恢复
+    class SendAwaiter {
+    public:
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<> handle);
+        bool await_resume() const { return result; }
+
+    private:
+        friend class AsyncSession;
+
+        SendAwaiter(CryptoWebSocketServer& server, websocketpp::connection_hdl hdl,
+                    std::string message, SendPriority priority)
+            : server(server), hdl(std::move(hdl)), message(std::move(message)), priority(priority) {}
+
+        CryptoWebSocketServer& server;
+        websocketpp::connection_hdl hdl;
+        std::string message;
+        SendPriority priority;
+        bool result = false;
+    };
+
+    websocketpp::connection_hdl handle() const { return hdl; }
+
+    // 发送加密消息，服务器未运行时返回 false
+    SendAwaiter send(std::string message, SendPriority priority = SendPriority::NORMAL) {
+        return SendAwaiter(*server, hdl, std::move(message), priority);
+    }
+
+    // 接收下一条消息，视图在下一次 co_await 之前有效；会话结束后返回空
+    MessageInbox::ReceiveAwaiter receive() { return inbox->receive(); }
+
+    bool isOpen() const { return !inbox->isClosed(); }
+
+private:
+    friend class AsyncServer;
+
+    AsyncSession(CryptoWebSocketServer& server, websocketpp::connection_hdl hdl,
+                 std::shared_ptr<MessageInbox> inbox)
+        : server(&server), hdl(std::move(hdl)), inbox(std::move(inbox)) {}
+
+    CryptoWebSocketServer* server;
+    websocketpp::connection_hdl hdl;
+    std::shared_ptr<MessageInbox> inbox;
+};
+
+// 服务器的协程接口（需要以 CRYPTOLINK_ENABLE_COROUTINES 构建）
+//
+//   AsyncServer async(server);
+//   while (auto session = co_await async.accept()) {
+//       handleSession(*session).detach();
+//   }
+//
+// 接管服务器的握手、会话结束和消息回调；等待操作都在事件循环线程上恢复，
+// 每个会话一个协程，成千上万个会话共用同一个事件循环线程
+class AsyncServer {
+public:
+    explicit AsyncServer(CryptoWebSocketServer& server);
+    ~AsyncServer();
+
+    AsyncServer(const AsyncServer&) = delete;
+    AsyncServer& operator=(const AsyncServer&) = delete;
+
+    class AcceptAwaiter {
+    public:
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        std::optional<AsyncSession> await_resume() { return std::move(result); }
+
+    private:
+        friend class AsyncServer;
+
+        explicit AcceptAwaiter(AsyncServer& owner) : owner(owner) {}
+
+        AsyncServer& owner;
+        std::coroutine_handle<> handle;
+        std::optional<AsyncSession> result;
+    };
+
+    // 等待下一个完成握手的会话，close() 之后返回空
+    AcceptAwaiter accept() { return AcceptAwaiter(*this); }
+
+    // 结束所有等待：accept 返回空，各会话的接收返回空
+    void close();
+
+private:
+    typedef std::map<websocketpp::connection_hdl, std::shared_ptr<MessageInbox>,
+                     std::owner_less<websocketpp::connection_hdl>> InboxMap;
+
+    CryptoWebSocketServer& server;
+
+    std::mutex mutex;
+    InboxMap inboxes;
+    std::deque<AsyncSession> pending;       // 尚未被 accept 取走的会话
+    std::deque<AcceptAwaiter*> acceptors;
+    bool closed;
+
+    // 在事件循环线程上调用
+    void onHandshake(websocketpp::connection_hdl hdl);
+    void onClose(websocketpp::connection_hdl hdl);
+    void onMessage(websocketpp::connection_hdl hdl, std::string_view message);
+};
+
+#endif // CRYPTOLINK_HAVE_COROUTINES
+
+#endif // ASYNC_SERVER_H
@@ -0,0 +1,113 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class BufferPool;
+struct BufferPoolCore;
+
+// 缓冲区块头，数据紧跟在头部之后
+struct BufferBlock {
+    std::atomic<uint32_t> refCount;
+    uint32_t sizeClass;             // 分级索引，超出最大分级时为 BufferPool::kOversizeClass
+    size_t capacity;
+    size_t length;
+    BufferPoolCore* core;
+    BufferBlock* nextFree;          // 跨线程归还时的侵入式链表指针
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+// 引用计数的缓冲区句柄，最后一个句柄析构时归还到所属的池
+class PooledBuffer {
+public:
+    PooledBuffer() : block(nullptr) {}
+    explicit PooledBuffer(BufferBlock* block) : block(block) {}
+    PooledBuffer(const PooledBuffer& other);
+    PooledBuffer(PooledBuffer&& other) noexcept : block(other.block) { other.block = nullptr; }
+    PooledBuffer& operator=(const PooledBuffer& other);
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+    ~PooledBuffer() { reset(); }
+
+    char* data() { return block ? block->data() : nullptr; }
+    const char* data() const { return block ? block->data() : nullptr; }
+    size_t size() const { return block ? block->length : 0; }
+    size_t capacity() const { return block ? block->capacity : 0; }
+    bool empty() const { return size() == 0; }
+    explicit operator bool() const { return block != nullptr; }
+
+    // 调整有效长度（不能超过容量）
+    bool resize(size_t length);
+
+    // 追加数据（不能超过容量）
+    bool append(const char* bytes, size_t length);
+
+    std::string_view view() const { return std::string_view(data(), size()); }
+    std::string toString() const { return std::string(data(), size()); }
+
+    uint32_t useCount() const { return block ? block->refCount.load(std::memory_order_relaxed) : 0; }
+
+    // 释放当前持有的缓冲区
+    void reset();
+
+private:
+    BufferBlock* block;
+};
+
+// 缓冲池统计信息
+struct BufferPoolStats {
+    uint64_t hits = 0;              // 从空闲链表命中
+    uint64_t misses = 0;            // 需要新分配
+    uint64_t oversize = 0;          // 超过最大分级，直接分配
+    uint64_t releases = 0;          // 归还到池中的次数
+    uint64_t foreignReleases = 0;   // 由其他线程归还的次数
+    uint64_t cachedBlocks = 0;      // 当前缓存的空闲块数量
+    uint64_t cachedBytes = 0;       // 当前缓存的空闲字节数
+};
+
+// 按大小分级的缓冲池，每个事件循环线程一个实例
+// 分配和回收在所属线程内无锁完成；其他线程归还的块先进入无锁回收栈，由所属线程下次分配时收回
+class BufferPool {
+public:
+    static constexpr size_t kNumSizeClasses = 7;
+    static constexpr uint32_t kOversizeClass = kNumSizeClasses;
+    static const size_t kSizeClasses[kNumSizeClasses];
+
+    explicit BufferPool(size_t maxCachedPerClass = 64);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // 获取至少 size 字节容量的缓冲区，有效长度为 0
+    PooledBuffer acquire(size_t size);
+
+    // 获取缓冲区并拷贝数据
+    PooledBuffer copyFrom(const char* bytes, size_t length);
+
+    // 获取本池的统计信息
+    BufferPoolStats getStats() const;
+
+    // 当前线程的缓冲池
+    static BufferPool& local();
+
+    // 汇总所有存活缓冲池的统计信息
+    static BufferPoolStats aggregateStats();
+
+private:
+    friend class PooledBuffer;
+
+    BufferPoolCore* core;
+
+    static void release(BufferBlock* block);
+    static uint32_t sizeClassFor(size_t size);
+};
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,121 @@
+#ifndef CHANNEL_MUX_H
+#define CHANNEL_MUX_H
+
+#include "BufferPool.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// 在一条加密连接上复用多个逻辑通道
+// 通道记录头：1字节记录类型 | 1字节标志 | 4字节通道号（大端），记录头作为 AEAD 附加数据参与认证
+// 每个通道每个方向独立维护发送窗口（信用），接收方交付数据后通过 CHANNEL_CREDIT 归还窗口；
+// 大消息按分片在就绪通道之间轮转发送，一个通道的大数据量传输不会阻塞其他通道的小消息
+// 客户端打开的通道号为奇数，服务端为偶数，通道号 0 不使用；对端用错奇偶的 CHANNEL_OPEN 视为协议错误，
+// 同时打开的通道数超过 kMaxChannels 时回复 CHANNEL_CLOSE 拒绝
+class ChannelMux {
+public:
+    typedef uint32_t ChannelId;
+
+    // 通道记录类型，与服务端/客户端的消息类型编号一致
+    enum RecordType : uint8_t {
+        CHANNEL_OPEN = 9,
+        CHANNEL_DATA = 10,
+        CHANNEL_CLOSE = 11,
+        CHANNEL_CREDIT = 12
+    };
+
+    static constexpr size_t kHeaderSize = 6;
+    static constexpr uint8_t kFinalFragment = 0x01;
+
+    // 双方约定的初始窗口，之后的窗口由 CHANNEL_CREDIT 增加
+    static constexpr uint32_t kInitialWindow = 256 * 1024;
+    static constexpr size_t kMaxFragment = 16 * 1024;
+
+    // 单条消息的上限：中间分片进入重组缓冲区后就归还窗口，窗口本身限制不了重组占用的内存，
+    // 对端发来的消息超过上限时关闭该通道
+    static constexpr size_t kMaxMessageSize = 16 * 1024 * 1024;
+
+    // 一条连接上同时打开的通道数上限（双方打开的合计），每个通道都有自己的窗口和重组缓冲区
+    static constexpr size_t kMaxChannels = 1024;
+
+    // 发送一条通道记录（由连接负责加密和发送）
+    typedef std::function<bool(std::string_view header, std::string_view payload)> RecordSender;
+    typedef std::function<void(ChannelId, std::string_view)> DataHandler;
+    typedef std::function<void(ChannelId)> ChannelHandler;
+
+    ChannelMux(RecordSender sender, bool initiator);
+
+    // 打开新通道，不需要新的握手；连接不可用、通道数已达上限或通道号用完一轮后仍被占用时返回 0
+    ChannelId openChannel();
+
+    // 发送完已排队的数据后关闭通道
+    bool closeChannel(ChannelId channel);
+
+    // 在通道上发送一条消息，窗口不足时排队等待对端归还信用；消息超过 kMaxMessageSize 时返回 false
+    bool send(ChannelId channel, std::string_view message);
+
+    // 处理收到并解密后的通道记录，header 至少 kHeaderSize 字节
+    bool handleRecord(std::string_view header, std::string_view payload);
+
+    // 连接断开时丢弃全部通道
+    void reset();
+
+    void setDataHandler(DataHandler handler);
+    void setOpenHandler(ChannelHandler handler);
+    void setCloseHandler(ChannelHandler handler);
+
+    bool isOpen(ChannelId channel) const;
+    size_t channelCount() const;
+
+    // 通道上等待信用的待发送字节数
+    size_t pendingBytes(ChannelId channel) const;
+
+    static bool isChannelRecord(uint8_t type) {
+        return type >= CHANNEL_OPEN && type <= CHANNEL_CREDIT;
+    }
+
+private:
+    struct PendingMessage {
+        PooledBuffer data;
+        size_t offset;
+    };
+
+    struct Channel {
+        uint32_t sendCredit = kInitialWindow;
+        uint32_t receiveWindow = kInitialWindow;   // 对端还可以发送的字节数
+        uint32_t consumed = 0;                     // 已交付但尚未归还的字节数
+        std::deque<PendingMessage> pending;
+        size_t pendingBytes = 0;
+        std::string reassembly;
+        bool queued = false;                       // 是否已在就绪队列中
+        bool closing = false;
+    };
+
+    RecordSender sender;
+    DataHandler dataHandler;
+    ChannelHandler openHandler;
+    ChannelHandler closeHandler;
+
+    mutable std::mutex mutex;
+    std::unordered_map<ChannelId, Channel> channels;
+    std::deque<ChannelId> ready;
+    ChannelId nextChannelId;
+    bool initiator;
+
+    static void writeHeader(char* header, RecordType type, uint8_t flags, ChannelId channel);
+    bool sendControl(RecordType type, ChannelId channel, std::string_view payload);
+
+    // 按就绪队列轮转发送，每次发送一个分片（调用方持有锁）
+    void pump();
+    bool sendFragment(ChannelId channel, Channel& state, std::string_view data, bool final);
+    void finishClose(ChannelId channel);
+
+    // 归还已交付数据占用的窗口
+    void releaseCredit(ChannelId channel, size_t length);
+};
+
+#endif // CHANNEL_MUX_H
@@ -0,0 +1,37 @@
+#ifndef CIPHER_SUITE_H
+#define CIPHER_SUITE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 握手阶段协商的对称加密套件，数值直接用于线路协议
+enum class CipherSuite : uint8_t {
+    NONE = 0,
+    AES_256_CBC = 1,            // 兼容旧版本：固定IV的CBC模式，无消息认证
+    AES_256_GCM = 2,
+    CHACHA20_POLY1305 = 3
+};
+
+// 当前CPU是否有AES及无进位乘法硬件加速（GCM依赖两者）
+bool hasAesHardwareAcceleration();
+
+// 本机的默认套件优先级：有AES硬件加速时GCM优先，否则ChaCha20-Poly1305优先，CBC仅用于兼容旧客户端
+std::vector<CipherSuite> preferredCipherSuites();
+
+// 按服务端优先级在客户端提供的列表中选择套件，没有交集时返回 NONE
+CipherSuite negotiateCipherSuite(const std::vector<CipherSuite>& serverPreference,
+                                 const std::vector<CipherSuite>& clientOffer);
+
+// 套件列表与线路格式（逗号分隔的数值，如 "2,3,1"）之间的转换
+std::string cipherSuitesToString(const std::vector<CipherSuite>& suites);
+std::vector<CipherSuite> parseCipherSuites(const std::string& text);
+
+// 协商记录：客户端提供的套件列表（线路格式原文）和服务端选定的套件
+// 双方把它混入会话密钥派生，客户端还随会话密钥把它发给服务端核对，中途篡改列表或选择都会让握手失败
+std::string cipherSuiteTranscript(const std::string& offer, CipherSuite selected);
+
+// 套件名称，用于日志
+const char* cipherSuiteName(CipherSuite suite);
+
+#endif // CIPHER_SUITE_H
@@ -0,0 +1,109 @@
+#ifndef CRYPTO_CLIENT_HUB_H
+#define CRYPTO_CLIENT_HUB_H
+
+#include "CryptoWebSocketClient.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 在少量固定的事件循环线程上管理大量出站加密会话
+// 每个会话仍是一个 CryptoWebSocketClient，但不再有自己的传输线程：新会话分配到会话最少的事件循环上，
+// 同一循环上的会话共用一个线程，会话的回调都在所属循环的线程上执行（同一会话的回调不会并发）
+//
+// 所有会话共用一个身份密钥（或同一个预共享密钥）和同一套加密套件，身份只生成一次并在连接之前载入，
+// 握手时不会在事件循环线程上等待密钥生成；连接断开或失败后按重连间隔自动重连，
+// remove 先关闭连接，连接关闭后再在所属循环上销毁会话
+class CryptoClientHub {
+public:
+    typedef uint64_t SessionId;
+
+    // threads 为 0 时使用硬件线程数
+    explicit CryptoClientHub(size_t threads = 0, unsigned int rsaKeySize = RSAKey::kDefaultKeySize);
+    ~CryptoClientHub();
+
+    CryptoClientHub(const CryptoClientHub&) = delete;
+    CryptoClientHub& operator=(const CryptoClientHub&) = delete;
+
+    // 以下设置在第一次 connect 之前调用，对所有会话生效
+
+    // 使用已有的身份私钥（Base64 PKCS#8）或可能仍在生成的身份，未设置时在第一次 connect 时于后台生成
+    bool setIdentity(const std::string& privateKey);
+    void setIdentity(std::shared_future<std::string> identity);
+
+    // 所有会话使用同一个预共享密钥握手，身份为空时恢复 RSA 握手
+    bool setPreSharedKey(const std::string& identity, const std::string& key);
+
+    // 握手时提供给服务端的加密套件列表
+    void setCipherSuites(const std::vector<CipherSuite>& suites);
+
+    // 断开或连接失败后隔多久重连，0 表示不重连（默认 1 秒）
+    void setReconnectInterval(std::chrono::milliseconds interval);
+
+    // 会话回调，在会话所属循环的线程上调用；明文仅在回调期间有效
+    void setConnectCallback(std::function<void(SessionId, bool)> callback);
+    void setHandshakeCallback(std::function<void(SessionId)> callback);
+    void setMessageCallback(std::function<void(SessionId, std::string_view)> callback);
+
+    // 新建会话并开始连接（线程安全），返回会话号，集线器已停止时返回 0
+    // configure 在连接之前于调用线程上执行，可以设置会话的其他选项和回调（连接和握手回调由集线器接管）
+    // 第一次调用时若身份仍在生成，在这里等待生成完成
+    SessionId connect(const std::string& uri, std::function<void(CryptoWebSocketClient&)> configure = nullptr);
+
+    // 关闭并移除会话（线程安全），会话不再重连，连接关闭后在所属循环上销毁
+    bool remove(SessionId id);
+
+    // 取得会话（线程安全），已移除时为空；通过它可以使用客户端的全部发送接口
+    // 最后一个引用释放时会话在所属循环上销毁；不要对它调用 connect / run / stop / setEventLoop
+    std::shared_ptr<CryptoWebSocketClient> session(SessionId id) const;
+
+    // 发送加密消息（线程安全），会话不存在或握手未完成时返回 false
+    bool sendEncryptedMessage(SessionId id, const std::string& message, SendPriority priority = SendPriority::NORMAL);
+
+    // 发送给所有已完成握手的会话（线程安全），返回发出的会话数
+    size_t broadcastEncryptedMessage(const std::string& message, SendPriority priority = SendPriority::NORMAL);
+
+    // 未移除的会话数和事件循环线程数
+    size_t sessionCount() const;
+    size_t threadCount() const { return loops.size(); }
+
+    // 关闭所有会话并停止事件循环线程，之后 connect 返回 0
+    void stop();
+
+private:
+    struct Loop;
+    struct Session;
+
+    unsigned int rsaKeySize;
+    std::vector<std::shared_ptr<Loop>> loops;     // 会话持有所属循环，循环比集线器之外的会话引用活得久
+
+    std::shared_future<std::string> identity;
+    std::string pskIdentity;
+    std::string pskKey;
+    std::vector<CipherSuite> cipherSuites;
+    std::chrono::milliseconds reconnectInterval;
+
+    std::function<void(SessionId, bool)> connectCallback;
+    std::function<void(SessionId)> handshakeCallback;
+    std::function<void(SessionId, std::string_view)> messageCallback;
+
+    // 会话表：移除的会话留在表中，直到在所属循环上销毁
+    mutable std::mutex mutex;
+    std::unordered_map<SessionId, std::shared_ptr<Session>> sessions;
+    SessionId nextSessionId;
+    size_t activeSessions;
+    bool stopped;
+
+    // 以下在会话所属循环的线程上调用
+    void startConnect(const std::shared_ptr<Session>& session);
+    void onSessionConnect(const std::shared_ptr<Session>& session, bool connected);
+    void retire(const std::shared_ptr<Session>& session);
+};
+
+#endif // CRYPTO_CLIENT_HUB_H
@@ -1,66 +1,345 @@
 #ifndef CRYPTO_WEBSOCKET_CLIENT_H
 #define CRYPTO_WEBSOCKET_CLIENT_H
 
-#include <websocketpp/config/asio_no_tls_client.hpp>
-#include <websocketpp/client.hpp>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <functional>
+#include <future>
 #include <thread>
+#include <string_view>
+#include <type_traits>
+#include "Transport.h"
 #include "RSAKey.h"
 #include "AESKey.h"
+#include "BufferPool.h"
+#include "SessionCipher.h"
+#include "TopicIndex.h"
+#include "ChannelMux.h"
+#include "MpscQueue.h"
+#include "MerkleBatch.h"
+#include "PriorityLanes.h"
+#include "LatencyProbe.h"
+#include "FileTransfer.h"
+#include "SegmentCipher.h"
+#include "RpcSession.h"
+#include "PeerRelay.h"
+#include "DatagramSocket.h"
 
-typedef websocketpp::client<websocketpp::config::asio_client> client;
-typedef websocketpp::config::asio_client::message_type::ptr message_ptr;
+namespace Json {
+class CharReader;
+}
 
+// 线程模型：握手、解密和回调都在传输线程上执行
+// sendEncryptedMessage / publish / sendOnChannel 等发送接口可以在任意线程调用：
+// 明文放入无锁队列，由传输线程批量取出、按顺序加密并发送，每批只唤醒一次事件循环
+// 发送时可以指定优先级，大消息分片后与其他优先级的记录交错发送
+//
+// 构造时不生成密钥：身份密钥对在 connect 时于后台生成，与建立连接并行，握手需要时才等待；
+// 也可以在 connect 之前通过 setIdentity 注入已有的私钥或与其他客户端共享的身份，完全跳过生成
 class CryptoWebSocketClient {
 public:
-    CryptoWebSocketClient();
+    explicit CryptoWebSocketClient(unsigned int rsaKeySize = RSAKey::kDefaultKeySize);
     ~CryptoWebSocketClient();
     
-    // 连接到服务器
+    // 连接到服务器，按地址选择传输后端：ws://host:port、tcp://host:port 或 unix:///path/to.sock
+    // 重新连接前需要先 stop()，上一个连接中尚未发出的记录会被丢弃
     bool connect(const std::string& uri);
     
     // 断开连接
     void disconnect();
     
-    // 发送加密消息
-    bool sendEncryptedMessage(const std::string& message);
+    // 使用已有的身份私钥（RSAKey::getLocalPrivateKey 导出的 Base64 PKCS#8），在 connect 之前调用
+    bool setIdentity(const std::string& privateKey);
+    
+    // 使用可能仍在后台生成的身份，例如 sharedIdentity() 返回的进程内共享身份，在 connect 之前调用
+    void setIdentity(std::shared_future<std::string> identity);
+    
+    // 使用预共享密钥握手（原始字节，至少 16 字节），在 connect 之前调用，身份为空时恢复 RSA 握手
+    // 会话密钥由 HKDF 从 PSK 和双方随机数派生，没有任何非对称运算，一个往返后即可发送数据；
+    // 服务端需要用 addPreSharedKey 配置同一身份和密钥，只协商 AEAD 套件；不交换 RSA 公钥，签名消息无法验证；
+    // 服务端改用 RSA 握手回复时按协议错误断开，不会降级
+    bool setPreSharedKey(const std::string& identity, const std::string& key);
+    
+    // 导出本客户端使用的身份私钥，便于持久化后下次直接注入（密钥仍在生成时等待完成）
+    std::string exportIdentity();
+    
+    // 在后台线程生成新的身份私钥
+    static std::shared_future<std::string> generateIdentity(unsigned int keySize = RSAKey::kDefaultKeySize);
+    
+    // 进程内共享的身份：每种模数位数只生成一次，第一次调用时在后台开始生成
+    static std::shared_future<std::string> sharedIdentity(unsigned int keySize = RSAKey::kDefaultKeySize);
+    
+    // 发送加密消息（线程安全），未连接或握手未完成时返回 false
+    bool sendEncryptedMessage(const std::string& message, SendPriority priority = SendPriority::NORMAL);
+    
+    // 订阅/取消订阅主题，支持 '+'（单段）和 '#'（剩余全部分段）通配符
+    bool subscribe(const std::string& pattern);
+    bool unsubscribe(const std::string& pattern);
+    
+    // 发布消息到主题，由服务端转发给匹配的订阅者
+    bool publish(const std::string& topic, std::string_view message, SendPriority priority = SendPriority::NORMAL);
+    
+    // 设置主题消息回调，未设置时主题消息交给普通消息回调
+    void setTopicMessageCallback(std::function<void(std::string_view, std::string_view)> callback);
+    
+    // 在当前连接上打开逻辑通道，复用已完成的握手；失败返回 0
+    ChannelMux::ChannelId openChannel();
+    
+    // 发送完通道上已排队的数据后关闭通道
+    bool closeChannel(ChannelMux::ChannelId channel);
+    
+    // 在通道上发送消息，每个通道独立流量控制，超出窗口的部分排队等待
+    bool sendOnChannel(ChannelMux::ChannelId channel, std::string_view message);
+    
+    // 发送文件（线程安全）：文件映射到内存后按块加密发送，内存占用与文件大小无关；返回传输号，失败返回 0
+    // 连接断开时未完成的传输保留，重新连接并完成握手后从服务端已写入磁盘的位置续传
+    FileTransfer::TransferId sendEncryptedFile(const std::string& path, SendPriority priority = SendPriority::BULK);
+    
+    // 放弃一个发送或接收中的文件传输
+    bool cancelFile(FileTransfer::TransferId id);
+    
+    // 调用服务端注册的方法（线程安全），同一连接上可以同时有任意多个调用在途，应答按完成顺序返回
+    // timeout 为 0 表示不限时；处理函数在传输线程上调用且恰好调用一次，应答只在回调期间有效
+    // 返回调用号，未连接或握手未完成时返回 0 且不调用处理函数
+    RpcSession::CallId call(const std::string& method, std::string_view request, RpcSession::ResponseHandler handler,
+                            std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                            SendPriority priority = SendPriority::NORMAL);
+    
+    // 返回 future 的调用，未能发出时立即得到 DISCONNECTED
+    std::future<RpcResult> call(const std::string& method, std::string_view request,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                                SendPriority priority = SendPriority::NORMAL);
+    
+    // 取消一个在途调用（线程安全），处理函数以 CANCELLED 调用，服务端的处理函数可以据此提前放弃
+    void cancelCall(RpcSession::CallId id);
+    
+    // 以名字启用客户端之间的端到端加密中继（服务端需要 setRelayEnabled），在 connect 之前调用
+    // 每次握手后向服务端登记名字和本端的 X25519 公钥；发给其他客户端的消息在本端加密，
+    // 服务端只看路由头、原样转发密文，只有对端能解密，详见 PeerRelay.h
+    bool enableRelay(const std::string& name);
+    
+    // 本端的中继公钥（Base64），可以通过其他渠道交给对端用 setRelayPeerKey 固定
+    std::string getRelayPublicKey() const;
+    
+    // 固定对端的中继公钥（Base64），服务端给出的不同公钥被拒绝，在 connect 之前调用
+    bool setRelayPeerKey(const std::string& peer, const std::string& publicKey);
+    
+    // 经服务端中继发送端到端加密的消息给另一个客户端（线程安全），未连接、握手未完成或未启用中继时返回 false
+    // 对端公钥未知时先向服务端查询，消息排队等待；中继消息都按 NORMAL 优先级发送，同一对端的消息按顺序到达
+    bool sendRelayMessage(const std::string& peer, std::string_view message);
+    
+    // 设置中继消息回调（参数为对端名字和明文，仅在回调期间有效）和消息未能送达的回调，在传输线程上调用
+    void setRelayMessageCallback(std::function<void(std::string_view, std::string_view)> callback);
+    void setRelayFailureCallback(std::function<void(std::string_view)> callback);
+    
+    // 启用 UDP 数据报通道（服务端需要 enableDatagrams），在 connect 之前调用
+    // 每次握手后经会话请求打开，数据报发往 host（为空时使用 connect 地址中的主机，unix 套接字时为本机）；
+    // delivery 为 ORDERED 时丢弃迟到的数据报。只对 AEAD 套件生效，详见 DatagramSocket.h
+    void enableDatagrams(DatagramCipher::Delivery delivery = DatagramCipher::Delivery::UNORDERED,
+                         const std::string& host = "");
+    
+    // 发送数据报（线程安全），数据报通道未打开或负载超过上限时返回 false；数据报可能丢失，不会重传
+    bool sendDatagram(std::string_view message);
+    
+    // 当前连接的数据报通道是否已打开（线程安全）
+    bool datagramsReady() const { return datagramReady; }
+    
+    // 设置数据报回调，在数据报线程（使用共享事件循环时即循环线程）上调用，负载仅在回调期间有效，在 connect 之前设置
+    void setDatagramCallback(std::function<void(std::string_view)> callback);
+    
+    // 设置接收文件的目录，未设置时拒绝服务端发来的文件
+    void setFileReceiveDirectory(const std::string& directory);
+    
+    // 设置文件发送完成（对端已全部写入）和接收完成的回调，在传输线程上调用
+    void setFileSentCallback(FileTransfer::CompletionHandler callback);
+    void setFileReceivedCallback(FileTransfer::CompletionHandler callback);
+    
+    // 设置通道消息回调（明文仅在回调期间有效）和对端关闭通道的回调
+    void setChannelMessageCallback(std::function<void(ChannelMux::ChannelId, std::string_view)> callback);
+    void setChannelClosedCallback(std::function<void(ChannelMux::ChannelId)> callback);
     
     // 设置消息接收回调
-    void setMessageCallback(std::function<void(const std::string&)> callback);
+    // 回调可以接收 std::string_view：直接指向接收帧内原地解密后的明文，零拷贝，仅在回调期间有效；
+    // 回调只接受 std::string 时自动退化为拷贝出一份由调用方持有的明文
+    template <typename Callback>
+    void setMessageCallback(Callback callback) {
+        if constexpr (std::is_invocable_v<Callback&, std::string_view>) {
+            messageCallback = std::move(callback);
+            ownedMessageCallback = nullptr;
+        } else {
+            setOwnedMessageCallback(std::move(callback));
+        }
+    }
+    
+    // 设置需要持有明文所有权的消息回调
+    void setOwnedMessageCallback(std::function<void(std::string)> callback);
+    
+    // 设置服务器签名消息的回调，消息的 Merkle 证明和根签名已通过服务器公钥验证
+    // 未设置时验证通过的签名消息交给普通消息回调
+    void setSignedMessageCallback(std::function<void(std::string_view)> callback);
+    
+    // 设置握手完成回调，在传输线程上调用，此后即可发送加密消息
+    void setHandshakeCallback(std::function<void()> callback);
+    
+    // 设置连接状态回调，在传输线程上调用：连接建立时参数为 true，连接失败或断开时为 false
+    void setConnectCallback(std::function<void(bool)> callback);
+    
+    // 在传输线程上执行任务（线程安全），尚未连接时返回 false
+    bool post(std::function<void()> task);
+    
+    // 当前线程是否为 run 创建的传输线程（使用共享事件循环时总是 false）
+    bool inTransportThread() const;
+    
+    // 运行在共享的事件循环上，不再创建自己的传输线程，在 connect 之前调用
+    // 循环由所有者在一个线程上运行（即本客户端的传输线程）；run 不做任何事，stop 只关闭连接且不触发回调；
+    // 客户端必须在循环线程上（或循环停止后）销毁和重新连接，CryptoClientHub 负责这些；
+    // 身份仍在生成时握手暂停在循环的定时检查上，生成完成后继续，不会阻塞同一循环上的其他会话
+    void setEventLoop(boost::asio::io_context& loop);
     
     // 运行客户端
     void run();
     
     // 停止客户端
     void stop();
+    
+    // 设置握手时提供给服务端的加密套件列表（默认按本机CPU特性排序）
+    void setCipherSuites(const std::vector<CipherSuite>& suites);
+    
+    // 获取与服务端协商出的加密套件
+    CipherSuite getNegotiatedCipherSuite() const;
+    
+    // 获取消息缓冲池的命中统计；缓冲池按线程共享，统计是本进程全部线程缓冲池的合计，不区分服务端或客户端实例
+    static BufferPoolStats getBufferPoolStats();
+    
+    // 设置各优先级通道的调度权重（权重为 0 表示严格优先），在 connect 之前调用
+    void setPriorityWeights(const PriorityLanes::Weights& weights);
+    
+    // 设置交给传输层但尚未写出的字节上限，在 connect 之前调用
+    void setSendQueueLimit(size_t bytes);
+    
+    // 设置分段并行加密的阈值：不小于此长度的消息拆成段在工作线程池上并行加密，
+    // 0 表示关闭（默认 1MB），只对 AEAD 套件生效，在 connect 之前调用；
+    // 关闭后也不接收分段消息，服务端改为串行发送
+    void setParallelThreshold(size_t bytes);
+    
+    // 设置未完成的分段消息合计占用的接收缓冲区上限（默认 256MB），握手完成后通告给服务端，
+    // 更长的消息服务端串行发送，几条消息合计超出时拒绝并通知服务端；在 connect 之前调用
+    void setParallelReceiveLimit(uint64_t bytes);
+    
+    // 设置加密延迟探测的间隔，0 表示关闭（默认），在 connect 之前调用
+    void setLatencyProbeInterval(std::chrono::milliseconds interval);
+    
+    // 发送的应用消息是否带发送时刻，对端据此统计单向延迟（线程安全）
+    void setTimestampRecords(bool enabled);
+    
+    // 获取当前连接的延迟统计（线程安全），重新连接时清零
+    LatencyStats getLatencyStats() const;
 
 private:
-    client wsClient;
+    std::unique_ptr<Transport> transport;
     websocketpp::connection_hdl connectionHandle;
     std::unique_ptr<RSAKey> rsaKey;
     std::unique_ptr<AESKey> aesKey;
-    std::function<void(const std::string&)> messageCallback;
+    unsigned int rsaKeySize;
+    std::shared_future<std::string> identity;   // Base64 身份私钥，可能仍在生成
+    bool identityInstalled;                     // 身份是否已经载入 rsaKey
+    SessionCipherSlot sessionCipher;
+    std::vector<CipherSuite> offeredCipherSuites;
+    std::string suiteOffer;                     // 本次公钥请求发出的套件列表（线路格式原文）
+    
+    // 预共享密钥握手的身份和密钥，以及本次握手发出的套件列表和随机数
+    std::string pskIdentity;
+    std::string pskKey;
+    std::string pskOffer;
+    std::string pskNonce;
+    std::function<void(std::string_view)> messageCallback;
+    std::function<void(std::string)> ownedMessageCallback;
+    std::function<void(std::string_view, std::string_view)> topicMessageCallback;
+    std::function<void()> handshakeCallback;
+    std::function<void(bool)> connectCallback;
+    std::function<void(std::string_view)> signedMessageCallback;
+    std::unique_ptr<MerkleBatchVerifier> signedVerifier;
     std::thread clientThread;
-    bool isConnected;
-    bool handshakeComplete;
+    boost::asio::io_context* eventLoop;     // 共享的事件循环，为空时使用自己的传输线程
+    std::atomic<bool> isConnected;
+    std::atomic<bool> handshakeComplete;
+    uint64_t handshakeGeneration;           // 每次握手加一，丢弃上一次握手遗留的定时任务
+    ChannelMux channels;
     
     // WebSocket事件处理
     void onOpen(websocketpp::connection_hdl hdl);
     void onClose(websocketpp::connection_hdl hdl);
-    void onMessage(websocketpp::connection_hdl hdl, message_ptr msg);
+    void onMessage(websocketpp::connection_hdl hdl, Transport::FrameType type, std::string& payload);
     void onFail(websocketpp::connection_hdl hdl);
     
+    // 原地解密二进制加密记录
+    void handleEncryptedRecord(std::string& record);
+    
+    // 按记录类型处理解密后的记录（分片记录拼接完整后也从这里处理）
+    void dispatchRecord(std::string_view header, std::string_view plaintext);
+    
+    // 把解密后的明文交给应用回调
+    void deliverMessage(std::string_view plaintext);
+    
+    // 把身份私钥载入 rsaKey，密钥仍在生成时在这里等待
+    bool installIdentity();
+    
+    // 身份是否已经可以载入而不需要等待
+    bool identityReady();
+    
+    // 共享事件循环上不能阻塞等待身份，定时检查，生成完成后继续本次握手
+    void awaitIdentity(uint64_t generation);
+    
+    // 收到服务器公钥后发送客户端公钥和会话密钥
+    void sendSessionKey();
+    
     // 加密握手过程
     void performHandshake();
     void handleHandshakeMessage(const std::string& message);
     
+    // 会话加密器就绪后（RSA 或 PSK 握手）开始收发加密记录
+    void completeHandshake();
+    
     // 消息类型
     enum MessageType {
         PUBLIC_KEY_REQUEST = 1,
         PUBLIC_KEY_RESPONSE = 2,
         SESSION_KEY = 3,
-        ENCRYPTED_DATA = 4
+        ENCRYPTED_DATA = 4,
+        CIPHER_SUITE_SELECT = 5,
+        SUBSCRIBE = 6,
+        UNSUBSCRIBE = 7,
+        PUBLISH = 8,
+        CHANNEL_OPEN = ChannelMux::CHANNEL_OPEN,
+        CHANNEL_DATA = ChannelMux::CHANNEL_DATA,
+        CHANNEL_CLOSE = ChannelMux::CHANNEL_CLOSE,
+        CHANNEL_CREDIT = ChannelMux::CHANNEL_CREDIT,
+        SIGNED_DATA = 13,
+        FRAGMENT = PriorityLanes::kFragmentRecord,
+        PROBE = 15,
+        PROBE_REPLY = 16,
+        STAMPED_DATA = 17,
+        FILE_OFFER = FileTransfer::FILE_OFFER,
+        FILE_CHUNK = FileTransfer::FILE_CHUNK,
+        FILE_ACK = FileTransfer::FILE_ACK,
+        FILE_CANCEL = FileTransfer::FILE_CANCEL,
+        SEGMENT_BEGIN = SegmentCipher::kBeginRecord,
+        SEGMENT = SegmentCipher::kSegmentRecord,
+        RPC_REQUEST = RpcSession::RPC_REQUEST,
+        RPC_RESPONSE = RpcSession::RPC_RESPONSE,
+        RPC_CANCEL = RpcSession::RPC_CANCEL,
+        PSK_HELLO = 27,
+        PSK_ACCEPT = 28,
+        PSK_FINISHED = 29,
+        RELAY_REGISTER = PeerRelay::RELAY_REGISTER,
+        RELAY_LOOKUP = PeerRelay::RELAY_LOOKUP,
+        RELAY_PEER = PeerRelay::RELAY_PEER,
+        RELAY_DATA = PeerRelay::RELAY_DATA,
+        DATAGRAM_OPEN = DatagramSocket::DATAGRAM_OPEN,
+        DATAGRAM_ACCEPT = DatagramSocket::DATAGRAM_ACCEPT,
+        SEGMENT_LIMIT = SegmentCipher::kLimitRecord,
+        SEGMENT_REJECT = SegmentCipher::kRejectRecord
     };
     
     struct Message {
@@ -68,8 +347,79 @@ private:
         std::string data;
     };
     
+    std::unique_ptr<Json::CharReader> jsonReader;
+    
     std::string serializeMessage(const Message& msg);
     Message parseMessage(const std::string& data);
+    bool sendHandshakeMessage(const Message& msg);
+    
+    // 把一条指定类型的二进制记录放入发送队列
+    bool sendRecord(MessageType type, std::string_view payload, SendPriority priority);
+    bool sendRecord(std::string_view header, std::string_view payload, SendPriority priority);
+    
+    // 待加密发送的记录：任意线程入队，传输线程按顺序加密，记录序号不会因并发发送而乱序
+    struct OutboundRecord {
+        char header[ChannelMux::kHeaderSize] = {0};
+        uint8_t headerLength = 0;
+        SendPriority priority = SendPriority::NORMAL;
+        PooledBuffer payload;
+    };
+    MpscQueue<OutboundRecord> outbound;
+    std::atomic<bool> outboundScheduled;
+    
+    bool enqueueRecord(OutboundRecord record);
+    void scheduleOutboundDrain();
+    void drainOutbound();
+    
+    // 分级发送队列，只在传输线程上使用；传输层排队的数据超过上限时由轮询定时器稍后继续
+    PriorityLanes lanes;
+    size_t sendQueueLimit;
+    bool sendPollScheduled;
+    
+    void pumpLanes();
+    
+    // 延迟探测和统计只在传输线程上更新，不加锁；其他线程读取统计时投递到事件循环上生成快照
+    std::chrono::milliseconds latencyProbeInterval;
+    std::atomic<bool> timestampRecords;
+    LatencyProbe latencyProbe;
+    std::atomic<bool> loopRunning{false};   // 自己的传输线程正在运行事件循环
+    
+    void sendLatencyProbe();
+    
+    // 大消息的分段并行加密，每次握手重建；加密或接收消息的解密完成后由工作线程通知传输线程，
+    // 加密的消息按提交顺序放入发送队列，解密的消息按原记录类型处理
+    std::unique_ptr<SegmentCipher> segments;
+    size_t parallelThreshold;
+    uint64_t parallelReceiveLimit;
+    
+    void flushSegments();
+    
+    // 文件传输的块记录经发送队列进入 BULK 通道，发送端未完成的传输跨连接保留
+    FileTransfer files;
+    
+    // 调用表在传输线程上维护；发送队列每处理一批记录后取出新登记的调用，
+    // 有带截止时间的调用时按最近的截止时间设置定时器
+    RpcSession rpc;
+    std::chrono::steady_clock::time_point rpcTimerDeadline;
+    bool rpcTimerArmed;
+    
+    void pollRpc();
+    
+    // 端到端加密中继在传输线程上加密和解密，中继数据记录不经过会话加密直接放入发送队列
+    PeerRelay relay;
+    
+    // UDP 数据报通道：套接字在第一次 connect 时创建（使用共享事件循环时运行在循环上），跨连接保留；
+    // 每次握手后请求打开，收到服务端分配的连接号和端口后用会话派生的数据报密钥建立通道
+    bool datagramsEnabled;
+    DatagramCipher::Delivery datagramDelivery;
+    std::string datagramHost;
+    std::string serverHost;     // connect 地址中的主机
+    std::atomic<bool> datagramReady;
+    std::function<void(std::string_view)> datagramCallback;
+    std::unique_ptr<DatagramSocket> datagrams;
+    
+    void openDatagrams(std::string_view accept);
+
 };
 
 #endif // CRYPTO_WEBSOCKET_CLIENT_H
@@ -1,67 +1,469 @@
 #ifndef CRYPTO_WEBSOCKET_SERVER_H
 #define CRYPTO_WEBSOCKET_SERVER_H
 
-#include <websocketpp/config/asio_no_tls.hpp>
-#include <websocketpp/server.hpp>
 #include <memory>
 #include <functional>
 #include <thread>
 #include <map>
+#include <mutex>
+#include <set>
+#include <atomic>
+#include <chrono>
+#include <shared_mutex>
+#include <unordered_map>
+#include <string_view>
+#include <type_traits>
+#include "Transport.h"
 #include "RSAKey.h"
 #include "AESKey.h"
+#include "BufferPool.h"
+#include "SessionCipher.h"
+#include "TopicIndex.h"
+#include "TimerWheel.h"
+#include "ChannelMux.h"
+#include "MpscQueue.h"
+#include "MerkleBatch.h"
+#include "PriorityLanes.h"
+#include "LatencyProbe.h"
+#include "FileTransfer.h"
+#include "SegmentCipher.h"
+#include "SessionRecorder.h"
+#include "RpcSession.h"
+#include "PeerRelay.h"
+#include "DatagramSocket.h"
 
-typedef websocketpp::server<websocketpp::config::asio> server;
-typedef server::message_ptr message_ptr;
+namespace Json {
+class CharReader;
+}
 
+// 会话存活检测配置，时长为 0 表示关闭对应的检测
+struct SessionTimeouts {
+    std::chrono::milliseconds handshakeTimeout{10000};   // 连接建立后必须在此时间内完成握手
+    std::chrono::milliseconds idleTimeout{300000};       // 超过此时间没有收到任何消息则回收会话
+    std::chrono::milliseconds heartbeatInterval{30000};  // 超过此时间没有收到数据则发送 ping
+    std::chrono::milliseconds heartbeatTimeout{10000};   // ping 发出后超过此时间仍无响应则回收会话，0 表示只发 ping 不回收
+};
+
+// 线程模型：握手、解密和回调都在事件循环线程上执行
+// sendEncryptedMessage / sendSignedMessage / broadcastEncryptedMessage / publish 可以在任意线程调用：
+// 明文放入无锁队列，由事件循环线程批量取出、按顺序加密并发送，每批只唤醒一次事件循环
+// 发送接口可以指定优先级：每个会话按优先级分通道排队，大消息分片后与其他通道的记录交错发送，
+// 交给传输层但尚未写出的数据不超过发送队列上限，控制消息不会排在大块数据之后
+// 其余接口只能在事件循环线程（各类回调内）调用
 class CryptoWebSocketServer {
 public:
-    CryptoWebSocketServer();
+    explicit CryptoWebSocketServer(unsigned int rsaKeySize = RSAKey::kDefaultKeySize);
     ~CryptoWebSocketServer();
     
-    // 启动服务器
+    // 在指定端口启动 WebSocket 服务器
     bool start(uint16_t port);
     
+    // 按地址选择传输后端启动：ws://host:port、tcp://host:port 或 unix:///path/to.sock
+    bool start(const std::string& endpoint);
+    
     // 停止服务器
     void stop();
     
-    // 广播加密消息给所有连接的客户端
-    void broadcastEncryptedMessage(const std::string& message);
+    // 广播加密消息给所有已完成握手的客户端（线程安全）
+    void broadcastEncryptedMessage(const std::string& message, SendPriority priority = SendPriority::NORMAL);
+    
+    // 发送加密消息给特定客户端（线程安全）
+    // 返回 false 表示服务器未运行；会话在发送前断开或尚未完成握手时记录在事件循环上被丢弃
+    bool sendEncryptedMessage(websocketpp::connection_hdl hdl, const std::string& message,
+                              SendPriority priority = SendPriority::NORMAL);
+    
+    // 发送带服务器签名的加密消息（线程安全）
+    // 签名窗口内的消息组成一棵 Merkle 树，只对根签名一次；每条消息携带包含证明，客户端可以逐条验证
+    bool sendSignedMessage(websocketpp::connection_hdl hdl, const std::string& message,
+                           SendPriority priority = SendPriority::NORMAL);
+    
+    // 设置签名窗口：最早一条消息等待的最长时间，以及每批最多的消息数（达到后立即签名）
+    void setSignedBatchWindow(std::chrono::milliseconds window, size_t maxMessages);
+    
+    // 发布消息到主题，只投递给订阅了匹配模式的客户端，返回排队投递的客户端数（线程安全）
+    size_t publish(const std::string& topic, std::string_view message, SendPriority priority = SendPriority::NORMAL);
+    
+    // 由服务端代客户端订阅/取消订阅主题（客户端也可以通过控制消息自行订阅）
+    bool subscribeClient(websocketpp::connection_hdl hdl, const std::string& pattern);
+    bool unsubscribeClient(websocketpp::connection_hdl hdl, const std::string& pattern);
+    
+    // 在客户端打开的逻辑通道上发送消息，每个通道独立流量控制
+    bool sendOnChannel(websocketpp::connection_hdl hdl, ChannelMux::ChannelId channel, std::string_view message);
+    
+    // 发送完已排队的数据后关闭客户端的逻辑通道
+    bool closeChannel(websocketpp::connection_hdl hdl, ChannelMux::ChannelId channel);
     
-    // 发送加密消息给特定客户端
-    bool sendEncryptedMessage(websocketpp::connection_hdl hdl, const std::string& message);
+    // 发送文件（线程安全）：文件映射到内存后按块加密发送，内存占用与文件大小无关；返回传输号，文件无法读取时返回 0
+    // 连接断开时传输失败，客户端部分文件保留；在新连接上重新发送同一文件时从客户端已写入的位置续传
+    FileTransfer::TransferId sendEncryptedFile(websocketpp::connection_hdl hdl, const std::string& path,
+                                               SendPriority priority = SendPriority::BULK);
+    
+    // 放弃与指定客户端之间的一个文件传输（线程安全）
+    void cancelFile(websocketpp::connection_hdl hdl, FileTransfer::TransferId id);
+    
+    // 注册调用方法，在 start 之前调用；客户端调用未注册的方法时得到 NOT_FOUND
+    // 处理函数在事件循环线程上调用，请求只在调用期间有效；应答句柄可以保存下来在任意线程稍后应答，
+    // 同一会话上的多个请求可以按任意顺序完成
+    typedef std::function<void(websocketpp::connection_hdl, std::string_view request, RpcSession::Responder responder)> RpcMethod;
+    void registerMethod(const std::string& name, RpcMethod method);
+    
+    // 设置接收文件的目录，未设置时拒绝客户端发来的文件（只影响之后建立的连接）
+    // PSK 客户端的部分文件按身份保留供重新连接后续传；RSA 客户端的身份未经证明，部分文件在断开时删除
+    void setFileReceiveDirectory(const std::string& directory);
+    
+    // 设置文件发送完成（客户端已全部写入）和接收完成的回调，在事件循环线程上调用
+    void setFileSentCallback(std::function<void(websocketpp::connection_hdl, FileTransfer::TransferId, const std::string&, bool)> callback);
+    void setFileReceivedCallback(std::function<void(websocketpp::connection_hdl, FileTransfer::TransferId, const std::string&, bool)> callback);
+    
+    // 设置通道消息回调，明文仅在回调期间有效
+    void setChannelMessageCallback(std::function<void(websocketpp::connection_hdl, ChannelMux::ChannelId, std::string_view)> callback);
     
     // 设置消息接收回调
-    void setMessageCallback(std::function<void(websocketpp::connection_hdl, const std::string&)> callback);
+    // 回调可以接收 std::string_view：直接指向接收帧内原地解密后的明文，零拷贝，仅在回调期间有效；
+    // 回调只接受 std::string 时自动退化为拷贝出一份由调用方持有的明文
+    template <typename Callback>
+    void setMessageCallback(Callback callback) {
+        if constexpr (std::is_invocable_v<Callback&, websocketpp::connection_hdl, std::string_view>) {
+            messageCallback = std::move(callback);
+            ownedMessageCallback = nullptr;
+        } else {
+            setOwnedMessageCallback(std::move(callback));
+        }
+    }
+    
+    // 设置需要持有明文所有权的消息回调
+    void setOwnedMessageCallback(std::function<void(websocketpp::connection_hdl, std::string)> callback);
+    
+    // 设置会话握手完成、会话结束（断开或被回收）的回调，在事件循环线程上调用
+    void setHandshakeCallback(std::function<void(websocketpp::connection_hdl)> callback);
+    void setCloseCallback(std::function<void(websocketpp::connection_hdl)> callback);
+    
+    // 在事件循环线程上执行任务（线程安全），服务器未运行时返回 false
+    bool post(std::function<void()> task);
     
     // 运行服务器
     void run();
+    
+    // 设置服务端的加密套件优先级（默认按本机CPU特性排序）
+    void setCipherSuitePreference(const std::vector<CipherSuite>& suites);
+    
+    // 添加预共享密钥（原始字节，至少 16 字节），在 start 之前调用
+    // 配置了同一身份和密钥的客户端使用 PSK 握手：会话密钥由 HKDF 从 PSK 和双方随机数派生，
+    // 没有任何非对称运算，一个往返完成；未配置 PSK 的客户端仍使用 RSA 握手
+    bool addPreSharedKey(const std::string& identity, const std::string& key);
+    
+    // 开启客户端之间的端到端加密中继，在 start 之前调用（默认关闭）
+    // 客户端以名字登记 X25519 公钥、查询对端公钥；中继数据记录只解析路由头，把密文原样转发给对端，
+    // 服务端不做任何对称运算，也看不到明文；服务端负责公钥分发，客户端可以固定对端公钥防止冒充
+    void setRelayEnabled(bool enabled);
+    
+    // 开启 UDP 数据报通道，在 start 之前调用；port 为 0 时由系统选择，实际端口由 getDatagramPort 取得
+    // 客户端握手后经会话请求打开，数据报用会话派生的独立密钥加密、各自独立解密，可能丢失但不会阻塞后续数据；
+    // 重放的数据报被丢弃，delivery 为 ORDERED 时迟到的数据报也被丢弃。只对 AEAD 套件的会话生效，详见 DatagramSocket.h
+    bool enableDatagrams(uint16_t port, DatagramCipher::Delivery delivery = DatagramCipher::Delivery::UNORDERED);
+    uint16_t getDatagramPort() const;
+    
+    // 发送数据报（线程安全），负载超过上限或未开启数据报通道时返回 false；
+    // 会话未打开数据报通道、客户端地址尚未确认或发送缓冲区满时静默丢弃
+    bool sendDatagram(websocketpp::connection_hdl hdl, std::string_view message);
+    
+    // 设置数据报回调，在数据报线程（不是事件循环线程）上调用，负载仅在回调期间有效，在 start 之前设置
+    void setDatagramCallback(std::function<void(websocketpp::connection_hdl, std::string_view)> callback);
+    
+    // 获取与指定客户端协商出的加密套件
+    CipherSuite getNegotiatedCipherSuite(websocketpp::connection_hdl hdl) const;
+    
+    // 获取消息缓冲池的命中统计；缓冲池按线程共享，统计是本进程全部线程缓冲池的合计，不区分服务端或客户端实例
+    static BufferPoolStats getBufferPoolStats();
+    
+    // 设置各优先级通道的调度权重（权重为 0 表示严格优先，只影响之后建立的连接）
+    void setPriorityWeights(const PriorityLanes::Weights& weights);
+    
+    // 设置每个连接交给传输层但尚未写出的字节上限，越小控制消息的排队延迟越低，越大批量吞吐越高
+    void setSendQueueLimit(size_t bytes);
+    
+    // 设置分段并行加密的阈值：不小于此长度的消息拆成段在工作线程池上并行加密，0 表示关闭（默认 1MB）
+    // 只对 AEAD 套件的会话生效；关闭后也不接收分段消息，客户端改为串行发送
+    void setParallelThreshold(size_t bytes);
+    
+    // 设置每个连接未完成的分段消息合计占用的接收缓冲区上限（默认 256MB），握手完成后通告给客户端，
+    // 更长的消息客户端串行发送，几条消息合计超出时拒绝并通知客户端；只影响之后完成握手的连接
+    void setParallelReceiveLimit(uint64_t bytes);
+    
+    // 设置心跳、握手截止时间和空闲超时（只影响之后建立的连接）
+    void setSessionTimeouts(const SessionTimeouts& timeouts);
+    
+    // 因超时被回收的会话总数
+    uint64_t getReapedSessionCount() const { return reapedSessions; }
+    
+    // 设置加密延迟探测的间隔，0 表示关闭（默认），只影响之后完成握手的会话
+    void setLatencyProbeInterval(std::chrono::milliseconds interval);
+    
+    // 发送的应用消息是否带发送时刻，对端据此统计单向延迟（线程安全）
+    void setTimestampRecords(bool enabled);
+    
+    // 获取指定会话的延迟统计（线程安全），会话不存在时返回 false
+    bool getSessionLatency(websocketpp::connection_hdl hdl, LatencyStats& stats) const;
+    
+    // 获取全部会话的延迟汇总和服务端处理耗时（线程安全）
+    LatencyReport getLatencyReport() const;
+    
+    // 开始把各会话的建立、断开和每条应用消息的时刻、方向、长度录制到文件（追加写入），供 session_replay 重放（线程安全）
+    // includePayloads 为 true 时同时记录明文，只应在测试环境使用；开始录制前已建立的会话在第一条消息处出现
+    bool startRecording(const std::string& path, bool includePayloads = false);
+    
+    // 停止录制，积压的事件写完后关闭文件（线程安全）
+    void stopRecording();
 
 private:
-    server wsServer;
+    std::unique_ptr<Transport> transport;
     std::map<websocketpp::connection_hdl, std::unique_ptr<RSAKey>, std::owner_less<websocketpp::connection_hdl>> clientRSAKeys;
     std::map<websocketpp::connection_hdl, std::unique_ptr<AESKey>, std::owner_less<websocketpp::connection_hdl>> clientAESKeys;
     std::map<websocketpp::connection_hdl, bool, std::owner_less<websocketpp::connection_hdl>> handshakeStatus;
+    std::map<websocketpp::connection_hdl, SessionCipherSlot, std::owner_less<websocketpp::connection_hdl>> clientCiphers;
+    std::map<websocketpp::connection_hdl, std::unique_ptr<ChannelMux>, std::owner_less<websocketpp::connection_hdl>> clientChannels;
+    std::vector<CipherSuite> cipherSuitePreference;
+    
+    // 会话的第一条握手消息决定握手方式，之后只接受同一种握手的消息
+    enum class HandshakeMode : uint8_t {
+        NONE,
+        RSA,
+        PSK
+    };
+    std::map<websocketpp::connection_hdl, HandshakeMode, std::owner_less<websocketpp::connection_hdl>> handshakeModes;
     
+    // 预共享密钥按身份查找；PSK 握手中等待客户端确认的会话记下期望的确认值和声称的身份
+    struct PendingPsk {
+        std::string confirm;
+        std::string identity;
+    };
+    std::map<std::string, std::string> preSharedKeys;
+    std::map<websocketpp::connection_hdl, PendingPsk, std::owner_less<websocketpp::connection_hdl>> pskConfirmations;
+    
+    // 会话编号：主题索引按编号记录订阅者
+    std::map<websocketpp::connection_hdl, uint64_t, std::owner_less<websocketpp::connection_hdl>> clientSessionIds;
+    std::unordered_map<uint64_t, websocketpp::connection_hdl> sessionHandles;
+    uint64_t nextSessionId;
+    TopicIndex topicIndex;
+    mutable std::shared_mutex topicMutex;   // 订阅变更在事件循环上独占，publish 在任意线程共享读取
+    
+    // 会话存活状态：所有会话的定时器共用一个时间轮，由事件循环上的单个周期定时器推进
+    struct SessionLiveness {
+        std::chrono::steady_clock::time_point lastReceive;   // 最近一次收到任何数据（含 pong）
+        std::chrono::steady_clock::time_point lastActivity;  // 最近一次收到消息
+        TimerWheel::TimerId handshakeTimer = 0;
+        TimerWheel::TimerId heartbeatTimer = 0;
+        TimerWheel::TimerId idleTimer = 0;
+        TimerWheel::TimerId probeTimer = 0;
+        SessionTimeouts timeouts;                            // 连接建立时的超时配置，之后修改配置不影响此会话
+    };
+    std::map<websocketpp::connection_hdl, SessionLiveness, std::owner_less<websocketpp::connection_hdl>> sessionLiveness;
+    TimerWheel timerWheel;
+    SessionTimeouts sessionTimeouts;
+    uint64_t reapedSessions;
+    
+    unsigned int rsaKeySize;
     std::unique_ptr<RSAKey> serverRSAKey;
-    std::function<void(websocketpp::connection_hdl, const std::string&)> messageCallback;
+    std::function<void(websocketpp::connection_hdl, std::string_view)> messageCallback;
+    std::function<void(websocketpp::connection_hdl, std::string)> ownedMessageCallback;
+    std::function<void(websocketpp::connection_hdl, ChannelMux::ChannelId, std::string_view)> channelMessageCallback;
+    std::function<void(websocketpp::connection_hdl)> handshakeCallback;
+    std::function<void(websocketpp::connection_hdl)> closeCallback;
     std::thread serverThread;
-    bool isRunning;
+    std::atomic<bool> isRunning;
+    
+    // 待加密发送的记录：应用线程入队，事件循环线程按顺序加密
+    // 记录的序号和加密器状态只在事件循环线程上推进，并发发送不会乱序
+    struct OutboundRecord {
+        enum Target : uint8_t {
+            HANDLE,
+            SESSION_ID,
+            BROADCAST
+        };
+        Target target = HANDLE;
+        websocketpp::connection_hdl hdl;
+        uint64_t sessionId = 0;
+        char header[ChannelMux::kHeaderSize] = {0};
+        uint8_t headerLength = 0;
+        SendPriority priority = SendPriority::NORMAL;
+        PooledBuffer payload;            // 广播和发布时多个记录共享同一份明文
+    };
+    MpscQueue<OutboundRecord> outbound;
+    std::atomic<bool> outboundScheduled;
+    
+    bool enqueueRecord(OutboundRecord record);
+    void scheduleOutboundDrain();
+    void drainOutbound();
+    
+    // Merkle 批量签名：待签名的消息在事件循环线程上收集，窗口到期或批次满时签名并发送
+    struct PendingSigned {
+        websocketpp::connection_hdl hdl;
+        SendPriority priority;
+        PooledBuffer message;
+    };
+    std::unique_ptr<MerkleBatchSigner> batchSigner;
+    std::vector<PendingSigned> pendingSigned;
+    std::chrono::milliseconds signedBatchWindow;
+    size_t signedBatchLimit;
+    uint64_t signedBatchGeneration;
+    
+    void addSignedMessage(websocketpp::connection_hdl hdl, SendPriority priority, PooledBuffer message);
+    void flushSignedBatch();
+    
+    // 每个会话的分级发送队列；有待发送数据的会话记在 backloggedSessions 中，
+    // 传输层排队的数据低于上限时继续取出，否则由轮询定时器稍后再试
+    std::map<websocketpp::connection_hdl, std::unique_ptr<PriorityLanes>, std::owner_less<websocketpp::connection_hdl>> clientLanes;
+    std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> backloggedSessions;
+    PriorityLanes::Weights priorityWeights;
+    size_t sendQueueLimit;
+    bool sendPollScheduled;
+    
+    // 把记录放入会话的优先级通道
+    bool queueRecord(websocketpp::connection_hdl hdl, SendPriority priority, std::string_view header, PooledBuffer payload);
+    void pumpLanes();
+    
+    // 大消息的分段并行加密，每个会话一个；加密或接收消息的解密完成后由工作线程通知事件循环，
+    // 加密的消息按提交顺序放入优先级通道，解密的消息按原记录类型处理
+    std::map<websocketpp::connection_hdl, std::unique_ptr<SegmentCipher>, std::owner_less<websocketpp::connection_hdl>> clientSegments;
+    size_t parallelThreshold;
+    uint64_t parallelReceiveLimit;
+    
+    void flushSegments(websocketpp::connection_hdl hdl);
+    
+    // 在事件循环线程上加密并发送一条记录
+    bool sealAndSend(websocketpp::connection_hdl hdl, std::string_view header, std::string_view payload);
+    
+    // 延迟探测：探测和统计只在事件循环线程上更新，不加锁；其他线程读取统计时投递到事件循环上生成快照
+    std::chrono::milliseconds latencyProbeInterval;
+    std::atomic<bool> timestampRecords;
+    std::map<websocketpp::connection_hdl, LatencyProbe, std::owner_less<websocketpp::connection_hdl>> sessionLatency;
+    LatencyReport retiredLatency;   // 已断开会话的统计
+    std::atomic<std::thread::id> loopThread{std::thread::id()};    // run 创建的事件循环线程，没有运行时为空
+    
+    // 在事件循环线程上（或事件循环没有运行时）直接求值，否则投递到事件循环上等待结果，超时返回 fallback
+    template <typename Result>
+    Result snapshotOnLoop(std::function<Result()> evaluate, Result fallback) const;
+    
+    void sendLatencyProbe(websocketpp::connection_hdl hdl);
+    
+    // 每个会话的文件传输，块记录经发送队列进入会话的优先级通道
+    typedef std::function<void(websocketpp::connection_hdl, FileTransfer::TransferId, const std::string&, bool)> FileCallback;
+    std::map<websocketpp::connection_hdl, std::unique_ptr<FileTransfer>, std::owner_less<websocketpp::connection_hdl>> clientFiles;
+    std::string fileReceiveDirectory;
+    
+    // 磁盘线程写完一批块后在事件循环上发出确认
+    void flushFiles(websocketpp::connection_hdl hdl);
+    FileCallback fileSentCallback;
+    FileCallback fileReceivedCallback;
+    
+    // 每个会话的调用表，方法表在启动前注册，运行中只读
+    std::map<websocketpp::connection_hdl, std::unique_ptr<RpcSession>, std::owner_less<websocketpp::connection_hdl>> clientRpc;
+    std::map<std::string, RpcMethod, std::less<>> rpcMethods;
+    
+    // 中继名字表，只在事件循环线程上访问：名字到登记它的会话和公钥，以及会话到名字
+    struct RelayEntry {
+        websocketpp::connection_hdl hdl;
+        std::string publicKey;
+    };
+    bool relayEnabled;
+    std::unordered_map<std::string, RelayEntry> relayDirectory;
+    std::map<websocketpp::connection_hdl, std::string, std::owner_less<websocketpp::connection_hdl>> relayNames;
+    
+    void handleRelayRecord(websocketpp::connection_hdl hdl, uint8_t type, std::string_view payload);
+    void forwardRelayFrame(websocketpp::connection_hdl hdl, std::string_view frame);
+    void sendRelayPeer(websocketpp::connection_hdl hdl, PeerRelay::PeerStatus status, std::string_view name,
+                       std::string_view publicKey = std::string_view());
+    
+    // 数据报通道：连接号在事件循环线程上分配，密钥交给数据报线程，数据报的收发都在数据报线程上进行
+    // 数据报套接字声明在回调之后，先于回调销毁
+    std::function<void(websocketpp::connection_hdl, std::string_view)> datagramCallback;
+    DatagramCipher::Delivery datagramDelivery;
+    std::map<websocketpp::connection_hdl, uint64_t, std::owner_less<websocketpp::connection_hdl>> datagramIds;
+    std::unique_ptr<DatagramSocket> datagramSocket;
+    
+    void openDatagram(websocketpp::connection_hdl hdl);
+    
+    // 会话录制器只在事件循环线程上使用，运行中由事件循环替换
+    std::shared_ptr<SessionRecorder> recorder;
+    
+    void installRecorder(std::shared_ptr<SessionRecorder> next);
+    void recordEvent(websocketpp::connection_hdl hdl, SessionRecorder::EventType type, uint8_t recordType = 0,
+                     SendPriority priority = SendPriority::NORMAL, std::string_view payload = std::string_view());
+    
+    // 探测应答、流量控制确认等协议内部记录不录制
+    static bool isApplicationRecord(uint8_t type);
     
     // WebSocket事件处理
     void onOpen(websocketpp::connection_hdl hdl);
     void onClose(websocketpp::connection_hdl hdl);
-    void onMessage(websocketpp::connection_hdl hdl, message_ptr msg);
+    void onMessage(websocketpp::connection_hdl hdl, Transport::FrameType type, std::string& payload);
+    void onPong(websocketpp::connection_hdl hdl);
+    
+    // 会话超时检测
+    void startTimerTick();
+    void scheduleSessionTimers(websocketpp::connection_hdl hdl);
+    void onHeartbeatTimer(websocketpp::connection_hdl hdl);
+    void onIdleTimer(websocketpp::connection_hdl hdl);
+    void reapSession(websocketpp::connection_hdl hdl, const std::string& reason);
+    
+    // 释放会话占用的全部资源
+    void releaseSession(websocketpp::connection_hdl hdl);
+    
+    // 原地解密二进制加密记录
+    void handleEncryptedRecord(websocketpp::connection_hdl hdl, std::string& record);
+    
+    // 按记录类型处理解密后的记录（分片记录拼接完整后也从这里处理）
+    void dispatchRecord(websocketpp::connection_hdl hdl, std::string_view header, std::string_view plaintext);
+    
+    // 把解密后的明文交给应用回调
+    void deliverMessage(websocketpp::connection_hdl hdl, std::string_view plaintext);
     
     // 加密握手过程
     void handleHandshakeMessage(websocketpp::connection_hdl hdl, const std::string& message);
     void initializeClientCrypto(websocketpp::connection_hdl hdl);
     
+    // 会话加密器就绪后（RSA 或 PSK 握手）开始处理加密记录
+    void completeHandshake(websocketpp::connection_hdl hdl, SessionCipherSlot& cipher);
+    
     // 消息类型
     enum MessageType {
         PUBLIC_KEY_REQUEST = 1,
         PUBLIC_KEY_RESPONSE = 2,
         SESSION_KEY = 3,
-        ENCRYPTED_DATA = 4
+        ENCRYPTED_DATA = 4,
+        CIPHER_SUITE_SELECT = 5,
+        SUBSCRIBE = 6,
+        UNSUBSCRIBE = 7,
+        PUBLISH = 8,
+        CHANNEL_OPEN = ChannelMux::CHANNEL_OPEN,
+        CHANNEL_DATA = ChannelMux::CHANNEL_DATA,
+        CHANNEL_CLOSE = ChannelMux::CHANNEL_CLOSE,
+        CHANNEL_CREDIT = ChannelMux::CHANNEL_CREDIT,
+        SIGNED_DATA = 13,
+        FRAGMENT = PriorityLanes::kFragmentRecord,
+        PROBE = 15,
+        PROBE_REPLY = 16,
+        STAMPED_DATA = 17,
+        FILE_OFFER = FileTransfer::FILE_OFFER,
+        FILE_CHUNK = FileTransfer::FILE_CHUNK,
+        FILE_ACK = FileTransfer::FILE_ACK,
+        FILE_CANCEL = FileTransfer::FILE_CANCEL,
+        SEGMENT_BEGIN = SegmentCipher::kBeginRecord,
+        SEGMENT = SegmentCipher::kSegmentRecord,
+        RPC_REQUEST = RpcSession::RPC_REQUEST,
+        RPC_RESPONSE = RpcSession::RPC_RESPONSE,
+        RPC_CANCEL = RpcSession::RPC_CANCEL,
+        PSK_HELLO = 27,
+        PSK_ACCEPT = 28,
+        PSK_FINISHED = 29,
+        RELAY_REGISTER = PeerRelay::RELAY_REGISTER,
+        RELAY_LOOKUP = PeerRelay::RELAY_LOOKUP,
+        RELAY_PEER = PeerRelay::RELAY_PEER,
+        RELAY_DATA = PeerRelay::RELAY_DATA,
+        DATAGRAM_OPEN = DatagramSocket::DATAGRAM_OPEN,
+        DATAGRAM_ACCEPT = DatagramSocket::DATAGRAM_ACCEPT,
+        SEGMENT_LIMIT = SegmentCipher::kLimitRecord,
+        SEGMENT_REJECT = SegmentCipher::kRejectRecord
     };
     
     struct Message {
@@ -69,8 +471,18 @@ private:
         std::string data;
     };
     
+    std::unique_ptr<Json::CharReader> jsonReader;
+    
     std::string serializeMessage(const Message& msg);
     Message parseMessage(const std::string& data);
+    bool sendHandshakeMessage(websocketpp::connection_hdl hdl, const Message& msg);
+    
+    // 把一条指定类型的二进制记录放入发送队列
+    bool sendRecord(websocketpp::connection_hdl hdl, MessageType type, std::string_view payload, SendPriority priority);
+    bool sendRecord(websocketpp::connection_hdl hdl, std::string_view header, std::string_view payload, SendPriority priority);
+    
+    // 应用消息的负载：开启时间戳时在消息前加发送时刻，type 输出对应的记录类型
+    PooledBuffer encodeData(std::string_view message, MessageType& type);
 };
 
 #endif // CRYPTO_WEBSOCKET_SERVER_H
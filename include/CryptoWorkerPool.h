@@ -0,0 +1,41 @@
+#ifndef CRYPTO_WORKER_POOL_H
+#define CRYPTO_WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 加解密工作线程池：事件循环把大块的加解密拆成任务交给这里，自己不等待计算
+// 任务按提交顺序取出，完成顺序不保证；任务需要自己持有用到的数据
+class CryptoWorkerPool {
+public:
+    typedef std::function<void()> Task;
+
+    // threads 为 0 时按 CPU 核数创建
+    explicit CryptoWorkerPool(size_t threads = 0);
+    ~CryptoWorkerPool();
+
+    CryptoWorkerPool(const CryptoWorkerPool&) = delete;
+    CryptoWorkerPool& operator=(const CryptoWorkerPool&) = delete;
+
+    void submit(Task task);
+
+    size_t size() const { return workers.size(); }
+
+    // 进程内共享的线程池，第一次使用时创建，进程退出前一直存在
+    static CryptoWorkerPool& shared();
+
+private:
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<Task> tasks;
+    bool stopping;
+    std::vector<std::thread> workers;
+
+    void workerLoop();
+};
+
+#endif // CRYPTO_WORKER_POOL_H
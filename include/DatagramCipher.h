@@ -0,0 +1,79 @@
+#ifndef DATAGRAM_CIPHER_H
+#define DATAGRAM_CIPHER_H
+
+#include "BufferPool.h"
+#include "CipherSuite.h"
+#include "SessionCipher.h"
+#include <cryptopp/cryptlib.h>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// 可以各自独立解密的加密数据报
+//   数据报：连接号(8) | 序号(8) | 密文 | 认证标签(16)
+// 前 16 字节作为附加认证数据，nonce = 4 字节盐值 || 序号，密钥来自 SessionCipherSlot 的数据报密钥；
+// 记录层要求序号严格递增、丢一条就无法继续，数据报则带显式序号，丢失、乱序都不影响后续数据报解密
+//
+// 接收端用滑动窗口防重放：窗口内每个序号只接受一次，落后最大序号超过窗口的数据报直接丢弃；
+// ORDERED 模式只接受比已收到的都新的数据报，迟到的数据报丢弃，交付顺序与发送顺序一致（但可能有缺口）
+//
+// 不是线程安全的，由数据报线程使用
+class DatagramCipher {
+public:
+    enum class Delivery : uint8_t {
+        UNORDERED = 0,      // 收到即交付，只去重
+        ORDERED = 1         // 丢弃迟到的数据报，交付的序号单调递增
+    };
+
+    static constexpr size_t kConnectionIdSize = 8;
+    static constexpr size_t kSequenceSize = 8;
+    static constexpr size_t kHeaderSize = kConnectionIdSize + kSequenceSize;
+    static constexpr size_t kTagSize = 16;
+    static constexpr size_t kOverhead = kHeaderSize + kTagSize;
+
+    // 重放窗口覆盖的序号数
+    static constexpr size_t kReplayWindow = 1024;
+
+    // UDP（IPv4）单个数据报的负载上限；超过路径 MTU 的数据报会被 IP 分片，任一分片丢失整个数据报即丢失，
+    // 实时数据建议不超过 kRecommendedPayloadSize
+    static constexpr size_t kMaxPayloadSize = 65507 - kOverhead;
+    static constexpr size_t kRecommendedPayloadSize = 1200;
+
+    // suite 必须是 AEAD 套件
+    DatagramCipher(CipherSuite suite, uint64_t connectionId, const DirectionalKey& sendKey,
+                   const DirectionalKey& receiveKey, Delivery delivery = Delivery::UNORDERED);
+
+    DatagramCipher(const DatagramCipher&) = delete;
+    DatagramCipher& operator=(const DatagramCipher&) = delete;
+
+    uint64_t connectionId() const { return id; }
+
+    // 加密一个数据报，负载可以为空（保活），失败时返回空缓冲区
+    PooledBuffer seal(std::string_view payload, BufferPool& pool);
+
+    // 在数据报缓冲区内原地解密并校验，成功时 payload 指向缓冲区内部；
+    // newest 表示它的序号比之前收到的都大，调用方只在这时更新对端地址
+    bool open(char* datagram, size_t length, std::string_view& payload, bool& newest);
+
+    // 读出数据报的连接号，长度不足时返回 false
+    static bool readConnectionId(const char* datagram, size_t length, uint64_t& connectionId);
+
+private:
+    const uint64_t id;
+    const Delivery delivery;
+    std::unique_ptr<CryptoPP::AuthenticatedSymmetricCipher> encryption;
+    std::unique_ptr<CryptoPP::AuthenticatedSymmetricCipher> decryption;
+    CryptoPP::byte sendSalt[4];
+    CryptoPP::byte receiveSalt[4];
+    uint64_t sendSequence;
+
+    // 重放窗口：位图按序号取模循环使用，highestSequence 为已接受的最大序号
+    uint64_t highestSequence;
+    std::array<uint64_t, kReplayWindow / 64> window;
+
+    bool seen(uint64_t sequence) const;
+    void accept(uint64_t sequence);
+};
+
+#endif // DATAGRAM_CIPHER_H
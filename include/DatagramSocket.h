@@ -0,0 +1,90 @@
+#ifndef DATAGRAM_SOCKET_H
+#define DATAGRAM_SOCKET_H
+
+#include "BufferPool.h"
+#include "DatagramCipher.h"
+#include <websocketpp/common/connection_hdl.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace boost {
+namespace asio {
+class io_context;
+}
+}
+
+// 与 WebSocket 会话并行的 UDP 数据报通道，适合宁可丢包也不愿整条流被阻塞的实时数据（遥测、位置更新）
+// 握手和控制仍走 WebSocket 会话：客户端握手完成后经会话请求打开数据报通道，
+// 服务端分配随机的连接号，用会话派生出的数据报密钥建立 DatagramCipher，经会话把连接号和 UDP 端口告诉客户端：
+//
+//   DATAGRAM_OPEN  （客户端 → 服务端，经会话加密）：空
+//   DATAGRAM_ACCEPT（服务端 → 客户端，经会话加密）：连接号(8) | UDP 端口(2)，端口为 0 表示服务端不提供
+//
+// 服务端在一个 UDP 端口上接收所有会话的数据报，按连接号找到会话，只有认证通过且序号最新的数据报才更新对端地址
+// （客户端换了网络或 NAT 映射变化后自动跟随）；服务端对每个空数据报回复一个空数据报。
+// 客户端打开后以退避间隔发送空数据报，直到收到服务端的回复（此后服务端才知道往哪里发），
+// 之后空闲时定期发送保活数据报维持 NAT 映射。连接号以明文出现在每个数据报中
+//
+// 发送不排队：套接字发送缓冲区满时直接丢弃，数据报本来就允许丢失
+// 状态都在数据报线程上访问：指定共享事件循环时就是循环线程，否则创建自己的线程；接口可以在任意线程调用，
+// 使用共享事件循环时必须在循环线程上（或循环停止后）销毁
+class DatagramSocket {
+public:
+    typedef websocketpp::connection_hdl Handle;
+
+    // 控制记录类型，与服务端/客户端的消息类型编号一致
+    enum RecordType : uint8_t {
+        DATAGRAM_OPEN = 34,
+        DATAGRAM_ACCEPT = 35
+    };
+
+    static constexpr size_t kAcceptSize = DatagramCipher::kConnectionIdSize + 2;
+
+    // 收到的数据报在数据报线程上交给处理函数，负载只在回调期间有效；客户端的 hdl 为空
+    typedef std::function<void(Handle hdl, std::string_view payload)> DatagramHandler;
+
+    explicit DatagramSocket(boost::asio::io_context* loop = nullptr);
+    ~DatagramSocket();
+
+    DatagramSocket(const DatagramSocket&) = delete;
+    DatagramSocket& operator=(const DatagramSocket&) = delete;
+
+    // 在 listen / connect 之前设置
+    void setHandler(DatagramHandler handler);
+
+    // 服务端：在端口上接收所有会话的数据报，0 表示由系统选择；优先双栈 IPv6，不支持时只用 IPv4
+    bool listen(uint16_t port);
+    uint16_t localPort() const { return boundPort; }
+
+    // 服务端：登记 / 注销会话的数据报密钥，每个会话只能登记一次（同一密钥下序号不能重新开始）
+    void bind(Handle hdl, std::unique_ptr<DatagramCipher> cipher);
+    void unbind(Handle hdl);
+
+    // 客户端：解析服务端地址并打开数据报通道，之前的通道被关闭
+    void connect(const std::string& host, uint16_t port, std::unique_ptr<DatagramCipher> cipher);
+
+    // 客户端：关闭数据报通道（会话断开时）
+    void close();
+
+    // 加密并发送一个数据报，客户端忽略 hdl；负载超过上限时返回 false，对端地址未知或发送缓冲区满时静默丢弃
+    bool send(Handle hdl, std::string_view payload);
+
+    // 以下供服务端和客户端生成、解析控制记录
+
+    static PooledBuffer encodeAccept(uint64_t connectionId, uint16_t port);
+    static bool decodeAccept(std::string_view payload, uint64_t& connectionId, uint16_t& port);
+
+private:
+    struct Core;
+
+    std::unique_ptr<boost::asio::io_context> ownedIo;     // 共享事件循环时为空
+    std::shared_ptr<Core> core;                           // 异步操作持有引用，关闭后才释放
+    std::thread thread;
+    uint16_t boundPort;
+};
+
+#endif // DATAGRAM_SOCKET_H
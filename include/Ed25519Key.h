@@ -0,0 +1,59 @@
+#ifndef ED25519_KEY_H
+#define ED25519_KEY_H
+
+#include "AsymmetricalEncryptionInterface.h"
+#include <cryptopp/xed25519.h>
+#include <cryptopp/osrng.h>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+using namespace CryptoPP;
+
+// Ed25519 签名后端：公钥 32 字节，签名 64 字节，签名和验证都比 RSA 快一到两个数量级
+// 只支持签名/验证，加解密接口返回空串（会话密钥交换仍使用 RSA）
+// 公钥和签名与 RSAKey 一样使用 Base64 编码
+class Ed25519Key : public AsymmetricalEncryptionInterface {
+public:
+    static const size_t kPublicKeySize = 32;
+    static const size_t kSignatureSize = 64;
+
+    // 批量验证的一项，三个字段都是 Base64 编码
+    struct SignatureCheck {
+        std::string_view message;
+        std::string_view signature;
+        std::string_view publicKey;
+    };
+
+    Ed25519Key();
+    ~Ed25519Key();
+
+    bool generateKeyPair() override;
+    std::string getLocalPublicKey() override;
+    bool setRemotePublicKey(const std::string& publicKey) override;
+    std::string encryptWithLocalPrivate(const std::string& plaintext) override;
+    std::string decryptWithLocalPrivate(const std::string& ciphertext) override;
+    std::string encryptWithRemotePublic(const std::string& plaintext) override;
+    std::string decryptWithRemotePublic(const std::string& ciphertext) override;
+    std::string signWithLocalPrivate(const std::string& data) override;
+    bool verifyWithRemotePublic(const std::string& data, const std::string& signature) override;
+
+    // 批量验证多组（消息, 签名, 公钥），分散到 threads 个线程（0 表示使用全部硬件线程）
+    // 每个线程内相同公钥只解码和构造一次验证器；results[i] 为第 i 项是否通过，返回是否全部通过
+    static bool verifyBatch(const std::vector<SignatureCheck>& checks, std::vector<uint8_t>& results, size_t threads = 0);
+
+private:
+    AutoSeededRandomPool rng;
+
+    // 签名器和验证器在密钥确定后构造一次，之后每次签名/验证直接复用
+    std::unique_ptr<ed25519Signer> signer;
+    std::unique_ptr<ed25519Verifier> remoteVerifier;
+    std::string localPublicKey;
+
+    static bool verifyWith(const ed25519Verifier& verifier, std::string_view message, std::string_view signature);
+
+    static std::string base64Encode(std::string_view data);
+    static std::string base64Decode(std::string_view data);
+};
+
+#endif // ED25519_KEY_H
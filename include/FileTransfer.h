@@ -0,0 +1,229 @@
+#ifndef FILE_TRANSFER_H
+#define FILE_TRANSFER_H
+
+#include "BufferPool.h"
+#include "CryptoWorkerPool.h"
+#include "PriorityLanes.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 在加密连接上分块传输文件
+// 发送端把文件映射到内存，每次只取出窗口内的块交给记录层，每块是一条独立加密认证的记录，
+// 内存占用与文件大小无关；接收端把解密后的块直接写入磁盘上的部分文件，全部到达后改名为目标文件
+//
+// 记录负载（记录头都是 1 字节记录类型）：
+//   FILE_OFFER : 传输号(8) | 文件长度(8) | 块长度(4) | 文件名
+//   FILE_CHUNK : 传输号(8) | 块序号(8) | 数据
+//   FILE_ACK   : 传输号(8) | 接收方已写入的块数(8)
+//   FILE_CANCEL: 传输号(8)
+// 接收方对 FILE_OFFER 的应答就是 FILE_ACK，其中的块数来自磁盘上已有的部分文件，发送端从这里续传；
+// 之后每写入 kAckInterval 块应答一次，发送端未确认的块不超过 kWindowChunks
+//
+// 传输号由文件的设备号、inode、长度和修改时间计算，同一个文件重新发送（包括重新连接后）得到同一个传输号，
+// 接收方据此找到上次的部分文件；文件被修改后传输号随之改变，不会拼接出新旧混合的内容
+//
+// 接收端的写盘、最后的落盘和改名在磁盘线程上进行，事件循环只拷贝块数据；应答按已写入磁盘的块数发出，
+// 磁盘跟不上时发送端的窗口自然停住
+// 线程安全，发送接口可以在任意线程调用，记录处理在连接的事件循环线程上进行
+class FileTransfer {
+public:
+    typedef uint64_t TransferId;
+
+    // 文件记录类型，与服务端/客户端的消息类型编号一致
+    enum RecordType : uint8_t {
+        FILE_OFFER = 18,
+        FILE_CHUNK = 19,
+        FILE_ACK = 20,
+        FILE_CANCEL = 21
+    };
+
+    static constexpr size_t kIdSize = 8;
+    static constexpr size_t kChunkHeaderSize = 16;
+
+    // 块记录正好是一个分片的大小，不会再被优先级通道拆分，可以与其他通道的记录交错发送
+    static constexpr size_t kChunkSize = PriorityLanes::kFragmentSize - kChunkHeaderSize;
+
+    // 每个传输最多约 4MB 已发出但未确认的数据
+    static constexpr uint64_t kWindowChunks = 256;
+    static constexpr uint64_t kAckInterval = 32;
+
+    // 发送一条文件记录（由连接负责排队、加密和发送）
+    typedef std::function<bool(RecordType type, SendPriority priority, PooledBuffer payload)> RecordSender;
+
+    // 传输结束的通知：文件路径（接收端为最终写入的路径）和是否成功
+    typedef std::function<void(TransferId, const std::string& path, bool completed)> CompletionHandler;
+
+    // 磁盘线程上有了进展（块写入、落盘完成或失败）时调用，由连接投递回事件循环后调用 flushDisk
+    typedef std::function<void()> ReadyNotifier;
+
+    explicit FileTransfer(RecordSender sender);
+    ~FileTransfer();
+
+    FileTransfer(const FileTransfer&) = delete;
+    FileTransfer& operator=(const FileTransfer&) = delete;
+
+    // 映射文件并发出传输请求，块记录使用 priority 指定的通道；失败返回 0
+    TransferId sendFile(const std::string& path, SendPriority priority);
+
+    // 放弃一个传输，通知对端并删除本端状态（接收端的部分文件保留）
+    bool cancel(TransferId id);
+
+    // 设置接收文件的目录，未设置时拒绝对端的传输请求
+    // 完成的文件不会覆盖目录中的已有文件：同名时改名为 "name (1).ext" 等，完成通知给出实际路径
+    void setReceiveDirectory(const std::string& directory);
+
+    // 设置对端已证明的身份（如通过确认的 PSK 身份），部分文件按身份分开存放：
+    // 同一对端重新连接后可以续传，不同对端即使选用相同的传输号也不会读写彼此的部分文件
+    void setPeerKey(std::string_view key);
+
+    // 对端身份未经证明时使用：部分文件名带本连接独有的随机标识，不能跨连接续传，断开时删除
+    void useConnectionTag();
+
+    void setSentHandler(CompletionHandler handler);
+    void setReceivedHandler(CompletionHandler handler);
+
+    // 把接收文件的写盘交给磁盘线程，在处理记录之前调用；未设置时在记录处理线程上直接写盘
+    void setDiskWorker(ReadyNotifier ready);
+
+    // 取出磁盘线程的进展：发出应答，通知完成或失败的接收（事件循环线程）
+    void flushDisk();
+
+    // 处理收到并解密后的文件记录
+    bool handleRecord(uint8_t type, std::string_view payload);
+
+    // 连接断开：关闭正在接收的文件，部分文件留在磁盘上供续传；
+    // keepOutgoing 为 true 时保留未完成的发送，等 resume 在新连接上续传，否则通知失败并丢弃
+    void disconnect(bool keepOutgoing);
+
+    // 新连接握手完成后重新发出未完成的传输请求
+    void resume();
+
+    // 未完成的发送和接收数
+    size_t outgoingCount() const;
+    size_t incomingCount() const;
+
+    static bool isFileRecord(uint8_t type) {
+        return type >= FILE_OFFER && type <= FILE_CANCEL;
+    }
+
+    // 计算文件的传输号，文件不存在时返回 0
+    static TransferId transferIdFor(const std::string& path);
+
+private:
+    struct Outgoing {
+        std::string path;
+        std::string name;
+        SendPriority priority = SendPriority::BULK;
+        const char* mapping = nullptr;
+        uint64_t size = 0;
+        uint64_t chunkCount = 0;
+        uint64_t acked = 0;         // 对端已写入的块数
+        uint64_t nextChunk = 0;     // 下一个要发出的块
+        bool accepted = false;      // 是否已收到对端对本次请求的应答
+    };
+
+    // 与磁盘线程共享的接收文件，同一时刻只有一个任务在处理它，块按到达顺序写入
+    struct DiskWriter {
+        std::mutex mutex;
+        int fd = -1;
+        std::string partPath;
+        std::string name;
+        std::string finalPath;      // 落盘改名后为实际路径
+        std::deque<std::pair<uint64_t, PooledBuffer>> writes;   // 待写入的块：文件偏移和数据
+        uint64_t written = 0;       // 已写入磁盘的块数（含续传前已有的块）
+        bool scheduled = false;     // 已有任务在处理
+        bool finish = false;        // 全部块已收到，写完后落盘并改名
+        bool finished = false;
+        bool failed = false;
+        bool closed = false;        // 传输已放弃，不再写入，任务结束时关闭文件
+        std::condition_variable idle;   // 任务结束时通知
+
+        ~DiskWriter();
+    };
+
+    struct Incoming {
+        std::shared_ptr<DiskWriter> writer;
+        uint64_t size = 0;
+        uint32_t chunkSize = 0;
+        uint64_t chunkCount = 0;
+        uint64_t nextChunk = 0;     // 下一个要收到的块
+        uint64_t acked = 0;         // 最近一次应答的块数
+    };
+
+    // 与磁盘任务共享，FileTransfer 析构后任务看到 closed 不再调用 ready
+    struct DiskShared {
+        std::mutex mutex;
+        bool closed = false;
+        ReadyNotifier ready;
+    };
+
+    // 传输结束后在锁外调用的通知
+    struct Completion {
+        bool outgoing;
+        TransferId id;
+        std::string path;
+        bool completed;
+    };
+
+    RecordSender sender;
+    CompletionHandler sentHandler;
+    CompletionHandler receivedHandler;
+    std::string receiveDirectory;
+    std::string peerTag;            // 部分文件名中的对端身份摘要，未设置时为空
+    bool discardPartial = false;    // 部分文件只属于本连接，断开时删除
+    std::shared_ptr<DiskShared> disk;
+    bool diskWorker = false;        // 是否在磁盘线程上写盘
+
+    mutable std::mutex mutex;
+    std::unordered_map<TransferId, Outgoing> outgoing;
+    std::unordered_map<TransferId, Incoming> incoming;
+    std::unordered_map<std::string, std::shared_ptr<DiskWriter>> retired;  // 已放弃但磁盘任务还没结束的接收文件
+
+    bool sendOffer(TransferId id, const Outgoing& transfer);
+    bool sendAck(TransferId id, uint64_t chunks);
+    bool sendCancel(TransferId id);
+    bool sendControl(RecordType type, const char* payload, size_t length);
+
+    // 在窗口内发出尚未发送的块（调用方持有锁）
+    void pump(TransferId id, Outgoing& transfer);
+
+    void handleOffer(std::string_view payload);
+    void handleChunk(std::string_view payload, std::vector<Completion>& completions);
+    void handleAck(std::string_view payload, std::vector<Completion>& completions);
+    void handleCancel(std::string_view payload, std::vector<Completion>& completions);
+
+    void notify(std::vector<Completion>& completions);
+
+    // 让磁盘线程（或当前线程）处理接收文件的待写入块
+    void schedule(const std::shared_ptr<DiskWriter>& writer);
+
+    // 按磁盘的进展发出应答，结束完成或失败的接收（调用方持有锁）
+    void collectDisk(std::vector<Completion>& completions);
+
+    static void closeOutgoing(Outgoing& transfer);
+
+    // 放弃接收文件，磁盘任务还在进行时留到任务结束再关闭文件（调用方持有锁）
+    void closeIncoming(Incoming& transfer);
+
+    // 等同一个部分文件上已放弃的磁盘任务结束，释放文件锁（调用方持有锁）
+    void waitRetired(const std::string& partPath);
+
+    // 写入待写入的块，全部块写完后落盘并改名（磁盘线程）
+    static void runWrites(DiskWriter& writer);
+
+    // 关闭所有正在接收的文件，部分文件只属于本连接时一并删除（调用方持有锁）
+    void closeAllIncoming();
+
+    // 把部分文件落盘并改名为目标文件，finalPath 传入预定路径，成功时改为实际路径（磁盘线程）
+    static bool finishIncoming(DiskWriter& writer, std::string& finalPath);
+};
+
+#endif // FILE_TRANSFER_H
@@ -0,0 +1,100 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+// 对数分桶的延迟直方图：每个 2 的幂区间再均分为 16 个子桶，相对误差约 3%，覆盖 0 ~ 约 36 分钟
+// 非线程安全
+class LatencyHistogram {
+public:
+    static constexpr size_t kSubBuckets = 16;
+    static constexpr size_t kMagnitudes = 38;
+    static constexpr size_t kBucketCount = kSubBuckets * kMagnitudes;
+
+    LatencyHistogram();
+
+    void record(std::chrono::nanoseconds value);
+    void merge(const LatencyHistogram& other);
+    void reset();
+
+    uint64_t count() const { return total; }
+    std::chrono::nanoseconds min() const;
+    std::chrono::nanoseconds max() const;
+    std::chrono::nanoseconds mean() const;
+
+    // p 取 0 ~ 100，返回所在桶的中点
+    std::chrono::nanoseconds percentile(double p) const;
+
+private:
+    std::array<uint64_t, kBucketCount> buckets;
+    uint64_t total;
+    uint64_t sum;
+    uint64_t minimum;
+    uint64_t maximum;
+
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketMidpoint(size_t index);
+};
+
+// 一个会话的延迟统计
+struct LatencyStats {
+    LatencyHistogram rtt;           // 探测往返时间，已扣除对端处理探测的时间
+    LatencyHistogram oneWay;        // 带时间戳记录的单向延迟（发送方调用发送接口到本端收到），按估计的时钟偏差校正
+    LatencyHistogram queueing;      // 单向延迟减去半个往返时间，即发送方排队和接收方处理前的等待
+    std::chrono::nanoseconds lastRtt{0};
+    std::chrono::nanoseconds clockOffset{0};    // 对端时钟减本端时钟的估计值
+    uint64_t probesSent = 0;
+    uint64_t probesAnswered = 0;
+};
+
+// 服务端汇总：在线会话与已断开会话的统计合并，以及服务端处理每条接收记录的耗时
+struct LatencyReport {
+    LatencyHistogram rtt;
+    LatencyHistogram oneWay;
+    LatencyHistogram queueing;
+    LatencyHistogram processing;    // 从收到加密帧到解密、分发和应用回调全部返回
+    size_t sessions = 0;            // 当前在线的会话数
+};
+
+// 会话内的加密延迟探测（与 NTP 相同的四时间戳算法）
+//   探测负载：探测号(8) | t0 发送方发出时刻(8)
+//   应答负载：探测号(8) | t0(8) | t1 应答方收到时刻(8) | t2 应答方发出时刻(8)
+//   发送方在 t3 收到应答：往返时间 = (t3 - t0) - (t2 - t1)，时钟偏差 = ((t1 - t0) + (t2 - t3)) / 2
+// 带时间戳的应用记录在消息前加 8 字节发送时刻，接收方据此计算单向延迟
+// 时刻都是 system_clock 的纳秒数（大端），非线程安全
+class LatencyProbe {
+public:
+    static constexpr size_t kProbeSize = 16;
+    static constexpr size_t kReplySize = 32;
+    static constexpr size_t kStampSize = 8;
+
+    LatencyProbe();
+
+    // 生成下一个探测负载
+    void makeProbe(char out[kProbeSize]);
+
+    // 为收到的探测生成应答负载，receivedAt 为收到探测的时刻
+    static bool makeReply(std::string_view probe, int64_t receivedAt, char out[kReplySize]);
+
+    // 处理收到的应答，更新往返时间和时钟偏差
+    bool handleReply(std::string_view reply);
+
+    // 在消息前写入当前时刻
+    static void writeStamp(char out[kStampSize]);
+
+    // 处理带时间戳的记录，message 指向去掉时间戳后的消息
+    bool handleStamped(std::string_view payload, std::string_view& message);
+
+    const LatencyStats& getStats() const { return stats; }
+
+    static int64_t now();
+
+private:
+    uint64_t nextProbeId;
+    LatencyStats stats;
+};
+
+#endif // LATENCY_PROBE_H
@@ -0,0 +1,166 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+// 分级的异步日志
+// 调用线程只把格式化好的一行写进无锁环形缓冲区，由后台线程写到终端或自定义输出，
+// 错误风暴（例如客户端持续发送无法解密的数据）时事件循环不会阻塞在终端/文件 I/O 上。
+// 每个日志点每秒最多输出 setRateLimit 条，超出的只计数，下一条输出时附带被抑制的条数；
+// 环形缓冲区满时丢弃新日志并计数，从不阻塞调用方
+enum class LogLevel : uint8_t {
+    DEBUG = 0,
+    INFO = 1,
+    WARNING = 2,
+    ERROR = 3,
+    OFF = 4
+};
+
+const char* logLevelName(LogLevel level);
+
+class Logger {
+public:
+    // 自定义输出，在后台线程上调用；line 为带时间和级别的一行，不含换行
+    typedef std::function<void(LogLevel, std::string_view)> Sink;
+
+    // 低于该级别的日志不格式化也不入队（默认 INFO），线程安全
+    static void setLevel(LogLevel level);
+    static LogLevel getLevel();
+
+    static bool enabled(LogLevel level) {
+        return static_cast<uint8_t>(level) >= currentLevel.load(std::memory_order_relaxed) &&
+               level != LogLevel::OFF;
+    }
+
+    // 每个日志点每秒最多输出的条数，0 表示不限（默认 20）
+    static void setRateLimit(uint32_t perSecond);
+    static uint32_t getRateLimit() {
+        return rateLimit.load(std::memory_order_relaxed);
+    }
+
+    // 替换默认输出（WARNING 及以上写 stderr，其余写 stdout），传入空函数恢复默认
+    static void setSink(Sink sink);
+
+    // 等待此前提交的日志全部写出，进程退出时也会自动调用
+    static void flush();
+
+    // 因环形缓冲区已满而丢弃的条数
+    static uint64_t getDroppedCount();
+
+    // 提交一条已格式化的日志，message 超长时截断（一般通过 LOG_* 宏调用）
+    static void write(LogLevel level, std::string_view message);
+
+private:
+    static std::atomic<uint8_t> currentLevel;
+    static std::atomic<uint32_t> rateLimit;
+};
+
+// 一个日志点的限流状态，LOG_* 宏为每个调用位置定义一个静态实例
+class LogSite {
+public:
+    // 本秒内的配额未用完时返回 true，否则计入被抑制的条数
+    bool admit();
+
+    // 取出并清零被抑制的条数
+    uint32_t takeSuppressed() {
+        return suppressed.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> window{-1};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> suppressed{0};
+};
+
+// 在栈上格式化一行日志，析构时提交；超过 kMaxMessageSize 的部分被截断
+class LogLine {
+public:
+    static constexpr size_t kMaxMessageSize = 480;
+
+    LogLine(LogLevel level, LogSite& site);
+    ~LogLine();
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    std::ostream& stream() { return out; }
+
+private:
+    class FixedBuffer : public std::streambuf {
+    public:
+        FixedBuffer(char* begin, char* end) {
+            setp(begin, end);
+        }
+
+        size_t size() const {
+            return static_cast<size_t>(pptr() - pbase());
+        }
+
+    protected:
+        // 缓冲区写满后丢弃其余字符
+        int_type overflow(int_type ch) override {
+            return traits_type::not_eof(ch);
+        }
+    };
+
+    LogLevel level;
+    LogSite& site;
+    char text[kMaxMessageSize];
+    FixedBuffer buffer;
+    std::ostream out;
+};
+
+// 按行把写入的文本提交为日志，供只接受 std::ostream 的第三方库（websocketpp）使用
+// 同一个 LogStream 不能被多个线程同时写入
+class LogStream : public std::ostream {
+public:
+    explicit LogStream(LogLevel level);
+
+    LogStream(const LogStream&) = delete;
+    LogStream& operator=(const LogStream&) = delete;
+
+private:
+    class LineBuffer : public std::streambuf {
+    public:
+        explicit LineBuffer(LogLevel level) : level(level) {}
+
+    protected:
+        int_type overflow(int_type ch) override;
+        std::streamsize xsputn(const char* data, std::streamsize length) override;
+        int sync() override;
+
+    private:
+        LogLevel level;
+        LogSite site;
+        std::string line;
+
+        void submit();
+    };
+
+    LineBuffer buffer;
+};
+
+#define CRYPTOLINK_LOG(level, ...)                                      \
+    do {                                                                \
+        if (Logger::enabled(level)) {                                   \
+            static LogSite cryptolinkLogSite;                           \
+            if (cryptolinkLogSite.admit()) {                            \
+                LogLine(level, cryptolinkLogSite).stream() << __VA_ARGS__; \
+            }                                                           \
+        }                                                               \
+    } while (0)
+
+// 用法与输出流相同：CRYPTOLINK_LOG_ERROR("解密失败: " << e.what());
+// 本头文件经公开头文件进入应用代码，宏名带前缀，不与 syslog.h 的 LOG_INFO 等常量冲突
+#define CRYPTOLINK_LOG_DEBUG(...) CRYPTOLINK_LOG(LogLevel::DEBUG, __VA_ARGS__)
+#define CRYPTOLINK_LOG_INFO(...) CRYPTOLINK_LOG(LogLevel::INFO, __VA_ARGS__)
+#define CRYPTOLINK_LOG_WARNING(...) CRYPTOLINK_LOG(LogLevel::WARNING, __VA_ARGS__)
+#define CRYPTOLINK_LOG_ERROR(...) CRYPTOLINK_LOG(LogLevel::ERROR, __VA_ARGS__)
+
+#endif // LOGGER_H
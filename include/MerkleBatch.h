@@ -0,0 +1,91 @@
+#ifndef MERKLE_BATCH_H
+#define MERKLE_BATCH_H
+
+#include "AsymmetricalEncryptionInterface.h"
+#include "BufferPool.h"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Merkle 批量签名：在一个短窗口内收集消息，只对 Merkle 根做一次私钥签名，
+// 每条消息携带自己的包含证明和根签名，接收方可以逐条独立验证（不可抵赖）
+//
+// 叶子哈希 = SHA256(0x00 || 消息)，内部节点 = SHA256(0x01 || 左 || 右)，
+// 某层节点数为奇数时最后一个节点直接提升到上一层
+// 被签名的数据 = "CLMB" | 批次号(8) | 叶子数(4) | 根哈希(32)
+//
+// 签名负载格式（整数均为大端）：
+//   批次号(8) | 叶子序号(4) | 叶子数(4) | 签名长度(2) | 根签名 | 兄弟节点数(1) | 兄弟节点哈希(32 * n) | 消息
+namespace MerkleBatch {
+
+typedef std::array<uint8_t, 32> Hash;
+
+Hash hashLeaf(std::string_view message);
+Hash hashNode(const Hash& left, const Hash& right);
+
+// 由叶子哈希、叶子序号和兄弟节点重新计算根哈希，证明长度不对时返回 false
+bool computeRoot(const Hash& leaf, uint32_t index, uint32_t leafCount,
+                 const std::vector<Hash>& siblings, Hash& root);
+
+// 被签名的根数据
+std::string rootStatement(uint64_t batchId, uint32_t leafCount, const Hash& root);
+
+}
+
+// 签名端，非线程安全（服务端只在事件循环线程上使用）
+class MerkleBatchSigner {
+public:
+    explicit MerkleBatchSigner(AsymmetricalEncryptionInterface& key);
+
+    // 加入一条消息，返回它在当前批次中的叶子序号
+    size_t add(std::string_view message);
+
+    size_t size() const { return leaves.size(); }
+
+    // 构建 Merkle 树并对根签名一次
+    bool sign();
+
+    // 为已签名批次中的一条消息生成签名负载（证明 + 消息）
+    PooledBuffer encode(size_t index, std::string_view message, BufferPool& pool) const;
+
+    // 开始下一个批次
+    void reset();
+
+    uint64_t getBatchId() const { return batchId; }
+
+private:
+    AsymmetricalEncryptionInterface& key;
+    uint64_t batchId;
+    std::vector<MerkleBatch::Hash> leaves;
+    std::vector<std::vector<MerkleBatch::Hash>> levels;   // levels[0] 为叶子层，最后一层只有根
+    std::string rootSignature;
+};
+
+// 验证端，非线程安全
+// 同一批次的根签名验证一次后缓存根哈希，后续消息只需计算 log2(n) 次哈希
+class MerkleBatchVerifier {
+public:
+    explicit MerkleBatchVerifier(AsymmetricalEncryptionInterface& key, size_t cacheSize = 64);
+
+    // 逐条验证，成功时 message 指向负载内的消息
+    bool verify(std::string_view payload, std::string_view& message);
+
+    // 批量验证，同一批次的消息共用一次签名验证；返回全部通过，messages 按输入顺序输出（失败项为空）
+    bool verifyBatch(const std::vector<std::string_view>& payloads, std::vector<std::string_view>& messages);
+
+    // 实际执行的公钥签名验证次数
+    uint64_t getSignatureVerifications() const { return signatureVerifications; }
+
+private:
+    AsymmetricalEncryptionInterface& key;
+    size_t cacheSize;
+    std::unordered_map<uint64_t, MerkleBatch::Hash> verifiedRoots;
+    std::deque<uint64_t> verifiedOrder;
+    uint64_t signatureVerifications;
+};
+
+#endif // MERKLE_BATCH_H
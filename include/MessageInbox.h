@@ -0,0 +1,55 @@
+#ifndef MESSAGE_INBOX_H
+#define MESSAGE_INBOX_H
+
+#ifdef CRYPTOLINK_HAVE_COROUTINES
+
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// 协程的接收队列：传输线程投递消息，有协程在等待时直接在投递时恢复它，
+// 协程拿到的是接收帧内原地解密后的明文视图，零拷贝；没有协程在等待时才拷贝一份排队
+// 收到的视图在该协程下一次 co_await 之前有效；连接关闭后等待中和之后的接收都返回空
+class MessageInbox {
+public:
+    class ReceiveAwaiter {
+    public:
+        explicit ReceiveAwaiter(MessageInbox& inbox) : inbox(inbox) {}
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        std::optional<std::string_view> await_resume() const { return result; }
+
+    private:
+        friend class MessageInbox;
+
+        MessageInbox& inbox;
+        std::coroutine_handle<> handle;
+        std::optional<std::string_view> result;
+    };
+
+    ReceiveAwaiter receive() { return ReceiveAwaiter(*this); }
+
+    // 在传输线程上调用
+    void deliver(std::string_view message);
+    void close();
+
+    // 重新连接前清空排队的消息
+    void reset();
+
+    bool isClosed() const;
+
+private:
+    mutable std::mutex mutex;
+    std::deque<std::string> queued;
+    std::string current;                    // 最近一次从队列取出的消息
+    std::deque<ReceiveAwaiter*> waiters;
+    bool closed = false;
+};
+
+#endif // CRYPTOLINK_HAVE_COROUTINES
+
+#endif // MESSAGE_INBOX_H
@@ -0,0 +1,65 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// 无锁多生产者单消费者队列（Vyukov 链表队列）
+// push 可以在任意线程调用，只有一次原子交换；pop 只能由唯一的消费者线程调用
+// 生产者在交换和链接之间被挂起时，消费者会暂时看不到之后入队的元素，
+// 因此消费者不能把 pop 失败当作“队列中没有任何元素”，需要由生产者在入队后负责唤醒
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head(new Node()), tail(head.load(std::memory_order_relaxed)) {}
+
+    ~MpscQueue() {
+        Node* node = tail;
+        while (node) {
+            Node* next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value) {
+        Node* node = new Node(std::move(value));
+        Node* previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    bool pop(T& value) {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+
+        // next 成为新的哨兵节点，取走它的值后释放旧哨兵
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+    // 仅供消费者线程判断，结果可能滞后于正在进行的 push
+    bool empty() const {
+        return tail->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node {
+        Node() : next(nullptr) {}
+        explicit Node(T value) : value(std::move(value)), next(nullptr) {}
+
+        T value;
+        std::atomic<Node*> next;
+    };
+
+    alignas(64) std::atomic<Node*> head;   // 生产者端
+    alignas(64) Node* tail;                // 消费者端
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,192 @@
+#ifndef PEER_RELAY_H
+#define PEER_RELAY_H
+
+#include "BufferPool.h"
+#include "PriorityLanes.h"
+#include <cryptopp/gcm.h>
+#include <cryptopp/aes.h>
+#include <cryptopp/secblock.h>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 经服务端中继的客户端之间的端到端加密
+// 每个客户端持有一对 X25519 密钥，以名字向服务端登记公钥，并通过服务端查询对端的公钥；
+// 发给对端的消息用双方 X25519 共享秘密经 HKDF 派生的密钥以 AES-256-GCM 加密，
+// 服务端只解析路由头（对端名字），把密文原样转发给对端，不做任何对称运算，也看不到明文
+//
+// 记录（RELAY_DATA 之外都经过会话加密，记录头是 1 字节记录类型）：
+//   RELAY_REGISTER: 名字长度(1) | 名字 | 公钥(32)                 客户端 → 服务端
+//   RELAY_LOOKUP  : 名字                                           客户端 → 服务端
+//   RELAY_PEER    : 状态(1) | 名字长度(1) | 名字 | 公钥(32，可无)  服务端 → 客户端
+//   RELAY_DATA    : 类型(1) | 名字长度(1) | 名字 | 密文体
+//                   不经过会话加密；客户端发出时名字是接收方，服务端转发时把名字改写为发送方，密文体原样转发。
+//                   路由名字、公钥标识、纪元和序号都是明文，连接是明文 WebSocket，网络上的观察者也能看到
+//   密文体        : 接收方公钥前 8 字节 | 纪元(8) | 序号(8) | 密文 | 认证标签(16)
+//
+// 每个方向的密钥 = HKDF-SHA256(X25519 共享秘密, 盐 = 发送方的纪元, 信息 = 双方名字和公钥)，
+// nonce = 派生出的 4 字节盐值 || 序号，密文体的前 24 字节作为附加认证数据；
+// 纪元在 enable 时取当前时刻（微秒），同一进程内严格递增，序号在本端所有对端之间共用且只增不减，
+// 同一密钥下 nonce 不会重复；接收端按（对端, 纪元）要求序号严格递增，重放和倒退的记录被丢弃，
+// 并拒绝比该对端已收到的最新纪元更早、又不在保留状态里的纪元（被挤出的旧纪元不能重放）。
+// 重放状态只在内存里：接收端重启后，之前收到过的记录可以被重放一次；
+// 对端重启后时钟回拨到上一个纪元之前时，它的消息被拒绝，直到时钟追上或本端重启
+//
+// 服务端负责公钥分发：未固定公钥时，恶意服务端可以冒充对端；用 setPeerKey 固定对端公钥后，
+// 服务端给出的不同公钥被拒绝。路由元数据（谁在和谁通信、消息长度和时刻，以及从纪元看出的发送方启用时刻）
+// 对服务端可见，RELAY_DATA 不经过会话加密，对网络上的观察者同样可见
+//
+// 只在传输线程上使用
+class PeerRelay {
+public:
+    // 中继记录类型，与服务端/客户端的消息类型编号一致
+    enum RecordType : uint8_t {
+        RELAY_REGISTER = 30,
+        RELAY_LOOKUP = 31,
+        RELAY_PEER = 32,
+        RELAY_DATA = 33
+    };
+
+    enum class PeerStatus : uint8_t {
+        FOUND = 0,              // 查询结果，带公钥
+        NOT_FOUND = 1,          // 对端未登记或已断开，查询失败或消息未送达
+        KEY_CHANGED = 2,        // 消息使用的公钥已过期，消息被丢弃，带当前公钥
+        REGISTERED = 3,         // 登记成功
+        NAME_IN_USE = 4         // 名字已被其他连接登记
+    };
+
+    static constexpr size_t kPublicKeySize = 32;
+    static constexpr size_t kKeyIdSize = 8;
+    static constexpr size_t kMaxNameLength = 64;
+    static constexpr size_t kSealedHeaderSize = kKeyIdSize + 8 + 8;
+    static constexpr size_t kTagSize = 16;
+    static constexpr size_t kMaxMessageSize = 1024 * 1024;
+
+    // 发送一条中继记录（由连接负责排队和发送）；RELAY_DATA 的负载是完整的线路记录，不再经过会话加密
+    typedef std::function<bool(RecordType type, SendPriority priority, PooledBuffer payload)> RecordSender;
+
+    // 收到对端的消息，明文只在回调期间有效
+    typedef std::function<void(std::string_view peer, std::string_view message)> MessageHandler;
+
+    // 发给对端的消息未能送达（对端不存在、公钥已更换或与固定的公钥不一致）
+    typedef std::function<void(std::string_view peer)> FailureHandler;
+
+    explicit PeerRelay(RecordSender sender);
+    ~PeerRelay();
+
+    PeerRelay(const PeerRelay&) = delete;
+    PeerRelay& operator=(const PeerRelay&) = delete;
+
+    // 以名字启用中继，第一次调用时生成本端的 X25519 密钥对，每次调用进入新的纪元
+    bool enable(const std::string& name);
+    bool enabled() const { return !localName.empty(); }
+    const std::string& name() const { return localName; }
+
+    // 本端公钥（Base64），可以通过其他渠道交给对端固定
+    std::string publicKey() const;
+
+    // 固定对端的公钥（Base64），服务端给出的不同公钥被拒绝
+    bool setPeerKey(const std::string& peer, const std::string& publicKey);
+
+    void setMessageHandler(MessageHandler handler) { messageHandler = std::move(handler); }
+    void setFailureHandler(FailureHandler handler) { failureHandler = std::move(handler); }
+
+    // 握手完成后向服务端登记
+    void connected();
+
+    // 连接断开：等待查询的消息视为未送达，已知的公钥和重放窗口保留
+    void disconnect();
+
+    // 加密发往对端的消息，对端公钥未知时先查询，消息排队等待结果
+    // 中继记录都按 NORMAL 优先级发送，同一对端的消息按发送顺序到达
+    bool send(std::string_view peer, std::string_view message);
+
+    // 处理服务端发来的 RELAY_PEER（已经过会话解密）
+    void handleRecord(uint8_t type, std::string_view payload);
+
+    // 处理收到的 RELAY_DATA 线路记录，在记录缓冲区内原地解密
+    void handleFrame(std::string& frame);
+
+    static bool isRelayFrame(uint8_t type) {
+        return type == RELAY_DATA;
+    }
+
+    // 以下供服务端解析和生成中继记录
+
+    static bool decodeRegister(std::string_view payload, std::string_view& name, std::string_view& publicKey);
+    static PooledBuffer encodePeer(PeerStatus status, std::string_view name, std::string_view publicKey);
+
+    // 解析 RELAY_DATA 的路由头，sealed 为原样转发的密文体
+    static bool decodeFrame(std::string_view frame, std::string_view& name, std::string_view& sealed);
+
+    // 生成转发给接收方的线路记录：路由名字改写为发送方，密文体原样拷贝
+    static PooledBuffer encodeFrame(std::string_view name, std::string_view sealed);
+
+    // 密文体中接收方公钥的标识，服务端据此发现发送方使用的公钥已过期
+    static std::string_view keyId(std::string_view sealed) { return sealed.substr(0, kKeyIdSize); }
+
+private:
+    typedef CryptoPP::GCM<CryptoPP::AES>::Encryption Encryption;
+    typedef CryptoPP::GCM<CryptoPP::AES>::Decryption Decryption;
+
+    // 对端某个纪元的接收密钥和已收到的最大序号
+    struct ReceiveEpoch {
+        uint64_t epoch = 0;
+        std::unique_ptr<Decryption> decryption;
+        CryptoPP::SecByteBlock salt;
+        uint64_t lastSequence = 0;
+    };
+
+    struct Peer {
+        std::string publicKey;          // 原始 32 字节，未知时为空
+        bool pinned = false;
+        bool lookupPending = false;
+
+        // 发往对端的密钥，公钥或本端纪元变化时重新派生
+        std::unique_ptr<Encryption> encryption;
+        CryptoPP::SecByteBlock sendSalt;
+
+        // 最近几个纪元的接收状态，对端重启后纪元变化；newestEpoch 为校验通过的最大纪元，
+        // 不在 epochs 里且更早的纪元一律拒绝（公钥更换时也不清零）
+        std::deque<ReceiveEpoch> epochs;
+        uint64_t newestEpoch = 0;
+
+        // 等待查询结果的发出消息和收到的记录
+        std::vector<std::string> outgoing;
+        std::vector<std::string> incoming;
+        size_t outgoingBytes = 0;
+        size_t incomingBytes = 0;
+    };
+
+    RecordSender sender;
+    MessageHandler messageHandler;
+    FailureHandler failureHandler;
+
+    std::string localName;
+    CryptoPP::SecByteBlock privateKey;
+    std::string localPublicKey;
+    uint64_t epoch;
+    uint64_t sendSequence;
+    bool online;
+
+    std::unordered_map<std::string, Peer> peers;
+
+    void lookup(const std::string& name, Peer& peer);
+    void updateKey(const std::string& name, Peer& peer, std::string_view publicKey);
+    void fail(const std::string& name, Peer& peer);
+    void flush(const std::string& name, Peer& peer);
+
+    bool seal(const std::string& name, Peer& peer, std::string_view message);
+    bool open(const std::string& name, Peer& peer, std::string& frame, size_t sealedOffset);
+
+    // 派生与对端之间一个方向（outgoing 为 true 时是本端发往对端）在指定纪元下的密钥和 nonce 盐值
+    bool deriveKey(const std::string& name, const Peer& peer, bool outgoing, uint64_t keyEpoch,
+                   CryptoPP::SecByteBlock& key, CryptoPP::SecByteBlock& salt) const;
+};
+
+#endif // PEER_RELAY_H
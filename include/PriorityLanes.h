@@ -0,0 +1,115 @@
+#ifndef PRIORITY_LANES_H
+#define PRIORITY_LANES_H
+
+#include "BufferPool.h"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// 发送优先级，数值越小越优先
+enum class SendPriority : uint8_t {
+    CONTROL = 0,    // 订阅变更、通道控制等协议控制记录
+    HIGH = 1,       // 对延迟敏感的小消息
+    NORMAL = 2,     // 默认
+    BULK = 3        // 大块数据传输
+};
+
+// 每个会话的分级发送队列
+// 记录先按优先级放入各自的通道，再由 pump 按传输层的空闲额度取出加密发送：
+// 权重为 0 的通道严格优先，其余通道按权重做赤字轮询（每轮额度 = 权重 * kFragmentSize 字节）
+// 超过 kFragmentSize 的消息拆成分片记录，不同通道的分片可以交错发送，
+// 控制消息最多等待一个分片，不会被排在前面的大消息阻塞
+//
+// 分片记录头：1字节记录类型(FRAGMENT) | 1字节标志 | 4字节消息号（大端） | 1字节原记录类型
+// 记录头作为 AEAD 附加数据参与认证；同一消息号的分片按顺序拼接，带结束标志的分片到达后还原为原记录
+// 发送端和接收端都不是线程安全的，只在事件循环线程上使用
+class PriorityLanes {
+public:
+    static constexpr size_t kLaneCount = 4;
+    static constexpr uint8_t kFragmentRecord = 14;
+    static constexpr size_t kHeaderSize = 7;
+    static constexpr uint8_t kFinalFragment = 0x01;
+    static constexpr size_t kFragmentSize = 16 * 1024;
+
+    // 未显式标为 HIGH/CONTROL 的消息超过此长度时自动归入 BULK
+    static constexpr size_t kBulkThreshold = 256 * 1024;
+
+    // 接收端拼接一条分片消息的上限
+    static constexpr size_t kMaxMessageSize = 64 * 1024 * 1024;
+
+    typedef std::array<uint32_t, kLaneCount> Weights;
+
+    // 默认：CONTROL 严格优先，HIGH:NORMAL:BULK = 8:4:1
+    static constexpr Weights kDefaultWeights = {{0, 8, 4, 1}};
+
+    // 发送一条记录（由连接负责加密和发送）
+    typedef std::function<bool(std::string_view header, std::string_view payload)> RecordSender;
+
+    explicit PriorityLanes(RecordSender sender, const Weights& weights = kDefaultWeights);
+
+    void setWeights(const Weights& weights);
+
+    // 把一条记录放入对应优先级的通道，payload 可以与其他会话共享
+    void enqueue(SendPriority priority, std::string_view header, PooledBuffer payload);
+
+    // 发出最多约 budget 字节（至少一个记录或分片），返回是否还有待发送的数据
+    bool pump(size_t budget);
+
+    bool empty() const { return queuedRecords == 0; }
+
+    // 各通道中尚未发出的负载字节数
+    size_t pendingBytes(SendPriority priority) const;
+
+    // 处理收到并解密后的分片记录，消息拼接完整时返回 true，
+    // type 为原记录类型，message 指向拼接好的明文，在下一次调用前有效
+    bool reassemble(std::string_view header, std::string_view payload, uint8_t& type, std::string_view& message);
+
+    // 连接断开时丢弃全部排队的记录和未完成的分片
+    void reset();
+
+    static bool isFragmentRecord(uint8_t type) {
+        return type == kFragmentRecord;
+    }
+
+private:
+    struct PendingRecord {
+        char header[kHeaderSize];
+        uint8_t headerLength;
+        PooledBuffer payload;
+        size_t offset;
+        uint32_t messageId;     // 0 表示整条发送，不分片
+    };
+
+    struct Lane {
+        std::deque<PendingRecord> records;
+        size_t bytes = 0;
+        size_t deficit = 0;
+        uint32_t weight = 0;
+    };
+
+    RecordSender sender;
+    std::array<Lane, kLaneCount> lanes;
+    size_t current;             // 赤字轮询当前服务的通道
+    bool quantumGranted;        // 当前通道本轮是否已经加过额度
+    size_t queuedRecords;
+    uint32_t nextMessageId;
+
+    // 接收端未完成的分片消息，发送端每个通道同时只有一条消息在分片，数量不超过 kLaneCount
+    struct Reassembly {
+        uint8_t type = 0;
+        std::string data;
+    };
+    std::unordered_map<uint32_t, Reassembly> reassembly;
+    std::string completed;
+
+    // 发出通道队首记录的下一个单元（整条记录或一个分片），返回发出的字节数（含记录头）
+    size_t sendNext(Lane& lane);
+    static size_t nextUnitSize(const PendingRecord& record);
+    void advance();
+};
+
+#endif // PRIORITY_LANES_H
@@ -0,0 +1,53 @@
+#ifndef PSK_HANDSHAKE_H
+#define PSK_HANDSHAKE_H
+
+#include "CipherSuite.h"
+#include <cryptopp/secblock.h>
+#include <string>
+#include <vector>
+
+// 预共享密钥握手：双方事先配置同一个身份和密钥，握手中没有任何非对称运算
+//   客户端 → PSK_HELLO   : Base64(身份) : Base64(客户端随机数) : 套件列表
+//   服务端 → PSK_ACCEPT  : Base64(服务端随机数) : 选中的套件 : Base64(服务端确认值)
+//   客户端 → PSK_FINISHED: Base64(客户端确认值)
+// 会话密钥材料和双方的确认值由一次 HKDF-SHA256 派生：输入密钥是 PSK，盐值是两个随机数，
+// 附加信息包含身份、客户端提供的套件列表和选中的套件，篡改其中任何一项都会使确认失败；
+// 确认值证明对方持有同一个 PSK。客户端收到 PSK_ACCEPT 后发出 PSK_FINISHED 即可发送数据，握手只需一个往返
+// 只使用 AEAD 套件，会话密钥材料交给 SessionCipherSlot 按方向派生记录层和分段加密的密钥
+class PskHandshake {
+public:
+    static constexpr size_t kNonceSize = 32;
+    static constexpr size_t kSecretSize = 32;
+    static constexpr size_t kConfirmSize = 32;
+    static constexpr size_t kMinKeySize = 16;
+
+    // 一次握手派生出的密钥材料和双方的确认值
+    struct Derived {
+        CryptoPP::SecByteBlock secret;
+        std::string clientConfirm;
+        std::string serverConfirm;
+    };
+
+    static std::string makeNonce();
+
+    static bool derive(const std::string& key, const std::string& identity, const std::string& offer,
+                       CipherSuite suite, const std::string& clientNonce, const std::string& serverNonce,
+                       Derived& derived);
+
+    // 定长时间比较确认值
+    static bool confirmEquals(const std::string& received, const std::string& expected);
+
+    // 去掉 CBC 后的套件列表，PSK 握手不使用没有消息认证的套件
+    static std::vector<CipherSuite> aeadSuites(const std::vector<CipherSuite>& suites);
+
+    static std::string encodeHello(const std::string& identity, const std::string& nonce, const std::string& offer);
+    static bool parseHello(const std::string& data, std::string& identity, std::string& nonce, std::string& offer);
+
+    static std::string encodeAccept(const std::string& nonce, CipherSuite suite, const std::string& confirm);
+    static bool parseAccept(const std::string& data, std::string& nonce, CipherSuite& suite, std::string& confirm);
+
+    static std::string encodeFinished(const std::string& confirm);
+    static bool parseFinished(const std::string& data, std::string& confirm);
+};
+
+#endif // PSK_HANDSHAKE_H
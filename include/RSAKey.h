@@ -12,10 +12,25 @@ using namespace CryptoPP;
 
 class RSAKey : public AsymmetricalEncryptionInterface {
 public:
-    RSAKey();
+    static const unsigned int kDefaultKeySize = 2048;
+    
+    explicit RSAKey(unsigned int keySize = kDefaultKeySize);
     ~RSAKey();
     
+    // 模数位数（2048/3072/4096），决定握手时签名和解密的开销
+    unsigned int getKeySize() const { return keySize; }
+    
     bool generateKeyPair() override;
+    
+    // 导出本地私钥（Base64 编码的 PKCS#8），可以持久化后再载入，或在多个客户端之间共享同一身份
+    std::string getLocalPrivateKey();
+    
+    // 载入已有的本地私钥代替 generateKeyPair，公钥由私钥派生
+    bool setLocalPrivateKey(const std::string& privateKey);
+    
+    // 是否已经有本地密钥对（生成或载入）
+    bool hasLocalKey() const { return signer != nullptr; }
+    
     std::string getLocalPublicKey() override;
     bool setRemotePublicKey(const std::string& publicKey) override;
     std::string encryptWithLocalPrivate(const std::string& plaintext) override;
@@ -26,11 +41,16 @@ public:
     bool verifyWithRemotePublic(const std::string& data, const std::string& signature) override;
 
 private:
+    unsigned int keySize;
     AutoSeededRandomPool rng;
     std::unique_ptr<RSA::PrivateKey> localPrivateKey;
     std::unique_ptr<RSA::PublicKey> localPublicKey;
     std::unique_ptr<RSA::PublicKey> remotePublicKey;
     
+    // 签名器和验证器在密钥确定后构造一次，之后每次签名/验证直接复用
+    std::unique_ptr<RSASS<PSSR, SHA256>::Signer> signer;
+    std::unique_ptr<RSASS<PSSR, SHA256>::Verifier> verifier;
+    
     // 辅助函数：将密钥转换为Base64字符串
     std::string keyToString(const RSA::PublicKey& key) const;
     
@@ -0,0 +1,178 @@
+#ifndef RPC_SESSION_H
+#define RPC_SESSION_H
+
+#include "BufferPool.h"
+#include "MpscQueue.h"
+#include "PriorityLanes.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 加密连接上的请求/应答调用
+// 每个连接一个 RpcSession：同一连接上可以同时有任意多个调用在途，应答按完成顺序返回，靠调用号对应到请求；
+// 调用可以带截止时间，到期未应答的调用在本端以 DEADLINE_EXCEEDED 结束，截止时间随请求发给对端，
+// 对端在截止时间之后的应答直接丢弃；调用方取消调用时通知对端，处理函数可以据此提前放弃
+//
+// 记录负载（记录头都是 1 字节记录类型）：
+//   RPC_REQUEST : 调用号(8) | 超时毫秒(4，0 表示不限) | 方法名长度(2) | 方法名 | 请求
+//   RPC_RESPONSE: 调用号(8) | 状态(1) | 应答或错误信息
+//   RPC_CANCEL  : 调用号(8)
+//
+// 调用表只在连接的事件循环线程上访问：call 在任意线程把调用登记放入无锁队列，再发出请求记录，
+// 事件循环在处理应答前先取出登记，因此发起调用不需要加锁，应答的查找也不需要加锁
+class RpcSession {
+public:
+    typedef uint64_t CallId;
+
+    // 调用记录类型，与服务端/客户端的消息类型编号一致
+    enum RecordType : uint8_t {
+        RPC_REQUEST = 24,
+        RPC_RESPONSE = 25,
+        RPC_CANCEL = 26
+    };
+
+    enum class Status : uint8_t {
+        OK = 0,
+        ERROR = 1,               // 处理函数返回了错误，负载是错误信息
+        NOT_FOUND = 2,           // 对端没有注册该方法
+        CANCELLED = 3,
+        DEADLINE_EXCEEDED = 4,
+        DISCONNECTED = 5         // 应答到达之前连接断开
+    };
+
+    static constexpr size_t kRequestHeaderSize = 8 + 4 + 2;
+    static constexpr size_t kResponseHeaderSize = 8 + 1;
+    static constexpr size_t kMaxMethodLength = 0xffff;
+
+    // 调用结果，在事件循环线程上调用且恰好调用一次；负载只在回调期间有效
+    typedef std::function<void(Status, std::string_view payload)> ResponseHandler;
+
+    // 发送一条调用记录（由连接负责排队、加密和发送，必须线程安全）
+    typedef std::function<bool(RecordType type, SendPriority priority, PooledBuffer payload)> RecordSender;
+
+    // 处理一个请求的应答句柄，可以复制，可以保存下来在任意线程稍后应答；只有第一次应答生效
+    // 所有副本销毁时仍未应答，自动以 ERROR 应答，调用方不会一直等待
+    class Responder {
+    public:
+        Responder() = default;
+
+        CallId id() const;
+
+        // 请求中的截止时间，不限时为 time_point::max()
+        std::chrono::steady_clock::time_point deadline() const;
+
+        // 调用方是否已经取消（或截止时间已过），处理函数可以据此提前放弃
+        bool isCancelled() const;
+
+        bool reply(std::string_view response) { return respond(Status::OK, response); }
+        bool fail(std::string_view error) { return respond(Status::ERROR, error); }
+
+        // 返回 false 表示已经应答过、调用已取消或已过截止时间，应答没有发出
+        bool respond(Status status, std::string_view payload);
+
+    private:
+        friend class RpcSession;
+
+        struct State;
+        explicit Responder(std::shared_ptr<State> state) : state(std::move(state)) {}
+
+        std::shared_ptr<State> state;
+    };
+
+    // 收到请求时在事件循环线程上调用，方法名和请求只在回调期间有效
+    typedef std::function<void(std::string_view method, std::string_view request, Responder responder)> RequestHandler;
+
+    explicit RpcSession(RecordSender sender);
+    ~RpcSession();
+
+    RpcSession(const RpcSession&) = delete;
+    RpcSession& operator=(const RpcSession&) = delete;
+
+    // 发起调用（线程安全），timeout 为 0 表示不限时
+    // 返回 0 表示请求没有发出，此时处理函数不会被调用；否则处理函数恰好调用一次
+    CallId call(std::string_view method, std::string_view request, ResponseHandler handler,
+                std::chrono::milliseconds timeout, SendPriority priority = SendPriority::NORMAL);
+
+    // 取消调用（线程安全），在下一次 poll 时以 CANCELLED 结束并通知对端
+    void cancel(CallId id);
+
+    // 设置请求处理函数，未设置时以 NOT_FOUND 应答所有请求
+    void setRequestHandler(RequestHandler handler);
+
+    // 以下在事件循环线程上调用
+
+    // 处理收到并解密后的调用记录
+    bool handleRecord(uint8_t type, std::string_view payload);
+
+    // 取出新登记的调用和取消请求，结束已过截止时间的调用，返回最近的截止时间（没有时为 time_point::max()）
+    std::chrono::steady_clock::time_point poll(std::chrono::steady_clock::time_point now);
+
+    // 连接断开：在途调用以 DISCONNECTED 结束，正在处理的请求视为已取消
+    void disconnect();
+
+    // 在途调用数（事件循环线程）
+    size_t pendingCount() const { return pending.size(); }
+
+    static bool isRpcRecord(uint8_t type) {
+        return type >= RPC_REQUEST && type <= RPC_CANCEL;
+    }
+
+    static const char* statusName(Status status);
+
+private:
+    struct PendingCall {
+        CallId id = 0;
+        ResponseHandler handler;
+        std::chrono::steady_clock::time_point deadline;
+        std::atomic<bool> done{false};
+    };
+
+    // 任意线程放入、事件循环取出的命令：登记调用或取消调用
+    struct Command {
+        std::shared_ptr<PendingCall> call;     // 为空表示取消
+        CallId id = 0;
+    };
+
+    typedef std::pair<std::chrono::steady_clock::time_point, CallId> Deadline;
+
+    std::shared_ptr<const RecordSender> sender;     // 应答句柄共享同一个发送函数
+    RequestHandler requestHandler;
+    std::atomic<CallId> nextCallId;
+    MpscQueue<Command> commands;
+
+    // 以下只在事件循环线程上访问
+    std::unordered_map<CallId, std::shared_ptr<PendingCall>> pending;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines;
+
+    // 正在处理的请求，用于把对端的取消转给处理函数；应答在任意线程发生，过期的条目批量清理
+    std::unordered_map<CallId, std::weak_ptr<Responder::State>> serving;
+    size_t servingSweepAt;
+
+    void absorbCommands();
+    void finish(PendingCall& call, Status status, std::string_view payload);
+    bool sendCancel(CallId id);
+
+    void handleRequest(std::string_view payload);
+    void handleResponse(std::string_view payload);
+    void handleCancel(std::string_view payload);
+};
+
+typedef RpcSession::Status RpcStatus;
+
+// 需要持有结果的调用（future 和协程接口）使用的结果
+struct RpcResult {
+    RpcStatus status = RpcStatus::DISCONNECTED;
+    std::string payload;
+
+    bool ok() const { return status == RpcStatus::OK; }
+};
+
+#endif // RPC_SESSION_H
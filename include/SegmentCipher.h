@@ -0,0 +1,194 @@
+#ifndef SEGMENT_CIPHER_H
+#define SEGMENT_CIPHER_H
+
+#include "BufferPool.h"
+#include "CipherSuite.h"
+#include "CryptoWorkerPool.h"
+#include "PriorityLanes.h"
+#include <cryptopp/osrng.h>
+#include <cryptopp/secblock.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 大消息的分段并行加密
+// 记录层的 AEAD 记录按序号串行加解密，一条几百 MB 的消息只能用一个核；
+// 超过阈值的消息改为分段发送，各段在工作线程池上并行加密，接收端同样并行解密和校验：
+//
+//   SEGMENT_BEGIN（经记录层加密，受记录序号保护）：
+//       消息随机数(16) | 消息号(2) | 原记录类型(1) | 消息长度(8) | 段长度(4)
+//   SEGMENT（不再经过记录层）：
+//       记录头：类型(1) | 消息号(2) | 段序号(4) ，作为附加认证数据
+//       负载：密文 | 16字节认证标签
+//
+//   SEGMENT_LIMIT（经记录层加密）：接收端一条分段消息的长度上限(8)
+//   SEGMENT_REJECT（经记录层加密）：被拒绝的消息号(2)
+//
+// 握手完成后启用了分段的一端先发出 SEGMENT_LIMIT，发送端收到之前、或消息超过对端上限时按普通记录串行发送，
+// 关闭了分段的一端不发送，对端始终串行发送；接收端仍然拒绝的消息（例如几条消息合计超过上限）回复 SEGMENT_REJECT，
+// 该消息后续的段直接丢弃
+//
+// 每条消息的密钥 = HKDF(会话的分段密钥, 消息随机数)，段的 nonce 为段序号，每段独立认证；
+// 段只有在对应的 SEGMENT_BEGIN 之后才被接受、每个序号只接受一次，消息完整后密钥即丢弃，
+// 因此无法重放或把不同消息的段拼在一起。全部段校验通过后才交付明文
+//
+// 发送端和接收端的接口只在事件循环线程调用；加密完成、或接收的消息全部段解密完成时在工作线程上调用 ready 通知，
+// 由连接投递回事件循环后用 collect 按提交顺序取出加密的消息，用 collectIncoming 按最后一段到达的顺序取出收到的消息
+class SegmentCipher {
+public:
+    static constexpr uint8_t kBeginRecord = 22;
+    static constexpr uint8_t kSegmentRecord = 23;
+    static constexpr uint8_t kLimitRecord = 36;
+    static constexpr uint8_t kRejectRecord = 37;
+    static constexpr size_t kHeaderSize = 7;
+    static constexpr size_t kTagSize = 16;
+    static constexpr size_t kMessageNonceSize = 16;
+    static constexpr size_t kBeginSize = kMessageNonceSize + 2 + 1 + 8 + 4;
+
+    // 整条段记录正好放进缓冲池 256KB 的分级，也不超过优先级通道归入 BULK 的阈值
+    static constexpr size_t kSegmentSize = 256 * 1024 - 64;
+
+    // 接收端一条分段消息的上限，同时未完成的消息数上限
+    static constexpr uint64_t kMaxMessageSize = uint64_t(4) << 30;
+    static constexpr size_t kMaxIncoming = 4;
+
+    // 未完成的接收消息合计占用的缓冲区上限（默认值）
+    // 缓冲区在 SEGMENT_BEGIN 到达时按声明的长度一次分配，段还没有经过认证，上限决定了对端能让本端占用多少内存；
+    // 段已经全部到达、还在解密的消息另计，不超过同样的上限
+    static constexpr uint64_t kDefaultReceiveLimit = uint64_t(256) << 20;
+
+    // 加密完成的一条消息：SEGMENT_BEGIN 的负载（由连接经记录层发送）和各段完整的线路记录
+    struct SealedMessage {
+        SendPriority priority = SendPriority::NORMAL;
+        PooledBuffer begin;
+        std::vector<PooledBuffer> segments;
+    };
+
+    typedef std::function<void()> ReadyNotifier;
+
+    // suite 必须是 AEAD 套件，密钥来自 SessionCipherSlot 的分段密钥
+    SegmentCipher(CipherSuite suite, const CryptoPP::SecByteBlock& sendKey, const CryptoPP::SecByteBlock& receiveKey,
+                  ReadyNotifier ready, CryptoWorkerPool& pool = CryptoWorkerPool::shared());
+
+    // 等待已提交的任务结束，尚未开始的任务直接跳过
+    ~SegmentCipher();
+
+    SegmentCipher(const SegmentCipher&) = delete;
+    SegmentCipher& operator=(const SegmentCipher&) = delete;
+
+    // 开始并行加密一条消息，type 为原记录类型（单字节记录头）
+    bool seal(uint8_t type, SendPriority priority, PooledBuffer plaintext);
+
+    // 按提交顺序取出下一条加密完成的消息，队首还在加密时返回 false
+    bool collect(SealedMessage& message);
+
+    // 设置未完成的接收消息合计的字节数上限，不超过 kMaxMessageSize；超出时拒绝新的分段消息
+    void setReceiveLimit(uint64_t bytes);
+
+    // 本端接收上限的 SEGMENT_LIMIT 负载，握手完成后发给对端
+    PooledBuffer limitPayload() const;
+
+    // 处理对端的 SEGMENT_LIMIT 负载
+    bool handleLimit(std::string_view payload);
+
+    // 对端是否接收这样长度的分段消息，不接收时调用方改为串行发送
+    bool accepts(size_t bytes) const;
+
+    // 处理对端的 SEGMENT_REJECT 负载，被拒绝的消息已经丢失，只记录错误
+    bool handleReject(std::string_view payload);
+
+    // 处理解密后的 SEGMENT_BEGIN 负载，拒绝时调用方用 rejectFor 回复对端
+    bool handleBegin(std::string_view payload);
+
+    // 拒绝一条分段消息的 SEGMENT_REJECT 负载，SEGMENT_BEGIN 无法解析时为空
+    static PooledBuffer rejectFor(std::string_view begin);
+
+    // 处理收到的段记录（未经记录层解密），密文拷出后交给工作线程解密，不等待解密完成；段无效时返回 false
+    bool handleSegment(std::string_view record);
+
+    // 取出下一条全部段校验通过的接收消息，队首还在解密时返回 false；认证失败的消息直接丢弃
+    // type 为原记录类型，message 指向明文，在下一次调用前有效
+    bool collectIncoming(uint8_t& type, std::string_view& message);
+
+    // 丢弃未完成的接收消息（连接断开时）
+    void resetIncoming();
+
+    static bool isSegmentRecord(uint8_t type) {
+        return type == kSegmentRecord;
+    }
+
+private:
+    struct Outgoing {
+        SealedMessage sealed;
+        PooledBuffer plaintext;
+        CryptoPP::SecByteBlock key;
+        uint16_t messageId = 0;
+        size_t remaining = 0;       // 尚未完成的段数
+        bool failed = false;
+    };
+
+    struct Incoming {
+        CryptoPP::SecByteBlock key;
+        uint8_t type = 0;
+        uint64_t length = 0;
+        uint32_t segmentSize = 0;
+        uint32_t segmentCount = 0;
+        uint32_t received = 0;
+        size_t remaining = 0;       // 已收到但尚未解密完的段数
+        bool complete = false;      // 全部段已到达，最后一个解密任务结束时通知 ready
+        bool failed = false;
+        std::vector<bool> seen;
+        std::string data;
+        std::string tags;           // 各段的认证标签
+    };
+
+    // 与工作线程共享的状态，SegmentCipher 析构后任务看到 closed 直接返回
+    struct Shared {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t outstanding = 0;
+        bool closed = false;
+        ReadyNotifier ready;
+    };
+
+    CipherSuite suite;
+    CryptoPP::SecByteBlock sendKey;
+    CryptoPP::SecByteBlock receiveKey;
+    CryptoWorkerPool& pool;
+    std::shared_ptr<Shared> shared;
+    CryptoPP::AutoSeededRandomPool rng;
+    uint16_t nextMessageId;
+
+    std::deque<std::shared_ptr<Outgoing>> outgoing;
+    std::unordered_map<uint16_t, std::shared_ptr<Incoming>> incoming;
+    std::deque<std::shared_ptr<Incoming>> completing;   // 段已全部到达的消息，按到达顺序交付
+    uint64_t receiveLimit;
+    uint64_t incomingBytes;         // 未完成的接收消息已分配的缓冲区合计
+    uint64_t completingBytes;       // 还在解密的消息占用的缓冲区合计
+    uint64_t peerLimit;             // 对端一条分段消息的长度上限，收到 SEGMENT_LIMIT 之前为 0
+    std::unordered_set<uint16_t> rejected;  // 已拒绝的消息号，后续的段直接丢弃
+    std::string completed;
+
+    void eraseIncoming(uint16_t messageId);
+
+    // 每条消息的密钥
+    static CryptoPP::SecByteBlock deriveMessageKey(const CryptoPP::SecByteBlock& key, const CryptoPP::byte* nonce);
+
+    static void writeHeader(char* header, uint16_t messageId, uint32_t index);
+
+    // 在工作线程上加密/解密一段
+    static bool sealSegment(CipherSuite suite, const CryptoPP::SecByteBlock& key, const char* header,
+                            const char* plaintext, size_t length, char* out);
+    static bool openSegment(CipherSuite suite, const CryptoPP::SecByteBlock& key, const char* header,
+                            char* data, size_t length, const char* tag);
+};
+
+#endif // SEGMENT_CIPHER_H
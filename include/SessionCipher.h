@@ -0,0 +1,299 @@
+#ifndef SESSION_CIPHER_H
+#define SESSION_CIPHER_H
+
+#include "BufferPool.h"
+#include "CipherSuite.h"
+#include "Logger.h"
+#include <cryptopp/aes.h>
+#include <cryptopp/modes.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/chachapoly.h>
+#include <cryptopp/secblock.h>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+
+using namespace CryptoPP;
+
+// 单个方向的会话密钥：加密密钥 + 4字节nonce盐值
+struct DirectionalKey {
+    SecByteBlock key;
+    SecByteBlock salt;
+};
+
+// 每个加密套件一个模板特化，收发热路径在编译期确定具体算法，可以被内联
+template <CipherSuite Suite>
+class SessionCipher;
+
+// AEAD 套件的公共实现
+// 记录格式：记录头 | 8字节序号（大端） | 密文 | 16字节认证标签
+// nonce = 4字节盐值 || 8字节序号，记录头作为附加认证数据；收到的序号必须严格递增
+template <class Encryption, class Decryption>
+class AeadSessionCipher {
+public:
+    static constexpr size_t kSequenceSize = 8;
+    static constexpr size_t kTagSize = 16;
+    static constexpr size_t kNonceSize = 12;
+    static constexpr size_t kSaltSize = 4;
+    static constexpr size_t kOverhead = kSequenceSize + kTagSize;
+
+    void setKeys(const DirectionalKey& sendKey, const DirectionalKey& receiveKey) {
+        byte nonce[kNonceSize] = {0};
+
+        std::memcpy(sendSalt, sendKey.salt.data(), kSaltSize);
+        std::memcpy(receiveSalt, receiveKey.salt.data(), kSaltSize);
+        encryption.SetKeyWithIV(sendKey.key, sendKey.key.size(), nonce, kNonceSize);
+        decryption.SetKeyWithIV(receiveKey.key, receiveKey.key.size(), nonce, kNonceSize);
+
+        sendSequence = 0;
+        receiveSequence = 0;
+    }
+
+    // 加密并生成完整记录（记录头原样写在最前面）
+    PooledBuffer seal(std::string_view header, std::string_view plaintext, BufferPool& pool) {
+        try {
+            size_t length = header.size() + kOverhead + plaintext.size();
+            PooledBuffer record = pool.acquire(length);
+            record.resize(length);
+
+            byte* out = (byte*)record.data();
+            std::memcpy(out, header.data(), header.size());
+
+            uint64_t sequence = ++sendSequence;
+            byte* sequenceOut = out + header.size();
+            writeSequence(sequenceOut, sequence);
+
+            byte nonce[kNonceSize];
+            makeNonce(nonce, sendSalt, sequence);
+
+            byte* cipher = sequenceOut + kSequenceSize;
+            encryption.EncryptAndAuthenticate(cipher, cipher + plaintext.size(), kTagSize,
+                                              nonce, kNonceSize,
+                                              out, header.size(),
+                                              (const byte*)plaintext.data(), plaintext.size());
+            return record;
+        } catch (const Exception& e) {
+            CRYPTOLINK_LOG_ERROR("会话加密失败: " << e.what());
+            return PooledBuffer();
+        }
+    }
+
+    // 在记录缓冲区内原地解密并校验，成功时 plaintext 指向记录内部
+    bool open(char* record, size_t length, size_t headerLength, std::string_view& plaintext) {
+        if (length < headerLength + kOverhead) {
+            return false;
+        }
+
+        try {
+            byte* in = (byte*)record;
+            uint64_t sequence = readSequence(in + headerLength);
+            if (sequence <= receiveSequence) {
+                CRYPTOLINK_LOG_WARNING("会话解密失败: 记录序号重复或倒退");
+                return false;
+            }
+
+            byte nonce[kNonceSize];
+            makeNonce(nonce, receiveSalt, sequence);
+
+            size_t cipherLength = length - headerLength - kOverhead;
+            byte* cipher = in + headerLength + kSequenceSize;
+            if (!decryption.DecryptAndVerify(cipher, cipher + cipherLength, kTagSize,
+                                             nonce, kNonceSize,
+                                             in, headerLength,
+                                             cipher, cipherLength)) {
+                CRYPTOLINK_LOG_WARNING("会话解密失败: 认证标签校验失败");
+                return false;
+            }
+
+            receiveSequence = sequence;
+            plaintext = std::string_view((const char*)cipher, cipherLength);
+            return true;
+        } catch (const Exception& e) {
+            CRYPTOLINK_LOG_WARNING("会话解密失败: " << e.what());
+            return false;
+        }
+    }
+
+private:
+    Encryption encryption;
+    Decryption decryption;
+    byte sendSalt[kSaltSize] = {0};
+    byte receiveSalt[kSaltSize] = {0};
+    uint64_t sendSequence = 0;
+    uint64_t receiveSequence = 0;
+
+    static void writeSequence(byte* out, uint64_t sequence) {
+        for (int i = 7; i >= 0; --i) {
+            out[i] = (byte)(sequence & 0xff);
+            sequence >>= 8;
+        }
+    }
+
+    static uint64_t readSequence(const byte* in) {
+        uint64_t sequence = 0;
+        for (int i = 0; i < 8; ++i) {
+            sequence = (sequence << 8) | in[i];
+        }
+        return sequence;
+    }
+
+    static void makeNonce(byte* nonce, const byte* salt, uint64_t sequence) {
+        std::memcpy(nonce, salt, kSaltSize);
+        writeSequence(nonce + kSaltSize, sequence);
+    }
+};
+
+template <>
+class SessionCipher<CipherSuite::AES_256_GCM>
+    : public AeadSessionCipher<GCM<AES>::Encryption, GCM<AES>::Decryption> {
+};
+
+template <>
+class SessionCipher<CipherSuite::CHACHA20_POLY1305>
+    : public AeadSessionCipher<ChaCha20Poly1305::Encryption, ChaCha20Poly1305::Decryption> {
+};
+
+// 兼容旧版本的CBC套件：两个方向共用同一个密钥和固定IV
+// 记录格式：记录头 | PKCS#7填充后的CBC密文
+template <>
+class SessionCipher<CipherSuite::AES_256_CBC> {
+public:
+    void setKeys(const SecByteBlock& key, const SecByteBlock& iv) {
+        this->iv = iv;
+        encryption.SetKeyWithIV(key, key.size(), iv);
+        decryption.SetKeyWithIV(key, key.size(), iv);
+    }
+
+    PooledBuffer seal(std::string_view header, std::string_view plaintext, BufferPool& pool) {
+        try {
+            size_t padding = AES::BLOCKSIZE - plaintext.size() % AES::BLOCKSIZE;
+            size_t cipherLength = plaintext.size() + padding;
+
+            PooledBuffer record = pool.acquire(header.size() + cipherLength);
+            record.resize(header.size() + cipherLength);
+            std::memcpy(record.data(), header.data(), header.size());
+
+            byte* cipher = (byte*)record.data() + header.size();
+            std::memcpy(cipher, plaintext.data(), plaintext.size());
+            std::memset(cipher + plaintext.size(), (int)padding, padding);
+
+            encryption.Resynchronize(iv);
+            encryption.ProcessData(cipher, cipher, cipherLength);
+            return record;
+        } catch (const Exception& e) {
+            CRYPTOLINK_LOG_ERROR("会话加密失败: " << e.what());
+            return PooledBuffer();
+        }
+    }
+
+    bool open(char* record, size_t length, size_t headerLength, std::string_view& plaintext) {
+        size_t cipherLength = length - headerLength;
+        if (length <= headerLength || cipherLength % AES::BLOCKSIZE != 0) {
+            return false;
+        }
+
+        try {
+            byte* cipher = (byte*)record + headerLength;
+            decryption.Resynchronize(iv);
+            decryption.ProcessData(cipher, cipher, cipherLength);
+
+            size_t padding = cipher[cipherLength - 1];
+            if (padding == 0 || padding > AES::BLOCKSIZE) {
+                CRYPTOLINK_LOG_WARNING("会话解密失败: 填充无效");
+                return false;
+            }
+            for (size_t i = cipherLength - padding; i < cipherLength; ++i) {
+                if (cipher[i] != padding) {
+                    CRYPTOLINK_LOG_WARNING("会话解密失败: 填充无效");
+                    return false;
+                }
+            }
+
+            plaintext = std::string_view((const char*)cipher, cipherLength - padding);
+            return true;
+        } catch (const Exception& e) {
+            CRYPTOLINK_LOG_WARNING("会话解密失败: " << e.what());
+            return false;
+        }
+    }
+
+private:
+    CBC_Mode<AES>::Encryption encryption;
+    CBC_Mode<AES>::Decryption decryption;
+    SecByteBlock iv;
+};
+
+// 持有协商出的会话加密器
+// 用 std::variant 保存具体特化，收发时通过 std::visit 直接分派，不经过虚函数
+class SessionCipherSlot {
+public:
+    // 设置协商出的套件（在会话密钥到达前调用）
+    // transcript 为 cipherSuiteTranscript 生成的协商记录，会混入 AEAD 套件的密钥派生；旧版本对端协商时为空
+    void selectSuite(CipherSuite suite, const std::string& transcript = std::string()) {
+        this->suite = suite;
+        this->transcript = transcript;
+    }
+    CipherSuite getSuite() const { return suite; }
+    const std::string& getTranscript() const { return transcript; }
+
+    // 用握手得到的会话密钥（"key:iv"，Base64）初始化
+    // AEAD 套件通过 HKDF 为两个方向分别派生密钥，isClient 决定哪个方向用于发送
+    bool initialize(const std::string& sessionKey, bool isClient);
+    
+    // 直接用密钥材料初始化（预共享密钥握手），只支持 AEAD 套件
+    bool initialize(const SecByteBlock& secret, bool isClient);
+
+    bool ready() const { return cipher.index() != 0; }
+
+    void reset() {
+        cipher.emplace<std::monostate>();
+        segmentSendKey.resize(0);
+        segmentReceiveKey.resize(0);
+        datagramSendKey = DirectionalKey();
+        datagramReceiveKey = DirectionalKey();
+    }
+
+    // 大消息分段并行加密使用的两个方向的密钥，只有 AEAD 套件才派生（CBC 套件时为空）
+    const SecByteBlock& getSegmentSendKey() const { return segmentSendKey; }
+    const SecByteBlock& getSegmentReceiveKey() const { return segmentReceiveKey; }
+
+    // UDP 数据报通道使用的两个方向的密钥和 nonce 盐值，同样只有 AEAD 套件才派生
+    const DirectionalKey& getDatagramSendKey() const { return datagramSendKey; }
+    const DirectionalKey& getDatagramReceiveKey() const { return datagramReceiveKey; }
+
+    PooledBuffer seal(std::string_view header, std::string_view plaintext, BufferPool& pool) {
+        return std::visit([&](auto& impl) -> PooledBuffer {
+            if constexpr (std::is_same_v<std::decay_t<decltype(impl)>, std::monostate>) {
+                return PooledBuffer();
+            } else {
+                return impl.seal(header, plaintext, pool);
+            }
+        }, cipher);
+    }
+
+    bool open(char* record, size_t length, size_t headerLength, std::string_view& plaintext) {
+        return std::visit([&](auto& impl) -> bool {
+            if constexpr (std::is_same_v<std::decay_t<decltype(impl)>, std::monostate>) {
+                return false;
+            } else {
+                return impl.open(record, length, headerLength, plaintext);
+            }
+        }, cipher);
+    }
+
+private:
+    CipherSuite suite = CipherSuite::AES_256_CBC;
+    std::string transcript;
+    std::variant<std::monostate,
+                 SessionCipher<CipherSuite::AES_256_GCM>,
+                 SessionCipher<CipherSuite::CHACHA20_POLY1305>,
+                 SessionCipher<CipherSuite::AES_256_CBC>> cipher;
+    SecByteBlock segmentSendKey;
+    SecByteBlock segmentReceiveKey;
+    DirectionalKey datagramSendKey;
+    DirectionalKey datagramReceiveKey;
+};
+
+#endif // SESSION_CIPHER_H
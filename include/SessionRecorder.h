@@ -0,0 +1,121 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include "PriorityLanes.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// 会话录制：把每个连接的建立、断开和每条应用消息的时刻、方向、长度追加写入紧凑的二进制文件，
+// 测试环境可以同时记录明文。录下的文件由 session_replay 按原来的节奏（或加速）重放到本地服务端
+//
+// 文件格式（整数均为大端）：
+//   文件头 32 字节：魔数 "CLRECORD"(8) | 版本(4) | 标志(4) | 开始时刻，Unix 微秒(8) | 保留(8)
+//   事件头 24 字节：相对开始时刻的微秒(8) | 会话号(8) | 事件类型(1) | 记录类型(1) | 优先级(1) | 保留(1) | 长度(4)
+//   带明文时事件头后紧跟“长度”字节的明文
+//
+// 文件只追加：已存在的录制文件继续写在末尾，时刻相对原文件头，会话号接着文件中已有的最大值编号，
+// 每次追加先写一个 SEGMENT 事件，重放时据此跳过两段录制之间的空闲，上一段未断开的会话在此结束。
+// 录制可能带明文，新建的文件只有属主可以读写（0600）。
+// record 只在一个线程（服务端的事件循环）调用，只拷贝到内存缓冲，由后台线程写文件；
+// 积压超过 kMaxBacklog 时丢弃事件并计数，录制不会拖慢事件循环
+class SessionRecorder {
+public:
+    enum EventType : uint8_t {
+        OPEN = 1,
+        CLOSE = 2,
+        INBOUND = 3,    // 客户端发给服务端
+        OUTBOUND = 4,   // 服务端发给客户端
+        SEGMENT = 5     // 追加的一段录制从这里开始，不属于任何会话
+    };
+
+    static constexpr char kMagic[8] = {'C', 'L', 'R', 'E', 'C', 'O', 'R', 'D'};
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kFlagPayloads = 1;
+    static constexpr size_t kFileHeaderSize = 32;
+    static constexpr size_t kEventHeaderSize = 24;
+    static constexpr size_t kMaxBacklog = 64 * 1024 * 1024;
+
+    struct Event {
+        uint64_t time = 0;          // 相对开始时刻的微秒
+        uint64_t session = 0;
+        EventType type = OPEN;
+        uint8_t recordType = 0;
+        SendPriority priority = SendPriority::NORMAL;
+        uint32_t length = 0;
+        std::string_view payload;   // 未记录明文时为空
+    };
+
+    // 打开（或创建）录制文件，失败时返回空指针
+    static std::unique_ptr<SessionRecorder> open(const std::string& path, bool includePayloads);
+
+    // 写出积压的事件后关闭文件
+    ~SessionRecorder();
+
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    // 记录一个事件，session 为服务端的会话号
+    void record(EventType type, uint64_t session, uint8_t recordType = 0,
+                SendPriority priority = SendPriority::NORMAL, std::string_view payload = std::string_view());
+
+    bool includesPayloads() const { return includePayloads; }
+
+    // 因积压过多而丢弃的事件数
+    uint64_t getDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+    // 录制文件的只读视图：整个文件映射到内存，按顺序解析事件
+    class Reader {
+    public:
+        Reader();
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        bool open(const std::string& path);
+
+        bool hasPayloads() const { return flags & kFlagPayloads; }
+        int64_t getStartTime() const { return startTime; }
+
+        // 取出下一个事件，到达末尾或遇到截断的事件时返回 false；payload 指向映射区，Reader 存在期间有效
+        bool next(Event& event);
+
+        void rewind() { position = kFileHeaderSize; }
+
+        // 已解析到的文件偏移，解析到末尾后即为最后一个完整事件的结尾
+        size_t getPosition() const { return position; }
+
+    private:
+        const char* data;
+        size_t size;
+        size_t position;
+        uint32_t flags;
+        int64_t startTime;
+    };
+
+private:
+    SessionRecorder(int fd, bool includePayloads, int64_t startTime, uint64_t sessionBase);
+
+    int fd;
+    bool includePayloads;
+    int64_t startTime;
+    uint64_t sessionBase;
+    std::atomic<uint64_t> dropped;
+
+    // 事件循环追加到 pending，后台线程整块交换出去写文件
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::string pending;
+    bool closing;
+    std::thread writer;
+
+    void writerLoop();
+};
+
+#endif // SESSION_RECORDER_H
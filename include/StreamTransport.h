@@ -0,0 +1,100 @@
+#ifndef STREAM_TRANSPORT_H
+#define STREAM_TRANSPORT_H
+
+#include "Transport.h"
+#include "BufferPool.h"
+#include <boost/asio.hpp>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <set>
+
+// 长度前缀分帧的流式传输，省去 HTTP 升级、WebSocket 分帧和客户端掩码
+// 帧格式：1字节帧类型 | 4字节负载长度（大端） | 负载
+// TCP 后端的地址为 port 或 host:port，AF_UNIX 后端的地址为套接字路径；
+// 主动连接时异步解析，按顺序尝试全部解析结果，超过时限没有连上则经 onFail 通知
+// 可以运行在共享的事件循环上：传输销毁后循环上仍可能有它的异步操作和定时器回调，回调先检查传输是否还在
+template <typename Protocol>
+class StreamTransport : public Transport {
+public:
+    static constexpr size_t kFrameHeaderSize = 5;
+    static constexpr size_t kMaxMessageSize = 32 * 1024 * 1024;
+
+    // loop 为空时使用自己的事件循环
+    explicit StreamTransport(boost::asio::io_context* loop = nullptr);
+    ~StreamTransport() override;
+
+    void setHandlers(Handlers handlers) override;
+    bool listen(const std::string& address) override;
+    bool connect(const std::string& address) override;
+    bool send(Handle hdl, const char* data, size_t length, FrameType type) override;
+    void close(Handle hdl, uint16_t code, const std::string& reason) override;
+    void ping(Handle hdl) override;
+    size_t bufferedAmount(Handle hdl) override;
+    void setTimer(std::chrono::milliseconds delay, std::function<void()> callback) override;
+    void post(std::function<void()> task) override;
+    void run() override;
+    void stop() override;
+
+private:
+    // 帧类型：数据帧与 FrameType 取值一致，心跳帧由传输层自行应答
+    enum WireType : uint8_t {
+        WIRE_TEXT = 1,
+        WIRE_BINARY = 2,
+        WIRE_PING = 3,
+        WIRE_PONG = 4
+    };
+
+    struct Connection {
+        explicit Connection(boost::asio::io_context& io) : socket(io), connectTimer(io) {}
+
+        typename Protocol::socket socket;
+        boost::asio::steady_timer connectTimer;     // 主动连接的解析和建立时限
+        char header[kFrameHeaderSize];
+        std::string payload;
+        std::deque<PooledBuffer> writeQueue;
+        size_t queuedBytes = 0;
+        std::atomic<bool> open{false};
+        bool closing = false;
+        bool closed = false;
+    };
+    typedef std::shared_ptr<Connection> ConnectionPtr;
+
+    std::unique_ptr<boost::asio::io_context> ownedIo;     // 共享事件循环时为空
+    boost::asio::io_context& io;
+    typename Protocol::acceptor acceptor;
+    std::set<ConnectionPtr> connections;
+    Handlers handlers;
+    std::string listenPath;
+
+    // 回调持有弱引用，传输销毁后不再执行
+    std::shared_ptr<bool> alive;
+    typedef std::weak_ptr<bool> Guard;
+
+    // 同步解析，只用于监听地址和 AF_UNIX 路径；主动连接的 TCP 地址在事件循环上异步解析
+    bool resolve(const std::string& address, bool passive, typename Protocol::endpoint& endpoint);
+    void configureSocket(typename Protocol::socket& socket);
+
+    void completeConnect(const ConnectionPtr& connection, const boost::system::error_code& ec);
+    void startAccept();
+    void startSession(const ConnectionPtr& connection);
+    void readHeader(const ConnectionPtr& connection);
+    void readPayload(const ConnectionPtr& connection, uint8_t type, size_t length);
+    void dispatchFrame(const ConnectionPtr& connection, uint8_t type);
+
+    // 在事件循环线程上执行，跨线程调用时投递过去
+    void enqueue(const ConnectionPtr& connection, PooledBuffer frame);
+    void startWrite(const ConnectionPtr& connection);
+    bool sendFrame(Handle hdl, uint8_t type, const char* data, size_t length);
+
+    void shutdown(const ConnectionPtr& connection);
+    void finish(const ConnectionPtr& connection);
+
+    // 停止监听并关闭所有连接，不触发回调（共享事件循环上的 stop 和析构）
+    void closeAll();
+};
+
+typedef StreamTransport<boost::asio::ip::tcp> TcpTransport;
+typedef StreamTransport<boost::asio::local::stream_protocol> UnixSocketTransport;
+
+#endif // STREAM_TRANSPORT_H
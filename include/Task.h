@@ -0,0 +1,183 @@
+#ifndef TASK_H
+#define TASK_H
+
+#ifdef CRYPTOLINK_HAVE_COROUTINES
+
+#include "Logger.h"
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// 协程任务：惰性启动，被 co_await 时才开始执行，结束时直接切换回等待它的协程（对称转移）
+// 最外层的任务用 detach() 启动后自行销毁，或用 syncWait() 在普通线程上等待结果
+// 协程接口的等待操作都在传输线程上恢复，一个传输线程可以同时运行成千上万个协程而不需要额外的线程
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+    bool detached = false;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            TaskPromiseBase& promise = handle.promise();
+            if (promise.detached) {
+                // 没有人等待的任务抛出的异常只能记录下来
+                if (promise.exception) {
+                    try {
+                        std::rethrow_exception(promise.exception);
+                    } catch (const std::exception& e) {
+                        CRYPTOLINK_LOG_ERROR("协程任务异常: " << e.what());
+                    } catch (...) {
+                        CRYPTOLINK_LOG_ERROR("协程任务异常");
+                    }
+                }
+                handle.destroy();
+                return std::noop_coroutine();
+            }
+            return promise.continuation ? promise.continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& result) {
+        value.emplace(std::forward<U>(result));
+    }
+
+    T result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+}
+
+template <typename T>
+class Task {
+public:
+    typedef detail::TaskPromise<T> promise_type;
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+        handle.promise().continuation = continuation;
+        return handle;
+    }
+
+    T await_resume() { return handle.promise().result(); }
+
+    // 在当前线程开始执行，任务结束后自行销毁
+    void detach() {
+        std::coroutine_handle<promise_type> started = std::exchange(handle, {});
+        started.promise().detached = true;
+        started.resume();
+    }
+
+private:
+    friend struct detail::TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+template <typename T>
+Task<void> completeInto(Task<T> task, std::shared_ptr<std::promise<T>> done) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await task;
+            done->set_value();
+        } else {
+            done->set_value(co_await task);
+        }
+    } catch (...) {
+        done->set_exception(std::current_exception());
+    }
+}
+
+}
+
+// 在当前线程启动任务并阻塞等待它完成，用于 main 等普通线程；不能在传输线程上调用
+template <typename T>
+T syncWait(Task<T> task) {
+    auto done = std::make_shared<std::promise<T>>();
+    std::future<T> result = done->get_future();
+    detail::completeInto(std::move(task), done).detach();
+    return result.get();
+}
+
+#endif // CRYPTOLINK_HAVE_COROUTINES
+
+#endif // TASK_H
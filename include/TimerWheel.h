@@ -0,0 +1,58 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+// 分层时间轮：4 层，每层 64 个槽
+// 所有会话共用一个时间轮，由事件循环上的单个周期定时器推进，添加/取消都是 O(1)
+// 非线程安全，只能在事件循环线程使用
+class TimerWheel {
+public:
+    typedef uint64_t TimerId;
+    typedef std::function<void()> Callback;
+
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 6;
+    static constexpr int kSlotsPerLevel = 1 << kSlotBits;
+
+    explicit TimerWheel(std::chrono::milliseconds tickInterval = std::chrono::milliseconds(100));
+
+    // 添加定时器，delay 向上取整到刻度，返回定时器编号
+    TimerId schedule(std::chrono::milliseconds delay, Callback callback);
+
+    // 取消定时器，已触发或不存在时返回 false
+    bool cancel(TimerId id);
+
+    // 推进到指定时刻并触发到期的定时器，返回触发数量
+    size_t advance(std::chrono::steady_clock::time_point now);
+
+    // 当前挂起的定时器数量
+    size_t size() const { return timers.size(); }
+
+    std::chrono::milliseconds getTickInterval() const { return tickInterval; }
+
+private:
+    struct Timer {
+        uint64_t expiry;
+        Callback callback;
+        std::list<TimerId>* slot;
+        std::list<TimerId>::iterator position;
+    };
+
+    std::chrono::milliseconds tickInterval;
+    std::chrono::steady_clock::time_point startTime;
+    uint64_t currentTick;
+    TimerId nextTimerId;
+    std::unordered_map<TimerId, Timer> timers;
+    std::list<TimerId> slots[kLevels][kSlotsPerLevel];
+
+    void place(TimerId id, Timer& timer);
+    void cascade(int level);
+    size_t fireCurrentSlot();
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,75 @@
+#ifndef TOPIC_INDEX_H
+#define TOPIC_INDEX_H
+
+#include "BufferPool.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 主题订阅索引
+// 主题以 '/' 分段；订阅模式支持 MQTT 风格通配符：
+//   '+' 匹配单个分段，'#' 只能出现在最后，匹配剩余任意多个分段（含零个）
+// 精确主题走哈希表，含通配符的模式走分段前缀树，发布时只访问匹配的订阅者
+class TopicIndex {
+public:
+    typedef uint64_t SubscriberId;
+
+    TopicIndex();
+    ~TopicIndex();
+
+    // 添加订阅，重复订阅返回 false
+    bool subscribe(SubscriberId subscriber, const std::string& pattern);
+
+    // 取消订阅，未订阅时返回 false
+    bool unsubscribe(SubscriberId subscriber, const std::string& pattern);
+
+    // 移除订阅者的全部订阅（连接关闭时调用）
+    void removeSubscriber(SubscriberId subscriber);
+
+    // 查找匹配主题的订阅者（结果去重）
+    void match(std::string_view topic, std::vector<SubscriberId>& subscribers) const;
+
+    // 订阅者当前的订阅模式
+    std::vector<std::string> getSubscriptions(SubscriberId subscriber) const;
+
+    // 订阅条目总数
+    size_t subscriptionCount() const { return totalSubscriptions; }
+
+    // 校验订阅模式是否合法
+    static bool isValidPattern(const std::string& pattern);
+
+    // 校验发布主题是否合法（不能包含通配符）
+    static bool isValidTopic(std::string_view topic);
+
+    // 发布记录的负载格式：2字节主题长度（大端） | 主题 | 消息
+    static PooledBuffer encodePublication(std::string_view topic, std::string_view message, BufferPool& pool);
+    static bool decodePublication(std::string_view payload, std::string_view& topic, std::string_view& message);
+
+private:
+    struct Node {
+        std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+        std::unique_ptr<Node> singleLevel;          // '+'
+        std::vector<SubscriberId> multiLevel;       // '#'
+        std::vector<SubscriberId> subscribers;      // 模式在此结束
+    };
+
+    std::unordered_map<std::string, std::vector<SubscriberId>> exactSubscriptions;
+    std::unique_ptr<Node> wildcardRoot;
+    std::unordered_map<SubscriberId, std::vector<std::string>> subscriptionsBySubscriber;
+    size_t totalSubscriptions;
+
+    static bool hasWildcard(const std::string& pattern);
+    static std::vector<std::string_view> splitSegments(std::string_view text);
+
+    std::vector<SubscriberId>* wildcardSlot(const std::string& pattern, bool create);
+    void collectMatches(const Node* node, const std::vector<std::string_view>& segments, size_t depth,
+                        std::vector<SubscriberId>& subscribers) const;
+    bool prunePath(Node* node, const std::vector<std::string_view>& segments, size_t depth);
+};
+
+#endif // TOPIC_INDEX_H
@@ -0,0 +1,105 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <websocketpp/common/connection_hdl.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace boost {
+namespace asio {
+class io_context;
+}
+}
+
+// 消息传输层接口
+// 握手和记录层只依赖这个接口，传输后端负责连接管理和消息分帧
+// 连接句柄沿用 websocketpp::connection_hdl（指向连接对象的 weak_ptr），各后端下回调签名保持一致
+class Transport {
+public:
+    typedef websocketpp::connection_hdl Handle;
+
+    enum class FrameType : uint8_t {
+        TEXT = 1,
+        BINARY = 2
+    };
+
+    // 关闭原因码，与 WebSocket 关闭码取值一致
+    enum CloseCode : uint16_t {
+        CLOSE_NORMAL = 1000,
+        CLOSE_GOING_AWAY = 1001,
+        CLOSE_POLICY_VIOLATION = 1008
+    };
+
+    struct Handlers {
+        std::function<void(Handle)> onOpen;
+        std::function<void(Handle)> onClose;
+        std::function<void(Handle)> onFail;
+        // 负载可写，记录层直接在接收缓冲区内原地解密
+        std::function<void(Handle, FrameType, std::string&)> onMessage;
+        std::function<void(Handle)> onPong;
+    };
+
+    virtual ~Transport() = default;
+
+    // 在 listen/connect 之前设置
+    virtual void setHandlers(Handlers handlers) = 0;
+
+    // 服务端开始监听，地址格式由后端决定（端口、host:port 或套接字路径）
+    virtual bool listen(const std::string& address) = 0;
+
+    // 客户端发起连接，连接建立后触发 onOpen，失败触发 onFail
+    virtual bool connect(const std::string& address) = 0;
+
+    // 可以在任意线程调用
+    virtual bool send(Handle hdl, const char* data, size_t length, FrameType type) = 0;
+    virtual void close(Handle hdl, uint16_t code, const std::string& reason) = 0;
+    virtual void ping(Handle hdl) = 0;
+
+    // 已交给传输层但尚未写入套接字的字节数，只能在事件循环线程上调用
+    // 发送方据此控制排队深度，让高优先级记录不必排在大量已提交的数据之后
+    virtual size_t bufferedAmount(Handle hdl) = 0;
+
+    // 在事件循环线程上延迟执行回调，事件循环停止后不再执行
+    virtual void setTimer(std::chrono::milliseconds delay, std::function<void()> callback) = 0;
+
+    // 可以在任意线程调用，把任务投递到事件循环线程上尽快执行
+    virtual void post(std::function<void()> task) = 0;
+
+    // 在事件循环线程上求值并等待结果，供其他线程读取只在事件循环上更新的状态；
+    // 不能在事件循环线程上调用，事件循环没有运行、任务不再执行时等到超时返回空
+    template <typename Result>
+    std::optional<Result> call(std::function<Result()> evaluate, std::chrono::milliseconds timeout) {
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(evaluate));
+        std::future<Result> result = task->get_future();
+        post([task]() {
+            (*task)();
+        });
+        if (result.wait_for(timeout) != std::future_status::ready) {
+            return std::nullopt;
+        }
+        try {
+            return result.get();
+        } catch (const std::future_error&) {
+            // 传输停止时丢弃了未执行的任务
+            return std::nullopt;
+        }
+    }
+
+    // 运行事件循环（阻塞），stop 可以在任意线程调用
+    virtual void run() = 0;
+    virtual void stop() = 0;
+
+    // 按 URI 协议创建传输后端：ws://（默认）、tcp://、unix://
+    // address 输出交给 listen/connect 的地址
+    // 指定 loop 时传输运行在这个共享的事件循环上：run 不做任何事，由循环的所有者在一个线程上运行它，
+    // stop 只关闭本传输的连接（不触发回调），传输必须在循环线程上（或循环已停止后）销毁
+    static std::unique_ptr<Transport> create(const std::string& uri, bool server, std::string& address,
+                                             boost::asio::io_context* loop = nullptr);
+};
+
+#endif // TRANSPORT_H
@@ -0,0 +1,182 @@
+#ifndef URING_TRANSPORT_H
+#define URING_TRANSPORT_H
+
+#ifdef CRYPTOLINK_HAVE_IO_URING
+
+#include "Transport.h"
+#include "BufferPool.h"
+#include <liburing.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/uio.h>
+
+// io_uring 传输后端（Linux），帧格式与 StreamTransport 相同，两端可以混用
+// - 事件循环每轮只调用一次 io_uring_submit_and_wait，批量提交请求、批量收割完成事件
+// - accept 和 recv 都使用 multishot，接收缓冲区来自注册给内核的缓冲区环，不需要每次重新投递
+// - 小帧合并拷贝到注册过的固定发送缓冲区后用一次 send 发出；大帧直接从池化缓冲区 sendmsg 聚集发送
+// - 所有发送都带 MSG_NOSIGNAL，对端关闭时得到 EPIPE 而不是 SIGPIPE，不修改进程的信号处理
+// 内核或运行环境不支持时 create 返回 nullptr，由调用方回退到基于 epoll 的 StreamTransport
+class UringTransport : public Transport {
+public:
+    enum class Family {
+        TCP,
+        UNIX
+    };
+
+    static constexpr size_t kFrameHeaderSize = 5;
+    static constexpr size_t kMaxMessageSize = 32 * 1024 * 1024;
+
+    // 创建并初始化，不支持 io_uring 时返回 nullptr
+    static std::unique_ptr<UringTransport> create(Family family);
+
+    ~UringTransport() override;
+
+    void setHandlers(Handlers handlers) override;
+    bool listen(const std::string& address) override;
+    bool connect(const std::string& address) override;
+    bool send(Handle hdl, const char* data, size_t length, FrameType type) override;
+    void close(Handle hdl, uint16_t code, const std::string& reason) override;
+    void ping(Handle hdl) override;
+    size_t bufferedAmount(Handle hdl) override;
+    void setTimer(std::chrono::milliseconds delay, std::function<void()> callback) override;
+    void post(std::function<void()> task) override;
+    void run() override;
+    void stop() override;
+
+private:
+    // 完成事件的 user_data：高 8 位为操作类型，低 56 位为连接编号
+    enum Operation : uint64_t {
+        OP_ACCEPT = 1,
+        OP_CONNECT = 2,
+        OP_RECV = 3,
+        OP_SEND = 4,
+        OP_WAKE = 5
+    };
+
+    enum WireType : uint8_t {
+        WIRE_TEXT = 1,
+        WIRE_BINARY = 2,
+        WIRE_PING = 3,
+        WIRE_PONG = 4
+    };
+
+    struct Connection {
+        uint64_t id = 0;
+        int fd = -1;
+        std::string inbound;            // 跨多次 recv 的半帧
+        size_t inboundOffset = 0;
+        std::string payload;            // 当前帧负载，记录层在其中原地解密
+        std::deque<PooledBuffer> writeQueue;
+        size_t queuedBytes = 0;
+        std::vector<iovec> writeVectors;
+        msghdr writeMessage;
+        size_t inflightFrames = 0;
+        size_t inflightBytes = 0;
+        size_t writtenBytes = 0;
+        int sendSlot = -1;
+        bool sendFixed = false;         // 在途的 send 是否带了 IORING_RECVSEND_FIXED_BUF
+        bool writing = false;
+        int pendingOps = 0;
+        std::atomic<bool> open{false};
+        bool closing = false;
+        bool closed = false;
+        sockaddr_storage peer;
+        socklen_t peerLength = 0;
+    };
+    typedef std::shared_ptr<Connection> ConnectionPtr;
+
+    struct Timer {
+        std::chrono::steady_clock::time_point deadline;
+        uint64_t sequence;
+        std::function<void()> callback;
+
+        bool operator>(const Timer& other) const {
+            return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+        }
+    };
+
+    explicit UringTransport(Family family);
+    bool initialize();
+
+    Family family;
+    io_uring ring;
+    bool ringReady;
+    Handlers handlers;
+
+    // 多发 recv 使用的缓冲区环
+    io_uring_buf_ring* recvRing;
+    std::vector<char> recvBuffers;
+
+    // 注册给内核的固定发送缓冲区，按槽分配
+    std::vector<char> sendArena;
+    std::vector<int> freeSendSlots;
+    bool sendArenaRegistered;
+    bool fixedSendSupported;    // 内核是否接受 send 使用固定缓冲区（IORING_RECVSEND_FIXED_BUF）
+
+    int listenFd;
+    std::string listenPath;
+    int wakeFd;
+    uint64_t wakeValue;
+
+    std::unordered_map<uint64_t, ConnectionPtr> connections;
+    uint64_t nextConnectionId;
+
+    // 其他线程提交的发送、关闭和定时器，由事件循环线程统一处理
+    std::mutex inboxMutex;
+    std::vector<std::pair<ConnectionPtr, PooledBuffer>> pendingSends;
+    std::vector<ConnectionPtr> pendingCloses;
+    std::vector<std::function<void()>> pendingTasks;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    uint64_t nextTimerSequence;
+    std::atomic<bool> wakeRequested;
+
+    std::atomic<bool> running;
+    std::atomic<std::thread::id> loopThread;
+
+    io_uring_sqe* getSqe();
+    static uint64_t userData(Operation op, uint64_t id) { return (op << 56) | (id & ((uint64_t(1) << 56) - 1)); }
+
+    bool resolve(const std::string& address, bool passive, sockaddr_storage& storage, socklen_t& length);
+    void configureSocket(int fd);
+
+    void armAccept();
+    void armRecv(const ConnectionPtr& connection);
+    void armWake();
+    void wake();
+
+    void recycleBuffer(unsigned bufferId);
+
+    void handleCompletion(io_uring_cqe* cqe);
+    void handleAccept(io_uring_cqe* cqe);
+    void handleRecv(const ConnectionPtr& connection, io_uring_cqe* cqe);
+    void handleSend(const ConnectionPtr& connection, int result);
+    void startSession(const ConnectionPtr& connection);
+
+    // 从接收数据中切出完整的帧并分发
+    void consume(const ConnectionPtr& connection, const char* data, size_t length);
+    size_t parseFrames(const ConnectionPtr& connection, const char* data, size_t length);
+    void dispatchFrame(const ConnectionPtr& connection, uint8_t type);
+
+    bool sendFrame(Handle hdl, uint8_t type, const char* data, size_t length);
+    void enqueue(const ConnectionPtr& connection, PooledBuffer frame);
+    void startWrite(const ConnectionPtr& connection);
+    void submitWrite(const ConnectionPtr& connection);
+    void releaseSendSlot(const ConnectionPtr& connection);
+
+    void drainInbox();
+    int runTimers();
+
+    void beginClose(const ConnectionPtr& connection);
+    void shutdown(const ConnectionPtr& connection);
+    void finish(const ConnectionPtr& connection);
+    void release(const ConnectionPtr& connection);
+};
+
+#endif // CRYPTOLINK_HAVE_IO_URING
+
+#endif // URING_TRANSPORT_H
@@ -0,0 +1,54 @@
+#ifndef WEBSOCKET_TRANSPORT_H
+#define WEBSOCKET_TRANSPORT_H
+
+#include "Logger.h"
+#include "Transport.h"
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/server.hpp>
+#include <websocketpp/client.hpp>
+#include <memory>
+#include <set>
+
+// 基于 websocketpp 的 WebSocket 传输
+// 服务端监听地址为端口或 host:port，客户端连接地址为完整的 ws:// URI
+// 运行在共享的事件循环上时，websocketpp 的日志写入随事件循环存在的日志流，传输销毁后仍在收尾的连接也能写日志
+template <typename Endpoint>
+class WebSocketTransport : public Transport {
+public:
+    // loop 为空时使用自己的事件循环
+    explicit WebSocketTransport(boost::asio::io_context* loop = nullptr);
+    ~WebSocketTransport() override;
+
+    void setHandlers(Handlers handlers) override;
+    bool listen(const std::string& address) override;
+    bool connect(const std::string& address) override;
+    bool send(Handle hdl, const char* data, size_t length, FrameType type) override;
+    void close(Handle hdl, uint16_t code, const std::string& reason) override;
+    void ping(Handle hdl) override;
+    size_t bufferedAmount(Handle hdl) override;
+    void setTimer(std::chrono::milliseconds delay, std::function<void()> callback) override;
+    void post(std::function<void()> task) override;
+    void run() override;
+    void stop() override;
+
+private:
+    // websocketpp 的访问日志和错误日志经由异步日志输出，必须比 endpoint 活得久
+    LogStream accessLog;
+    LogStream errorLog;
+    Endpoint endpoint;
+    Handlers handlers;
+    bool sharedLoop;
+
+    // 共享事件循环时记录打开的连接，stop 时逐个关闭；回调持有弱引用，传输销毁或停止后不再执行
+    std::set<Handle, std::owner_less<Handle>> openHandles;
+    std::shared_ptr<bool> alive;
+    typedef std::weak_ptr<bool> Guard;
+
+    void closeAll();
+};
+
+typedef WebSocketTransport<websocketpp::server<websocketpp::config::asio>> WebSocketServerTransport;
+typedef WebSocketTransport<websocketpp::client<websocketpp::config::asio_client>> WebSocketClientTransport;
+
+#endif // WEBSOCKET_TRANSPORT_H
@@ -1,9 +1,10 @@
 #include "AESKey.h"
+#include "Logger.h"
 #include <cryptopp/aes.h>
 #include <cryptopp/modes.h>
 #include <cryptopp/filters.h>
 #include <cryptopp/hex.h>
-#include <iostream>
+#include <cstring>
 
 AESKey::AESKey() = default;
 
@@ -15,42 +16,73 @@ bool AESKey::generateRawKey() {
         byte key[32];  // AES-256 需要32字节密钥
         rng.GenerateBlock(key, sizeof(key));
         localKey = base64Encode(std::string((char*)key, sizeof(key)));
+        localKeyRaw.Assign(key, sizeof(key));
         
         // 生成IV（16字节）
         byte iv[AES::BLOCKSIZE];
         rng.GenerateBlock(iv, sizeof(iv));
         localIV = base64Encode(std::string((char*)iv, sizeof(iv)));
+        localIVRaw.Assign(iv, sizeof(iv));
         
         return true;
     } catch (const Exception& e) {
-        std::cerr << "AES密钥生成失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("AES密钥生成失败: " << e.what());
         return false;
     }
 }
 
 std::string AESKey::encryptWithLocal(const std::string& plaintext) {
-    return aesEncrypt(plaintext, localKey, localIV);
+    return aesEncrypt(plaintext, localKeyRaw, localIVRaw);
 }
 
 std::string AESKey::decryptWithLocal(const std::string& ciphertext) {
-    return aesDecrypt(ciphertext, localKey, localIV);
+    return aesDecrypt(ciphertext, localKeyRaw, localIVRaw);
 }
 
 std::string AESKey::encryptWithRemote(const std::string& plaintext) {
-    return aesEncrypt(plaintext, remoteKey, remoteIV);
+    return aesEncrypt(plaintext, remoteKeyRaw, remoteIVRaw);
 }
 
 std::string AESKey::decryptWithRemote(const std::string& ciphertext) {
-    return aesDecrypt(ciphertext, remoteKey, remoteIV);
+    return aesDecrypt(ciphertext, remoteKeyRaw, remoteIVRaw);
+}
+
+PooledBuffer AESKey::decryptWithLocal(std::string_view ciphertext, BufferPool& pool) {
+    return aesDecrypt(ciphertext, localKeyRaw, localIVRaw, pool);
+}
+
+PooledBuffer AESKey::decryptWithRemote(std::string_view ciphertext, BufferPool& pool) {
+    return aesDecrypt(ciphertext, remoteKeyRaw, remoteIVRaw, pool);
+}
+
+PooledBuffer AESKey::encryptWithLocalRaw(std::string_view plaintext, size_t headroom, BufferPool& pool) {
+    return aesEncryptRaw(plaintext, headroom, localKeyRaw, localIVRaw, pool);
+}
+
+PooledBuffer AESKey::encryptWithRemoteRaw(std::string_view plaintext, size_t headroom, BufferPool& pool) {
+    return aesEncryptRaw(plaintext, headroom, remoteKeyRaw, remoteIVRaw, pool);
+}
+
+bool AESKey::decryptWithLocalInPlace(char* data, size_t& length) {
+    return aesDecryptInPlace(data, length, localKeyRaw, localIVRaw);
+}
+
+bool AESKey::decryptWithRemoteInPlace(char* data, size_t& length) {
+    return aesDecryptInPlace(data, length, remoteKeyRaw, remoteIVRaw);
 }
 
 bool AESKey::setRemotePublicKey(const std::string& keyString, const std::string& iv) {
     try {
         remoteKey = keyString;
         remoteIV = iv;
+        
+        std::string keyDecoded = base64Decode(keyString);
+        std::string ivDecoded = base64Decode(iv);
+        remoteKeyRaw.Assign((const byte*)keyDecoded.data(), keyDecoded.size());
+        remoteIVRaw.Assign((const byte*)ivDecoded.data(), ivDecoded.size());
         return true;
     } catch (const Exception& e) {
-        std::cerr << "设置远程密钥失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("设置远程密钥失败: " << e.what());
         return false;
     }
 }
@@ -88,16 +120,12 @@ std::string AESKey::base64Decode(const std::string& data) const {
     return decoded;
 }
 
-std::string AESKey::aesEncrypt(const std::string& plaintext, const std::string& key, const std::string& iv) const {
+std::string AESKey::aesEncrypt(const std::string& plaintext, const SecByteBlock& key, const SecByteBlock& iv) const {
     try {
-        std::string keyDecoded = base64Decode(key);
-        std::string ivDecoded = base64Decode(iv);
-        
         std::string ciphertext;
         
         CBC_Mode<AES>::Encryption encryption;
-        encryption.SetKeyWithIV((const byte*)keyDecoded.c_str(), keyDecoded.size(),
-                               (const byte*)ivDecoded.c_str());
+        encryption.SetKeyWithIV(key, key.size(), iv);
         
         StringSource ss(plaintext, true,
             new StreamTransformationFilter(encryption,
@@ -107,22 +135,19 @@ std::string AESKey::aesEncrypt(const std::string& plaintext, const std::string&
         
         return base64Encode(ciphertext);
     } catch (const Exception& e) {
-        std::cerr << "AES加密失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("AES加密失败: " << e.what());
         return "";
     }
 }
 
-std::string AESKey::aesDecrypt(const std::string& ciphertext, const std::string& key, const std::string& iv) const {
+std::string AESKey::aesDecrypt(const std::string& ciphertext, const SecByteBlock& key, const SecByteBlock& iv) const {
     try {
-        std::string keyDecoded = base64Decode(key);
-        std::string ivDecoded = base64Decode(iv);
         std::string ciphertextDecoded = base64Decode(ciphertext);
         
         std::string recovered;
         
         CBC_Mode<AES>::Decryption decryption;
-        decryption.SetKeyWithIV((const byte*)keyDecoded.c_str(), keyDecoded.size(),
-                               (const byte*)ivDecoded.c_str());
+        decryption.SetKeyWithIV(key, key.size(), iv);
         
         StringSource ss(ciphertextDecoded, true,
             new StreamTransformationFilter(decryption,
@@ -132,7 +157,94 @@ std::string AESKey::aesDecrypt(const std::string& ciphertext, const std::string&
         
         return recovered;
     } catch (const Exception& e) {
-        std::cerr << "AES解密失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_WARNING("AES解密失败: " << e.what());
         return "";
     }
 }
+
+PooledBuffer AESKey::aesDecrypt(std::string_view ciphertext, const SecByteBlock& key, const SecByteBlock& iv, BufferPool& pool) const {
+    try {
+        // Base64解码后的长度不会超过输入的3/4
+        size_t decodedCapacity = ciphertext.size() / 4 * 3 + 3;
+        PooledBuffer decoded = pool.acquire(decodedCapacity);
+        
+        ArraySink* decodedSink = new ArraySink((byte*)decoded.data(), decodedCapacity);
+        Base64Decoder decoder(decodedSink);
+        decoder.Put((const byte*)ciphertext.data(), ciphertext.size());
+        decoder.MessageEnd();
+        decoded.resize(decodedSink->TotalPutLength());
+        
+        // 明文长度不会超过密文长度
+        PooledBuffer recovered = pool.acquire(decoded.size());
+        
+        CBC_Mode<AES>::Decryption decryption;
+        decryption.SetKeyWithIV(key, key.size(), iv);
+        
+        ArraySink* recoveredSink = new ArraySink((byte*)recovered.data(), recovered.capacity());
+        StreamTransformationFilter filter(decryption, recoveredSink);
+        filter.Put((const byte*)decoded.data(), decoded.size());
+        filter.MessageEnd();
+        recovered.resize(recoveredSink->TotalPutLength());
+        
+        return recovered;
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_WARNING("AES解密失败: " << e.what());
+        return PooledBuffer();
+    }
+}
+
+PooledBuffer AESKey::aesEncryptRaw(std::string_view plaintext, size_t headroom, const SecByteBlock& key, const SecByteBlock& iv, BufferPool& pool) const {
+    try {
+        size_t padding = AES::BLOCKSIZE - plaintext.size() % AES::BLOCKSIZE;
+        size_t cipherLength = plaintext.size() + padding;
+        
+        PooledBuffer buffer = pool.acquire(headroom + cipherLength);
+        buffer.resize(headroom + cipherLength);
+        
+        // 先拷贝明文并写入PKCS#7填充，再在同一块内存上原地加密
+        byte* cipher = (byte*)buffer.data() + headroom;
+        std::memcpy(cipher, plaintext.data(), plaintext.size());
+        std::memset(cipher + plaintext.size(), (int)padding, padding);
+        
+        CBC_Mode<AES>::Encryption encryption;
+        encryption.SetKeyWithIV(key, key.size(), iv);
+        encryption.ProcessData(cipher, cipher, cipherLength);
+        
+        return buffer;
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("AES加密失败: " << e.what());
+        return PooledBuffer();
+    }
+}
+
+bool AESKey::aesDecryptInPlace(char* data, size_t& length, const SecByteBlock& key, const SecByteBlock& iv) const {
+    try {
+        if (length == 0 || length % AES::BLOCKSIZE != 0) {
+            CRYPTOLINK_LOG_WARNING("AES解密失败: 密文长度不是分组长度的整数倍");
+            return false;
+        }
+        
+        CBC_Mode<AES>::Decryption decryption;
+        decryption.SetKeyWithIV(key, key.size(), iv);
+        decryption.ProcessData((byte*)data, (const byte*)data, length);
+        
+        // 校验并去除PKCS#7填充
+        size_t padding = (byte)data[length - 1];
+        if (padding == 0 || padding > AES::BLOCKSIZE) {
+            CRYPTOLINK_LOG_WARNING("AES解密失败: 填充无效");
+            return false;
+        }
+        for (size_t i = length - padding; i < length; ++i) {
+            if ((byte)data[i] != padding) {
+                CRYPTOLINK_LOG_WARNING("AES解密失败: 填充无效");
+                return false;
+            }
+        }
+        
+        length -= padding;
+        return true;
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_WARNING("AES解密失败: " << e.what());
+        return false;
+    }
+}
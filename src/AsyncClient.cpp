@@ -0,0 +1,171 @@
+#include "AsyncClient.h"
+
+#ifdef CRYPTOLINK_HAVE_COROUTINES
+
+#include <algorithm>
+#include <thread>
+
+AsyncClient::AsyncClient(CryptoWebSocketClient& client)
+    : client(client), state(State::IDLE) {
+    client.setConnectCallback([this](bool connected) {
+        onConnect(connected);
+    });
+    client.setHandshakeCallback([this]() {
+        onHandshake();
+    });
+    client.setMessageCallback([this](std::string_view message) {
+        inbox.deliver(message);
+    });
+}
+
+AsyncClient::~AsyncClient() {
+    client.setConnectCallback(nullptr);
+    client.setHandshakeCallback(nullptr);
+    client.setMessageCallback(std::function<void(std::string_view)>());
+}
+
+AsyncClient::StateAwaiter AsyncClient::connect(const std::string& uri) {
+    return StateAwaiter(*this, false, uri);
+}
+
+AsyncClient::StateAwaiter AsyncClient::handshake() {
+    return StateAwaiter(*this, true, std::string());
+}
+
+AsyncClient::SendAwaiter AsyncClient::send(std::string message, SendPriority priority) {
+    return SendAwaiter(client, std::move(message), priority);
+}
+
+AsyncClient::CallAwaiter AsyncClient::call(std::string method, std::string request,
+                                           std::chrono::milliseconds timeout, SendPriority priority) {
+    return CallAwaiter(client, std::move(method), std::move(request), timeout, priority);
+}
+
+bool AsyncClient::StateAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    this->handle = handle;
+
+    if (!uri.empty()) {
+        // 传输线程不能停止并等待它自己，换到临时线程上重新连接
+        if (owner.client.inTransportThread()) {
+            std::thread([this, handle]() {
+                if (!startConnect()) {
+                    handle.resume();
+                }
+            }).detach();
+            return true;
+        }
+        return startConnect();
+    }
+
+    std::lock_guard<std::mutex> lock(owner.mutex);
+    switch (owner.state) {
+        case State::ESTABLISHED:
+            result = true;
+            return false;
+        case State::IDLE:
+        case State::CLOSED:
+            result = false;
+            return false;
+        default:
+            break;
+    }
+    (waitHandshake ? owner.handshakeWaiters : owner.openWaiters).push_back(this);
+    return true;
+}
+
+bool AsyncClient::StateAwaiter::startConnect() {
+    AsyncClient& owner = this->owner;
+    StateAwaiter* self = this;
+
+    // 先停止旧的传输线程；等待在发起连接之前登记，使用共享事件循环时连接回调可能早于 connect 返回
+    owner.client.stop();
+    owner.inbox.reset();
+    {
+        std::lock_guard<std::mutex> lock(owner.mutex);
+        owner.state = State::CONNECTING;
+        owner.openWaiters.push_back(self);
+    }
+
+    if (!owner.client.connect(uri)) {
+        std::lock_guard<std::mutex> lock(owner.mutex);
+        auto it = std::find(owner.openWaiters.begin(), owner.openWaiters.end(), self);
+        if (it == owner.openWaiters.end()) {
+            // 失败回调已经恢复了协程，本对象可能已经销毁
+            return true;
+        }
+        owner.openWaiters.erase(it);
+        owner.state = State::CLOSED;
+        result = false;
+        return false;
+    }
+
+    // 之后本对象随时可能被回调恢复并销毁，只能使用局部变量
+    owner.client.run();
+    return true;
+}
+
+bool AsyncClient::SendAwaiter::await_ready() {
+    result = client.sendEncryptedMessage(message, priority);
+    return !result;
+}
+
+bool AsyncClient::SendAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    // 恢复任务排在已投递的发送任务之后，同一连接上的大量协程轮流推进
+    return client.post([handle]() {
+        handle.resume();
+    });
+}
+
+bool AsyncClient::CallAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    // 应答可能在 call 返回之前就在传输线程上恢复协程，发出请求之后不能再访问本对象
+    RpcSession::CallId id = client.call(method, request, [this, handle](RpcSession::Status status, std::string_view payload) {
+        result.status = status;
+        result.payload.assign(payload.data(), payload.size());
+        handle.resume();
+    }, timeout, priority);
+    if (id == 0) {
+        result.status = RpcSession::Status::DISCONNECTED;
+        return false;
+    }
+    return true;
+}
+
+void AsyncClient::onConnect(bool connected) {
+    std::vector<StateAwaiter*> opened;
+    std::vector<StateAwaiter*> established;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        state = connected ? State::OPEN : State::CLOSED;
+        opened.swap(openWaiters);
+        if (!connected) {
+            established.swap(handshakeWaiters);
+        }
+    }
+    resumeAll(opened, connected);
+    resumeAll(established, false);
+    if (!connected) {
+        inbox.close();
+    }
+}
+
+void AsyncClient::onHandshake() {
+    std::vector<StateAwaiter*> opened;
+    std::vector<StateAwaiter*> established;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        state = State::ESTABLISHED;
+        opened.swap(openWaiters);
+        established.swap(handshakeWaiters);
+    }
+    resumeAll(opened, true);
+    resumeAll(established, true);
+}
+
+void AsyncClient::resumeAll(std::vector<StateAwaiter*>& waiters, bool result) {
+    for (StateAwaiter* waiter : waiters) {
+        waiter->result = result;
+        waiter->handle.resume();
+    }
+}
+
+#endif // CRYPTOLINK_HAVE_COROUTINES
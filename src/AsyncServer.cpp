@@ -0,0 +1,122 @@
+#include "AsyncServer.h"
+
+#ifdef CRYPTOLINK_HAVE_COROUTINES
+
+#include <vector>
+
+bool AsyncSession::SendAwaiter::await_ready() {
+    result = server.sendEncryptedMessage(hdl, message, priority);
+    return !result;
+}
+
+bool AsyncSession::SendAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    return server.post([handle]() {
+        handle.resume();
+    });
+}
+
+AsyncServer::AsyncServer(CryptoWebSocketServer& server)
+    : server(server), closed(false) {
+    server.setHandshakeCallback([this](websocketpp::connection_hdl hdl) {
+        onHandshake(hdl);
+    });
+    server.setCloseCallback([this](websocketpp::connection_hdl hdl) {
+        onClose(hdl);
+    });
+    server.setMessageCallback([this](websocketpp::connection_hdl hdl, std::string_view message) {
+        onMessage(hdl, message);
+    });
+}
+
+AsyncServer::~AsyncServer() {
+    server.setHandshakeCallback(nullptr);
+    server.setCloseCallback(nullptr);
+    server.setMessageCallback(std::function<void(websocketpp::connection_hdl, std::string_view)>());
+    close();
+}
+
+bool AsyncServer::AcceptAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> lock(owner.mutex);
+    if (!owner.pending.empty()) {
+        result.emplace(std::move(owner.pending.front()));
+        owner.pending.pop_front();
+        return false;
+    }
+    if (owner.closed) {
+        return false;
+    }
+    this->handle = handle;
+    owner.acceptors.push_back(this);
+    return true;
+}
+
+void AsyncServer::close() {
+    std::deque<AcceptAwaiter*> waiting;
+    std::vector<std::shared_ptr<MessageInbox>> open;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        waiting.swap(acceptors);
+        for (auto& entry : inboxes) {
+            open.push_back(entry.second);
+        }
+        inboxes.clear();
+        pending.clear();
+    }
+    for (AcceptAwaiter* acceptor : waiting) {
+        acceptor->result.reset();
+        acceptor->handle.resume();
+    }
+    for (auto& inbox : open) {
+        inbox->close();
+    }
+}
+
+void AsyncServer::onHandshake(websocketpp::connection_hdl hdl) {
+    auto inbox = std::make_shared<MessageInbox>();
+    AcceptAwaiter* acceptor = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed) {
+            return;
+        }
+        inboxes[hdl] = inbox;
+        if (acceptors.empty()) {
+            pending.push_back(AsyncSession(server, hdl, inbox));
+            return;
+        }
+        acceptor = acceptors.front();
+        acceptors.pop_front();
+    }
+    acceptor->result.emplace(AsyncSession(server, hdl, inbox));
+    acceptor->handle.resume();
+}
+
+void AsyncServer::onClose(websocketpp::connection_hdl hdl) {
+    std::shared_ptr<MessageInbox> inbox;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = inboxes.find(hdl);
+        if (it == inboxes.end()) {
+            return;
+        }
+        inbox = std::move(it->second);
+        inboxes.erase(it);
+    }
+    inbox->close();
+}
+
+void AsyncServer::onMessage(websocketpp::connection_hdl hdl, std::string_view message) {
+    std::shared_ptr<MessageInbox> inbox;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = inboxes.find(hdl);
+        if (it == inboxes.end()) {
+            return;
+        }
+        inbox = it->second;
+    }
+    inbox->deliver(message);
+}
+
+#endif // CRYPTOLINK_HAVE_COROUTINES
@@ -0,0 +1,278 @@
+#include "BufferPool.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <set>
+
+const size_t BufferPool::kSizeClasses[BufferPool::kNumSizeClasses] = {
+    256, 1024, 4096, 16384, 65536, 262144, 1048576
+};
+
+// 缓冲池的共享状态，由池本身和所有已分配的块共同持有
+// 池析构后仍在外部流转的块归还时直接释放，最后一个块释放时销毁该结构
+struct BufferPoolCore {
+    std::thread::id ownerThread;
+    size_t maxCachedPerClass;
+    std::vector<BufferBlock*> freeLists[BufferPool::kNumSizeClasses];
+    std::atomic<BufferBlock*> returnStack{nullptr};
+    std::atomic<bool> closed{false};
+    std::atomic<uint64_t> refs{1};
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> oversize{0};
+    std::atomic<uint64_t> releases{0};
+    std::atomic<uint64_t> foreignReleases{0};
+    std::atomic<uint64_t> cachedBlocks{0};
+    std::atomic<uint64_t> cachedBytes{0};
+};
+
+namespace {
+
+std::mutex registryMutex;
+std::set<BufferPoolCore*> registry;
+
+BufferBlock* allocateBlock(BufferPoolCore* core, uint32_t sizeClass, size_t capacity) {
+    void* memory = ::operator new(sizeof(BufferBlock) + capacity);
+    BufferBlock* block = new (memory) BufferBlock;
+    block->sizeClass = sizeClass;
+    block->capacity = capacity;
+    block->core = core;
+    core->refs.fetch_add(1, std::memory_order_relaxed);
+    return block;
+}
+
+void dropCoreRef(BufferPoolCore* core) {
+    if (core->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete core;
+    }
+}
+
+void freeBlock(BufferBlock* block) {
+    BufferPoolCore* core = block->core;
+    block->~BufferBlock();
+    ::operator delete(block);
+    dropCoreRef(core);
+}
+
+void freeBlockList(BufferBlock* head) {
+    while (head) {
+        BufferBlock* next = head->nextFree;
+        freeBlock(head);
+        head = next;
+    }
+}
+
+// 把其他线程归还的块收回到空闲链表（仅在所属线程调用）
+void drainReturnStack(BufferPoolCore* core) {
+    if (!core->returnStack.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    BufferBlock* head = core->returnStack.exchange(nullptr, std::memory_order_acquire);
+    while (head) {
+        BufferBlock* next = head->nextFree;
+        auto& freeList = core->freeLists[head->sizeClass];
+        if (freeList.size() < core->maxCachedPerClass) {
+            freeList.push_back(head);
+            core->cachedBlocks.fetch_add(1, std::memory_order_relaxed);
+            core->cachedBytes.fetch_add(head->capacity, std::memory_order_relaxed);
+        } else {
+            freeBlock(head);
+        }
+        head = next;
+    }
+}
+
+} // namespace
+
+PooledBuffer::PooledBuffer(const PooledBuffer& other) : block(other.block) {
+    if (block) {
+        block->refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+PooledBuffer& PooledBuffer::operator=(const PooledBuffer& other) {
+    if (this != &other) {
+        if (other.block) {
+            other.block->refCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        reset();
+        block = other.block;
+    }
+    return *this;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        block = other.block;
+        other.block = nullptr;
+    }
+    return *this;
+}
+
+bool PooledBuffer::resize(size_t length) {
+    if (!block || length > block->capacity) {
+        return false;
+    }
+    block->length = length;
+    return true;
+}
+
+bool PooledBuffer::append(const char* bytes, size_t length) {
+    if (!block || block->length + length > block->capacity) {
+        return false;
+    }
+    std::memcpy(block->data() + block->length, bytes, length);
+    block->length += length;
+    return true;
+}
+
+void PooledBuffer::reset() {
+    if (block) {
+        if (block->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            BufferPool::release(block);
+        }
+        block = nullptr;
+    }
+}
+
+BufferPool::BufferPool(size_t maxCachedPerClass) : core(new BufferPoolCore) {
+    core->ownerThread = std::this_thread::get_id();
+    core->maxCachedPerClass = maxCachedPerClass;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.insert(core);
+}
+
+BufferPool::~BufferPool() {
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.erase(core);
+    }
+
+    core->closed.store(true);
+    for (auto& freeList : core->freeLists) {
+        for (BufferBlock* block : freeList) {
+            freeBlock(block);
+        }
+        freeList.clear();
+    }
+    freeBlockList(core->returnStack.exchange(nullptr));
+
+    dropCoreRef(core);
+}
+
+PooledBuffer BufferPool::acquire(size_t size) {
+    uint32_t sizeClass = sizeClassFor(size);
+    BufferBlock* block = nullptr;
+
+    if (sizeClass == kOversizeClass) {
+        block = allocateBlock(core, kOversizeClass, size);
+        core->oversize.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        drainReturnStack(core);
+
+        auto& freeList = core->freeLists[sizeClass];
+        if (!freeList.empty()) {
+            block = freeList.back();
+            freeList.pop_back();
+            core->hits.fetch_add(1, std::memory_order_relaxed);
+            core->cachedBlocks.fetch_sub(1, std::memory_order_relaxed);
+            core->cachedBytes.fetch_sub(block->capacity, std::memory_order_relaxed);
+        } else {
+            block = allocateBlock(core, sizeClass, kSizeClasses[sizeClass]);
+            core->misses.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    block->refCount.store(1, std::memory_order_relaxed);
+    block->length = 0;
+    block->nextFree = nullptr;
+    return PooledBuffer(block);
+}
+
+PooledBuffer BufferPool::copyFrom(const char* bytes, size_t length) {
+    PooledBuffer buffer = acquire(length);
+    buffer.append(bytes, length);
+    return buffer;
+}
+
+BufferPoolStats BufferPool::getStats() const {
+    BufferPoolStats stats;
+    stats.hits = core->hits.load(std::memory_order_relaxed);
+    stats.misses = core->misses.load(std::memory_order_relaxed);
+    stats.oversize = core->oversize.load(std::memory_order_relaxed);
+    stats.releases = core->releases.load(std::memory_order_relaxed);
+    stats.foreignReleases = core->foreignReleases.load(std::memory_order_relaxed);
+    stats.cachedBlocks = core->cachedBlocks.load(std::memory_order_relaxed);
+    stats.cachedBytes = core->cachedBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+BufferPool& BufferPool::local() {
+    static thread_local BufferPool pool;
+    return pool;
+}
+
+BufferPoolStats BufferPool::aggregateStats() {
+    BufferPoolStats total;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (BufferPoolCore* core : registry) {
+        total.hits += core->hits.load(std::memory_order_relaxed);
+        total.misses += core->misses.load(std::memory_order_relaxed);
+        total.oversize += core->oversize.load(std::memory_order_relaxed);
+        total.releases += core->releases.load(std::memory_order_relaxed);
+        total.foreignReleases += core->foreignReleases.load(std::memory_order_relaxed);
+        total.cachedBlocks += core->cachedBlocks.load(std::memory_order_relaxed);
+        total.cachedBytes += core->cachedBytes.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void BufferPool::release(BufferBlock* block) {
+    BufferPoolCore* core = block->core;
+
+    if (block->sizeClass == kOversizeClass) {
+        freeBlock(block);
+        return;
+    }
+
+    // 所属线程直接放回空闲链表
+    if (!core->closed.load(std::memory_order_relaxed) &&
+        core->ownerThread == std::this_thread::get_id()) {
+        auto& freeList = core->freeLists[block->sizeClass];
+        if (freeList.size() < core->maxCachedPerClass) {
+            freeList.push_back(block);
+            core->releases.fetch_add(1, std::memory_order_relaxed);
+            core->cachedBlocks.fetch_add(1, std::memory_order_relaxed);
+            core->cachedBytes.fetch_add(block->capacity, std::memory_order_relaxed);
+        } else {
+            freeBlock(block);
+        }
+        return;
+    }
+
+    // 其他线程归还：压入无锁回收栈
+    // 压栈后块可能立刻被池的析构释放，先额外持有一份引用保证 core 存活
+    core->refs.fetch_add(1, std::memory_order_relaxed);
+    core->foreignReleases.fetch_add(1, std::memory_order_relaxed);
+
+    BufferBlock* head = core->returnStack.load();
+    do {
+        block->nextFree = head;
+    } while (!core->returnStack.compare_exchange_weak(head, block));
+
+    // 池已经析构，没有线程会再收回这些块，直接释放
+    if (core->closed.load()) {
+        freeBlockList(core->returnStack.exchange(nullptr));
+    }
+    dropCoreRef(core);
+}
+
+uint32_t BufferPool::sizeClassFor(size_t size) {
+    const size_t* found = std::lower_bound(kSizeClasses, kSizeClasses + kNumSizeClasses, size);
+    return static_cast<uint32_t>(found - kSizeClasses);
+}
@@ -0,0 +1,348 @@
+#include "ChannelMux.h"
+#include "Logger.h"
+#include <algorithm>
+#include <limits>
+
+ChannelMux::ChannelMux(RecordSender sender, bool initiator)
+    : sender(std::move(sender)),
+      nextChannelId(initiator ? 1 : 2),
+      initiator(initiator) {
+}
+
+ChannelMux::ChannelId ChannelMux::openChannel() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (channels.size() >= kMaxChannels) {
+        return 0;
+    }
+    ChannelId channel = nextChannelId;
+    nextChannelId += 2;
+
+    // 通道号回绕后可能与仍在使用的通道相同
+    if (channel == 0 || !channels.emplace(channel, Channel()).second) {
+        return 0;
+    }
+    if (!sendControl(CHANNEL_OPEN, channel, std::string_view())) {
+        channels.erase(channel);
+        return 0;
+    }
+    return channel;
+}
+
+bool ChannelMux::closeChannel(ChannelId channel) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = channels.find(channel);
+    if (it == channels.end() || it->second.closing) {
+        return false;
+    }
+
+    // 还有排队数据时等发送完再关闭
+    if (it->second.pending.empty()) {
+        finishClose(channel);
+    } else {
+        it->second.closing = true;
+    }
+    return true;
+}
+
+bool ChannelMux::send(ChannelId channel, std::string_view message) {
+    if (message.size() > kMaxMessageSize) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = channels.find(channel);
+    if (it == channels.end() || it->second.closing) {
+        return false;
+    }
+    Channel& state = it->second;
+
+    size_t offset = 0;
+    if (state.pending.empty()) {
+        if (message.empty()) {
+            return sendFragment(channel, state, message, true);
+        }
+
+        // 没有排队数据时，窗口内的部分直接从调用方缓冲区分片发出
+        while (offset < message.size() && state.sendCredit > 0) {
+            size_t length = std::min({kMaxFragment, size_t(state.sendCredit), message.size() - offset});
+            if (!sendFragment(channel, state, message.substr(offset, length), offset + length == message.size())) {
+                return false;
+            }
+            offset += length;
+        }
+        if (offset == message.size()) {
+            return true;
+        }
+    }
+
+    // 超出窗口的部分拷贝到池化缓冲区排队，等对端归还信用
+    PooledBuffer remainder = BufferPool::local().copyFrom(message.data() + offset, message.size() - offset);
+    if (!remainder) {
+        return false;
+    }
+    // 已发出的分片不带结束标志，排队部分发完时才结束这条消息
+    state.pendingBytes += remainder.size();
+    state.pending.push_back({std::move(remainder), 0});
+    return true;
+}
+
+bool ChannelMux::handleRecord(std::string_view header, std::string_view payload) {
+    if (header.size() < kHeaderSize) {
+        return false;
+    }
+
+    const RecordType type = static_cast<RecordType>(header[0]);
+    const uint8_t flags = static_cast<uint8_t>(header[1]);
+    ChannelId channel = 0;
+    for (size_t i = 2; i < kHeaderSize; ++i) {
+        channel = (channel << 8) | static_cast<uint8_t>(header[i]);
+    }
+
+    switch (type) {
+        case CHANNEL_OPEN: {
+            // 对端只能使用它那一侧奇偶的通道号，否则会占用本端将要分配的通道号
+            if (channel == 0 || (channel % 2 == 1) == initiator) {
+                CRYPTOLINK_LOG_WARNING("对端打开的通道号无效: " << channel);
+                return false;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (channels.size() >= kMaxChannels) {
+                    CRYPTOLINK_LOG_WARNING("通道数已达上限，拒绝通道 " << channel);
+                    sendControl(CHANNEL_CLOSE, channel, std::string_view());
+                    return false;
+                }
+                if (!channels.emplace(channel, Channel()).second) {
+                    return false;
+                }
+            }
+            if (openHandler) {
+                openHandler(channel);
+            }
+            return true;
+        }
+        case CHANNEL_CLOSE: {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (channels.erase(channel) == 0) {
+                    return false;
+                }
+            }
+            if (closeHandler) {
+                closeHandler(channel);
+            }
+            return true;
+        }
+        case CHANNEL_CREDIT: {
+            if (payload.size() != 4) {
+                return false;
+            }
+            uint32_t increment = 0;
+            for (char byte : payload) {
+                increment = (increment << 8) | static_cast<uint8_t>(byte);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = channels.find(channel);
+            if (it == channels.end()) {
+                return false;
+            }
+            Channel& state = it->second;
+            state.sendCredit = uint32_t(std::min<uint64_t>(uint64_t(state.sendCredit) + increment,
+                                                           std::numeric_limits<uint32_t>::max()));
+            if (!state.pending.empty() && !state.queued) {
+                state.queued = true;
+                ready.push_back(channel);
+            }
+            pump();
+            return true;
+        }
+        case CHANNEL_DATA: {
+            std::string message;
+            bool reassembled = false;
+            bool oversized = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = channels.find(channel);
+                if (it == channels.end()) {
+                    return false;
+                }
+                Channel& state = it->second;
+                if (payload.size() > state.receiveWindow) {
+                    CRYPTOLINK_LOG_WARNING("通道 " << channel << " 超出流量控制窗口");
+                    return false;
+                }
+                state.receiveWindow -= uint32_t(payload.size());
+
+                if (state.reassembly.size() + payload.size() > kMaxMessageSize) {
+                    CRYPTOLINK_LOG_WARNING("通道 " << channel << " 的消息超过长度上限，关闭通道");
+                    finishClose(channel);
+                    oversized = true;
+                } else if (!(flags & kFinalFragment)) {
+                    // 中间分片移入重组缓冲区即视为已消费，否则大于窗口的消息永远收不完
+                    state.reassembly.append(payload.data(), payload.size());
+                    releaseCredit(channel, payload.size());
+                    return true;
+                } else if (!state.reassembly.empty()) {
+                    state.reassembly.append(payload.data(), payload.size());
+                    message.swap(state.reassembly);
+                    reassembled = true;
+                }
+            }
+
+            if (oversized) {
+                if (closeHandler) {
+                    closeHandler(channel);
+                }
+                return false;
+            }
+
+            // 回调在锁外执行，回调里可以继续在通道上发送
+            if (dataHandler) {
+                dataHandler(channel, reassembled ? std::string_view(message) : payload);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            releaseCredit(channel, payload.size());
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+void ChannelMux::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    channels.clear();
+    ready.clear();
+}
+
+void ChannelMux::setDataHandler(DataHandler handler) {
+    dataHandler = std::move(handler);
+}
+
+void ChannelMux::setOpenHandler(ChannelHandler handler) {
+    openHandler = std::move(handler);
+}
+
+void ChannelMux::setCloseHandler(ChannelHandler handler) {
+    closeHandler = std::move(handler);
+}
+
+bool ChannelMux::isOpen(ChannelId channel) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = channels.find(channel);
+    return it != channels.end() && !it->second.closing;
+}
+
+size_t ChannelMux::channelCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return channels.size();
+}
+
+size_t ChannelMux::pendingBytes(ChannelId channel) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = channels.find(channel);
+    return it == channels.end() ? 0 : it->second.pendingBytes;
+}
+
+void ChannelMux::writeHeader(char* header, RecordType type, uint8_t flags, ChannelId channel) {
+    header[0] = static_cast<char>(type);
+    header[1] = static_cast<char>(flags);
+    for (int i = 5; i >= 2; --i) {
+        header[i] = static_cast<char>(channel & 0xff);
+        channel >>= 8;
+    }
+}
+
+bool ChannelMux::sendControl(RecordType type, ChannelId channel, std::string_view payload) {
+    char header[kHeaderSize];
+    writeHeader(header, type, 0, channel);
+    return sender(std::string_view(header, kHeaderSize), payload);
+}
+
+void ChannelMux::pump() {
+    while (!ready.empty()) {
+        ChannelId channel = ready.front();
+        ready.pop_front();
+
+        auto it = channels.find(channel);
+        if (it == channels.end()) {
+            continue;
+        }
+        Channel& state = it->second;
+        state.queued = false;
+
+        if (state.pending.empty()) {
+            if (state.closing) {
+                finishClose(channel);
+            }
+            continue;
+        }
+
+        PendingMessage& head = state.pending.front();
+        size_t remaining = head.data.size() - head.offset;
+        if (state.sendCredit == 0 && remaining > 0) {
+            continue;
+        }
+
+        // 每轮只发一个分片，让其他就绪通道有机会插进来
+        size_t length = std::min({kMaxFragment, size_t(state.sendCredit), remaining});
+        bool final = length == remaining;
+        if (!sendFragment(channel, state, head.data.view().substr(head.offset, length), final)) {
+            continue;
+        }
+        head.offset += length;
+        state.pendingBytes -= length;
+        if (final) {
+            state.pending.pop_front();
+        }
+
+        bool more = state.pending.empty() ? state.closing : state.sendCredit > 0;
+        if (more) {
+            state.queued = true;
+            ready.push_back(channel);
+        }
+    }
+}
+
+bool ChannelMux::sendFragment(ChannelId channel, Channel& state, std::string_view data, bool final) {
+    char header[kHeaderSize];
+    writeHeader(header, CHANNEL_DATA, final ? kFinalFragment : 0, channel);
+    if (!sender(std::string_view(header, kHeaderSize), data)) {
+        return false;
+    }
+    state.sendCredit -= uint32_t(data.size());
+    return true;
+}
+
+void ChannelMux::finishClose(ChannelId channel) {
+    sendControl(CHANNEL_CLOSE, channel, std::string_view());
+    channels.erase(channel);
+}
+
+void ChannelMux::releaseCredit(ChannelId channel, size_t length) {
+    auto it = channels.find(channel);
+    if (it == channels.end()) {
+        return;
+    }
+    Channel& state = it->second;
+    state.consumed += uint32_t(length);
+
+    // 攒够半个窗口再归还，避免每条消息都回一条信用记录
+    if (state.consumed >= kInitialWindow / 2) {
+        const char increment[4] = {
+            static_cast<char>((state.consumed >> 24) & 0xff),
+            static_cast<char>((state.consumed >> 16) & 0xff),
+            static_cast<char>((state.consumed >> 8) & 0xff),
+            static_cast<char>(state.consumed & 0xff)
+        };
+        if (sendControl(CHANNEL_CREDIT, channel, std::string_view(increment, 4))) {
+            state.receiveWindow += state.consumed;
+            state.consumed = 0;
+        }
+    }
+}
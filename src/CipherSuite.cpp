@@ -0,0 +1,78 @@
+#include "CipherSuite.h"
+#include <cryptopp/cpu.h>
+#include <algorithm>
+#include <sstream>
+
+bool hasAesHardwareAcceleration() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    return CryptoPP::HasAESNI() && CryptoPP::HasCLMUL();
+#elif defined(__aarch64__) || defined(__arm__) || defined(_M_ARM64)
+    return CryptoPP::HasAES() && CryptoPP::HasPMULL();
+#else
+    return false;
+#endif
+}
+
+std::vector<CipherSuite> preferredCipherSuites() {
+    if (hasAesHardwareAcceleration()) {
+        return {CipherSuite::AES_256_GCM, CipherSuite::CHACHA20_POLY1305, CipherSuite::AES_256_CBC};
+    }
+    return {CipherSuite::CHACHA20_POLY1305, CipherSuite::AES_256_GCM, CipherSuite::AES_256_CBC};
+}
+
+CipherSuite negotiateCipherSuite(const std::vector<CipherSuite>& serverPreference,
+                                 const std::vector<CipherSuite>& clientOffer) {
+    for (CipherSuite suite : serverPreference) {
+        if (std::find(clientOffer.begin(), clientOffer.end(), suite) != clientOffer.end()) {
+            return suite;
+        }
+    }
+    return CipherSuite::NONE;
+}
+
+std::string cipherSuitesToString(const std::vector<CipherSuite>& suites) {
+    std::string text;
+    for (CipherSuite suite : suites) {
+        if (!text.empty()) {
+            text += ",";
+        }
+        text += std::to_string(static_cast<int>(suite));
+    }
+    return text;
+}
+
+std::vector<CipherSuite> parseCipherSuites(const std::string& text) {
+    std::vector<CipherSuite> suites;
+    std::stringstream ss(text);
+    std::string item;
+
+    while (std::getline(ss, item, ',')) {
+        try {
+            int value = std::stoi(item);
+            if (value >= static_cast<int>(CipherSuite::AES_256_CBC) &&
+                value <= static_cast<int>(CipherSuite::CHACHA20_POLY1305)) {
+                suites.push_back(static_cast<CipherSuite>(value));
+            }
+        } catch (const std::exception&) {
+            // 忽略无法识别的条目
+        }
+    }
+    return suites;
+}
+
+std::string cipherSuiteTranscript(const std::string& offer, CipherSuite selected) {
+    return "offer=" + offer + ";select=" + std::to_string(static_cast<int>(selected));
+}
+
+const char* cipherSuiteName(CipherSuite suite) {
+    switch (suite) {
+        case CipherSuite::AES_256_CBC:
+            return "AES-256-CBC";
+        case CipherSuite::AES_256_GCM:
+            return "AES-256-GCM";
+        case CipherSuite::CHACHA20_POLY1305:
+            return "ChaCha20-Poly1305";
+        default:
+            return "NONE";
+    }
+}
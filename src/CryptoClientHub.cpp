@@ -0,0 +1,373 @@
+#include "CryptoClientHub.h"
+#include "Logger.h"
+#include "PskHandshake.h"
+#include <algorithm>
+#include <thread>
+#include <boost/asio.hpp>
+
+namespace {
+
+// 默认断开 1 秒后重连
+const std::chrono::milliseconds kDefaultReconnectInterval(1000);
+
+}
+
+struct CryptoClientHub::Loop {
+    Loop() : work(boost::asio::make_work_guard(io)) {}
+
+    boost::asio::io_context io;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    std::thread thread;
+    size_t sessions = 0;        // 分配到本循环的会话数，受集线器的锁保护
+};
+
+struct CryptoClientHub::Session {
+    enum class State {
+        IDLE,           // 尚未连接或等待重连
+        CONNECTING,
+        OPEN
+    };
+
+    Session(SessionId id, const std::string& uri, std::shared_ptr<Loop> loop)
+        : id(id), uri(uri), loop(std::move(loop)), reconnectTimer(this->loop->io) {}
+
+    const SessionId id;
+    const std::string uri;
+    const std::shared_ptr<Loop> loop;
+
+    // 受集线器的锁保护，只在所属循环的线程上修改
+    std::shared_ptr<CryptoWebSocketClient> client;
+    bool removed = false;
+
+    // 以下只在所属循环的线程上访问
+    State state = State::IDLE;
+    bool closing = false;
+    boost::asio::steady_timer reconnectTimer;
+};
+
+CryptoClientHub::CryptoClientHub(size_t threads, unsigned int rsaKeySize)
+    : rsaKeySize(rsaKeySize), cipherSuites(preferredCipherSuites()), reconnectInterval(kDefaultReconnectInterval),
+      nextSessionId(1), activeSessions(0), stopped(false) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        auto loop = std::make_shared<Loop>();
+        Loop* raw = loop.get();
+        loop->thread = std::thread([raw]() {
+            raw->io.run();
+        });
+        loops.push_back(std::move(loop));
+    }
+}
+
+CryptoClientHub::~CryptoClientHub() {
+    stop();
+}
+
+bool CryptoClientHub::setIdentity(const std::string& privateKey) {
+    RSAKey key(rsaKeySize);
+    if (!key.setLocalPrivateKey(privateKey)) {
+        return false;
+    }
+    std::promise<std::string> ready;
+    ready.set_value(privateKey);
+    setIdentity(ready.get_future().share());
+    return true;
+}
+
+void CryptoClientHub::setIdentity(std::shared_future<std::string> identity) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->identity = std::move(identity);
+}
+
+bool CryptoClientHub::setPreSharedKey(const std::string& identity, const std::string& key) {
+    if (!identity.empty() && (key.size() < PskHandshake::kMinKeySize || PskHandshake::aeadSuites(cipherSuites).empty())) {
+        CRYPTOLINK_LOG_ERROR("预共享密钥无效: 密钥至少 " << PskHandshake::kMinKeySize << " 字节，且需要提供 AEAD 套件");
+        return false;
+    }
+    pskIdentity = identity;
+    pskKey = identity.empty() ? std::string() : key;
+    return true;
+}
+
+void CryptoClientHub::setCipherSuites(const std::vector<CipherSuite>& suites) {
+    cipherSuites = suites;
+}
+
+void CryptoClientHub::setReconnectInterval(std::chrono::milliseconds interval) {
+    reconnectInterval = interval;
+}
+
+void CryptoClientHub::setConnectCallback(std::function<void(SessionId, bool)> callback) {
+    connectCallback = callback;
+}
+
+void CryptoClientHub::setHandshakeCallback(std::function<void(SessionId)> callback) {
+    handshakeCallback = callback;
+}
+
+void CryptoClientHub::setMessageCallback(std::function<void(SessionId, std::string_view)> callback) {
+    messageCallback = callback;
+}
+
+CryptoClientHub::SessionId CryptoClientHub::connect(const std::string& uri,
+                                                    std::function<void(CryptoWebSocketClient&)> configure) {
+    std::shared_future<std::string> sharedIdentity;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopped) {
+            return 0;
+        }
+        if (pskIdentity.empty() && !identity.valid()) {
+            identity = CryptoWebSocketClient::generateIdentity(rsaKeySize);
+        }
+        sharedIdentity = identity;
+    }
+
+    // 身份在调用线程上载入，握手时传输线程不会等待密钥生成，也不会拖住同一循环上的其他会话
+    auto client = std::make_unique<CryptoWebSocketClient>(rsaKeySize);
+    client->setCipherSuites(cipherSuites);
+    if (!pskIdentity.empty()) {
+        if (!client->setPreSharedKey(pskIdentity, pskKey)) {
+            return 0;
+        }
+    } else if (!client->setIdentity(sharedIdentity.get())) {
+        CRYPTOLINK_LOG_ERROR("会话身份密钥不可用");
+        return 0;
+    }
+
+    std::shared_ptr<Session> session;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopped) {
+            return 0;
+        }
+
+        // 分配到会话最少的事件循环
+        std::shared_ptr<Loop> loop = *std::min_element(loops.begin(), loops.end(),
+            [](const std::shared_ptr<Loop>& a, const std::shared_ptr<Loop>& b) {
+                return a->sessions < b->sessions;
+            });
+        ++loop->sessions;
+        ++activeSessions;
+        session = std::make_shared<Session>(nextSessionId++, uri, loop);
+    }
+
+    const SessionId id = session->id;
+    std::weak_ptr<Session> weak = session;
+    client->setEventLoop(session->loop->io);
+    client->setMessageCallback([this, id](std::string_view message) {
+        if (messageCallback) {
+            messageCallback(id, message);
+        }
+    });
+    if (configure) {
+        configure(*client);
+    }
+    client->setConnectCallback([this, weak](bool connected) {
+        if (auto session = weak.lock()) {
+            onSessionConnect(session, connected);
+        }
+    });
+    client->setHandshakeCallback([this, id]() {
+        if (handshakeCallback) {
+            handshakeCallback(id);
+        }
+    });
+
+    // 最后一个引用可能在任意线程、甚至会话自己的回调里释放，销毁统一投递到所属循环；循环停止后直接销毁
+    std::shared_ptr<Loop> loop = session->loop;
+    session->client.reset(client.release(), [loop](CryptoWebSocketClient* client) {
+        if (loop->io.stopped()) {
+            delete client;
+            return;
+        }
+        boost::asio::post(loop->io, [client]() {
+            delete client;
+        });
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.emplace(id, session);
+    }
+    boost::asio::post(loop->io, [this, session]() {
+        startConnect(session);
+    });
+    return id;
+}
+
+bool CryptoClientHub::remove(SessionId id) {
+    std::shared_ptr<Session> session;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sessions.find(id);
+        if (it == sessions.end() || it->second->removed) {
+            return false;
+        }
+        session = it->second;
+        session->removed = true;
+        --session->loop->sessions;
+        --activeSessions;
+    }
+
+    boost::asio::post(session->loop->io, [this, session]() {
+        session->closing = true;
+        session->reconnectTimer.cancel();
+        switch (session->state) {
+            case Session::State::IDLE:
+                retire(session);
+                break;
+            case Session::State::CONNECTING:
+                // 连接建立或失败时再处理，连接过程中不销毁传输
+                break;
+            case Session::State::OPEN:
+                session->client->disconnect();
+                break;
+        }
+    });
+    return true;
+}
+
+std::shared_ptr<CryptoWebSocketClient> CryptoClientHub::session(SessionId id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sessions.find(id);
+    if (it == sessions.end() || it->second->removed) {
+        return nullptr;
+    }
+    return it->second->client;
+}
+
+bool CryptoClientHub::sendEncryptedMessage(SessionId id, const std::string& message, SendPriority priority) {
+    std::shared_ptr<CryptoWebSocketClient> client = session(id);
+    return client && client->sendEncryptedMessage(message, priority);
+}
+
+size_t CryptoClientHub::broadcastEncryptedMessage(const std::string& message, SendPriority priority) {
+    // 在锁外逐个加入发送队列，加密在各会话所属的循环上并行进行
+    std::vector<std::shared_ptr<CryptoWebSocketClient>> targets;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        targets.reserve(sessions.size());
+        for (const auto& entry : sessions) {
+            if (!entry.second->removed && entry.second->client) {
+                targets.push_back(entry.second->client);
+            }
+        }
+    }
+
+    size_t sent = 0;
+    for (const auto& client : targets) {
+        if (client->sendEncryptedMessage(message, priority)) {
+            ++sent;
+        }
+    }
+    return sent;
+}
+
+size_t CryptoClientHub::sessionCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return activeSessions;
+}
+
+void CryptoClientHub::stop() {
+    std::unordered_map<SessionId, std::shared_ptr<Session>> closing;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopped) {
+            return;
+        }
+        stopped = true;
+        closing.swap(sessions);
+        activeSessions = 0;
+    }
+
+    for (auto& entry : closing) {
+        std::shared_ptr<Session> session = entry.second;
+        boost::asio::post(session->loop->io, [session]() {
+            session->closing = true;
+            session->reconnectTimer.cancel();
+            if (session->client) {
+                // 共享事件循环上的 stop 只关闭连接，不再触发回调
+                session->client->stop();
+                session->client.reset();
+            }
+        });
+    }
+
+    // 上面的任务释放客户端时又投递了销毁任务，隔一轮再投递停止，排在这些销毁任务之后
+    for (auto& loop : loops) {
+        Loop* raw = loop.get();
+        boost::asio::post(raw->io, [raw]() {
+            boost::asio::post(raw->io, [raw]() {
+                raw->io.stop();
+            });
+        });
+    }
+    for (auto& loop : loops) {
+        if (loop->thread.joinable()) {
+            loop->thread.join();
+        }
+    }
+}
+
+void CryptoClientHub::startConnect(const std::shared_ptr<Session>& session) {
+    if (session->closing || !session->client) {
+        return;
+    }
+
+    // 上一个连接的传输在这里于循环线程上销毁
+    session->state = Session::State::CONNECTING;
+    if (!session->client->connect(session->uri)) {
+        onSessionConnect(session, false);
+    }
+}
+
+void CryptoClientHub::onSessionConnect(const std::shared_ptr<Session>& session, bool connected) {
+    if (!session->client) {
+        return;
+    }
+
+    if (connected) {
+        session->state = Session::State::OPEN;
+        if (session->closing) {
+            // 连接过程中被移除，连接关闭后销毁
+            session->client->disconnect();
+            return;
+        }
+    } else {
+        session->state = Session::State::IDLE;
+    }
+
+    if (connectCallback) {
+        connectCallback(session->id, connected);
+    }
+    if (connected) {
+        return;
+    }
+
+    if (session->closing) {
+        retire(session);
+        return;
+    }
+    if (reconnectInterval.count() > 0) {
+        session->reconnectTimer.expires_after(reconnectInterval);
+        session->reconnectTimer.async_wait([this, weak = std::weak_ptr<Session>(session)](const boost::system::error_code& ec) {
+            std::shared_ptr<Session> session = weak.lock();
+            if (!ec && session) {
+                startConnect(session);
+            }
+        });
+    }
+}
+
+void CryptoClientHub::retire(const std::shared_ptr<Session>& session) {
+    // 释放集线器的引用：客户端在本任务结束后于循环上销毁，仍被 session() 的调用方持有时由最后一个引用释放
+    std::shared_ptr<CryptoWebSocketClient> client;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.erase(session->id);
+        client.swap(session->client);
+    }
+}
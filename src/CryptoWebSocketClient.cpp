@@ -1,38 +1,130 @@
 #include "CryptoWebSocketClient.h"
-#include <iostream>
+#include "PskHandshake.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
 #include <jsoncpp/json/json.h>
+#include <boost/asio/io_context.hpp>
 
-CryptoWebSocketClient::CryptoWebSocketClient() 
-    : isConnected(false), handshakeComplete(false) {
-    
-    // 初始化加密对象
-    rsaKey = std::make_unique<RSAKey>();
-    aesKey = std::make_unique<AESKey>();
-    
-    // 生成密钥对
-    rsaKey->generateKeyPair();
-    aesKey->generateRawKey();
+namespace {
+
+// 传输线程每轮最多处理的待发送记录数，避免大量发送饿死接收
+const size_t kMaxOutboundBatch = 256;
+
+// 默认最多交给传输层 256KB 尚未写出的数据
+const size_t kDefaultSendQueueLimit = 256 * 1024;
+
+// 传输层排队数据超过上限时，隔多久再检查一次
+const std::chrono::milliseconds kSendPollInterval(1);
+
+// 共享事件循环上等待身份生成时，隔多久检查一次
+const std::chrono::milliseconds kIdentityPollInterval(10);
+
+// 默认从 1MB 起分段并行加密
+const size_t kDefaultParallelThreshold = 1024 * 1024;
+
+// 其他线程读取事件循环上的统计时最多等待多久
+const std::chrono::milliseconds kSnapshotTimeout(1000);
+
+// 数据报通道默认发往 connect 地址中的主机，unix 套接字没有主机，使用本机
+std::string uriHost(const std::string& uri) {
+    size_t start = uri.find("://");
+    const std::string scheme = start == std::string::npos ? "ws" : uri.substr(0, start);
+    start = start == std::string::npos ? 0 : start + 3;
+    if (scheme == "unix" || scheme == "uring+unix") {
+        return "127.0.0.1";
+    }
+    if (start < uri.size() && uri[start] == '[') {
+        size_t end = uri.find(']', start);
+        return end == std::string::npos ? std::string() : uri.substr(start + 1, end - start - 1);
+    }
+    std::string host = uri.substr(start, uri.find_first_of(":/", start) - start);
+    return host.empty() ? "127.0.0.1" : host;
+}
+
+}
+
+CryptoWebSocketClient::CryptoWebSocketClient(unsigned int rsaKeySize)
+    : rsaKeySize(rsaKeySize), identityInstalled(false),
+      eventLoop(nullptr), isConnected(false), handshakeComplete(false), handshakeGeneration(0),
+      channels([this](std::string_view header, std::string_view payload) {
+          // 通道控制记录走控制通道，数据分片按普通优先级
+          SendPriority priority = header[0] == static_cast<char>(CHANNEL_DATA) ? SendPriority::NORMAL : SendPriority::CONTROL;
+          return sendRecord(header, payload, priority);
+      }, true),
+      outboundScheduled(false),
+      lanes([this](std::string_view header, std::string_view payload) {
+          // 分段记录已经在工作线程上加密，中继数据记录已经端到端加密，负载就是完整的线路记录
+          const uint8_t type = static_cast<uint8_t>(header[0]);
+          if (SegmentCipher::isSegmentRecord(type) || PeerRelay::isRelayFrame(type)) {
+              return transport->send(connectionHandle, payload.data(), payload.size(), Transport::FrameType::BINARY);
+          }
+          
+          // 使用协商出的会话加密器生成二进制记录，记录头作为附加数据参与认证
+          PooledBuffer sealed = sessionCipher.seal(header, payload, BufferPool::local());
+          return sealed && transport->send(connectionHandle, sealed.data(), sealed.size(), Transport::FrameType::BINARY);
+      }),
+      sendQueueLimit(kDefaultSendQueueLimit),
+      sendPollScheduled(false),
+      latencyProbeInterval(0),
+      timestampRecords(false),
+      parallelThreshold(kDefaultParallelThreshold),
+      parallelReceiveLimit(SegmentCipher::kDefaultReceiveLimit),
+      files([this](FileTransfer::RecordType type, SendPriority priority, PooledBuffer payload) {
+          OutboundRecord record;
+          record.header[0] = static_cast<char>(type);
+          record.headerLength = 1;
+          record.priority = priority;
+          record.payload = std::move(payload);
+          return enqueueRecord(std::move(record));
+      }),
+      rpc([this](RpcSession::RecordType type, SendPriority priority, PooledBuffer payload) {
+          OutboundRecord record;
+          record.header[0] = static_cast<char>(type);
+          record.headerLength = 1;
+          record.priority = priority;
+          record.payload = std::move(payload);
+          return enqueueRecord(std::move(record));
+      }),
+      rpcTimerArmed(false),
+      relay([this](PeerRelay::RecordType type, SendPriority priority, PooledBuffer payload) {
+          // 中继数据记录直接放入发送队列（记录头是类型和名字长度，不会被分片），由调用方负责发出
+          if (type == PeerRelay::RELAY_DATA) {
+              std::string_view header(payload.data(), 2);
+              lanes.enqueue(priority, header, std::move(payload));
+              return true;
+          }
+          OutboundRecord record;
+          record.header[0] = static_cast<char>(type);
+          record.headerLength = 1;
+          record.priority = priority;
+          record.payload = std::move(payload);
+          return enqueueRecord(std::move(record));
+      }),
+      datagramsEnabled(false),
+      datagramDelivery(DatagramCipher::Delivery::UNORDERED),
+      datagramReady(false) {
     
-    // 配置WebSocket客户端
-    wsClient.set_access_channels(websocketpp::log::alevel::all);
-    wsClient.clear_access_channels(websocketpp::log::alevel::frame_payload);
-    wsClient.init_asio();
+    // 复用JSON解析器，避免每条消息重新构造
+    jsonReader.reset(Json::CharReaderBuilder().newCharReader());
     
-    // 设置回调函数
-    wsClient.set_open_handler([this](websocketpp::connection_hdl hdl) {
-        this->onOpen(hdl);
-    });
+    // 初始化加密对象，密钥对在 connect 时于后台生成，会话密钥在每次握手时生成
+    rsaKey = std::make_unique<RSAKey>(rsaKeySize);
+    aesKey = std::make_unique<AESKey>();
     
-    wsClient.set_close_handler([this](websocketpp::connection_hdl hdl) {
-        this->onClose(hdl);
-    });
+    // 签名消息用服务器公钥验证，同一批次只验证一次根签名
+    signedVerifier = std::make_unique<MerkleBatchVerifier>(*rsaKey);
     
-    wsClient.set_message_handler([this](websocketpp::connection_hdl hdl, message_ptr msg) {
-        this->onMessage(hdl, msg);
-    });
+    // 默认按本机CPU特性提供加密套件
+    offeredCipherSuites = preferredCipherSuites();
     
-    wsClient.set_fail_handler([this](websocketpp::connection_hdl hdl) {
-        this->onFail(hdl);
+    // 接收文件在磁盘线程上写入和落盘，完成一批后回到传输线程发出确认
+    files.setDiskWorker([this]() {
+        transport->post([this]() {
+            files.flushDisk();
+        });
     });
 }
 
@@ -41,150 +133,978 @@ CryptoWebSocketClient::~CryptoWebSocketClient() {
 }
 
 bool CryptoWebSocketClient::connect(const std::string& uri) {
-    try {
-        websocketpp::lib::error_code ec;
-        client::connection_ptr con = wsClient.get_connection(uri, ec);
-        
-        if (ec) {
-            std::cerr << "连接创建失败: " << ec.message() << std::endl;
-            return false;
-        }
-        
-        connectionHandle = con->get_handle();
-        wsClient.connect(con);
-        
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "连接异常: " << e.what() << std::endl;
+    // 旧传输的事件循环已经停止，投递给它的发送任务不会再执行，由这里丢弃未发出的记录
+    OutboundRecord stale;
+    while (outbound.pop(stale)) {
+    }
+    outboundScheduled = false;
+    lanes.reset();
+    segments.reset();
+    sendPollScheduled = false;
+    rpcTimerArmed = false;
+    latencyProbe = LatencyProbe();
+    
+    // 数据报套接字跨连接保留，每次握手后重新打开通道
+    datagramReady = false;
+    serverHost = uriHost(uri);
+    if (datagramsEnabled && !datagrams) {
+        datagrams = std::make_unique<DatagramSocket>(eventLoop);
+        datagrams->setHandler([this](DatagramSocket::Handle, std::string_view payload) {
+            if (datagramCallback) {
+                datagramCallback(payload);
+            }
+        });
+    }
+    
+    std::string address;
+    transport = Transport::create(uri, false, address, eventLoop);
+    if (!transport) {
         return false;
     }
+    
+    // 没有注入身份时在后台生成，与解析地址、建立连接和 WebSocket 升级并行；PSK 握手不需要身份
+    if (pskIdentity.empty() && !identity.valid()) {
+        identity = generateIdentity(rsaKeySize);
+    }
+    
+    // 握手和记录层只通过传输接口收发，各后端共用同一套回调
+    Transport::Handlers handlers;
+    handlers.onOpen = [this](websocketpp::connection_hdl hdl) {
+        this->onOpen(hdl);
+    };
+    handlers.onClose = [this](websocketpp::connection_hdl hdl) {
+        this->onClose(hdl);
+    };
+    handlers.onFail = [this](websocketpp::connection_hdl hdl) {
+        this->onFail(hdl);
+    };
+    handlers.onMessage = [this](websocketpp::connection_hdl hdl, Transport::FrameType type, std::string& payload) {
+        this->onMessage(hdl, type, payload);
+    };
+    transport->setHandlers(std::move(handlers));
+    
+    if (!transport->connect(address)) {
+        transport.reset();
+        return false;
+    }
+    return true;
 }
 
 void CryptoWebSocketClient::disconnect() {
     if (isConnected) {
-        wsClient.close(connectionHandle, websocketpp::close::status::normal, "Client disconnect");
+        transport->close(connectionHandle, Transport::CLOSE_NORMAL, "Client disconnect");
         isConnected = false;
         handshakeComplete = false;
     }
 }
 
-bool CryptoWebSocketClient::sendEncryptedMessage(const std::string& message) {
+bool CryptoWebSocketClient::setIdentity(const std::string& privateKey) {
+    if (!rsaKey->setLocalPrivateKey(privateKey)) {
+        return false;
+    }
+    std::promise<std::string> ready;
+    ready.set_value(privateKey);
+    identity = ready.get_future().share();
+    identityInstalled = true;
+    return true;
+}
+
+bool CryptoWebSocketClient::setPreSharedKey(const std::string& identity, const std::string& key) {
+    if (identity.empty()) {
+        pskIdentity.clear();
+        pskKey.clear();
+        return true;
+    }
+    if (key.size() < PskHandshake::kMinKeySize || PskHandshake::aeadSuites(offeredCipherSuites).empty()) {
+        CRYPTOLINK_LOG_ERROR("预共享密钥无效: 密钥至少 " << PskHandshake::kMinKeySize << " 字节，且需要提供 AEAD 套件");
+        return false;
+    }
+    pskIdentity = identity;
+    pskKey = key;
+    return true;
+}
+
+void CryptoWebSocketClient::setIdentity(std::shared_future<std::string> identity) {
+    this->identity = std::move(identity);
+    identityInstalled = false;
+}
+
+std::string CryptoWebSocketClient::exportIdentity() {
+    if (!identity.valid()) {
+        identity = generateIdentity(rsaKeySize);
+    }
+    return identity.get();
+}
+
+std::shared_future<std::string> CryptoWebSocketClient::generateIdentity(unsigned int keySize) {
+    return std::async(std::launch::async, [keySize]() {
+        RSAKey key(keySize);
+        return key.generateKeyPair() ? key.getLocalPrivateKey() : std::string();
+    }).share();
+}
+
+std::shared_future<std::string> CryptoWebSocketClient::sharedIdentity(unsigned int keySize) {
+    static std::mutex mutex;
+    static std::map<unsigned int, std::shared_future<std::string>> identities;
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_future<std::string>& shared = identities[keySize];
+    if (!shared.valid()) {
+        shared = generateIdentity(keySize);
+    }
+    return shared;
+}
+
+bool CryptoWebSocketClient::installIdentity() {
+    if (identityInstalled) {
+        return true;
+    }
+    if (!identity.valid()) {
+        identity = generateIdentity(rsaKeySize);
+    }
+    
+    // 通常在连接建立期间已经生成完毕；还没完成时阻塞传输线程（共享事件循环时由 awaitIdentity 等到完成才调用）
+    const std::string& privateKey = identity.get();
+    if (privateKey.empty() || !rsaKey->setLocalPrivateKey(privateKey)) {
+        return false;
+    }
+    identityInstalled = true;
+    return true;
+}
+
+bool CryptoWebSocketClient::identityReady() {
+    if (identityInstalled) {
+        return true;
+    }
+    if (!identity.valid()) {
+        identity = generateIdentity(rsaKeySize);
+    }
+    return identity.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void CryptoWebSocketClient::awaitIdentity(uint64_t generation) {
+    transport->setTimer(kIdentityPollInterval, [this, generation]() {
+        // 连接已经断开或开始了新的握手
+        if (generation != handshakeGeneration || !isConnected || handshakeComplete) {
+            return;
+        }
+        if (!identityReady()) {
+            awaitIdentity(generation);
+            return;
+        }
+        sendSessionKey();
+    });
+}
+
+bool CryptoWebSocketClient::sendEncryptedMessage(const std::string& message, SendPriority priority) {
+    if (!timestampRecords.load(std::memory_order_relaxed)) {
+        return sendRecord(ENCRYPTED_DATA, message, priority);
+    }
+    
+    // 发送时刻在调用发送接口时记录，对端算出的单向延迟包含本端排队的时间
+    OutboundRecord record;
+    record.header[0] = static_cast<char>(STAMPED_DATA);
+    record.headerLength = 1;
+    record.priority = priority;
+    record.payload = BufferPool::local().acquire(LatencyProbe::kStampSize + message.size());
+    if (!record.payload) {
+        return false;
+    }
+    char stamp[LatencyProbe::kStampSize];
+    LatencyProbe::writeStamp(stamp);
+    record.payload.append(stamp, sizeof(stamp));
+    record.payload.append(message.data(), message.size());
+    return enqueueRecord(std::move(record));
+}
+
+bool CryptoWebSocketClient::subscribe(const std::string& pattern) {
+    if (!TopicIndex::isValidPattern(pattern)) {
+        CRYPTOLINK_LOG_WARNING("无效的订阅模式: " << pattern);
+        return false;
+    }
+    return sendRecord(SUBSCRIBE, pattern, SendPriority::CONTROL);
+}
+
+bool CryptoWebSocketClient::unsubscribe(const std::string& pattern) {
+    return sendRecord(UNSUBSCRIBE, pattern, SendPriority::CONTROL);
+}
+
+bool CryptoWebSocketClient::publish(const std::string& topic, std::string_view message, SendPriority priority) {
+    if (!TopicIndex::isValidTopic(topic)) {
+        CRYPTOLINK_LOG_WARNING("无效的发布主题: " << topic);
+        return false;
+    }
+    
+    PooledBuffer publication = TopicIndex::encodePublication(topic, message, BufferPool::local());
+    return publication && sendRecord(PUBLISH, publication.view(), priority);
+}
+
+void CryptoWebSocketClient::setTopicMessageCallback(std::function<void(std::string_view, std::string_view)> callback) {
+    topicMessageCallback = callback;
+}
+
+void CryptoWebSocketClient::setSignedMessageCallback(std::function<void(std::string_view)> callback) {
+    signedMessageCallback = callback;
+}
+
+void CryptoWebSocketClient::setHandshakeCallback(std::function<void()> callback) {
+    handshakeCallback = callback;
+}
+
+void CryptoWebSocketClient::setConnectCallback(std::function<void(bool)> callback) {
+    connectCallback = callback;
+}
+
+bool CryptoWebSocketClient::post(std::function<void()> task) {
+    if (!transport) {
+        return false;
+    }
+    transport->post(std::move(task));
+    return true;
+}
+
+ChannelMux::ChannelId CryptoWebSocketClient::openChannel() {
+    if (!isConnected || !handshakeComplete) {
+        CRYPTOLINK_LOG_WARNING("客户端未连接或握手未完成");
+        return 0;
+    }
+    return channels.openChannel();
+}
+
+bool CryptoWebSocketClient::closeChannel(ChannelMux::ChannelId channel) {
+    return channels.closeChannel(channel);
+}
+
+bool CryptoWebSocketClient::sendOnChannel(ChannelMux::ChannelId channel, std::string_view message) {
+    return channels.send(channel, message);
+}
+
+FileTransfer::TransferId CryptoWebSocketClient::sendEncryptedFile(const std::string& path, SendPriority priority) {
+    if (!isConnected || !handshakeComplete) {
+        CRYPTOLINK_LOG_WARNING("客户端未连接或握手未完成");
+        return 0;
+    }
+    return files.sendFile(path, priority);
+}
+
+bool CryptoWebSocketClient::cancelFile(FileTransfer::TransferId id) {
+    return files.cancel(id);
+}
+
+RpcSession::CallId CryptoWebSocketClient::call(const std::string& method, std::string_view request,
+                                               RpcSession::ResponseHandler handler, std::chrono::milliseconds timeout,
+                                               SendPriority priority) {
+    if (!isConnected || !handshakeComplete) {
+        CRYPTOLINK_LOG_WARNING("客户端未连接或握手未完成");
+        return 0;
+    }
+    return rpc.call(method, request, std::move(handler), timeout, priority);
+}
+
+std::future<RpcResult> CryptoWebSocketClient::call(const std::string& method, std::string_view request,
+                                                   std::chrono::milliseconds timeout, SendPriority priority) {
+    auto done = std::make_shared<std::promise<RpcResult>>();
+    std::future<RpcResult> result = done->get_future();
+    RpcSession::CallId id = call(method, request, [done](RpcSession::Status status, std::string_view payload) {
+        done->set_value(RpcResult{status, std::string(payload)});
+    }, timeout, priority);
+    if (id == 0) {
+        done->set_value(RpcResult{RpcSession::Status::DISCONNECTED, std::string()});
+    }
+    return result;
+}
+
+void CryptoWebSocketClient::cancelCall(RpcSession::CallId id) {
+    rpc.cancel(id);
+    if (transport && isConnected) {
+        transport->post([this]() {
+            pollRpc();
+        });
+    }
+}
+
+void CryptoWebSocketClient::pollRpc() {
+    const auto now = std::chrono::steady_clock::now();
+    const auto next = rpc.poll(now);
+    if (next == std::chrono::steady_clock::time_point::max() || (rpcTimerArmed && rpcTimerDeadline <= next)) {
+        return;
+    }
+    
+    // 已设置的定时器晚于最近的截止时间时再设一个，先到的定时器重新计算下一次
+    rpcTimerArmed = true;
+    rpcTimerDeadline = next;
+    auto delay = std::chrono::ceil<std::chrono::milliseconds>(next - now);
+    transport->setTimer(delay, [this]() {
+        rpcTimerArmed = false;
+        pollRpc();
+    });
+}
+
+bool CryptoWebSocketClient::enableRelay(const std::string& name) {
+    return relay.enable(name);
+}
+
+std::string CryptoWebSocketClient::getRelayPublicKey() const {
+    return relay.publicKey();
+}
+
+bool CryptoWebSocketClient::setRelayPeerKey(const std::string& peer, const std::string& publicKey) {
+    return relay.setPeerKey(peer, publicKey);
+}
+
+bool CryptoWebSocketClient::sendRelayMessage(const std::string& peer, std::string_view message) {
+    if (!relay.enabled() || peer.empty() || peer.size() > PeerRelay::kMaxNameLength ||
+        message.size() > PeerRelay::kMaxMessageSize) {
+        CRYPTOLINK_LOG_WARNING("中继未启用、对端名字无效或消息过大");
+        return false;
+    }
     if (!isConnected || !handshakeComplete) {
-        std::cerr << "客户端未连接或握手未完成" << std::endl;
+        CRYPTOLINK_LOG_WARNING("客户端未连接或握手未完成");
         return false;
     }
     
-    try {
-        // 使用AES会话密钥加密消息
-        std::string encryptedData = aesKey->encryptWithLocal(message);
-        
-        Message msg = {ENCRYPTED_DATA, encryptedData};
-        std::string serialized = serializeMessage(msg);
-        
-        websocketpp::lib::error_code ec;
-        wsClient.send(connectionHandle, serialized, websocketpp::frame::opcode::text, ec);
+    // 记录头带上名字长度，负载是对端名字和明文，传输线程取出后按对端加密
+    OutboundRecord record;
+    record.header[0] = static_cast<char>(RELAY_DATA);
+    record.header[1] = static_cast<char>(peer.size());
+    record.headerLength = 2;
+    record.payload = BufferPool::local().acquire(peer.size() + message.size());
+    if (!record.payload) {
+        return false;
+    }
+    record.payload.append(peer.data(), peer.size());
+    record.payload.append(message.data(), message.size());
+    return enqueueRecord(std::move(record));
+}
+
+void CryptoWebSocketClient::setRelayMessageCallback(std::function<void(std::string_view, std::string_view)> callback) {
+    relay.setMessageHandler(std::move(callback));
+}
+
+void CryptoWebSocketClient::setRelayFailureCallback(std::function<void(std::string_view)> callback) {
+    relay.setFailureHandler(std::move(callback));
+}
+
+void CryptoWebSocketClient::enableDatagrams(DatagramCipher::Delivery delivery, const std::string& host) {
+    datagramsEnabled = true;
+    datagramDelivery = delivery;
+    datagramHost = host;
+}
+
+bool CryptoWebSocketClient::sendDatagram(std::string_view message) {
+    return datagramReady && datagrams->send(DatagramSocket::Handle(), message);
+}
+
+void CryptoWebSocketClient::setDatagramCallback(std::function<void(std::string_view)> callback) {
+    datagramCallback = callback;
+}
+
+void CryptoWebSocketClient::openDatagrams(std::string_view accept) {
+    uint64_t connectionId = 0;
+    uint16_t port = 0;
+    if (!datagrams || datagramReady || !DatagramSocket::decodeAccept(accept, connectionId, port)) {
+        return;
+    }
+    if (port == 0) {
+        CRYPTOLINK_LOG_WARNING("服务端未开启数据报通道");
+        return;
+    }
+    
+    // 数据报密钥与记录层的密钥分开派生，连接断开后通道随会话一起失效
+    datagrams->connect(datagramHost.empty() ? serverHost : datagramHost, port,
+        std::make_unique<DatagramCipher>(sessionCipher.getSuite(), connectionId, sessionCipher.getDatagramSendKey(),
+                                         sessionCipher.getDatagramReceiveKey(), datagramDelivery));
+    datagramReady = true;
+}
+
+void CryptoWebSocketClient::setFileReceiveDirectory(const std::string& directory) {
+    files.setReceiveDirectory(directory);
+}
+
+void CryptoWebSocketClient::setFileSentCallback(FileTransfer::CompletionHandler callback) {
+    files.setSentHandler(callback);
+}
+
+void CryptoWebSocketClient::setFileReceivedCallback(FileTransfer::CompletionHandler callback) {
+    files.setReceivedHandler(callback);
+}
+
+void CryptoWebSocketClient::setChannelMessageCallback(std::function<void(ChannelMux::ChannelId, std::string_view)> callback) {
+    channels.setDataHandler(callback);
+}
+
+void CryptoWebSocketClient::setChannelClosedCallback(std::function<void(ChannelMux::ChannelId)> callback) {
+    channels.setCloseHandler(callback);
+}
+
+bool CryptoWebSocketClient::sendRecord(MessageType type, std::string_view payload, SendPriority priority) {
+    // 1字节记录类型作为记录头
+    const char header = static_cast<char>(type);
+    return sendRecord(std::string_view(&header, 1), payload, priority);
+}
+
+bool CryptoWebSocketClient::sendRecord(std::string_view header, std::string_view payload, SendPriority priority) {
+    if (!isConnected || !handshakeComplete) {
+        CRYPTOLINK_LOG_WARNING("客户端未连接或握手未完成");
+        return false;
+    }
+    
+    OutboundRecord record;
+    std::memcpy(record.header, header.data(), header.size());
+    record.headerLength = static_cast<uint8_t>(header.size());
+    record.priority = priority;
+    record.payload = BufferPool::local().acquire(payload.size());
+    if (!record.payload) {
+        return false;
+    }
+    record.payload.append(payload.data(), payload.size());
+    return enqueueRecord(std::move(record));
+}
+
+bool CryptoWebSocketClient::enqueueRecord(OutboundRecord record) {
+    if (!isConnected || !handshakeComplete) {
+        CRYPTOLINK_LOG_WARNING("客户端未连接或握手未完成");
+        return false;
+    }
+    outbound.push(std::move(record));
+    scheduleOutboundDrain();
+    return true;
+}
+
+void CryptoWebSocketClient::scheduleOutboundDrain() {
+    // 只有把标志从 false 改为 true 的生产者负责唤醒传输线程，一批记录只投递一次任务
+    if (!outboundScheduled.exchange(true, std::memory_order_acq_rel)) {
+        transport->post([this]() {
+            drainOutbound();
+        });
+    }
+}
+
+void CryptoWebSocketClient::drainOutbound() {
+    // 先清除标志再取队列：之后入队的生产者会重新投递，不会有记录被遗漏
+    outboundScheduled.exchange(false, std::memory_order_acq_rel);
+    
+    OutboundRecord record;
+    size_t drained = 0;
+    while (drained < kMaxOutboundBatch && outbound.pop(record)) {
+        ++drained;
         
-        if (ec) {
-            std::cerr << "发送消息失败: " << ec.message() << std::endl;
-            return false;
+        // 连接在记录入队后断开，剩余记录直接丢弃；大消息交给工作线程池分段并行加密，完成后由 flushSegments 放入发送队列
+        if (handshakeComplete) {
+            if (record.header[0] == static_cast<char>(RELAY_DATA)) {
+                std::string_view payload = record.payload.view();
+                const size_t nameLength = static_cast<uint8_t>(record.header[1]);
+                relay.send(payload.substr(0, nameLength), payload.substr(nameLength));
+            } else if (segments && parallelThreshold > 0 && record.headerLength == 1 && record.payload.size() >= parallelThreshold &&
+                       segments->accepts(record.payload.size())) {
+                segments->seal(static_cast<uint8_t>(record.header[0]), record.priority, std::move(record.payload));
+            } else {
+                lanes.enqueue(record.priority, std::string_view(record.header, record.headerLength), std::move(record.payload));
+            }
         }
-        
-        return true;
+        record.payload = PooledBuffer();
+    }
+    
+    // 整批记录按优先级排好后再统一发送
+    pumpLanes();
+    
+    // 本批中的调用请求已经登记，取出登记并按截止时间设置定时器
+    if (handshakeComplete) {
+        pollRpc();
+    }
+    
+    // 一批处理不完时让出事件循环，剩余的记录在下一轮继续
+    if (drained == kMaxOutboundBatch) {
+        scheduleOutboundDrain();
+    }
+}
+
+void CryptoWebSocketClient::flushSegments() {
+    // 解密完成的接收消息按原记录类型处理
+    uint8_t innerType = 0;
+    std::string_view received;
+    while (segments && segments->collectIncoming(innerType, received)) {
+        const char innerHeader = static_cast<char>(innerType);
+        dispatchRecord(std::string_view(&innerHeader, 1), received);
+    }
+    if (!segments) {
+        return;
+    }
+    
+    SegmentCipher::SealedMessage message;
+    while (segments->collect(message)) {
+        // SEGMENT_BEGIN 经记录层加密，和各段放在同一个通道里，保证先于各段发出
+        const char beginHeader = static_cast<char>(SEGMENT_BEGIN);
+        lanes.enqueue(message.priority, std::string_view(&beginHeader, 1), std::move(message.begin));
+        for (PooledBuffer& segment : message.segments) {
+            std::string_view header(segment.data(), SegmentCipher::kHeaderSize);
+            lanes.enqueue(message.priority, header, std::move(segment));
+        }
+    }
+    pumpLanes();
+}
+
+void CryptoWebSocketClient::pumpLanes() {
+    if (lanes.empty()) {
+        return;
+    }
+    
+    bool pending = true;
+    try {
+        // 传输层已排队的数据到达上限时先不发，等它写出去后高优先级记录还能插到前面
+        size_t buffered = transport->bufferedAmount(connectionHandle);
+        pending = buffered >= sendQueueLimit || lanes.pump(sendQueueLimit - buffered);
     } catch (const std::exception& e) {
-        std::cerr << "发送加密消息异常: " << e.what() << std::endl;
-        return false;
+        CRYPTOLINK_LOG_ERROR("发送加密消息异常: " << e.what());
+    }
+    
+    if (pending && !sendPollScheduled) {
+        sendPollScheduled = true;
+        transport->setTimer(kSendPollInterval, [this]() {
+            sendPollScheduled = false;
+            if (handshakeComplete) {
+                pumpLanes();
+            }
+        });
+    }
+}
+
+void CryptoWebSocketClient::setParallelThreshold(size_t bytes) {
+    parallelThreshold = bytes;
+}
+
+void CryptoWebSocketClient::setParallelReceiveLimit(uint64_t bytes) {
+    parallelReceiveLimit = bytes;
+}
+
+void CryptoWebSocketClient::setLatencyProbeInterval(std::chrono::milliseconds interval) {
+    latencyProbeInterval = interval;
+}
+
+void CryptoWebSocketClient::setTimestampRecords(bool enabled) {
+    timestampRecords = enabled;
+}
+
+LatencyStats CryptoWebSocketClient::getLatencyStats() const {
+    // 事件循环线程上或事件循环没有运行时直接读取，否则投递到事件循环上取快照
+    const bool direct = eventLoop
+        ? eventLoop->stopped() || eventLoop->get_executor().running_in_this_thread()
+        : !loopRunning || inTransportThread();
+    if (direct) {
+        return latencyProbe.getStats();
+    }
+    return transport->call<LatencyStats>([this]() {
+        return latencyProbe.getStats();
+    }, kSnapshotTimeout).value_or(LatencyStats());
+}
+
+void CryptoWebSocketClient::sendLatencyProbe() {
+    if (!handshakeComplete || latencyProbeInterval.count() <= 0) {
+        return;
     }
+    
+    char probe[LatencyProbe::kProbeSize];
+    latencyProbe.makeProbe(probe);
+    
+    // 探测走控制通道并立即发出，测到的往返时间不包含排在后面的大块数据
+    const char header = static_cast<char>(PROBE);
+    PooledBuffer payload = BufferPool::local().copyFrom(probe, sizeof(probe));
+    if (payload) {
+        lanes.enqueue(SendPriority::CONTROL, std::string_view(&header, 1), std::move(payload));
+        pumpLanes();
+    }
+    
+    transport->setTimer(latencyProbeInterval, [this]() {
+        sendLatencyProbe();
+    });
+}
+
+void CryptoWebSocketClient::setPriorityWeights(const PriorityLanes::Weights& weights) {
+    lanes.setWeights(weights);
+}
+
+void CryptoWebSocketClient::setSendQueueLimit(size_t bytes) {
+    sendQueueLimit = std::max(bytes, PriorityLanes::kFragmentSize);
+}
+
+void CryptoWebSocketClient::setCipherSuites(const std::vector<CipherSuite>& suites) {
+    offeredCipherSuites = suites;
+}
+
+CipherSuite CryptoWebSocketClient::getNegotiatedCipherSuite() const {
+    return handshakeComplete ? sessionCipher.getSuite() : CipherSuite::NONE;
 }
 
-void CryptoWebSocketClient::setMessageCallback(std::function<void(const std::string&)> callback) {
-    messageCallback = callback;
+void CryptoWebSocketClient::setOwnedMessageCallback(std::function<void(std::string)> callback) {
+    ownedMessageCallback = callback;
+    messageCallback = nullptr;
+}
+
+void CryptoWebSocketClient::setEventLoop(boost::asio::io_context& loop) {
+    eventLoop = &loop;
 }
 
 void CryptoWebSocketClient::run() {
+    if (!transport || eventLoop) {
+        return;
+    }
     clientThread = std::thread([this]() {
-        wsClient.run();
+        loopRunning = true;
+        transport->run();
+        loopRunning = false;
     });
 }
 
+bool CryptoWebSocketClient::inTransportThread() const {
+    return clientThread.joinable() && clientThread.get_id() == std::this_thread::get_id();
+}
+
 void CryptoWebSocketClient::stop() {
-    wsClient.stop();
+    if (transport) {
+        transport->stop();
+    }
     if (clientThread.joinable()) {
         clientThread.join();
     }
 }
 
+BufferPoolStats CryptoWebSocketClient::getBufferPoolStats() {
+    return BufferPool::aggregateStats();
+}
+
 void CryptoWebSocketClient::onOpen(websocketpp::connection_hdl hdl) {
-    std::cout << "连接已建立，开始握手..." << std::endl;
+    CRYPTOLINK_LOG_INFO("连接已建立，开始握手...");
+    connectionHandle = hdl;
     isConnected = true;
+    if (connectCallback) {
+        connectCallback(true);
+    }
     performHandshake();
 }
 
 void CryptoWebSocketClient::onClose(websocketpp::connection_hdl hdl) {
-    std::cout << "连接已关闭" << std::endl;
+    CRYPTOLINK_LOG_INFO("连接已关闭");
     isConnected = false;
     handshakeComplete = false;
+    channels.reset();
+    lanes.reset();
+    segments.reset();
+    
+    // 接收中的文件留在磁盘上，发送中的文件等重新连接后续传
+    files.disconnect(true);
+    
+    // 在途调用以 DISCONNECTED 结束，不会跨连接重发
+    rpc.disconnect();
+    rpcTimerArmed = false;
+    
+    // 等待查询对端公钥的中继消息视为未送达
+    relay.disconnect();
+    
+    // 数据报通道随会话关闭，下次握手后用新的密钥重新打开
+    datagramReady = false;
+    if (datagrams) {
+        datagrams->close();
+    }
+    
+    if (connectCallback) {
+        connectCallback(false);
+    }
 }
 
-void CryptoWebSocketClient::onMessage(websocketpp::connection_hdl hdl, message_ptr msg) {
-    std::string payload = msg->get_payload();
-    
+void CryptoWebSocketClient::onMessage(websocketpp::connection_hdl hdl, Transport::FrameType type, std::string& payload) {
     if (!handshakeComplete) {
         handleHandshakeMessage(payload);
+    } else if (type == Transport::FrameType::BINARY) {
+        // 二进制加密记录直接在接收帧缓冲区内解密
+        handleEncryptedRecord(payload);
     } else {
-        // 处理加密消息
+        // 兼容旧版本的JSON加密消息
         Message parsedMsg = parseMessage(payload);
         if (parsedMsg.type == ENCRYPTED_DATA) {
-            std::string decryptedData = aesKey->decryptWithLocal(parsedMsg.data);
-            if (messageCallback) {
-                messageCallback(decryptedData);
+            PooledBuffer decryptedData = aesKey->decryptWithLocal(parsedMsg.data, BufferPool::local());
+            if (decryptedData) {
+                deliverMessage(decryptedData.view());
             }
         }
     }
 }
 
+void CryptoWebSocketClient::handleEncryptedRecord(std::string& record) {
+    if (record.empty()) {
+        return;
+    }
+    
+    // 分段记录不经过记录层，各段在工作线程上并行解密，整条消息校验通过后由 flushSegments 按原记录类型处理
+    const uint8_t type = static_cast<uint8_t>(record[0]);
+    if (SegmentCipher::isSegmentRecord(type)) {
+        if (segments) {
+            segments->handleSegment(record);
+        }
+        return;
+    }
+    
+    // 中继数据记录由对端端到端加密，服务端原样转发，不经过会话加密
+    if (PeerRelay::isRelayFrame(type)) {
+        relay.handleFrame(record);
+        return;
+    }
+    
+    // 通道记录和分片记录的记录头更长
+    size_t headerLength = 1;
+    if (ChannelMux::isChannelRecord(type)) {
+        headerLength = ChannelMux::kHeaderSize;
+    } else if (PriorityLanes::isFragmentRecord(type)) {
+        headerLength = PriorityLanes::kHeaderSize;
+    }
+    if (record.size() < headerLength) {
+        return;
+    }
+    
+    std::string_view plaintext;
+    if (!sessionCipher.open(&record[0], record.size(), headerLength, plaintext)) {
+        return;
+    }
+    
+    std::string_view header(record.data(), headerLength);
+    if (PriorityLanes::isFragmentRecord(type)) {
+        // 分片拼接完整后按原记录类型处理，只有单字节记录头的记录会被分片
+        uint8_t innerType = 0;
+        std::string_view message;
+        if (lanes.reassemble(header, plaintext, innerType, message)) {
+            const char innerHeader = static_cast<char>(innerType);
+            dispatchRecord(std::string_view(&innerHeader, 1), message);
+        }
+        return;
+    }
+    dispatchRecord(header, plaintext);
+}
+
+void CryptoWebSocketClient::dispatchRecord(std::string_view header, std::string_view plaintext) {
+    switch (static_cast<MessageType>(static_cast<uint8_t>(header[0]))) {
+        case ENCRYPTED_DATA:
+            deliverMessage(plaintext);
+            break;
+        case STAMPED_DATA: {
+            std::string_view message;
+            if (latencyProbe.handleStamped(plaintext, message)) {
+                deliverMessage(message);
+            }
+            break;
+        }
+        case PROBE: {
+            // 立即应答，应答中带上收到和发出的时刻，对端据此扣除本端的处理时间
+            const int64_t receivedAt = LatencyProbe::now();
+            char reply[LatencyProbe::kReplySize];
+            if (LatencyProbe::makeReply(plaintext, receivedAt, reply)) {
+                PooledBuffer payload = BufferPool::local().copyFrom(reply, sizeof(reply));
+                const char replyHeader = static_cast<char>(PROBE_REPLY);
+                if (payload) {
+                    lanes.enqueue(SendPriority::CONTROL, std::string_view(&replyHeader, 1), std::move(payload));
+                    pumpLanes();
+                }
+            }
+            break;
+        }
+        case PROBE_REPLY:
+            latencyProbe.handleReply(plaintext);
+            break;
+        case SIGNED_DATA: {
+            std::string_view message;
+            if (!signedVerifier->verify(plaintext, message)) {
+                CRYPTOLINK_LOG_WARNING("签名消息验证失败");
+                break;
+            }
+            if (signedMessageCallback) {
+                signedMessageCallback(message);
+            } else {
+                deliverMessage(message);
+            }
+            break;
+        }
+        case PUBLISH: {
+            std::string_view topic;
+            std::string_view message;
+            if (!TopicIndex::decodePublication(plaintext, topic, message)) {
+                break;
+            }
+            if (topicMessageCallback) {
+                topicMessageCallback(topic, message);
+            } else {
+                deliverMessage(message);
+            }
+            break;
+        }
+        case CHANNEL_OPEN:
+        case CHANNEL_DATA:
+        case CHANNEL_CLOSE:
+        case CHANNEL_CREDIT:
+            channels.handleRecord(header, plaintext);
+            break;
+        case SEGMENT_BEGIN:
+            // 拒绝的消息告诉服务端，它的段到达后直接丢弃
+            if (!segments || !segments->handleBegin(plaintext)) {
+                CRYPTOLINK_LOG_WARNING("拒绝服务端的分段消息");
+                PooledBuffer reject = SegmentCipher::rejectFor(plaintext);
+                if (reject) {
+                    sendRecord(SEGMENT_REJECT, reject.view(), SendPriority::CONTROL);
+                }
+            }
+            break;
+        case SEGMENT_LIMIT:
+            if (segments) {
+                segments->handleLimit(plaintext);
+            }
+            break;
+        case SEGMENT_REJECT:
+            if (segments) {
+                segments->handleReject(plaintext);
+            }
+            break;
+        case FILE_OFFER:
+        case FILE_CHUNK:
+        case FILE_ACK:
+        case FILE_CANCEL:
+            files.handleRecord(static_cast<uint8_t>(header[0]), plaintext);
+            break;
+        case RPC_REQUEST:
+        case RPC_RESPONSE:
+        case RPC_CANCEL:
+            rpc.handleRecord(static_cast<uint8_t>(header[0]), plaintext);
+            break;
+        case RELAY_PEER:
+            // 查询到对端公钥后排队的消息在这里加密放入发送队列
+            relay.handleRecord(static_cast<uint8_t>(header[0]), plaintext);
+            pumpLanes();
+            break;
+        case DATAGRAM_ACCEPT:
+            openDatagrams(plaintext);
+            break;
+        default:
+            CRYPTOLINK_LOG_WARNING("未知的二进制记录类型");
+            break;
+    }
+}
+
+void CryptoWebSocketClient::deliverMessage(std::string_view plaintext) {
+    if (messageCallback) {
+        messageCallback(plaintext);
+    } else if (ownedMessageCallback) {
+        ownedMessageCallback(std::string(plaintext));
+    }
+}
+
 void CryptoWebSocketClient::onFail(websocketpp::connection_hdl hdl) {
-    std::cerr << "连接失败" << std::endl;
+    CRYPTOLINK_LOG_WARNING("连接失败");
     isConnected = false;
+    if (connectCallback) {
+        connectCallback(false);
+    }
 }
 
 void CryptoWebSocketClient::performHandshake() {
-    // 发送公钥请求
-    Message msg = {PUBLIC_KEY_REQUEST, ""};
-    std::string serialized = serializeMessage(msg);
+    ++handshakeGeneration;
+    
+    // 服务端不回复套件选择时（旧版本服务端）按CBC处理
+    sessionCipher.reset();
+    sessionCipher.selectSuite(CipherSuite::AES_256_CBC);
+    channels.reset();
+    lanes.reset();
+    segments.reset();
+    
+    // 预共享密钥握手：只发一条带随机数的问候，不生成会话密钥也不做非对称运算
+    if (!pskIdentity.empty()) {
+        pskOffer = cipherSuitesToString(PskHandshake::aeadSuites(offeredCipherSuites));
+        pskNonce = PskHandshake::makeNonce();
+        Message hello = {PSK_HELLO, PskHandshake::encodeHello(pskIdentity, pskNonce, pskOffer)};
+        if (!sendHandshakeMessage(hello)) {
+            CRYPTOLINK_LOG_ERROR("发送 PSK 问候失败");
+        }
+        return;
+    }
     
-    websocketpp::lib::error_code ec;
-    wsClient.send(connectionHandle, serialized, websocketpp::frame::opcode::text, ec);
+    // 每个连接使用新的会话密钥
+    aesKey->generateRawKey();
     
-    if (ec) {
-        std::cerr << "发送公钥请求失败: " << ec.message() << std::endl;
+    // 发送公钥请求，附带客户端支持的加密套件列表
+    suiteOffer = cipherSuitesToString(offeredCipherSuites);
+    Message msg = {PUBLIC_KEY_REQUEST, suiteOffer};
+    if (!sendHandshakeMessage(msg)) {
+        CRYPTOLINK_LOG_ERROR("发送公钥请求失败");
     }
 }
 
 void CryptoWebSocketClient::handleHandshakeMessage(const std::string& message) {
     Message msg = parseMessage(message);
     
+    // 配置了 PSK 时只接受 PSK_ACCEPT，RSA 握手时也不接受它；对端换用另一种握手说明配置不一致或握手被篡改
+    if (pskIdentity.empty() == (msg.type == PSK_ACCEPT)) {
+        CRYPTOLINK_LOG_ERROR("收到与握手方式不符的握手消息: " << msg.type);
+        transport->close(connectionHandle, Transport::CLOSE_POLICY_VIOLATION, "Unexpected handshake message");
+        return;
+    }
+    
     switch (msg.type) {
+        case CIPHER_SUITE_SELECT: {
+            // 服务端从我们提供的列表中选出的套件，不在列表中说明握手被篡改（例如降级到CBC）
+            const std::vector<CipherSuite> offer = parseCipherSuites(suiteOffer);
+            const std::vector<CipherSuite> selected = parseCipherSuites(msg.data);
+            if (selected.size() != 1 ||
+                std::find(offer.begin(), offer.end(), selected.front()) == offer.end()) {
+                CRYPTOLINK_LOG_ERROR("服务端选择了未提供的加密套件: " << msg.data);
+                transport->close(connectionHandle, Transport::CLOSE_POLICY_VIOLATION, "Cipher suite not offered");
+                break;
+            }
+            sessionCipher.selectSuite(selected.front(), cipherSuiteTranscript(suiteOffer, selected.front()));
+            break;
+        }
         case PUBLIC_KEY_RESPONSE: {
+            // 没有收到套件选择时只能按旧版本服务端的CBC处理，前提是我们提供了CBC
+            const std::vector<CipherSuite> offer = parseCipherSuites(suiteOffer);
+            if (sessionCipher.getTranscript().empty() && !offer.empty() &&
+                std::find(offer.begin(), offer.end(), CipherSuite::AES_256_CBC) == offer.end()) {
+                CRYPTOLINK_LOG_ERROR("服务端没有选择加密套件");
+                transport->close(connectionHandle, Transport::CLOSE_POLICY_VIOLATION, "Cipher suite not selected");
+                break;
+            }
+            
             // 设置服务器公钥
             rsaKey->setRemotePublicKey(msg.data);
             
-            // 发送客户端公钥
-            Message response = {PUBLIC_KEY_RESPONSE, rsaKey->getLocalPublicKey()};
-            std::string serialized = serializeMessage(response);
-            
-            websocketpp::lib::error_code ec;
-            wsClient.send(connectionHandle, serialized, websocketpp::frame::opcode::text, ec);
+            // 共享事件循环上身份还在生成时不能阻塞，否则同一循环上的所有会话都会停住
+            if (eventLoop && !identityReady()) {
+                awaitIdentity(handshakeGeneration);
+                break;
+            }
+            sendSessionKey();
+            break;
+        }
+        case PSK_ACCEPT: {
+            std::string serverNonce;
+            std::string serverConfirm;
+            CipherSuite suite = CipherSuite::NONE;
+            PskHandshake::Derived derived;
+            const std::vector<CipherSuite> offer = parseCipherSuites(pskOffer);
             
-            // 发送会话密钥（用服务器公钥加密）
-            std::string sessionKey = aesKey->getLocalKey();
-            std::string encryptedSessionKey = rsaKey->encryptWithRemotePublic(sessionKey);
+            // 确认值不符说明服务端没有同一个 PSK，或握手消息被篡改
+            if (!PskHandshake::parseAccept(msg.data, serverNonce, suite, serverConfirm) ||
+                std::find(offer.begin(), offer.end(), suite) == offer.end() ||
+                !PskHandshake::derive(pskKey, pskIdentity, pskOffer, suite, pskNonce, serverNonce, derived) ||
+                !PskHandshake::confirmEquals(serverConfirm, derived.serverConfirm)) {
+                CRYPTOLINK_LOG_ERROR("预共享密钥握手失败");
+                transport->close(connectionHandle, Transport::CLOSE_POLICY_VIOLATION, "PSK confirmation failed");
+                break;
+            }
             
-            Message sessionMsg = {SESSION_KEY, encryptedSessionKey};
-            std::string sessionSerialized = serializeMessage(sessionMsg);
-            wsClient.send(connectionHandle, sessionSerialized, websocketpp::frame::opcode::text, ec);
+            sessionCipher.selectSuite(suite);
+            if (!sessionCipher.initialize(derived.secret, true)) {
+                CRYPTOLINK_LOG_ERROR("会话加密器初始化失败");
+                break;
+            }
             
-            handshakeComplete = true;
-            std::cout << "握手完成！" << std::endl;
+            // 确认消息先于之后的加密记录发出，服务端收到后开始处理记录
+            Message finished = {PSK_FINISHED, PskHandshake::encodeFinished(derived.clientConfirm)};
+            sendHandshakeMessage(finished);
+            completeHandshake();
             break;
         }
         default:
@@ -192,6 +1112,81 @@ void CryptoWebSocketClient::handleHandshakeMessage(const std::string& message) {
     }
 }
 
+void CryptoWebSocketClient::sendSessionKey() {
+    if (!installIdentity()) {
+        CRYPTOLINK_LOG_ERROR("客户端身份密钥不可用");
+        transport->close(connectionHandle, Transport::CLOSE_POLICY_VIOLATION, "Identity unavailable");
+        return;
+    }
+    
+    // 发送客户端公钥
+    Message response = {PUBLIC_KEY_RESPONSE, rsaKey->getLocalPublicKey()};
+    sendHandshakeMessage(response);
+    
+    // 发送会话密钥（用服务器公钥加密）
+    // 新版本服务端选择了套件时附上协商记录（"key:iv:记录"），由服务端核对
+    std::string sessionKey = aesKey->getLocalKey();
+    std::string sessionKeyPayload = sessionKey;
+    if (!sessionCipher.getTranscript().empty()) {
+        sessionKeyPayload += ":" + sessionCipher.getTranscript();
+    }
+    std::string encryptedSessionKey = rsaKey->encryptWithRemotePublic(sessionKeyPayload);
+    
+    Message sessionMsg = {SESSION_KEY, encryptedSessionKey};
+    sendHandshakeMessage(sessionMsg);
+    
+    if (!sessionCipher.initialize(sessionKey, true)) {
+        CRYPTOLINK_LOG_ERROR("会话加密器初始化失败");
+        return;
+    }
+    
+    completeHandshake();
+}
+
+void CryptoWebSocketClient::completeHandshake() {
+    // AEAD 套件的会话支持大消息分段并行加解密，关闭并行加密时不接受分段消息
+    if (sessionCipher.getSuite() != CipherSuite::AES_256_CBC && parallelThreshold > 0) {
+        segments = std::make_unique<SegmentCipher>(sessionCipher.getSuite(),
+            sessionCipher.getSegmentSendKey(), sessionCipher.getSegmentReceiveKey(), [this]() {
+                transport->post([this]() {
+                    flushSegments();
+                });
+            });
+        segments->setReceiveLimit(parallelReceiveLimit);
+    }
+    
+    handshakeComplete = true;
+    CRYPTOLINK_LOG_INFO("握手完成！加密套件: " << cipherSuiteName(sessionCipher.getSuite()));
+    
+    // 告诉服务端本端接收分段消息的上限，服务端收到之前大消息串行发送
+    if (segments) {
+        PooledBuffer limit = segments->limitPayload();
+        sendRecord(SEGMENT_LIMIT, limit.view(), SendPriority::CONTROL);
+    }
+    
+    // 握手完成后立即发出第一次探测，之后按间隔周期探测
+    sendLatencyProbe();
+    
+    // 上一个连接上未完成的文件传输从服务端已写入的位置续传
+    files.resume();
+    
+    // 向服务端登记中继名字和公钥
+    relay.connected();
+    
+    // 请求打开数据报通道，服务端回复连接号和 UDP 端口
+    if (datagrams && sessionCipher.getSuite() != CipherSuite::AES_256_CBC) {
+        sendRecord(DATAGRAM_OPEN, std::string_view(), SendPriority::CONTROL);
+    }
+    if (handshakeCallback) {
+        handshakeCallback();
+    }
+}
+
+bool CryptoWebSocketClient::sendHandshakeMessage(const Message& msg) {
+    std::string serialized = serializeMessage(msg);
+    return transport->send(connectionHandle, serialized.data(), serialized.size(), Transport::FrameType::TEXT);
+}
+
 std::string CryptoWebSocketClient::serializeMessage(const Message& msg) {
     Json::Value root;
     root["type"] = static_cast<int>(msg.type);
@@ -203,14 +1198,10 @@ std::string CryptoWebSocketClient::serializeMessage(const Message& msg) {
 
 CryptoWebSocketClient::Message CryptoWebSocketClient::parseMessage(const std::string& data) {
     Json::Value root;
-    Json::CharReaderBuilder builder;
-    Json::CharReader* reader = builder.newCharReader();
-    
     std::string errors;
-    bool success = reader->parse(data.c_str(), data.c_str() + data.length(), &root, &errors);
-    delete reader;
+    bool success = jsonReader->parse(data.c_str(), data.c_str() + data.length(), &root, &errors);
     
-    Message msg;
+    Message msg = {};
     if (success) {
         msg.type = static_cast<MessageType>(root["type"].asInt());
         msg.data = root["data"].asString();
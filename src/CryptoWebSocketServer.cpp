@@ -1,30 +1,47 @@
 #include "CryptoWebSocketServer.h"
-#include <iostream>
+#include "PskHandshake.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <cryptopp/osrng.h>
 #include <jsoncpp/json/json.h>
 
-CryptoWebSocketServer::CryptoWebSocketServer() : isRunning(false) {
+namespace {
+
+// 事件循环每轮最多处理的待发送记录数，避免大量发送饿死接收和定时器
+const size_t kMaxOutboundBatch = 256;
+
+// 每个连接默认最多交给传输层 256KB 尚未写出的数据
+const size_t kDefaultSendQueueLimit = 256 * 1024;
+
+// 传输层排队数据超过上限时，隔多久再检查一次
+const std::chrono::milliseconds kSendPollInterval(1);
+
+// 默认从 1MB 起分段并行加密
+const size_t kDefaultParallelThreshold = 1024 * 1024;
+
+// 其他线程读取事件循环上的统计时最多等待多久
+const std::chrono::milliseconds kSnapshotTimeout(1000);
+
+}
+
+CryptoWebSocketServer::CryptoWebSocketServer(unsigned int rsaKeySize)
+    : nextSessionId(1), reapedSessions(0), rsaKeySize(rsaKeySize), isRunning(false), outboundScheduled(false),
+      signedBatchWindow(5), signedBatchLimit(4096), signedBatchGeneration(0),
+      priorityWeights(PriorityLanes::kDefaultWeights), sendQueueLimit(kDefaultSendQueueLimit), sendPollScheduled(false),
+      parallelThreshold(kDefaultParallelThreshold), parallelReceiveLimit(SegmentCipher::kDefaultReceiveLimit),
+      latencyProbeInterval(0), timestampRecords(false), relayEnabled(false),
+      datagramDelivery(DatagramCipher::Delivery::UNORDERED) {
+    // 复用JSON解析器，避免每条消息重新构造
+    jsonReader.reset(Json::CharReaderBuilder().newCharReader());
+    
     // 初始化服务器RSA密钥
-    serverRSAKey = std::make_unique<RSAKey>();
+    serverRSAKey = std::make_unique<RSAKey>(rsaKeySize);
     serverRSAKey->generateKeyPair();
+    batchSigner = std::make_unique<MerkleBatchSigner>(*serverRSAKey);
     
-    // 配置WebSocket服务器
-    wsServer.set_access_channels(websocketpp::log::alevel::all);
-    wsServer.clear_access_channels(websocketpp::log::alevel::frame_payload);
-    wsServer.init_asio();
-    wsServer.set_reuse_addr(true);
-    
-    // 设置回调函数
-    wsServer.set_open_handler([this](websocketpp::connection_hdl hdl) {
-        this->onOpen(hdl);
-    });
-    
-    wsServer.set_close_handler([this](websocketpp::connection_hdl hdl) {
-        this->onClose(hdl);
-    });
-    
-    wsServer.set_message_handler([this](websocketpp::connection_hdl hdl, message_ptr msg) {
-        this->onMessage(hdl, msg);
-    });
+    // 默认按本机CPU特性选择加密套件优先级
+    cipherSuitePreference = preferredCipherSuites();
 }
 
 CryptoWebSocketServer::~CryptoWebSocketServer() {
@@ -32,22 +49,47 @@ CryptoWebSocketServer::~CryptoWebSocketServer() {
 }
 
 bool CryptoWebSocketServer::start(uint16_t port) {
-    try {
-        wsServer.listen(port);
-        wsServer.start_accept();
-        
-        isRunning = true;
-        std::cout << "服务器启动在端口: " << port << std::endl;
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "服务器启动失败: " << e.what() << std::endl;
+    return start(std::to_string(port));
+}
+
+bool CryptoWebSocketServer::start(const std::string& endpoint) {
+    std::string address;
+    transport = Transport::create(endpoint, true, address);
+    if (!transport) {
         return false;
     }
+    
+    // 握手和记录层只通过传输接口收发，各后端共用同一套回调
+    Transport::Handlers handlers;
+    handlers.onOpen = [this](websocketpp::connection_hdl hdl) {
+        this->onOpen(hdl);
+    };
+    handlers.onClose = [this](websocketpp::connection_hdl hdl) {
+        this->onClose(hdl);
+    };
+    handlers.onMessage = [this](websocketpp::connection_hdl hdl, Transport::FrameType type, std::string& payload) {
+        this->onMessage(hdl, type, payload);
+    };
+    handlers.onPong = [this](websocketpp::connection_hdl hdl) {
+        this->onPong(hdl);
+    };
+    transport->setHandlers(std::move(handlers));
+    
+    if (!transport->listen(address)) {
+        CRYPTOLINK_LOG_ERROR("服务器启动失败: " << endpoint);
+        transport.reset();
+        return false;
+    }
+    
+    isRunning = true;
+    startTimerTick();
+    CRYPTOLINK_LOG_INFO("服务器启动在: " << endpoint);
+    return true;
 }
 
 void CryptoWebSocketServer::stop() {
     if (isRunning) {
-        wsServer.stop();
+        transport->stop();
         isRunning = false;
         
         if (serverThread.joinable()) {
@@ -56,101 +98,1151 @@ void CryptoWebSocketServer::stop() {
     }
 }
 
-void CryptoWebSocketServer::broadcastEncryptedMessage(const std::string& message) {
-    for (auto& pair : clientAESKeys) {
-        if (handshakeStatus[pair.first]) {
-            sendEncryptedMessage(pair.first, message);
+void CryptoWebSocketServer::broadcastEncryptedMessage(const std::string& message, SendPriority priority) {
+    // 明文只拷贝一次，事件循环上为每个会话分别加密
+    OutboundRecord record;
+    record.target = OutboundRecord::BROADCAST;
+    record.priority = priority;
+    MessageType type = ENCRYPTED_DATA;
+    record.payload = encodeData(message, type);
+    if (!record.payload) {
+        return;
+    }
+    record.header[0] = static_cast<char>(type);
+    record.headerLength = 1;
+    enqueueRecord(std::move(record));
+}
+
+bool CryptoWebSocketServer::sendEncryptedMessage(websocketpp::connection_hdl hdl, const std::string& message,
+                                                 SendPriority priority) {
+    OutboundRecord record;
+    record.hdl = hdl;
+    record.priority = priority;
+    MessageType type = ENCRYPTED_DATA;
+    record.payload = encodeData(message, type);
+    if (!record.payload) {
+        return false;
+    }
+    record.header[0] = static_cast<char>(type);
+    record.headerLength = 1;
+    return enqueueRecord(std::move(record));
+}
+
+PooledBuffer CryptoWebSocketServer::encodeData(std::string_view message, MessageType& type) {
+    // 发送时刻在调用发送接口时记录，对端算出的单向延迟包含本端排队的时间
+    const bool stamped = timestampRecords.load(std::memory_order_relaxed);
+    PooledBuffer payload = BufferPool::local().acquire(message.size() + (stamped ? LatencyProbe::kStampSize : 0));
+    if (!payload) {
+        return payload;
+    }
+    if (stamped) {
+        char stamp[LatencyProbe::kStampSize];
+        LatencyProbe::writeStamp(stamp);
+        payload.append(stamp, sizeof(stamp));
+        type = STAMPED_DATA;
+    } else {
+        type = ENCRYPTED_DATA;
+    }
+    payload.append(message.data(), message.size());
+    return payload;
+}
+
+bool CryptoWebSocketServer::sendSignedMessage(websocketpp::connection_hdl hdl, const std::string& message,
+                                              SendPriority priority) {
+    // 先按普通记录入队，事件循环取出时转入签名批次
+    return sendRecord(hdl, SIGNED_DATA, message, priority);
+}
+
+void CryptoWebSocketServer::setSignedBatchWindow(std::chrono::milliseconds window, size_t maxMessages) {
+    signedBatchWindow = window;
+    signedBatchLimit = std::max<size_t>(1, maxMessages);
+}
+
+void CryptoWebSocketServer::addSignedMessage(websocketpp::connection_hdl hdl, SendPriority priority, PooledBuffer message) {
+    batchSigner->add(message.view());
+    pendingSigned.push_back({hdl, priority, std::move(message)});
+    
+    if (pendingSigned.size() >= signedBatchLimit) {
+        flushSignedBatch();
+        return;
+    }
+    
+    // 批次的第一条消息启动窗口定时器；批次提前签完时旧定时器按代号失效
+    if (pendingSigned.size() == 1) {
+        uint64_t generation = signedBatchGeneration;
+        transport->setTimer(signedBatchWindow, [this, generation]() {
+            if (generation == signedBatchGeneration) {
+                flushSignedBatch();
+            }
+        });
+    }
+}
+
+void CryptoWebSocketServer::flushSignedBatch() {
+    if (pendingSigned.empty()) {
+        return;
+    }
+    ++signedBatchGeneration;
+    
+    if (batchSigner->sign()) {
+        for (size_t i = 0; i < pendingSigned.size(); ++i) {
+            PendingSigned& pending = pendingSigned[i];
+            PooledBuffer payload = batchSigner->encode(i, pending.message.view(), BufferPool::local());
+            if (payload) {
+                const char header = static_cast<char>(SIGNED_DATA);
+                queueRecord(pending.hdl, pending.priority, std::string_view(&header, 1), std::move(payload));
+            }
         }
     }
+    
+    pendingSigned.clear();
+    batchSigner->reset();
+    pumpLanes();
 }
 
-bool CryptoWebSocketServer::sendEncryptedMessage(websocketpp::connection_hdl hdl, const std::string& message) {
-    auto it = clientAESKeys.find(hdl);
-    auto statusIt = handshakeStatus.find(hdl);
+size_t CryptoWebSocketServer::publish(const std::string& topic, std::string_view message, SendPriority priority) {
+    if (!TopicIndex::isValidTopic(topic)) {
+        CRYPTOLINK_LOG_WARNING("无效的发布主题: " << topic);
+        return 0;
+    }
     
-    if (it == clientAESKeys.end() || statusIt == handshakeStatus.end() || !statusIt->second) {
-        std::cerr << "客户端未找到或握手未完成" << std::endl;
+    // 只遍历匹配的订阅者
+    std::vector<TopicIndex::SubscriberId> subscribers;
+    {
+        std::shared_lock<std::shared_mutex> lock(topicMutex);
+        topicIndex.match(topic, subscribers);
+    }
+    if (subscribers.empty()) {
+        return 0;
+    }
+    
+    // 发布负载只构造一次，每个订阅者的记录共享它，在事件循环上用各自的会话密钥加密
+    PooledBuffer publication = TopicIndex::encodePublication(topic, message, BufferPool::local());
+    if (!publication) {
+        return 0;
+    }
+    
+    for (TopicIndex::SubscriberId subscriber : subscribers) {
+        OutboundRecord record;
+        record.target = OutboundRecord::SESSION_ID;
+        record.sessionId = subscriber;
+        record.header[0] = static_cast<char>(PUBLISH);
+        record.headerLength = 1;
+        record.priority = priority;
+        record.payload = publication;
+        enqueueRecord(std::move(record));
+    }
+    return subscribers.size();
+}
+
+bool CryptoWebSocketServer::subscribeClient(websocketpp::connection_hdl hdl, const std::string& pattern) {
+    auto it = clientSessionIds.find(hdl);
+    if (it == clientSessionIds.end()) {
         return false;
     }
+    std::unique_lock<std::shared_mutex> lock(topicMutex);
+    return topicIndex.subscribe(it->second, pattern);
+}
+
+bool CryptoWebSocketServer::unsubscribeClient(websocketpp::connection_hdl hdl, const std::string& pattern) {
+    auto it = clientSessionIds.find(hdl);
+    if (it == clientSessionIds.end()) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(topicMutex);
+    return topicIndex.unsubscribe(it->second, pattern);
+}
+
+bool CryptoWebSocketServer::sendOnChannel(websocketpp::connection_hdl hdl, ChannelMux::ChannelId channel, std::string_view message) {
+    auto it = clientChannels.find(hdl);
+    return it != clientChannels.end() && it->second->send(channel, message);
+}
+
+bool CryptoWebSocketServer::closeChannel(websocketpp::connection_hdl hdl, ChannelMux::ChannelId channel) {
+    auto it = clientChannels.find(hdl);
+    return it != clientChannels.end() && it->second->closeChannel(channel);
+}
+
+FileTransfer::TransferId CryptoWebSocketServer::sendEncryptedFile(websocketpp::connection_hdl hdl, const std::string& path,
+                                                                  SendPriority priority) {
+    FileTransfer::TransferId id = FileTransfer::transferIdFor(path);
+    if (id == 0 || !isRunning) {
+        return 0;
+    }
     
-    try {
-        // 使用客户端的AES会话密钥加密消息
-        std::string encryptedData = it->second->encryptWithRemote(message);
+    // 会话状态只在事件循环上访问，映射文件和发出请求都在那里进行
+    transport->post([this, hdl, id, path, priority]() {
+        auto it = clientFiles.find(hdl);
+        auto statusIt = handshakeStatus.find(hdl);
+        if (it == clientFiles.end() || statusIt == handshakeStatus.end() || !statusIt->second ||
+            it->second->sendFile(path, priority) == 0) {
+            CRYPTOLINK_LOG_ERROR("文件发送失败: " << path);
+            if (fileSentCallback) {
+                fileSentCallback(hdl, id, path, false);
+            }
+        }
+    });
+    return id;
+}
+
+void CryptoWebSocketServer::cancelFile(websocketpp::connection_hdl hdl, FileTransfer::TransferId id) {
+    if (!isRunning) {
+        return;
+    }
+    transport->post([this, hdl, id]() {
+        auto it = clientFiles.find(hdl);
+        if (it != clientFiles.end()) {
+            it->second->cancel(id);
+        }
+    });
+}
+
+bool CryptoWebSocketServer::addPreSharedKey(const std::string& identity, const std::string& key) {
+    if (identity.empty() || key.size() < PskHandshake::kMinKeySize) {
+        CRYPTOLINK_LOG_ERROR("预共享密钥无效: 身份不能为空，密钥至少 " << PskHandshake::kMinKeySize << " 字节");
+        return false;
+    }
+    preSharedKeys[identity] = key;
+    return true;
+}
+
+void CryptoWebSocketServer::setRelayEnabled(bool enabled) {
+    relayEnabled = enabled;
+}
+
+bool CryptoWebSocketServer::enableDatagrams(uint16_t port, DatagramCipher::Delivery delivery) {
+    auto socket = std::make_unique<DatagramSocket>();
+    socket->setHandler([this](websocketpp::connection_hdl hdl, std::string_view payload) {
+        if (datagramCallback) {
+            datagramCallback(hdl, payload);
+        }
+    });
+    if (!socket->listen(port)) {
+        return false;
+    }
+    datagramDelivery = delivery;
+    datagramSocket = std::move(socket);
+    CRYPTOLINK_LOG_INFO("数据报通道监听 UDP 端口 " << datagramSocket->localPort());
+    return true;
+}
+
+uint16_t CryptoWebSocketServer::getDatagramPort() const {
+    return datagramSocket ? datagramSocket->localPort() : 0;
+}
+
+bool CryptoWebSocketServer::sendDatagram(websocketpp::connection_hdl hdl, std::string_view message) {
+    return datagramSocket && datagramSocket->send(hdl, message);
+}
+
+void CryptoWebSocketServer::setDatagramCallback(std::function<void(websocketpp::connection_hdl, std::string_view)> callback) {
+    datagramCallback = callback;
+}
+
+void CryptoWebSocketServer::registerMethod(const std::string& name, RpcMethod method) {
+    rpcMethods[name] = std::move(method);
+}
+
+void CryptoWebSocketServer::setFileReceiveDirectory(const std::string& directory) {
+    fileReceiveDirectory = directory;
+}
+
+void CryptoWebSocketServer::setFileSentCallback(FileCallback callback) {
+    fileSentCallback = callback;
+}
+
+void CryptoWebSocketServer::setFileReceivedCallback(FileCallback callback) {
+    fileReceivedCallback = callback;
+}
+
+void CryptoWebSocketServer::setChannelMessageCallback(std::function<void(websocketpp::connection_hdl, ChannelMux::ChannelId, std::string_view)> callback) {
+    channelMessageCallback = callback;
+}
+
+bool CryptoWebSocketServer::sendRecord(websocketpp::connection_hdl hdl, MessageType type, std::string_view payload,
+                                       SendPriority priority) {
+    // 1字节记录类型作为记录头
+    const char header = static_cast<char>(type);
+    return sendRecord(hdl, std::string_view(&header, 1), payload, priority);
+}
+
+bool CryptoWebSocketServer::sendRecord(websocketpp::connection_hdl hdl, std::string_view header, std::string_view payload,
+                                       SendPriority priority) {
+    OutboundRecord record;
+    record.hdl = hdl;
+    std::memcpy(record.header, header.data(), header.size());
+    record.headerLength = static_cast<uint8_t>(header.size());
+    record.priority = priority;
+    record.payload = BufferPool::local().acquire(payload.size());
+    if (!record.payload) {
+        return false;
+    }
+    record.payload.append(payload.data(), payload.size());
+    return enqueueRecord(std::move(record));
+}
+
+bool CryptoWebSocketServer::enqueueRecord(OutboundRecord record) {
+    if (!isRunning) {
+        return false;
+    }
+    outbound.push(std::move(record));
+    scheduleOutboundDrain();
+    return true;
+}
+
+void CryptoWebSocketServer::scheduleOutboundDrain() {
+    // 只有把标志从 false 改为 true 的生产者负责唤醒事件循环，一批记录只投递一次任务
+    if (!outboundScheduled.exchange(true, std::memory_order_acq_rel)) {
+        transport->post([this]() {
+            drainOutbound();
+        });
+    }
+}
+
+void CryptoWebSocketServer::drainOutbound() {
+    // 先清除标志再取队列：之后入队的生产者会重新投递，不会有记录被遗漏
+    outboundScheduled.exchange(false, std::memory_order_acq_rel);
+    
+    OutboundRecord record;
+    size_t drained = 0;
+    while (drained < kMaxOutboundBatch && outbound.pop(record)) {
+        ++drained;
+        std::string_view header(record.header, record.headerLength);
         
-        Message msg = {ENCRYPTED_DATA, encryptedData};
-        std::string serialized = serializeMessage(msg);
+        switch (record.target) {
+            case OutboundRecord::HANDLE:
+                if (record.header[0] == static_cast<char>(SIGNED_DATA)) {
+                    addSignedMessage(record.hdl, record.priority, std::move(record.payload));
+                } else {
+                    queueRecord(record.hdl, record.priority, header, std::move(record.payload));
+                }
+                break;
+            case OutboundRecord::SESSION_ID: {
+                auto it = sessionHandles.find(record.sessionId);
+                if (it != sessionHandles.end()) {
+                    queueRecord(it->second, record.priority, header, record.payload);
+                }
+                break;
+            }
+            case OutboundRecord::BROADCAST:
+                for (auto& pair : handshakeStatus) {
+                    if (pair.second) {
+                        queueRecord(pair.first, record.priority, header, record.payload);
+                    }
+                }
+                break;
+        }
+        record.payload = PooledBuffer();
+    }
+    
+    // 整批记录按优先级排好后再统一发送
+    pumpLanes();
+    
+    // 一批处理不完时让出事件循环，剩余的记录在下一轮继续
+    if (drained == kMaxOutboundBatch) {
+        scheduleOutboundDrain();
+    }
+}
+
+bool CryptoWebSocketServer::queueRecord(websocketpp::connection_hdl hdl, SendPriority priority, std::string_view header,
+                                        PooledBuffer payload) {
+    auto statusIt = handshakeStatus.find(hdl);
+    auto it = clientLanes.find(hdl);
+    if (statusIt == handshakeStatus.end() || !statusIt->second || it == clientLanes.end()) {
+        CRYPTOLINK_LOG_WARNING("客户端未找到或握手未完成");
+        return false;
+    }
+    
+    if (recorder && isApplicationRecord(static_cast<uint8_t>(header[0]))) {
+        recordEvent(hdl, SessionRecorder::OUTBOUND, static_cast<uint8_t>(header[0]), priority, payload.view());
+    }
+    
+    // 大消息交给工作线程池分段并行加密，完成后由 flushSegments 放入通道；超过客户端接收上限的消息串行发送
+    if (parallelThreshold > 0 && header.size() == 1 && payload.size() >= parallelThreshold) {
+        auto segmentsIt = clientSegments.find(hdl);
+        if (segmentsIt != clientSegments.end() && segmentsIt->second->accepts(payload.size())) {
+            return segmentsIt->second->seal(static_cast<uint8_t>(header[0]), priority, std::move(payload));
+        }
+    }
+    
+    it->second->enqueue(priority, header, std::move(payload));
+    backloggedSessions.insert(hdl);
+    return true;
+}
+
+void CryptoWebSocketServer::flushSegments(websocketpp::connection_hdl hdl) {
+    // 解密完成的接收消息按原记录类型处理；处理消息可能关闭会话，每条之前重新查找
+    uint8_t innerType = 0;
+    std::string_view received;
+    for (auto it = clientSegments.find(hdl); it != clientSegments.end() && it->second->collectIncoming(innerType, received);
+         it = clientSegments.find(hdl)) {
+        const char innerHeader = static_cast<char>(innerType);
+        dispatchRecord(hdl, std::string_view(&innerHeader, 1), received);
+    }
+    
+    auto it = clientSegments.find(hdl);
+    auto lanesIt = clientLanes.find(hdl);
+    if (it == clientSegments.end() || lanesIt == clientLanes.end()) {
+        return;
+    }
+    
+    SegmentCipher::SealedMessage message;
+    while (it->second->collect(message)) {
+        // SEGMENT_BEGIN 经记录层加密，和各段放在同一个通道里，保证先于各段发出
+        const char beginHeader = static_cast<char>(SEGMENT_BEGIN);
+        lanesIt->second->enqueue(message.priority, std::string_view(&beginHeader, 1), std::move(message.begin));
+        for (PooledBuffer& segment : message.segments) {
+            std::string_view header(segment.data(), SegmentCipher::kHeaderSize);
+            lanesIt->second->enqueue(message.priority, header, std::move(segment));
+        }
+        backloggedSessions.insert(hdl);
+    }
+    pumpLanes();
+}
+
+void CryptoWebSocketServer::flushFiles(websocketpp::connection_hdl hdl) {
+    auto it = clientFiles.find(hdl);
+    if (it != clientFiles.end()) {
+        it->second->flushDisk();
+    }
+}
+
+void CryptoWebSocketServer::pumpLanes() {
+    for (auto it = backloggedSessions.begin(); it != backloggedSessions.end();) {
+        auto lanesIt = clientLanes.find(*it);
+        if (lanesIt == clientLanes.end()) {
+            it = backloggedSessions.erase(it);
+            continue;
+        }
         
-        websocketpp::lib::error_code ec;
-        wsServer.send(hdl, serialized, websocketpp::frame::opcode::text, ec);
+        // 传输层已排队的数据到达上限时先不发，等它写出去后高优先级记录还能插到前面
+        size_t buffered = transport->bufferedAmount(*it);
+        bool pending = buffered >= sendQueueLimit || lanesIt->second->pump(sendQueueLimit - buffered);
+        if (pending) {
+            ++it;
+        } else {
+            it = backloggedSessions.erase(it);
+        }
+    }
+    
+    if (!backloggedSessions.empty() && !sendPollScheduled) {
+        sendPollScheduled = true;
+        transport->setTimer(kSendPollInterval, [this]() {
+            sendPollScheduled = false;
+            if (isRunning) {
+                pumpLanes();
+            }
+        });
+    }
+}
+
+bool CryptoWebSocketServer::sealAndSend(websocketpp::connection_hdl hdl, std::string_view header, std::string_view payload) {
+    auto it = clientCiphers.find(hdl);
+    auto statusIt = handshakeStatus.find(hdl);
+    
+    if (it == clientCiphers.end() || statusIt == handshakeStatus.end() || !statusIt->second) {
+        CRYPTOLINK_LOG_WARNING("客户端未找到或握手未完成");
+        return false;
+    }
+    
+    try {
+        // 分段记录已经在工作线程上加密，中继数据记录由客户端端到端加密，负载就是完整的线路记录
+        const uint8_t type = static_cast<uint8_t>(header[0]);
+        if (SegmentCipher::isSegmentRecord(type) || PeerRelay::isRelayFrame(type)) {
+            return transport->send(hdl, payload.data(), payload.size(), Transport::FrameType::BINARY);
+        }
         
-        if (ec) {
-            std::cerr << "发送消息失败: " << ec.message() << std::endl;
+        // 使用该客户端协商出的会话加密器生成二进制记录，记录头作为附加数据参与认证
+        PooledBuffer record = it->second.seal(header, payload, BufferPool::local());
+        if (!record) {
             return false;
         }
         
-        return true;
+        return transport->send(hdl, record.data(), record.size(), Transport::FrameType::BINARY);
     } catch (const std::exception& e) {
-        std::cerr << "发送加密消息异常: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("发送加密消息异常: " << e.what());
+        return false;
+    }
+}
+
+void CryptoWebSocketServer::setPriorityWeights(const PriorityLanes::Weights& weights) {
+    priorityWeights = weights;
+}
+
+void CryptoWebSocketServer::setSendQueueLimit(size_t bytes) {
+    sendQueueLimit = std::max(bytes, PriorityLanes::kFragmentSize);
+}
+
+bool CryptoWebSocketServer::startRecording(const std::string& path, bool includePayloads) {
+    std::shared_ptr<SessionRecorder> opened = SessionRecorder::open(path, includePayloads);
+    if (!opened) {
+        return false;
+    }
+    installRecorder(std::move(opened));
+    return true;
+}
+
+void CryptoWebSocketServer::stopRecording() {
+    installRecorder(nullptr);
+}
+
+void CryptoWebSocketServer::installRecorder(std::shared_ptr<SessionRecorder> next) {
+    if (isRunning) {
+        transport->post([this, next]() {
+            recorder = next;
+        });
+    } else {
+        recorder = std::move(next);
+    }
+}
+
+void CryptoWebSocketServer::recordEvent(websocketpp::connection_hdl hdl, SessionRecorder::EventType type,
+                                        uint8_t recordType, SendPriority priority, std::string_view payload) {
+    auto it = clientSessionIds.find(hdl);
+    if (it != clientSessionIds.end()) {
+        recorder->record(type, it->second, recordType, priority, payload);
+    }
+}
+
+bool CryptoWebSocketServer::isApplicationRecord(uint8_t type) {
+    switch (static_cast<MessageType>(type)) {
+        case PROBE:
+        case PROBE_REPLY:
+        case CHANNEL_CREDIT:
+        case FILE_ACK:
+        case SEGMENT_BEGIN:
+        case SEGMENT_LIMIT:
+        case SEGMENT_REJECT:
+        case RPC_CANCEL:
+        case RELAY_REGISTER:
+        case RELAY_LOOKUP:
+        case RELAY_PEER:
+        case RELAY_DATA:
+        case DATAGRAM_OPEN:
+        case DATAGRAM_ACCEPT:
+            return false;
+        default:
+            return true;
+    }
+}
+
+void CryptoWebSocketServer::setParallelThreshold(size_t bytes) {
+    parallelThreshold = bytes;
+}
+
+void CryptoWebSocketServer::setParallelReceiveLimit(uint64_t bytes) {
+    parallelReceiveLimit = bytes;
+}
+
+void CryptoWebSocketServer::setLatencyProbeInterval(std::chrono::milliseconds interval) {
+    latencyProbeInterval = interval;
+}
+
+void CryptoWebSocketServer::setTimestampRecords(bool enabled) {
+    timestampRecords = enabled;
+}
+
+template <typename Result>
+Result CryptoWebSocketServer::snapshotOnLoop(std::function<Result()> evaluate, Result fallback) const {
+    const std::thread::id loop = loopThread.load();
+    if (loop == std::thread::id() || loop == std::this_thread::get_id()) {
+        return evaluate();
+    }
+    return transport->call(std::move(evaluate), kSnapshotTimeout).value_or(std::move(fallback));
+}
+
+bool CryptoWebSocketServer::getSessionLatency(websocketpp::connection_hdl hdl, LatencyStats& stats) const {
+    std::optional<LatencyStats> session = snapshotOnLoop<std::optional<LatencyStats>>([this, hdl]() {
+        std::optional<LatencyStats> result;
+        auto it = sessionLatency.find(hdl);
+        if (it != sessionLatency.end()) {
+            result = it->second.getStats();
+        }
+        return result;
+    }, std::nullopt);
+    if (!session) {
         return false;
     }
+    stats = *session;
+    return true;
+}
+
+LatencyReport CryptoWebSocketServer::getLatencyReport() const {
+    return snapshotOnLoop<LatencyReport>([this]() {
+        LatencyReport report = retiredLatency;
+        for (const auto& pair : sessionLatency) {
+            const LatencyStats& stats = pair.second.getStats();
+            report.rtt.merge(stats.rtt);
+            report.oneWay.merge(stats.oneWay);
+            report.queueing.merge(stats.queueing);
+        }
+        report.sessions = sessionLatency.size();
+        return report;
+    }, LatencyReport());
+}
+
+void CryptoWebSocketServer::sendLatencyProbe(websocketpp::connection_hdl hdl) {
+    auto livenessIt = sessionLiveness.find(hdl);
+    if (livenessIt == sessionLiveness.end()) {
+        return;
+    }
+    livenessIt->second.probeTimer = 0;
+    
+    PooledBuffer payload = BufferPool::local().acquire(LatencyProbe::kProbeSize);
+    if (payload) {
+        auto it = sessionLatency.find(hdl);
+        if (it == sessionLatency.end()) {
+            return;
+        }
+        char probe[LatencyProbe::kProbeSize];
+        it->second.makeProbe(probe);
+        payload.append(probe, sizeof(probe));
+        
+        // 探测走控制通道并立即发出，测到的往返时间不包含排在后面的大块数据
+        const char header = static_cast<char>(PROBE);
+        queueRecord(hdl, SendPriority::CONTROL, std::string_view(&header, 1), std::move(payload));
+        pumpLanes();
+    }
+    
+    livenessIt->second.probeTimer = timerWheel.schedule(latencyProbeInterval, [this, hdl]() {
+        sendLatencyProbe(hdl);
+    });
+}
+
+void CryptoWebSocketServer::setCipherSuitePreference(const std::vector<CipherSuite>& suites) {
+    cipherSuitePreference = suites;
+}
+
+CipherSuite CryptoWebSocketServer::getNegotiatedCipherSuite(websocketpp::connection_hdl hdl) const {
+    auto statusIt = handshakeStatus.find(hdl);
+    auto it = clientCiphers.find(hdl);
+    if (statusIt == handshakeStatus.end() || !statusIt->second || it == clientCiphers.end()) {
+        return CipherSuite::NONE;
+    }
+    return it->second.getSuite();
+}
+
+void CryptoWebSocketServer::setOwnedMessageCallback(std::function<void(websocketpp::connection_hdl, std::string)> callback) {
+    ownedMessageCallback = callback;
+    messageCallback = nullptr;
+}
+
+void CryptoWebSocketServer::setHandshakeCallback(std::function<void(websocketpp::connection_hdl)> callback) {
+    handshakeCallback = callback;
 }
 
-void CryptoWebSocketServer::setMessageCallback(std::function<void(websocketpp::connection_hdl, const std::string&)> callback) {
-    messageCallback = callback;
+void CryptoWebSocketServer::setCloseCallback(std::function<void(websocketpp::connection_hdl)> callback) {
+    closeCallback = callback;
+}
+
+bool CryptoWebSocketServer::post(std::function<void()> task) {
+    if (!isRunning) {
+        return false;
+    }
+    transport->post(std::move(task));
+    return true;
 }
 
 void CryptoWebSocketServer::run() {
+    if (!transport) {
+        return;
+    }
     serverThread = std::thread([this]() {
-        wsServer.run();
+        loopThread = std::this_thread::get_id();
+        transport->run();
+        loopThread = std::thread::id();
     });
 }
 
+BufferPoolStats CryptoWebSocketServer::getBufferPoolStats() {
+    return BufferPool::aggregateStats();
+}
+
 void CryptoWebSocketServer::onOpen(websocketpp::connection_hdl hdl) {
-    std::cout << "新客户端连接" << std::endl;
+    CRYPTOLINK_LOG_DEBUG("新客户端连接");
     initializeClientCrypto(hdl);
+    if (recorder) {
+        recordEvent(hdl, SessionRecorder::OPEN);
+    }
+    scheduleSessionTimers(hdl);
 }
 
 void CryptoWebSocketServer::onClose(websocketpp::connection_hdl hdl) {
-    std::cout << "客户端断开连接" << std::endl;
-    
+    CRYPTOLINK_LOG_DEBUG("客户端断开连接");
+    releaseSession(hdl);
+}
+
+void CryptoWebSocketServer::releaseSession(websocketpp::connection_hdl hdl) {
     // 清理客户端相关的加密对象
     clientRSAKeys.erase(hdl);
     clientAESKeys.erase(hdl);
     handshakeStatus.erase(hdl);
+    clientCiphers.erase(hdl);
+    handshakeModes.erase(hdl);
+    pskConfirmations.erase(hdl);
+    clientChannels.erase(hdl);
+    clientLanes.erase(hdl);
+    backloggedSessions.erase(hdl);
+    clientSegments.erase(hdl);
+    
+    // 未完成的发送通知失败，客户端的部分文件留给之后的续传
+    auto filesIt = clientFiles.find(hdl);
+    if (filesIt != clientFiles.end()) {
+        std::unique_ptr<FileTransfer> files = std::move(filesIt->second);
+        clientFiles.erase(filesIt);
+        files->disconnect(false);
+    }
+    
+    // 在途调用以 DISCONNECTED 结束，仍在处理的请求视为已取消
+    auto rpcIt = clientRpc.find(hdl);
+    if (rpcIt != clientRpc.end()) {
+        std::unique_ptr<RpcSession> rpc = std::move(rpcIt->second);
+        clientRpc.erase(rpcIt);
+        rpc->disconnect();
+    }
+    
+    // 会话的延迟统计并入汇总
+    auto latencyIt = sessionLatency.find(hdl);
+    if (latencyIt != sessionLatency.end()) {
+        const LatencyStats& stats = latencyIt->second.getStats();
+        retiredLatency.rtt.merge(stats.rtt);
+        retiredLatency.oneWay.merge(stats.oneWay);
+        retiredLatency.queueing.merge(stats.queueing);
+        sessionLatency.erase(latencyIt);
+    }
+    
+    if (recorder) {
+        recordEvent(hdl, SessionRecorder::CLOSE);
+    }
+    if (closeCallback && clientSessionIds.count(hdl) > 0) {
+        closeCallback(hdl);
+    }
+    
+    // 清理会话的全部订阅
+    auto sessionIt = clientSessionIds.find(hdl);
+    if (sessionIt != clientSessionIds.end()) {
+        {
+            std::unique_lock<std::shared_mutex> lock(topicMutex);
+            topicIndex.removeSubscriber(sessionIt->second);
+        }
+        sessionHandles.erase(sessionIt->second);
+        clientSessionIds.erase(sessionIt);
+    }
+    
+    // 释放会话登记的中继名字
+    auto relayIt = relayNames.find(hdl);
+    if (relayIt != relayNames.end()) {
+        relayDirectory.erase(relayIt->second);
+        relayNames.erase(relayIt);
+    }
+    
+    // 注销会话的数据报通道
+    auto datagramIt = datagramIds.find(hdl);
+    if (datagramIt != datagramIds.end()) {
+        datagramSocket->unbind(hdl);
+        datagramIds.erase(datagramIt);
+    }
+    
+    // 取消会话的全部定时器
+    auto livenessIt = sessionLiveness.find(hdl);
+    if (livenessIt != sessionLiveness.end()) {
+        timerWheel.cancel(livenessIt->second.handshakeTimer);
+        timerWheel.cancel(livenessIt->second.heartbeatTimer);
+        timerWheel.cancel(livenessIt->second.idleTimer);
+        timerWheel.cancel(livenessIt->second.probeTimer);
+        sessionLiveness.erase(livenessIt);
+    }
 }
 
-void CryptoWebSocketServer::onMessage(websocketpp::connection_hdl hdl, message_ptr msg) {
-    std::string payload = msg->get_payload();
+void CryptoWebSocketServer::onMessage(websocketpp::connection_hdl hdl, Transport::FrameType type, std::string& payload) {
+    auto livenessIt = sessionLiveness.find(hdl);
+    if (livenessIt != sessionLiveness.end()) {
+        livenessIt->second.lastReceive = livenessIt->second.lastActivity = std::chrono::steady_clock::now();
+    }
     
     auto statusIt = handshakeStatus.find(hdl);
     if (statusIt == handshakeStatus.end() || !statusIt->second) {
         handleHandshakeMessage(hdl, payload);
+    } else if (type == Transport::FrameType::BINARY) {
+        // 二进制加密记录直接在接收帧缓冲区内解密，整个处理过程计入服务端处理耗时
+        auto start = std::chrono::steady_clock::now();
+        handleEncryptedRecord(hdl, payload);
+        retiredLatency.processing.record(std::chrono::steady_clock::now() - start);
     } else {
-        // 处理加密消息
+        // 兼容旧版本的JSON加密消息
         Message parsedMsg = parseMessage(payload);
         if (parsedMsg.type == ENCRYPTED_DATA) {
             auto it = clientAESKeys.find(hdl);
             if (it != clientAESKeys.end()) {
-                std::string decryptedData = it->second->decryptWithRemote(parsedMsg.data);
-                if (messageCallback) {
-                    messageCallback(hdl, decryptedData);
+                PooledBuffer decryptedData = it->second->decryptWithRemote(parsedMsg.data, BufferPool::local());
+                if (decryptedData) {
+                    deliverMessage(hdl, decryptedData.view());
+                }
+            }
+        }
+    }
+}
+
+void CryptoWebSocketServer::handleEncryptedRecord(websocketpp::connection_hdl hdl, std::string& record) {
+    if (record.empty()) {
+        return;
+    }
+    
+    auto it = clientCiphers.find(hdl);
+    if (it == clientCiphers.end()) {
+        return;
+    }
+    
+    // 分段记录不经过记录层，各段在工作线程上并行解密，整条消息校验通过后由 flushSegments 按原记录类型处理
+    const uint8_t type = static_cast<uint8_t>(record[0]);
+    if (SegmentCipher::isSegmentRecord(type)) {
+        auto segmentsIt = clientSegments.find(hdl);
+        if (segmentsIt != clientSegments.end()) {
+            segmentsIt->second->handleSegment(record);
+        }
+        return;
+    }
+    
+    // 中继数据记录由客户端端到端加密，只解析路由头后原样转发，不经过会话加密
+    if (PeerRelay::isRelayFrame(type)) {
+        forwardRelayFrame(hdl, record);
+        return;
+    }
+    
+    // 通道记录和分片记录的记录头更长
+    size_t headerLength = 1;
+    if (ChannelMux::isChannelRecord(type)) {
+        headerLength = ChannelMux::kHeaderSize;
+    } else if (PriorityLanes::isFragmentRecord(type)) {
+        headerLength = PriorityLanes::kHeaderSize;
+    }
+    if (record.size() < headerLength) {
+        return;
+    }
+    
+    std::string_view plaintext;
+    if (!it->second.open(&record[0], record.size(), headerLength, plaintext)) {
+        return;
+    }
+    
+    std::string_view header(record.data(), headerLength);
+    if (PriorityLanes::isFragmentRecord(type)) {
+        // 分片拼接完整后按原记录类型处理，只有单字节记录头的记录会被分片
+        auto lanesIt = clientLanes.find(hdl);
+        uint8_t innerType = 0;
+        std::string_view message;
+        if (lanesIt != clientLanes.end() && lanesIt->second->reassemble(header, plaintext, innerType, message)) {
+            const char innerHeader = static_cast<char>(innerType);
+            dispatchRecord(hdl, std::string_view(&innerHeader, 1), message);
+        }
+        return;
+    }
+    dispatchRecord(hdl, header, plaintext);
+}
+
+void CryptoWebSocketServer::dispatchRecord(websocketpp::connection_hdl hdl, std::string_view header, std::string_view plaintext) {
+    if (recorder && isApplicationRecord(static_cast<uint8_t>(header[0]))) {
+        recordEvent(hdl, SessionRecorder::INBOUND, static_cast<uint8_t>(header[0]), SendPriority::NORMAL, plaintext);
+    }
+    
+    switch (static_cast<MessageType>(static_cast<uint8_t>(header[0]))) {
+        case ENCRYPTED_DATA:
+            deliverMessage(hdl, plaintext);
+            break;
+        case STAMPED_DATA: {
+            std::string_view message;
+            auto it = sessionLatency.find(hdl);
+            if (it != sessionLatency.end() && it->second.handleStamped(plaintext, message)) {
+                deliverMessage(hdl, message);
+            }
+            break;
+        }
+        case PROBE: {
+            // 立即应答，应答中带上收到和发出的时刻，对端据此扣除本端的处理时间
+            const int64_t receivedAt = LatencyProbe::now();
+            PooledBuffer reply = BufferPool::local().acquire(LatencyProbe::kReplySize);
+            char data[LatencyProbe::kReplySize];
+            if (reply && LatencyProbe::makeReply(plaintext, receivedAt, data)) {
+                reply.append(data, sizeof(data));
+                const char replyHeader = static_cast<char>(PROBE_REPLY);
+                queueRecord(hdl, SendPriority::CONTROL, std::string_view(&replyHeader, 1), std::move(reply));
+                pumpLanes();
+            }
+            break;
+        }
+        case PROBE_REPLY: {
+            auto it = sessionLatency.find(hdl);
+            if (it != sessionLatency.end()) {
+                it->second.handleReply(plaintext);
+            }
+            break;
+        }
+        case SUBSCRIBE:
+            if (!subscribeClient(hdl, std::string(plaintext))) {
+                CRYPTOLINK_LOG_WARNING("订阅失败: " << plaintext);
+            }
+            break;
+        case UNSUBSCRIBE:
+            unsubscribeClient(hdl, std::string(plaintext));
+            break;
+        case PUBLISH: {
+            // 客户端发布的消息由服务端按订阅关系转发
+            std::string_view topic;
+            std::string_view message;
+            if (TopicIndex::decodePublication(plaintext, topic, message)) {
+                publish(std::string(topic), message);
+            }
+            break;
+        }
+        case CHANNEL_OPEN:
+        case CHANNEL_DATA:
+        case CHANNEL_CLOSE:
+        case CHANNEL_CREDIT: {
+            auto channelIt = clientChannels.find(hdl);
+            if (channelIt != clientChannels.end()) {
+                channelIt->second->handleRecord(header, plaintext);
+            }
+            break;
+        }
+        case SEGMENT_BEGIN: {
+            // 拒绝的消息告诉客户端，它的段到达后直接丢弃
+            auto segmentsIt = clientSegments.find(hdl);
+            if (segmentsIt == clientSegments.end() || !segmentsIt->second->handleBegin(plaintext)) {
+                CRYPTOLINK_LOG_WARNING("拒绝客户端的分段消息");
+                PooledBuffer reject = SegmentCipher::rejectFor(plaintext);
+                if (reject) {
+                    const char rejectHeader = static_cast<char>(SEGMENT_REJECT);
+                    queueRecord(hdl, SendPriority::CONTROL, std::string_view(&rejectHeader, 1), std::move(reject));
                 }
             }
+            break;
+        }
+        case SEGMENT_LIMIT: {
+            auto segmentsIt = clientSegments.find(hdl);
+            if (segmentsIt != clientSegments.end()) {
+                segmentsIt->second->handleLimit(plaintext);
+            }
+            break;
+        }
+        case SEGMENT_REJECT: {
+            auto segmentsIt = clientSegments.find(hdl);
+            if (segmentsIt != clientSegments.end()) {
+                segmentsIt->second->handleReject(plaintext);
+            }
+            break;
+        }
+        case FILE_OFFER:
+        case FILE_CHUNK:
+        case FILE_ACK:
+        case FILE_CANCEL: {
+            auto filesIt = clientFiles.find(hdl);
+            if (filesIt != clientFiles.end()) {
+                filesIt->second->handleRecord(static_cast<uint8_t>(header[0]), plaintext);
+            }
+            break;
+        }
+        case RPC_REQUEST:
+        case RPC_RESPONSE:
+        case RPC_CANCEL: {
+            auto rpcIt = clientRpc.find(hdl);
+            if (rpcIt != clientRpc.end()) {
+                rpcIt->second->handleRecord(static_cast<uint8_t>(header[0]), plaintext);
+            }
+            break;
+        }
+        case RELAY_REGISTER:
+        case RELAY_LOOKUP:
+            handleRelayRecord(hdl, static_cast<uint8_t>(header[0]), plaintext);
+            pumpLanes();
+            break;
+        case DATAGRAM_OPEN:
+            openDatagram(hdl);
+            pumpLanes();
+            break;
+        default:
+            CRYPTOLINK_LOG_WARNING("未知的二进制记录类型");
+            break;
+    }
+}
+
+void CryptoWebSocketServer::handleRelayRecord(websocketpp::connection_hdl hdl, uint8_t type, std::string_view payload) {
+    if (!relayEnabled) {
+        CRYPTOLINK_LOG_WARNING("未开启中继，忽略中继记录");
+        return;
+    }
+    
+    if (type == RELAY_LOOKUP) {
+        if (payload.empty() || payload.size() > PeerRelay::kMaxNameLength) {
+            return;
+        }
+        auto it = relayDirectory.find(std::string(payload));
+        if (it == relayDirectory.end()) {
+            sendRelayPeer(hdl, PeerRelay::PeerStatus::NOT_FOUND, payload);
+        } else {
+            sendRelayPeer(hdl, PeerRelay::PeerStatus::FOUND, payload, it->second.publicKey);
+        }
+        return;
+    }
+    
+    std::string_view name;
+    std::string_view publicKey;
+    if (!PeerRelay::decodeRegister(payload, name, publicKey)) {
+        CRYPTOLINK_LOG_WARNING("中继登记无效");
+        return;
+    }
+    
+    // 名字只能被一个连接占用，连接断开时释放
+    const std::string key(name);
+    std::owner_less<websocketpp::connection_hdl> before;
+    auto it = relayDirectory.find(key);
+    if (it != relayDirectory.end() && (before(it->second.hdl, hdl) || before(hdl, it->second.hdl))) {
+        sendRelayPeer(hdl, PeerRelay::PeerStatus::NAME_IN_USE, name);
+        return;
+    }
+    
+    // 同一连接换了名字时释放旧名字
+    auto nameIt = relayNames.find(hdl);
+    if (nameIt != relayNames.end() && nameIt->second != key) {
+        relayDirectory.erase(nameIt->second);
+    }
+    relayDirectory[key] = RelayEntry{hdl, std::string(publicKey)};
+    relayNames[hdl] = key;
+    sendRelayPeer(hdl, PeerRelay::PeerStatus::REGISTERED, name);
+}
+
+void CryptoWebSocketServer::forwardRelayFrame(websocketpp::connection_hdl hdl, std::string_view frame) {
+    auto senderIt = relayNames.find(hdl);
+    std::string_view name;
+    std::string_view sealed;
+    if (!relayEnabled || senderIt == relayNames.end() || !PeerRelay::decodeFrame(frame, name, sealed) ||
+        sealed.size() < PeerRelay::kKeyIdSize) {
+        CRYPTOLINK_LOG_WARNING("中继记录无效或发送方未登记");
+        return;
+    }
+    
+    auto it = relayDirectory.find(std::string(name));
+    if (it == relayDirectory.end()) {
+        sendRelayPeer(hdl, PeerRelay::PeerStatus::NOT_FOUND, name);
+    } else if (PeerRelay::keyId(sealed) != std::string_view(it->second.publicKey).substr(0, PeerRelay::kKeyIdSize)) {
+        // 发送方用的是接收方的旧公钥，接收方解不开，退回并告知当前公钥
+        sendRelayPeer(hdl, PeerRelay::PeerStatus::KEY_CHANGED, name, it->second.publicKey);
+    } else {
+        // 只把路由名字改写为发送方，密文体原样转发
+        PooledBuffer forwarded = PeerRelay::encodeFrame(senderIt->second, sealed);
+        if (forwarded) {
+            std::string_view header(forwarded.data(), 2);
+            queueRecord(it->second.hdl, SendPriority::NORMAL, header, std::move(forwarded));
         }
     }
+    pumpLanes();
+}
+
+void CryptoWebSocketServer::sendRelayPeer(websocketpp::connection_hdl hdl, PeerRelay::PeerStatus status,
+                                          std::string_view name, std::string_view publicKey) {
+    PooledBuffer record = PeerRelay::encodePeer(status, name, publicKey);
+    if (record) {
+        const char header = static_cast<char>(RELAY_PEER);
+        queueRecord(hdl, SendPriority::CONTROL, std::string_view(&header, 1), std::move(record));
+    }
+}
+
+void CryptoWebSocketServer::openDatagram(websocketpp::connection_hdl hdl) {
+    uint64_t connectionId = 0;
+    uint16_t port = 0;
+    auto cipherIt = clientCiphers.find(hdl);
+    auto it = datagramIds.find(hdl);
+    if (it != datagramIds.end()) {
+        // 重复请求时回复同一个连接号，同一密钥下的序号不能重新开始
+        connectionId = it->second;
+        port = datagramSocket->localPort();
+    } else if (datagramSocket && cipherIt != clientCiphers.end() && cipherIt->second.getSuite() != CipherSuite::AES_256_CBC) {
+        // 连接号随机选取，不暴露会话数量，也无法猜出其他会话的连接号
+        CryptoPP::AutoSeededRandomPool rng;
+        do {
+            rng.GenerateBlock(reinterpret_cast<CryptoPP::byte*>(&connectionId), sizeof(connectionId));
+        } while (connectionId == 0);
+        
+        const SessionCipherSlot& cipher = cipherIt->second;
+        datagramSocket->bind(hdl, std::make_unique<DatagramCipher>(cipher.getSuite(), connectionId,
+            cipher.getDatagramSendKey(), cipher.getDatagramReceiveKey(), datagramDelivery));
+        datagramIds[hdl] = connectionId;
+        port = datagramSocket->localPort();
+    } else {
+        CRYPTOLINK_LOG_WARNING("未开启数据报通道或会话不是 AEAD 套件，拒绝打开数据报通道");
+    }
+    
+    PooledBuffer accept = DatagramSocket::encodeAccept(connectionId, port);
+    if (accept) {
+        const char header = static_cast<char>(DATAGRAM_ACCEPT);
+        queueRecord(hdl, SendPriority::CONTROL, std::string_view(&header, 1), std::move(accept));
+    }
+}
+
+void CryptoWebSocketServer::deliverMessage(websocketpp::connection_hdl hdl, std::string_view plaintext) {
+    if (messageCallback) {
+        messageCallback(hdl, plaintext);
+    } else if (ownedMessageCallback) {
+        ownedMessageCallback(hdl, std::string(plaintext));
+    }
 }
 
 void CryptoWebSocketServer::handleHandshakeMessage(websocketpp::connection_hdl hdl, const std::string& message) {
     Message msg = parseMessage(message);
     
+    // PSK 握手只接受 PSK_FINISHED，RSA 握手不接受 PSK 消息：
+    // 否则不知道 PSK 的客户端可以先发 PSK_HELLO 冒用身份，再用 RSA 的会话密钥完成握手
+    HandshakeMode& mode = handshakeModes[hdl];
+    bool expected = true;
+    switch (msg.type) {
+        case PUBLIC_KEY_REQUEST:
+        case PSK_HELLO:
+            expected = mode == HandshakeMode::NONE;
+            break;
+        case PUBLIC_KEY_RESPONSE:
+        case SESSION_KEY:
+            expected = mode == HandshakeMode::RSA;
+            break;
+        case PSK_FINISHED:
+            expected = mode == HandshakeMode::PSK;
+            break;
+        default:
+            break;
+    }
+    if (!expected) {
+        CRYPTOLINK_LOG_WARNING("握手消息与握手方式不符: " << static_cast<int>(msg.type));
+        transport->close(hdl, Transport::CLOSE_POLICY_VIOLATION, "Unexpected handshake message");
+        return;
+    }
+    if (msg.type == PUBLIC_KEY_REQUEST) {
+        mode = HandshakeMode::RSA;
+    } else if (msg.type == PSK_HELLO) {
+        mode = HandshakeMode::PSK;
+    }
+    
     switch (msg.type) {
         case PUBLIC_KEY_REQUEST: {
+            // 协商加密套件：旧版本客户端不带套件列表，只能使用CBC
+            std::vector<CipherSuite> offer = parseCipherSuites(msg.data);
+            if (offer.empty()) {
+                offer.push_back(CipherSuite::AES_256_CBC);
+            }
+            
+            CipherSuite suite = negotiateCipherSuite(cipherSuitePreference, offer);
+            if (suite == CipherSuite::NONE) {
+                CRYPTOLINK_LOG_WARNING("没有双方都支持的加密套件");
+                transport->close(hdl, Transport::CLOSE_POLICY_VIOLATION, "No common cipher suite");
+                break;
+            }
+            // 新版本客户端的协商记录混入密钥派生，并由客户端随会话密钥发回核对
+            clientCiphers[hdl].selectSuite(suite, msg.data.empty() ? std::string() : cipherSuiteTranscript(msg.data, suite));
+            
+            if (!msg.data.empty()) {
+                Message selection = {CIPHER_SUITE_SELECT, cipherSuitesToString({suite})};
+                sendHandshakeMessage(hdl, selection);
+            }
+            
             // 响应公钥请求
             Message response = {PUBLIC_KEY_RESPONSE, serverRSAKey->getLocalPublicKey()};
-            std::string serialized = serializeMessage(response);
-            
-            websocketpp::lib::error_code ec;
-            wsServer.send(hdl, serialized, websocketpp::frame::opcode::text, ec);
+            sendHandshakeMessage(hdl, response);
             break;
         }
         case PUBLIC_KEY_RESPONSE: {
@@ -165,37 +1257,345 @@ void CryptoWebSocketServer::handleHandshakeMessage(websocketpp::connection_hdl h
             // 解密会话密钥
             std::string decryptedSessionKey = serverRSAKey->decryptWithLocalPrivate(msg.data);
             
-            // 解析会话密钥（格式：key:iv）
+            // 解析会话密钥（格式：key:iv，新版本客户端在后面附上协商记录 key:iv:记录）
             size_t colonPos = decryptedSessionKey.find(':');
             if (colonPos != std::string::npos) {
                 std::string key = decryptedSessionKey.substr(0, colonPos);
                 std::string iv = decryptedSessionKey.substr(colonPos + 1);
+                std::string transcript;
+                size_t transcriptPos = iv.find(':');
+                if (transcriptPos != std::string::npos) {
+                    transcript = iv.substr(transcriptPos + 1);
+                    iv.resize(transcriptPos);
+                }
                 
                 auto it = clientAESKeys.find(hdl);
-                if (it != clientAESKeys.end()) {
+                auto cipherIt = clientCiphers.find(hdl);
+                if (it != clientAESKeys.end() && cipherIt != clientCiphers.end()) {
+                    // 双方看到的套件列表或选择不一致，说明握手消息被篡改
+                    if (transcript != cipherIt->second.getTranscript()) {
+                        CRYPTOLINK_LOG_ERROR("加密套件协商记录不一致");
+                        transport->close(hdl, Transport::CLOSE_POLICY_VIOLATION, "Cipher suite negotiation mismatch");
+                        break;
+                    }
+                    
                     it->second->setRemotePublicKey(key, iv);
-                    handshakeStatus[hdl] = true;
-                    std::cout << "客户端握手完成！" << std::endl;
+                    if (!cipherIt->second.initialize(key + ":" + iv, false)) {
+                        CRYPTOLINK_LOG_ERROR("会话加密器初始化失败");
+                        break;
+                    }
+                    completeHandshake(hdl, cipherIt->second);
                 }
             }
             break;
         }
+        case PSK_HELLO: {
+            std::string identity;
+            std::string clientNonce;
+            std::string offerText;
+            auto keyIt = preSharedKeys.end();
+            if (PskHandshake::parseHello(msg.data, identity, clientNonce, offerText)) {
+                keyIt = preSharedKeys.find(identity);
+            }
+            if (keyIt == preSharedKeys.end()) {
+                CRYPTOLINK_LOG_WARNING("未知的预共享密钥身份");
+                transport->close(hdl, Transport::CLOSE_POLICY_VIOLATION, "Unknown PSK identity");
+                break;
+            }
+            
+            // 只在 AEAD 套件中协商，CBC 没有消息认证
+            CipherSuite suite = negotiateCipherSuite(PskHandshake::aeadSuites(cipherSuitePreference),
+                                                     parseCipherSuites(offerText));
+            auto cipherIt = clientCiphers.find(hdl);
+            if (suite == CipherSuite::NONE || cipherIt == clientCiphers.end()) {
+                CRYPTOLINK_LOG_WARNING("没有双方都支持的加密套件");
+                transport->close(hdl, Transport::CLOSE_POLICY_VIOLATION, "No common cipher suite");
+                break;
+            }
+            
+            const std::string serverNonce = PskHandshake::makeNonce();
+            PskHandshake::Derived derived;
+            cipherIt->second.selectSuite(suite);
+            if (!PskHandshake::derive(keyIt->second, identity, offerText, suite, clientNonce, serverNonce, derived) ||
+                !cipherIt->second.initialize(derived.secret, false)) {
+                CRYPTOLINK_LOG_ERROR("会话加密器初始化失败");
+                transport->close(hdl, Transport::CLOSE_POLICY_VIOLATION, "PSK handshake failed");
+                break;
+            }
+            
+            // 收到客户端的确认值才算握手完成，在此之前不处理任何加密记录，也不认可声称的身份
+            pskConfirmations[hdl] = PendingPsk{derived.clientConfirm, identity};
+            Message accept = {PSK_ACCEPT, PskHandshake::encodeAccept(serverNonce, suite, derived.serverConfirm)};
+            sendHandshakeMessage(hdl, accept);
+            break;
+        }
+        case PSK_FINISHED: {
+            auto confirmIt = pskConfirmations.find(hdl);
+            auto cipherIt = clientCiphers.find(hdl);
+            std::string confirm;
+            if (confirmIt == pskConfirmations.end() || cipherIt == clientCiphers.end() ||
+                !PskHandshake::parseFinished(msg.data, confirm) ||
+                !PskHandshake::confirmEquals(confirm, confirmIt->second.confirm)) {
+                CRYPTOLINK_LOG_WARNING("预共享密钥确认失败");
+                transport->close(hdl, Transport::CLOSE_POLICY_VIOLATION, "PSK confirmation failed");
+                break;
+            }
+            
+            // 确认值证明客户端持有该身份的 PSK，接收文件的部分文件才按身份分开存放
+            auto filesIt = clientFiles.find(hdl);
+            if (filesIt != clientFiles.end()) {
+                filesIt->second->setPeerKey("psk:" + confirmIt->second.identity);
+            }
+            pskConfirmations.erase(confirmIt);
+            completeHandshake(hdl, cipherIt->second);
+            break;
+        }
         default:
             break;
     }
 }
 
+void CryptoWebSocketServer::completeHandshake(websocketpp::connection_hdl hdl, SessionCipherSlot& cipher) {
+    handshakeStatus[hdl] = true;
+    
+    // AEAD 套件的会话支持大消息分段并行加解密，关闭并行加密时不接受分段消息
+    if (cipher.getSuite() != CipherSuite::AES_256_CBC && parallelThreshold > 0) {
+        auto segments = std::make_unique<SegmentCipher>(cipher.getSuite(),
+            cipher.getSegmentSendKey(), cipher.getSegmentReceiveKey(), [this, hdl]() {
+                transport->post([this, hdl]() {
+                    flushSegments(hdl);
+                });
+            });
+        segments->setReceiveLimit(parallelReceiveLimit);
+        PooledBuffer limit = segments->limitPayload();
+        clientSegments[hdl] = std::move(segments);
+        
+        // 告诉客户端本端接收分段消息的上限，客户端收到之前大消息串行发送
+        const char limitHeader = static_cast<char>(SEGMENT_LIMIT);
+        queueRecord(hdl, SendPriority::CONTROL, std::string_view(&limitHeader, 1), std::move(limit));
+    }
+    
+    auto livenessIt = sessionLiveness.find(hdl);
+    if (livenessIt != sessionLiveness.end()) {
+        timerWheel.cancel(livenessIt->second.handshakeTimer);
+        livenessIt->second.handshakeTimer = 0;
+    
+        // 握手完成后立即发出第一次探测，之后按间隔周期探测
+        if (latencyProbeInterval.count() > 0) {
+            livenessIt->second.probeTimer = timerWheel.schedule(std::chrono::milliseconds(0), [this, hdl]() {
+                sendLatencyProbe(hdl);
+            });
+        }
+    }
+    CRYPTOLINK_LOG_DEBUG("客户端握手完成！加密套件: " << cipherSuiteName(cipher.getSuite()));
+    if (handshakeCallback) {
+        handshakeCallback(hdl);
+    }
+}
+
 void CryptoWebSocketServer::initializeClientCrypto(websocketpp::connection_hdl hdl) {
     // 为新客户端创建RSA和AES对象
-    clientRSAKeys[hdl] = std::make_unique<RSAKey>();
+    clientRSAKeys[hdl] = std::make_unique<RSAKey>(rsaKeySize);
     clientAESKeys[hdl] = std::make_unique<AESKey>();
     handshakeStatus[hdl] = false;
+    clientCiphers[hdl].reset();
     
-    // 生成密钥
-    clientRSAKeys[hdl]->generateKeyPair();
+    // 加密和发送都按会话的优先级通道调度
+    clientLanes[hdl] = std::make_unique<PriorityLanes>([this, hdl](std::string_view header, std::string_view payload) {
+        return sealAndSend(hdl, header, payload);
+    }, priorityWeights);
+    
+    // 客户端打开的逻辑通道共用这条连接的会话加密器，通道控制记录走控制通道
+    auto channels = std::make_unique<ChannelMux>([this, hdl](std::string_view header, std::string_view payload) {
+        SendPriority priority = header[0] == static_cast<char>(CHANNEL_DATA) ? SendPriority::NORMAL : SendPriority::CONTROL;
+        return sendRecord(hdl, header, payload, priority);
+    }, false);
+    channels->setDataHandler([this, hdl](ChannelMux::ChannelId channel, std::string_view message) {
+        if (channelMessageCallback) {
+            channelMessageCallback(hdl, channel, message);
+        }
+    });
+    clientChannels[hdl] = std::move(channels);
+    
+    // 文件记录都是单字节记录头，块记录按发送时指定的优先级排队
+    auto files = std::make_unique<FileTransfer>([this, hdl](FileTransfer::RecordType type, SendPriority priority, PooledBuffer payload) {
+        OutboundRecord record;
+        record.hdl = hdl;
+        record.header[0] = static_cast<char>(type);
+        record.headerLength = 1;
+        record.priority = priority;
+        record.payload = std::move(payload);
+        return enqueueRecord(std::move(record));
+    });
+    files->setReceiveDirectory(fileReceiveDirectory);
+    files->setDiskWorker([this, hdl]() {
+        transport->post([this, hdl]() {
+            flushFiles(hdl);
+        });
+    });
+    
+    // RSA 握手中客户端公钥未经证明，任何人都可以发送别人的公钥，部分文件只属于本连接；
+    // PSK 握手确认后改为按身份存放，同一身份重新连接后可以续传
+    files->useConnectionTag();
+    files->setSentHandler([this, hdl](FileTransfer::TransferId id, const std::string& path, bool completed) {
+        if (fileSentCallback) {
+            fileSentCallback(hdl, id, path, completed);
+        }
+    });
+    files->setReceivedHandler([this, hdl](FileTransfer::TransferId id, const std::string& path, bool completed) {
+        if (fileReceivedCallback) {
+            fileReceivedCallback(hdl, id, path, completed);
+        }
+    });
+    clientFiles[hdl] = std::move(files);
+    
+    // 调用记录都是单字节记录头，应答可能在任意线程发出，经发送队列进入会话的优先级通道
+    auto rpc = std::make_unique<RpcSession>([this, hdl](RpcSession::RecordType type, SendPriority priority, PooledBuffer payload) {
+        OutboundRecord record;
+        record.hdl = hdl;
+        record.header[0] = static_cast<char>(type);
+        record.headerLength = 1;
+        record.priority = priority;
+        record.payload = std::move(payload);
+        return enqueueRecord(std::move(record));
+    });
+    rpc->setRequestHandler([this, hdl](std::string_view method, std::string_view request, RpcSession::Responder responder) {
+        auto methodIt = rpcMethods.find(method);
+        if (methodIt == rpcMethods.end()) {
+            responder.respond(RpcSession::Status::NOT_FOUND, method);
+            return;
+        }
+        methodIt->second(hdl, request, std::move(responder));
+    });
+    clientRpc[hdl] = std::move(rpc);
+    
+    sessionLatency[hdl] = LatencyProbe();
+    
+    uint64_t sessionId = nextSessionId++;
+    clientSessionIds[hdl] = sessionId;
+    sessionHandles[sessionId] = hdl;
+    
+    // 客户端的 RSA 对象只保存客户端公钥，不需要为每个连接生成密钥对（在事件循环上生成会阻塞所有会话）
     clientAESKeys[hdl]->generateRawKey();
 }
 
+void CryptoWebSocketServer::setSessionTimeouts(const SessionTimeouts& timeouts) {
+    sessionTimeouts = timeouts;
+}
+
+void CryptoWebSocketServer::onPong(websocketpp::connection_hdl hdl) {
+    auto it = sessionLiveness.find(hdl);
+    if (it != sessionLiveness.end()) {
+        it->second.lastReceive = std::chrono::steady_clock::now();
+    }
+}
+
+void CryptoWebSocketServer::startTimerTick() {
+    // 整个服务器只有这一个 asio 定时器，每个刻度推进一次时间轮
+    transport->setTimer(timerWheel.getTickInterval(), [this]() {
+        if (!isRunning) {
+            return;
+        }
+        timerWheel.advance(std::chrono::steady_clock::now());
+        startTimerTick();
+    });
+}
+
+void CryptoWebSocketServer::scheduleSessionTimers(websocketpp::connection_hdl hdl) {
+    SessionLiveness& liveness = sessionLiveness[hdl];
+    liveness.lastReceive = liveness.lastActivity = std::chrono::steady_clock::now();
+    liveness.timeouts = sessionTimeouts;
+    const SessionTimeouts& timeouts = liveness.timeouts;
+    
+    if (timeouts.handshakeTimeout.count() > 0) {
+        liveness.handshakeTimer = timerWheel.schedule(timeouts.handshakeTimeout, [this, hdl]() {
+            auto it = sessionLiveness.find(hdl);
+            if (it != sessionLiveness.end()) {
+                it->second.handshakeTimer = 0;
+                reapSession(hdl, "Handshake timeout");
+            }
+        });
+    }
+    if (timeouts.heartbeatInterval.count() > 0) {
+        liveness.heartbeatTimer = timerWheel.schedule(timeouts.heartbeatInterval, [this, hdl]() {
+            onHeartbeatTimer(hdl);
+        });
+    }
+    if (timeouts.idleTimeout.count() > 0) {
+        liveness.idleTimer = timerWheel.schedule(timeouts.idleTimeout, [this, hdl]() {
+            onIdleTimer(hdl);
+        });
+    }
+}
+
+void CryptoWebSocketServer::onHeartbeatTimer(websocketpp::connection_hdl hdl) {
+    auto it = sessionLiveness.find(hdl);
+    if (it == sessionLiveness.end()) {
+        return;
+    }
+    it->second.heartbeatTimer = 0;
+    const SessionTimeouts& timeouts = it->second.timeouts;
+    
+    auto silence = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - it->second.lastReceive);
+    
+    // 已经 ping 过且超时仍未收到任何数据，说明连接半开
+    const bool reapOnTimeout = timeouts.heartbeatTimeout.count() > 0;
+    if (reapOnTimeout && silence >= timeouts.heartbeatInterval + timeouts.heartbeatTimeout) {
+        reapSession(hdl, "Heartbeat timeout");
+        return;
+    }
+    
+    std::chrono::milliseconds nextCheck = timeouts.heartbeatInterval - silence;
+    if (silence >= timeouts.heartbeatInterval) {
+        transport->ping(hdl);
+        // 不回收时只用 ping 维持连接（例如穿过会清理空闲连接的代理），每个间隔发一次
+        nextCheck = reapOnTimeout
+            ? timeouts.heartbeatInterval + timeouts.heartbeatTimeout - silence
+            : timeouts.heartbeatInterval;
+    }
+    
+    it->second.heartbeatTimer = timerWheel.schedule(nextCheck, [this, hdl]() {
+        onHeartbeatTimer(hdl);
+    });
+}
+
+void CryptoWebSocketServer::onIdleTimer(websocketpp::connection_hdl hdl) {
+    auto it = sessionLiveness.find(hdl);
+    if (it == sessionLiveness.end()) {
+        return;
+    }
+    it->second.idleTimer = 0;
+    const std::chrono::milliseconds idleTimeout = it->second.timeouts.idleTimeout;
+    
+    auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - it->second.lastActivity);
+    if (idle >= idleTimeout) {
+        reapSession(hdl, "Idle timeout");
+        return;
+    }
+    
+    // 收到消息时不重置定时器，到期后按最近活动时间顺延
+    it->second.idleTimer = timerWheel.schedule(idleTimeout - idle, [this, hdl]() {
+        onIdleTimer(hdl);
+    });
+}
+
+void CryptoWebSocketServer::reapSession(websocketpp::connection_hdl hdl, const std::string& reason) {
+    CRYPTOLINK_LOG_INFO("回收超时会话: " << reason);
+    
+    // 先释放会话资源，半开连接可能永远等不到关闭回调
+    releaseSession(hdl);
+    ++reapedSessions;
+    
+    transport->close(hdl, Transport::CLOSE_GOING_AWAY, reason);
+}
+
+bool CryptoWebSocketServer::sendHandshakeMessage(websocketpp::connection_hdl hdl, const Message& msg) {
+    std::string serialized = serializeMessage(msg);
+    return transport->send(hdl, serialized.data(), serialized.size(), Transport::FrameType::TEXT);
+}
+
 std::string CryptoWebSocketServer::serializeMessage(const Message& msg) {
     Json::Value root;
     root["type"] = static_cast<int>(msg.type);
@@ -207,12 +1607,8 @@ std::string CryptoWebSocketServer::serializeMessage(const Message& msg) {
 
 CryptoWebSocketServer::Message CryptoWebSocketServer::parseMessage(const std::string& data) {
     Json::Value root;
-    Json::CharReaderBuilder builder;
-    Json::CharReader* reader = builder.newCharReader();
-    
     std::string errors;
-    bool success = reader->parse(data.c_str(), data.c_str() + data.length(), &root, &errors);
-    delete reader;
+    bool success = jsonReader->parse(data.c_str(), data.c_str() + data.length(), &root, &errors);
     
     Message msg;
     if (success) {
@@ -0,0 +1,58 @@
+#include "CryptoWorkerPool.h"
+#include <algorithm>
+
+CryptoWorkerPool::CryptoWorkerPool(size_t threads) : stopping(false) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this]() {
+            workerLoop();
+        });
+    }
+}
+
+CryptoWorkerPool::~CryptoWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void CryptoWorkerPool::submit(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    available.notify_one();
+}
+
+CryptoWorkerPool& CryptoWorkerPool::shared() {
+    // 不在静态析构时销毁：静态存储期的服务端/客户端析构时可能还在等待已提交的任务
+    static CryptoWorkerPool* pool = new CryptoWorkerPool();
+    return *pool;
+}
+
+void CryptoWorkerPool::workerLoop() {
+    for (;;) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this]() {
+                return stopping || !tasks.empty();
+            });
+            // 停止前把已提交的任务执行完，提交方可能在等待它们
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
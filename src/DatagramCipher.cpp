@@ -0,0 +1,176 @@
+#include "DatagramCipher.h"
+#include "Logger.h"
+#include <cryptopp/aes.h>
+#include <cryptopp/chachapoly.h>
+#include <cryptopp/gcm.h>
+#include <cstring>
+
+using namespace CryptoPP;
+
+namespace {
+
+const size_t kNonceSize = 12;
+const size_t kSaltSize = 4;
+
+void writeUint(char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[bytes - 1 - i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t readUint(const char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(in[i]);
+    }
+    return value;
+}
+
+void makeNonce(byte* nonce, const byte* salt, uint64_t sequence) {
+    std::memcpy(nonce, salt, kSaltSize);
+    writeUint(reinterpret_cast<char*>(nonce) + kSaltSize, sequence, 8);
+}
+
+template <class Encryption, class Decryption>
+void createCiphers(std::unique_ptr<AuthenticatedSymmetricCipher>& encryption,
+                   std::unique_ptr<AuthenticatedSymmetricCipher>& decryption) {
+    encryption = std::make_unique<Encryption>();
+    decryption = std::make_unique<Decryption>();
+}
+
+}
+
+DatagramCipher::DatagramCipher(CipherSuite suite, uint64_t connectionId, const DirectionalKey& sendKey,
+                               const DirectionalKey& receiveKey, Delivery delivery)
+    : id(connectionId),
+      delivery(delivery),
+      sendSequence(0),
+      highestSequence(0) {
+    window.fill(0);
+
+    switch (suite) {
+        case CipherSuite::AES_256_GCM:
+            createCiphers<GCM<AES>::Encryption, GCM<AES>::Decryption>(encryption, decryption);
+            break;
+        case CipherSuite::CHACHA20_POLY1305:
+            createCiphers<ChaCha20Poly1305::Encryption, ChaCha20Poly1305::Decryption>(encryption, decryption);
+            break;
+        default:
+            CRYPTOLINK_LOG_ERROR("数据报只支持 AEAD 套件");
+            return;
+    }
+
+    // 密钥只设置一次，每个数据报的 nonce 在加解密时传入
+    byte nonce[kNonceSize] = {0};
+    std::memcpy(sendSalt, sendKey.salt.data(), kSaltSize);
+    std::memcpy(receiveSalt, receiveKey.salt.data(), kSaltSize);
+    encryption->SetKeyWithIV(sendKey.key, sendKey.key.size(), nonce, kNonceSize);
+    decryption->SetKeyWithIV(receiveKey.key, receiveKey.key.size(), nonce, kNonceSize);
+}
+
+PooledBuffer DatagramCipher::seal(std::string_view payload, BufferPool& pool) {
+    if (!encryption || payload.size() > kMaxPayloadSize) {
+        return PooledBuffer();
+    }
+
+    try {
+        const size_t length = kOverhead + payload.size();
+        PooledBuffer datagram = pool.acquire(length);
+        if (!datagram) {
+            return datagram;
+        }
+        datagram.resize(length);
+
+        // 同一密钥下序号不重复，nonce 也就不重复
+        const uint64_t sequence = ++sendSequence;
+        char* out = datagram.data();
+        writeUint(out, id, kConnectionIdSize);
+        writeUint(out + kConnectionIdSize, sequence, kSequenceSize);
+
+        byte nonce[kNonceSize];
+        makeNonce(nonce, sendSalt, sequence);
+
+        byte* cipher = reinterpret_cast<byte*>(out) + kHeaderSize;
+        encryption->EncryptAndAuthenticate(cipher, cipher + payload.size(), kTagSize,
+                                           nonce, kNonceSize,
+                                           reinterpret_cast<const byte*>(out), kHeaderSize,
+                                           reinterpret_cast<const byte*>(payload.data()), payload.size());
+        return datagram;
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("数据报加密失败: " << e.what());
+        return PooledBuffer();
+    }
+}
+
+bool DatagramCipher::open(char* datagram, size_t length, std::string_view& payload, bool& newest) {
+    if (!decryption || length < kOverhead || readUint(datagram, kConnectionIdSize) != id) {
+        return false;
+    }
+
+    // 先按序号过滤重放和迟到的数据报，省去一次解密；校验通过后才记入窗口
+    const uint64_t sequence = readUint(datagram + kConnectionIdSize, kSequenceSize);
+    if (sequence == 0 || seen(sequence) ||
+        (delivery == Delivery::ORDERED && sequence <= highestSequence)) {
+        return false;
+    }
+
+    try {
+        byte nonce[kNonceSize];
+        makeNonce(nonce, receiveSalt, sequence);
+
+        const size_t cipherLength = length - kOverhead;
+        byte* cipher = reinterpret_cast<byte*>(datagram) + kHeaderSize;
+        if (!decryption->DecryptAndVerify(cipher, cipher + cipherLength, kTagSize,
+                                          nonce, kNonceSize,
+                                          reinterpret_cast<const byte*>(datagram), kHeaderSize,
+                                          cipher, cipherLength)) {
+            return false;
+        }
+
+        newest = sequence > highestSequence;
+        accept(sequence);
+        payload = std::string_view(reinterpret_cast<const char*>(cipher), cipherLength);
+        return true;
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_WARNING("数据报解密失败: " << e.what());
+        return false;
+    }
+}
+
+bool DatagramCipher::readConnectionId(const char* datagram, size_t length, uint64_t& connectionId) {
+    if (length < kConnectionIdSize) {
+        return false;
+    }
+    connectionId = readUint(datagram, kConnectionIdSize);
+    return true;
+}
+
+bool DatagramCipher::seen(uint64_t sequence) const {
+    if (sequence > highestSequence) {
+        return false;
+    }
+    if (highestSequence - sequence >= kReplayWindow) {
+        // 落后太多，无法判断是否收到过，按重放处理
+        return true;
+    }
+    const size_t bit = sequence % kReplayWindow;
+    return (window[bit / 64] >> (bit % 64)) & 1;
+}
+
+void DatagramCipher::accept(uint64_t sequence) {
+    if (sequence > highestSequence) {
+        // 窗口前移，清掉移出的序号对应的位（它们将被新序号复用）
+        if (sequence - highestSequence >= kReplayWindow) {
+            window.fill(0);
+        } else {
+            for (uint64_t next = highestSequence + 1; next <= sequence; ++next) {
+                const size_t bit = next % kReplayWindow;
+                window[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+            }
+        }
+        highestSequence = sequence;
+    }
+    const size_t bit = sequence % kReplayWindow;
+    window[bit / 64] |= uint64_t(1) << (bit % 64);
+}
@@ -0,0 +1,439 @@
+#include "DatagramSocket.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+
+using boost::asio::ip::udp;
+
+namespace {
+
+// 接收缓冲区能放下最大的 UDP 数据报
+const size_t kReceiveBufferSize = 64 * 1024;
+
+// 客户端打开通道后发送空数据报的初始间隔，未收到回复时加倍，最长到保活间隔
+const std::chrono::milliseconds kInitialProbeInterval(100);
+
+// 空闲多久发送一次保活数据报，短于常见 NAT 的 UDP 映射超时
+const std::chrono::milliseconds kKeepaliveInterval(15000);
+
+void writeUint(char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[bytes - 1 - i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t readUint(const char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(in[i]);
+    }
+    return value;
+}
+
+}
+
+struct DatagramSocket::Core : std::enable_shared_from_this<Core> {
+    explicit Core(boost::asio::io_context& io)
+        : io(io), socket(io), resolver(io), keepaliveTimer(io), receiveBuffer(kReceiveBufferSize) {}
+
+    // 服务端每个会话的密钥和最近一次确认的对端地址
+    struct Binding {
+        Handle hdl;
+        std::unique_ptr<DatagramCipher> cipher;
+        udp::endpoint peer;
+        bool peerKnown = false;
+    };
+
+    boost::asio::io_context& io;
+    udp::socket socket;
+    udp::resolver resolver;
+    boost::asio::steady_timer keepaliveTimer;
+    DatagramHandler handler;
+    bool server = false;
+    bool closed = false;
+
+    std::vector<char> receiveBuffer;
+    udp::endpoint sender;
+
+    // 服务端：连接号到会话，会话到连接号
+    std::unordered_map<uint64_t, Binding> bindings;
+    std::map<Handle, uint64_t, std::owner_less<Handle>> connectionIds;
+
+    // 客户端：每次 connect / close 递增 generation，过期的解析、接收和定时器回调据此丢弃
+    std::unique_ptr<DatagramCipher> cipher;
+    uint64_t generation = 0;
+    bool confirmed = false;
+    std::chrono::milliseconds probeInterval = kInitialProbeInterval;
+    std::chrono::steady_clock::time_point lastSend;
+
+    void startReceive();
+    void handleServerDatagram(size_t length);
+    void handleClientDatagram(size_t length);
+    void sendTo(Handle hdl, std::string_view payload);
+    void transmit(DatagramCipher& sealer, std::string_view payload, const udp::endpoint* peer);
+
+    void connectTo(const std::string& host, uint16_t port, std::unique_ptr<DatagramCipher> next);
+    void resetClient();
+    void scheduleKeepalive(std::chrono::milliseconds delay);
+    void onKeepalive();
+    void shutdown();
+};
+
+void DatagramSocket::Core::startReceive() {
+    const uint64_t current = generation;
+    socket.async_receive_from(boost::asio::buffer(receiveBuffer), sender,
+        [self = shared_from_this(), current](const boost::system::error_code& ec, size_t length) {
+            if (self->closed || self->generation != current || ec == boost::asio::error::operation_aborted) {
+                return;
+            }
+            if (!ec) {
+                if (self->server) {
+                    self->handleServerDatagram(length);
+                } else {
+                    self->handleClientDatagram(length);
+                }
+            }
+
+            // 对端不可达等错误只影响这一个数据报，继续接收
+            if (self->socket.is_open() && self->generation == current) {
+                self->startReceive();
+            }
+        });
+}
+
+void DatagramSocket::Core::handleServerDatagram(size_t length) {
+    uint64_t connectionId = 0;
+    if (!DatagramCipher::readConnectionId(receiveBuffer.data(), length, connectionId)) {
+        return;
+    }
+    auto it = bindings.find(connectionId);
+    if (it == bindings.end()) {
+        return;
+    }
+
+    Binding& binding = it->second;
+    std::string_view payload;
+    bool newest = false;
+    if (!binding.cipher->open(receiveBuffer.data(), length, payload, newest)) {
+        return;
+    }
+
+    // 迟到的数据报可能来自客户端换网络之前的地址，只按最新的数据报更新
+    if (newest || !binding.peerKnown) {
+        binding.peer = sender;
+        binding.peerKnown = true;
+    }
+
+    if (payload.empty()) {
+        // 回复保活数据报，客户端据此确认服务端已经知道它的地址
+        transmit(*binding.cipher, std::string_view(), &binding.peer);
+        return;
+    }
+    if (handler) {
+        handler(binding.hdl, payload);
+    }
+}
+
+void DatagramSocket::Core::handleClientDatagram(size_t length) {
+    std::string_view payload;
+    bool newest = false;
+    if (!cipher || !cipher->open(receiveBuffer.data(), length, payload, newest)) {
+        return;
+    }
+
+    if (!confirmed) {
+        // 服务端已经收到过本端的数据报，改为空闲时保活
+        confirmed = true;
+        scheduleKeepalive(kKeepaliveInterval);
+    }
+    if (!payload.empty() && handler) {
+        handler(Handle(), payload);
+    }
+}
+
+void DatagramSocket::Core::sendTo(Handle hdl, std::string_view payload) {
+    if (closed) {
+        return;
+    }
+
+    if (!server) {
+        if (cipher && socket.is_open()) {
+            transmit(*cipher, payload, nullptr);
+        }
+        return;
+    }
+
+    auto idIt = connectionIds.find(hdl);
+    if (idIt == connectionIds.end()) {
+        return;
+    }
+    auto it = bindings.find(idIt->second);
+    if (it != bindings.end() && it->second.peerKnown) {
+        transmit(*it->second.cipher, payload, &it->second.peer);
+    }
+}
+
+void DatagramSocket::Core::transmit(DatagramCipher& sealer, std::string_view payload, const udp::endpoint* peer) {
+    PooledBuffer datagram = sealer.seal(payload, BufferPool::local());
+    if (!datagram) {
+        return;
+    }
+
+    // 非阻塞发送，发送缓冲区满时丢弃而不是排队
+    boost::system::error_code ec;
+    if (peer) {
+        socket.send_to(boost::asio::buffer(datagram.data(), datagram.size()), *peer, 0, ec);
+    } else {
+        socket.send(boost::asio::buffer(datagram.data(), datagram.size()), 0, ec);
+    }
+    if (ec && ec != boost::asio::error::would_block) {
+        CRYPTOLINK_LOG_DEBUG("数据报发送失败: " << ec.message());
+    }
+    lastSend = std::chrono::steady_clock::now();
+}
+
+void DatagramSocket::Core::connectTo(const std::string& host, uint16_t port, std::unique_ptr<DatagramCipher> next) {
+    resetClient();
+    if (closed) {
+        return;
+    }
+
+    const uint64_t current = generation;
+    resolver.async_resolve(host, std::to_string(port),
+        [self = shared_from_this(), current, next = std::move(next), host](
+            const boost::system::error_code& ec, udp::resolver::results_type results) mutable {
+            if (self->closed || self->generation != current) {
+                return;
+            }
+            if (ec) {
+                CRYPTOLINK_LOG_WARNING("数据报通道地址解析失败: " << host << ": " << ec.message());
+                return;
+            }
+
+            // 依次尝试解析出的地址，UDP 的 connect 只设置默认目的地址并过滤其他来源
+            boost::system::error_code openError;
+            for (const auto& entry : results) {
+                self->socket.close(openError);
+                self->socket.open(entry.endpoint().protocol(), openError);
+                if (!openError) {
+                    self->socket.connect(entry.endpoint(), openError);
+                }
+                if (!openError) {
+                    self->socket.non_blocking(true, openError);
+                }
+                if (!openError) {
+                    break;
+                }
+            }
+            if (openError || !self->socket.is_open()) {
+                CRYPTOLINK_LOG_WARNING("数据报通道打开失败: " << host);
+                self->socket.close(openError);
+                return;
+            }
+
+            self->cipher = std::move(next);
+            self->confirmed = false;
+            self->probeInterval = kInitialProbeInterval;
+            self->startReceive();
+            self->onKeepalive();
+        });
+}
+
+void DatagramSocket::Core::resetClient() {
+    ++generation;
+    boost::system::error_code ec;
+    resolver.cancel();
+    keepaliveTimer.cancel();
+    socket.close(ec);
+    cipher.reset();
+    confirmed = false;
+}
+
+void DatagramSocket::Core::scheduleKeepalive(std::chrono::milliseconds delay) {
+    keepaliveTimer.expires_after(delay);
+    keepaliveTimer.async_wait([self = shared_from_this(), current = generation](const boost::system::error_code& ec) {
+        if (!ec && !self->closed && self->generation == current) {
+            self->onKeepalive();
+        }
+    });
+}
+
+void DatagramSocket::Core::onKeepalive() {
+    if (!cipher) {
+        return;
+    }
+
+    if (!confirmed) {
+        // 服务端还不知道本端地址，按退避间隔重发空数据报
+        transmit(*cipher, std::string_view(), nullptr);
+        const std::chrono::milliseconds delay = probeInterval;
+        probeInterval = std::min(probeInterval * 2, kKeepaliveInterval);
+        scheduleKeepalive(delay);
+        return;
+    }
+
+    auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lastSend);
+    if (idle >= kKeepaliveInterval) {
+        transmit(*cipher, std::string_view(), nullptr);
+        idle = std::chrono::milliseconds(0);
+    }
+    scheduleKeepalive(kKeepaliveInterval - idle);
+}
+
+void DatagramSocket::Core::shutdown() {
+    resetClient();
+    closed = true;
+    bindings.clear();
+    connectionIds.clear();
+    handler = nullptr;
+}
+
+DatagramSocket::DatagramSocket(boost::asio::io_context* loop)
+    : ownedIo(loop ? nullptr : new boost::asio::io_context()),
+      core(std::make_shared<Core>(loop ? *loop : *ownedIo)),
+      boundPort(0) {
+    if (ownedIo) {
+        boost::asio::io_context* io = ownedIo.get();
+        thread = std::thread([io]() {
+            auto work = boost::asio::make_work_guard(*io);
+            io->run();
+        });
+    }
+}
+
+DatagramSocket::~DatagramSocket() {
+    if (ownedIo) {
+        ownedIo->stop();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    // 自己的线程已经退出，或者正在共享事件循环的线程上：直接关闭，已排队的回调看到 closed 后返回
+    core->shutdown();
+}
+
+void DatagramSocket::setHandler(DatagramHandler handler) {
+    core->handler = std::move(handler);
+}
+
+bool DatagramSocket::listen(uint16_t port) {
+    // 还没有任何异步操作，可以在调用线程上打开套接字
+    udp::socket& socket = core->socket;
+    boost::system::error_code ec;
+    socket.open(udp::v6(), ec);
+    if (!ec) {
+        socket.set_option(boost::asio::ip::v6_only(false), ec);
+    }
+    if (!ec) {
+        socket.bind(udp::endpoint(udp::v6(), port), ec);
+    }
+    if (ec) {
+        boost::system::error_code ignored;
+        socket.close(ignored);
+        ec.clear();
+        socket.open(udp::v4(), ec);
+        if (!ec) {
+            socket.bind(udp::endpoint(udp::v4(), port), ec);
+        }
+    }
+    if (!ec) {
+        socket.non_blocking(true, ec);
+    }
+    if (ec) {
+        CRYPTOLINK_LOG_ERROR("数据报端口 " << port << " 监听失败: " << ec.message());
+        boost::system::error_code ignored;
+        socket.close(ignored);
+        return false;
+    }
+
+    boundPort = socket.local_endpoint(ec).port();
+    core->server = true;
+    boost::asio::post(core->io, [core = this->core]() {
+        core->startReceive();
+    });
+    return true;
+}
+
+void DatagramSocket::bind(Handle hdl, std::unique_ptr<DatagramCipher> cipher) {
+    boost::asio::post(core->io, [core = this->core, hdl, cipher = std::move(cipher)]() mutable {
+        if (core->closed || core->connectionIds.count(hdl) > 0 || core->bindings.count(cipher->connectionId()) > 0) {
+            CRYPTOLINK_LOG_WARNING("数据报连接号重复登记");
+            return;
+        }
+        const uint64_t connectionId = cipher->connectionId();
+        core->connectionIds[hdl] = connectionId;
+        Core::Binding& binding = core->bindings[connectionId];
+        binding.hdl = hdl;
+        binding.cipher = std::move(cipher);
+    });
+}
+
+void DatagramSocket::unbind(Handle hdl) {
+    boost::asio::post(core->io, [core = this->core, hdl]() {
+        auto it = core->connectionIds.find(hdl);
+        if (it != core->connectionIds.end()) {
+            core->bindings.erase(it->second);
+            core->connectionIds.erase(it);
+        }
+    });
+}
+
+void DatagramSocket::connect(const std::string& host, uint16_t port, std::unique_ptr<DatagramCipher> cipher) {
+    boost::asio::post(core->io, [core = this->core, host, port, cipher = std::move(cipher)]() mutable {
+        core->connectTo(host, port, std::move(cipher));
+    });
+}
+
+void DatagramSocket::close() {
+    boost::asio::post(core->io, [core = this->core]() {
+        core->resetClient();
+    });
+}
+
+bool DatagramSocket::send(Handle hdl, std::string_view payload) {
+    // 空数据报保留给保活
+    if (payload.empty() || payload.size() > DatagramCipher::kMaxPayloadSize) {
+        return false;
+    }
+
+    // 已经在数据报线程上时直接加密发送，省去一次拷贝和线程切换
+    if (core->io.get_executor().running_in_this_thread()) {
+        core->sendTo(hdl, payload);
+        return true;
+    }
+
+    PooledBuffer copy = BufferPool::local().copyFrom(payload.data(), payload.size());
+    if (!copy) {
+        return false;
+    }
+    boost::asio::post(core->io, [core = this->core, hdl, copy = std::move(copy)]() {
+        core->sendTo(hdl, copy.view());
+    });
+    return true;
+}
+
+PooledBuffer DatagramSocket::encodeAccept(uint64_t connectionId, uint16_t port) {
+    PooledBuffer payload = BufferPool::local().acquire(kAcceptSize);
+    if (payload) {
+        char out[kAcceptSize];
+        writeUint(out, connectionId, DatagramCipher::kConnectionIdSize);
+        writeUint(out + DatagramCipher::kConnectionIdSize, port, 2);
+        payload.append(out, sizeof(out));
+    }
+    return payload;
+}
+
+bool DatagramSocket::decodeAccept(std::string_view payload, uint64_t& connectionId, uint16_t& port) {
+    if (payload.size() != kAcceptSize) {
+        return false;
+    }
+    connectionId = readUint(payload.data(), DatagramCipher::kConnectionIdSize);
+    port = static_cast<uint16_t>(readUint(payload.data() + DatagramCipher::kConnectionIdSize, 2));
+    return true;
+}
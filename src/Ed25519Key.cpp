@@ -0,0 +1,193 @@
+#include "Ed25519Key.h"
+#include "Logger.h"
+#include <cryptopp/base64.h>
+#include <cryptopp/filters.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+// 每个线程至少分到的验证项数，太少时线程创建的开销超过收益
+const size_t kMinChecksPerThread = 64;
+
+}
+
+Ed25519Key::Ed25519Key() = default;
+
+Ed25519Key::~Ed25519Key() = default;
+
+bool Ed25519Key::generateKeyPair() {
+    try {
+        signer = std::make_unique<ed25519Signer>();
+        signer->AccessPrivateKey().GenerateRandom(rng);
+
+        // 从私钥派生公钥
+        ed25519Verifier verifier(*signer);
+        const ed25519PublicKey& publicKey = dynamic_cast<const ed25519PublicKey&>(verifier.GetPublicKey());
+        localPublicKey.assign((const char*)publicKey.GetPublicKeyBytePtr(), kPublicKeySize);
+        return true;
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("Ed25519密钥对生成失败: " << e.what());
+        signer.reset();
+        return false;
+    }
+}
+
+std::string Ed25519Key::getLocalPublicKey() {
+    if (localPublicKey.empty()) {
+        return "";
+    }
+    return base64Encode(localPublicKey);
+}
+
+bool Ed25519Key::setRemotePublicKey(const std::string& publicKey) {
+    std::string decoded = base64Decode(publicKey);
+    if (decoded.size() != kPublicKeySize) {
+        CRYPTOLINK_LOG_ERROR("设置远程公钥失败: Ed25519公钥长度错误");
+        return false;
+    }
+
+    try {
+        remoteVerifier = std::make_unique<ed25519Verifier>((const byte*)decoded.data());
+        return true;
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("设置远程公钥失败: " << e.what());
+        return false;
+    }
+}
+
+std::string Ed25519Key::encryptWithLocalPrivate(const std::string&) {
+    CRYPTOLINK_LOG_ERROR("Ed25519只支持签名，不支持加密");
+    return "";
+}
+
+std::string Ed25519Key::decryptWithLocalPrivate(const std::string&) {
+    CRYPTOLINK_LOG_ERROR("Ed25519只支持签名，不支持解密");
+    return "";
+}
+
+std::string Ed25519Key::encryptWithRemotePublic(const std::string&) {
+    CRYPTOLINK_LOG_ERROR("Ed25519只支持签名，不支持加密");
+    return "";
+}
+
+std::string Ed25519Key::decryptWithRemotePublic(const std::string&) {
+    CRYPTOLINK_LOG_ERROR("Ed25519只支持签名，不支持解密");
+    return "";
+}
+
+std::string Ed25519Key::signWithLocalPrivate(const std::string& data) {
+    if (!signer) {
+        CRYPTOLINK_LOG_ERROR("使用本地私钥签名失败: 密钥对尚未生成");
+        return "";
+    }
+
+    try {
+        std::string signature(kSignatureSize, '\0');
+        size_t length = signer->SignMessage(rng, (const byte*)data.data(), data.size(), (byte*)&signature[0]);
+        signature.resize(length);
+        return base64Encode(signature);
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("使用本地私钥签名失败: " << e.what());
+        return "";
+    }
+}
+
+bool Ed25519Key::verifyWithRemotePublic(const std::string& data, const std::string& signature) {
+    if (!remoteVerifier) {
+        CRYPTOLINK_LOG_WARNING("使用远程公钥验证签名失败: 尚未设置远程公钥");
+        return false;
+    }
+    return verifyWith(*remoteVerifier, data, base64Decode(signature));
+}
+
+bool Ed25519Key::verifyBatch(const std::vector<SignatureCheck>& checks, std::vector<uint8_t>& results, size_t threads) {
+    results.assign(checks.size(), 0);
+    if (checks.empty()) {
+        return true;
+    }
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max<size_t>(1, std::min(threads, (checks.size() + kMinChecksPerThread - 1) / kMinChecksPerThread));
+
+    // 每个线程处理连续的一段，各自缓存按公钥构造好的验证器，线程之间不共享可变状态
+    auto verifyRange = [&checks, &results](size_t begin, size_t end) {
+        std::unordered_map<std::string_view, std::unique_ptr<ed25519Verifier>> verifiers;
+        for (size_t i = begin; i < end; ++i) {
+            const SignatureCheck& check = checks[i];
+
+            auto it = verifiers.find(check.publicKey);
+            if (it == verifiers.end()) {
+                std::unique_ptr<ed25519Verifier> verifier;
+                std::string decoded = base64Decode(check.publicKey);
+                if (decoded.size() == kPublicKeySize) {
+                    try {
+                        verifier = std::make_unique<ed25519Verifier>((const byte*)decoded.data());
+                    } catch (const Exception&) {
+                        verifier.reset();
+                    }
+                }
+                it = verifiers.emplace(check.publicKey, std::move(verifier)).first;
+            }
+
+            if (it->second) {
+                results[i] = verifyWith(*it->second, check.message, base64Decode(check.signature)) ? 1 : 0;
+            }
+        }
+    };
+
+    const size_t chunk = (checks.size() + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) {
+        size_t begin = t * chunk;
+        size_t end = std::min(checks.size(), begin + chunk);
+        if (begin < end) {
+            workers.emplace_back(verifyRange, begin, end);
+        }
+    }
+    verifyRange(0, std::min(checks.size(), chunk));
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    return std::all_of(results.begin(), results.end(), [](uint8_t valid) { return valid != 0; });
+}
+
+bool Ed25519Key::verifyWith(const ed25519Verifier& verifier, std::string_view message, std::string_view signature) {
+    if (signature.size() != kSignatureSize) {
+        return false;
+    }
+
+    try {
+        return verifier.VerifyMessage((const byte*)message.data(), message.size(),
+                                      (const byte*)signature.data(), signature.size());
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_WARNING("使用远程公钥验证签名失败: " << e.what());
+        return false;
+    }
+}
+
+std::string Ed25519Key::base64Encode(std::string_view data) {
+    std::string encoded;
+    StringSource ss((const byte*)data.data(), data.size(), true,
+        new Base64Encoder(
+            new StringSink(encoded),
+            false
+        )
+    );
+    return encoded;
+}
+
+std::string Ed25519Key::base64Decode(std::string_view data) {
+    std::string decoded;
+    StringSource ss((const byte*)data.data(), data.size(), true,
+        new Base64Decoder(
+            new StringSink(decoded)
+        )
+    );
+    return decoded;
+}
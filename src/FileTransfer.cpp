@@ -0,0 +1,804 @@
+#include "FileTransfer.h"
+#include "Logger.h"
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// 文件名长度上限，与常见文件系统一致
+const size_t kMaxNameLength = 255;
+
+// 目标文件名被占用时最多尝试的编号
+const unsigned kMaxNameAttempts = 1000;
+
+const size_t kOfferHeaderSize = 8 + 8 + 4;
+
+void writeUint(char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[bytes - 1 - i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t readUint(const char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(in[i]);
+    }
+    return value;
+}
+
+std::string baseName(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// 对端给出的文件名只能是单个路径分量，不能写到接收目录之外
+bool isSafeName(std::string_view name) {
+    return !name.empty() && name.size() <= kMaxNameLength && name != "." && name != ".." &&
+           name.find('/') == std::string_view::npos && name.find('\0') == std::string_view::npos;
+}
+
+// 同名文件已存在时依次尝试 "name (1).ext"、"name (2).ext"……，扩展名从最后一个点算起（隐藏文件的前导点除外）
+std::string candidateName(const std::string& name, unsigned attempt) {
+    if (attempt == 0) {
+        return name;
+    }
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos || dot == 0) {
+        dot = name.size();
+    }
+    return name.substr(0, dot) + " (" + std::to_string(attempt) + ")" + name.substr(dot);
+}
+
+// 改名但不覆盖已有文件；文件系统不支持 RENAME_NOREPLACE 时用 link + unlink，同样在目标存在时失败
+bool renameNoReplace(const std::string& from, const std::string& to) {
+    if (::renameat2(AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(), RENAME_NOREPLACE) == 0) {
+        return true;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        return false;
+    }
+    if (::link(from.c_str(), to.c_str()) != 0) {
+        return false;
+    }
+    ::unlink(from.c_str());
+    return true;
+}
+
+FileTransfer::TransferId computeId(const struct stat& st, const std::string& name) {
+    char fields[8 * 5];
+    writeUint(fields, static_cast<uint64_t>(st.st_dev), 8);
+    writeUint(fields + 8, static_cast<uint64_t>(st.st_ino), 8);
+    writeUint(fields + 16, static_cast<uint64_t>(st.st_size), 8);
+    writeUint(fields + 24, static_cast<uint64_t>(st.st_mtim.tv_sec), 8);
+    writeUint(fields + 32, static_cast<uint64_t>(st.st_mtim.tv_nsec), 8);
+
+    CryptoPP::byte digest[CryptoPP::SHA256::DIGESTSIZE];
+    CryptoPP::SHA256 sha;
+    sha.Update(reinterpret_cast<const CryptoPP::byte*>(fields), sizeof(fields));
+    sha.Update(reinterpret_cast<const CryptoPP::byte*>(name.data()), name.size());
+    sha.Final(digest);
+
+    // 0 表示失败，不作为传输号使用
+    FileTransfer::TransferId id = readUint(reinterpret_cast<const char*>(digest), 8);
+    return id ? id : 1;
+}
+
+uint64_t chunkCountFor(uint64_t size, uint64_t chunkSize) {
+    return (size + chunkSize - 1) / chunkSize;
+}
+
+bool writeAll(int fd, const char* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t written = ::pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+}
+
+// 接收文件的写盘单独用一个小线程池：fdatasync 可能阻塞数秒，不占用加解密线程
+CryptoWorkerPool& diskPool() {
+    static CryptoWorkerPool pool(2);
+    return pool;
+}
+
+// 按页对齐后对映射区间给出访问建议，区间不足一页时忽略
+void adviseRange(const char* mapping, uint64_t size, uint64_t begin, uint64_t end, int advice) {
+    static const uint64_t pageSize = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    end = std::min(end, size);
+    begin -= begin % pageSize;
+    if (begin >= end) {
+        return;
+    }
+    ::madvise(const_cast<char*>(mapping) + begin, end - begin, advice);
+}
+
+}
+
+FileTransfer::DiskWriter::~DiskWriter() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+FileTransfer::FileTransfer(RecordSender sender)
+    : sender(std::move(sender)),
+      disk(std::make_shared<DiskShared>()) {
+}
+
+FileTransfer::~FileTransfer() {
+    {
+        // 磁盘任务持有自己的接收文件状态，这里只需要保证之后不再调用 ready
+        std::lock_guard<std::mutex> lock(disk->mutex);
+        disk->closed = true;
+    }
+    for (auto& pair : outgoing) {
+        closeOutgoing(pair.second);
+    }
+    closeAllIncoming();
+}
+
+FileTransfer::TransferId FileTransfer::sendFile(const std::string& path, SendPriority priority) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        CRYPTOLINK_LOG_ERROR("打开待发送文件失败: " << path << ": " << std::strerror(errno));
+        return 0;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        CRYPTOLINK_LOG_ERROR("只能发送普通文件: " << path);
+        ::close(fd);
+        return 0;
+    }
+
+    Outgoing transfer;
+    transfer.path = path;
+    transfer.name = baseName(path);
+    transfer.priority = priority;
+    transfer.size = static_cast<uint64_t>(st.st_size);
+    transfer.chunkCount = chunkCountFor(transfer.size, kChunkSize);
+
+    // 只映射不读取，块在发出时才从页缓存拷贝到记录缓冲区
+    if (transfer.size > 0) {
+        void* mapping = ::mmap(nullptr, transfer.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            CRYPTOLINK_LOG_ERROR("映射待发送文件失败: " << path << ": " << std::strerror(errno));
+            ::close(fd);
+            return 0;
+        }
+        ::madvise(mapping, transfer.size, MADV_SEQUENTIAL);
+        transfer.mapping = static_cast<const char*>(mapping);
+    }
+    ::close(fd);
+
+    const TransferId id = computeId(st, transfer.name);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (outgoing.count(id)) {
+        // 同一个文件已经在发送
+        closeOutgoing(transfer);
+        return id;
+    }
+    if (!sendOffer(id, transfer)) {
+        closeOutgoing(transfer);
+        return 0;
+    }
+    outgoing.emplace(id, std::move(transfer));
+    return id;
+}
+
+FileTransfer::TransferId FileTransfer::transferIdFor(const std::string& path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    return computeId(st, baseName(path));
+}
+
+bool FileTransfer::cancel(TransferId id) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    bool found = false;
+    auto outIt = outgoing.find(id);
+    if (outIt != outgoing.end()) {
+        closeOutgoing(outIt->second);
+        outgoing.erase(outIt);
+        found = true;
+    }
+    auto inIt = incoming.find(id);
+    if (inIt != incoming.end()) {
+        closeIncoming(inIt->second);
+        incoming.erase(inIt);
+        found = true;
+    }
+    if (found) {
+        sendCancel(id);
+    }
+    return found;
+}
+
+void FileTransfer::setReceiveDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    receiveDirectory = directory;
+}
+
+void FileTransfer::setPeerKey(std::string_view key) {
+    std::string tag;
+    if (!key.empty()) {
+        CryptoPP::byte digest[CryptoPP::SHA256::DIGESTSIZE];
+        CryptoPP::SHA256().CalculateDigest(digest, reinterpret_cast<const CryptoPP::byte*>(key.data()), key.size());
+        char hex[2 * 8 + 1];
+        std::snprintf(hex, sizeof(hex), "%016llx",
+                      static_cast<unsigned long long>(readUint(reinterpret_cast<const char*>(digest), 8)));
+        tag = std::string(hex) + "-";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    peerTag = tag;
+    discardPartial = false;
+}
+
+void FileTransfer::useConnectionTag() {
+    CryptoPP::byte random[8];
+    CryptoPP::AutoSeededRandomPool().GenerateBlock(random, sizeof(random));
+    char hex[2 * 8 + 1];
+    std::snprintf(hex, sizeof(hex), "%016llx",
+                  static_cast<unsigned long long>(readUint(reinterpret_cast<const char*>(random), 8)));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    peerTag = std::string(hex) + "-";
+    discardPartial = true;
+}
+
+void FileTransfer::setSentHandler(CompletionHandler handler) {
+    sentHandler = handler;
+}
+
+void FileTransfer::setReceivedHandler(CompletionHandler handler) {
+    receivedHandler = handler;
+}
+
+void FileTransfer::setDiskWorker(ReadyNotifier ready) {
+    {
+        std::lock_guard<std::mutex> lock(disk->mutex);
+        disk->ready = std::move(ready);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    diskWorker = true;
+}
+
+void FileTransfer::flushDisk() {
+    std::vector<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        collectDisk(completions);
+    }
+    notify(completions);
+}
+
+bool FileTransfer::handleRecord(uint8_t type, std::string_view payload) {
+    if (payload.size() < kIdSize) {
+        return false;
+    }
+
+    std::vector<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        switch (type) {
+            case FILE_OFFER:
+                handleOffer(payload);
+                break;
+            case FILE_CHUNK:
+                handleChunk(payload, completions);
+                break;
+            case FILE_ACK:
+                handleAck(payload, completions);
+                break;
+            case FILE_CANCEL:
+                handleCancel(payload, completions);
+                break;
+            default:
+                return false;
+        }
+        collectDisk(completions);
+    }
+    notify(completions);
+    return true;
+}
+
+void FileTransfer::disconnect(bool keepOutgoing) {
+    std::vector<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closeAllIncoming();
+        incoming.clear();
+
+        for (auto it = outgoing.begin(); it != outgoing.end();) {
+            if (keepOutgoing) {
+                it->second.accepted = false;
+                ++it;
+            } else {
+                closeOutgoing(it->second);
+                completions.push_back({true, it->first, it->second.path, false});
+                it = outgoing.erase(it);
+            }
+        }
+    }
+    notify(completions);
+}
+
+void FileTransfer::resume() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& pair : outgoing) {
+        // 等接收方按磁盘上的部分文件给出续传位置
+        pair.second.accepted = false;
+        sendOffer(pair.first, pair.second);
+    }
+}
+
+size_t FileTransfer::outgoingCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return outgoing.size();
+}
+
+size_t FileTransfer::incomingCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return incoming.size();
+}
+
+bool FileTransfer::sendOffer(TransferId id, const Outgoing& transfer) {
+    PooledBuffer payload = BufferPool::local().acquire(kOfferHeaderSize + transfer.name.size());
+    if (!payload) {
+        return false;
+    }
+    char header[kOfferHeaderSize];
+    writeUint(header, id, 8);
+    writeUint(header + 8, transfer.size, 8);
+    writeUint(header + 16, kChunkSize, 4);
+    payload.append(header, sizeof(header));
+    payload.append(transfer.name.data(), transfer.name.size());
+    return sender(FILE_OFFER, SendPriority::CONTROL, std::move(payload));
+}
+
+bool FileTransfer::sendAck(TransferId id, uint64_t chunks) {
+    char payload[kIdSize + 8];
+    writeUint(payload, id, 8);
+    writeUint(payload + kIdSize, chunks, 8);
+    return sendControl(FILE_ACK, payload, sizeof(payload));
+}
+
+bool FileTransfer::sendCancel(TransferId id) {
+    char payload[kIdSize];
+    writeUint(payload, id, 8);
+    return sendControl(FILE_CANCEL, payload, sizeof(payload));
+}
+
+bool FileTransfer::sendControl(RecordType type, const char* payload, size_t length) {
+    PooledBuffer buffer = BufferPool::local().copyFrom(payload, length);
+    return buffer && sender(type, SendPriority::CONTROL, std::move(buffer));
+}
+
+void FileTransfer::pump(TransferId id, Outgoing& transfer) {
+    if (!transfer.accepted) {
+        return;
+    }
+
+    const uint64_t windowEnd = std::min(transfer.chunkCount, transfer.acked + kWindowChunks);
+    if (transfer.nextChunk >= windowEnd) {
+        return;
+    }
+
+    // 提前让内核读入窗口内的页，发送时的拷贝尽量不在事件循环上等待磁盘
+    adviseRange(transfer.mapping, transfer.size, transfer.nextChunk * kChunkSize, windowEnd * kChunkSize, MADV_WILLNEED);
+
+    while (transfer.nextChunk < windowEnd) {
+        const uint64_t offset = transfer.nextChunk * kChunkSize;
+        const size_t length = static_cast<size_t>(std::min<uint64_t>(kChunkSize, transfer.size - offset));
+
+        PooledBuffer payload = BufferPool::local().acquire(kChunkHeaderSize + length);
+        if (!payload) {
+            return;
+        }
+        char header[kChunkHeaderSize];
+        writeUint(header, id, 8);
+        writeUint(header + 8, transfer.nextChunk, 8);
+        payload.append(header, sizeof(header));
+        payload.append(transfer.mapping + offset, length);
+
+        if (!sender(FILE_CHUNK, transfer.priority, std::move(payload))) {
+            return;
+        }
+        ++transfer.nextChunk;
+    }
+}
+
+void FileTransfer::handleOffer(std::string_view payload) {
+    const TransferId id = readUint(payload.data(), 8);
+    if (payload.size() < kOfferHeaderSize) {
+        sendCancel(id);
+        return;
+    }
+    const uint64_t size = readUint(payload.data() + 8, 8);
+    const uint32_t chunkSize = static_cast<uint32_t>(readUint(payload.data() + 16, 4));
+    std::string_view name = payload.substr(kOfferHeaderSize);
+
+    if (receiveDirectory.empty()) {
+        CRYPTOLINK_LOG_WARNING("未设置接收目录，拒绝文件传输");
+        sendCancel(id);
+        return;
+    }
+    if (chunkSize == 0 || chunkSize > PriorityLanes::kMaxMessageSize || !isSafeName(name)) {
+        CRYPTOLINK_LOG_WARNING("无效的文件传输请求");
+        sendCancel(id);
+        return;
+    }
+
+    // 同一个传输重新请求时（对端重新连接）以磁盘上的部分文件为准
+    auto existing = incoming.find(id);
+    if (existing != incoming.end()) {
+        closeIncoming(existing->second);
+        incoming.erase(existing);
+    }
+
+    char hex[2 * kIdSize + 1];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(id));
+
+    // 部分文件按对端身份分开存放，不同对端选用同一个传输号也不会写到别人的部分文件上
+    auto writer = std::make_shared<DiskWriter>();
+    writer->partPath = receiveDirectory + "/." + peerTag + hex + ".part";
+    writer->name = std::string(name);
+    writer->finalPath = receiveDirectory + "/" + writer->name;
+    waitRetired(writer->partPath);
+
+    Incoming transfer;
+    transfer.size = size;
+    transfer.chunkSize = chunkSize;
+    transfer.chunkCount = chunkCountFor(size, chunkSize);
+
+    // 不跟随符号链接；加锁后同一对端的两个会话不能同时写同一个部分文件
+    writer->fd = ::open(writer->partPath.c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+    struct stat st;
+    if (writer->fd < 0 || ::flock(writer->fd, LOCK_EX | LOCK_NB) != 0 || ::fstat(writer->fd, &st) != 0 ||
+        !S_ISREG(st.st_mode)) {
+        CRYPTOLINK_LOG_ERROR("创建接收文件失败: " << writer->partPath << ": " << std::strerror(errno));
+        sendCancel(id);
+        return;
+    }
+
+    // 从最后一个完整的块之后续传，不完整的尾部截掉重写
+    uint64_t existingBytes = static_cast<uint64_t>(st.st_size);
+    if (existingBytes > size) {
+        existingBytes = 0;
+    }
+    transfer.nextChunk = existingBytes == size ? transfer.chunkCount : existingBytes / chunkSize;
+    uint64_t keep = std::min(size, transfer.nextChunk * chunkSize);
+    if (keep != static_cast<uint64_t>(st.st_size) && ::ftruncate(writer->fd, static_cast<off_t>(keep)) != 0) {
+        CRYPTOLINK_LOG_ERROR("截断接收文件失败: " << writer->partPath);
+        sendCancel(id);
+        return;
+    }
+    if (transfer.nextChunk > 0) {
+        CRYPTOLINK_LOG_INFO("文件续传: " << name << " 从第 " << transfer.nextChunk << " 块开始");
+    }
+    writer->written = transfer.acked = transfer.nextChunk;
+    transfer.writer = writer;
+
+    // 已经完整的部分文件直接落盘改名，完成后应答全部块数
+    if (transfer.nextChunk == transfer.chunkCount) {
+        writer->finish = true;
+        incoming.emplace(id, std::move(transfer));
+        schedule(writer);
+        return;
+    }
+
+    sendAck(id, transfer.nextChunk);
+    incoming.emplace(id, std::move(transfer));
+}
+
+void FileTransfer::handleChunk(std::string_view payload, std::vector<Completion>& completions) {
+    if (payload.size() < kChunkHeaderSize) {
+        return;
+    }
+    const TransferId id = readUint(payload.data(), 8);
+    const uint64_t index = readUint(payload.data() + 8, 8);
+    std::string_view data = payload.substr(kChunkHeaderSize);
+
+    auto it = incoming.find(id);
+    if (it == incoming.end()) {
+        return;
+    }
+    Incoming& transfer = it->second;
+
+    // 同一连接上的块按顺序到达，序号不符说明是续传前已经发出的块
+    if (index != transfer.nextChunk) {
+        return;
+    }
+
+    // 接收帧缓冲区在回调返回后就会被复用，块数据拷出后交给磁盘线程写入
+    const uint64_t offset = index * transfer.chunkSize;
+    const uint64_t expected = std::min<uint64_t>(transfer.chunkSize, transfer.size - offset);
+    PooledBuffer chunk;
+    if (data.size() == expected) {
+        chunk = BufferPool::local().copyFrom(data.data(), data.size());
+    }
+    if (!chunk) {
+        CRYPTOLINK_LOG_ERROR("写入接收文件失败: " << transfer.writer->partPath);
+        completions.push_back({false, id, transfer.writer->finalPath, false});
+        closeIncoming(transfer);
+        incoming.erase(it);
+        sendCancel(id);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(transfer.writer->mutex);
+        transfer.writer->writes.emplace_back(offset, std::move(chunk));
+        if (++transfer.nextChunk == transfer.chunkCount) {
+            transfer.writer->finish = true;
+        }
+    }
+    schedule(transfer.writer);
+}
+
+void FileTransfer::handleAck(std::string_view payload, std::vector<Completion>& completions) {
+    if (payload.size() < kIdSize + 8) {
+        return;
+    }
+    const TransferId id = readUint(payload.data(), 8);
+    const uint64_t chunks = readUint(payload.data() + kIdSize, 8);
+
+    auto it = outgoing.find(id);
+    if (it == outgoing.end()) {
+        return;
+    }
+    Outgoing& transfer = it->second;
+    if (chunks > transfer.chunkCount) {
+        return;
+    }
+
+    if (!transfer.accepted) {
+        // 对请求的应答给出续传位置
+        transfer.accepted = true;
+        transfer.acked = transfer.nextChunk = chunks;
+    } else if (chunks > transfer.acked && chunks <= transfer.nextChunk) {
+        // 已确认的页不会再读，释放映射占用的内存
+        adviseRange(transfer.mapping, transfer.size, transfer.acked * kChunkSize, chunks * kChunkSize, MADV_DONTNEED);
+        transfer.acked = chunks;
+    } else {
+        return;
+    }
+
+    if (transfer.acked == transfer.chunkCount) {
+        completions.push_back({true, id, transfer.path, true});
+        closeOutgoing(transfer);
+        outgoing.erase(it);
+        return;
+    }
+    pump(id, transfer);
+}
+
+void FileTransfer::handleCancel(std::string_view payload, std::vector<Completion>& completions) {
+    const TransferId id = readUint(payload.data(), 8);
+
+    auto outIt = outgoing.find(id);
+    if (outIt != outgoing.end()) {
+        CRYPTOLINK_LOG_WARNING("对端拒绝或取消了文件传输: " << outIt->second.path);
+        completions.push_back({true, id, outIt->second.path, false});
+        closeOutgoing(outIt->second);
+        outgoing.erase(outIt);
+    }
+    auto inIt = incoming.find(id);
+    if (inIt != incoming.end()) {
+        std::string finalPath;
+        {
+            std::lock_guard<std::mutex> lock(inIt->second.writer->mutex);
+            finalPath = inIt->second.writer->finalPath;
+        }
+        completions.push_back({false, id, finalPath, false});
+        closeIncoming(inIt->second);
+        incoming.erase(inIt);
+    }
+}
+
+void FileTransfer::notify(std::vector<Completion>& completions) {
+    for (const Completion& completion : completions) {
+        const CompletionHandler& handler = completion.outgoing ? sentHandler : receivedHandler;
+        if (handler) {
+            handler(completion.id, completion.path, completion.completed);
+        }
+    }
+}
+
+void FileTransfer::closeOutgoing(Outgoing& transfer) {
+    if (transfer.mapping) {
+        ::munmap(const_cast<char*>(transfer.mapping), transfer.size);
+        transfer.mapping = nullptr;
+    }
+}
+
+void FileTransfer::schedule(const std::shared_ptr<DiskWriter>& writer) {
+    if (!diskWorker) {
+        runWrites(*writer);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(writer->mutex);
+        if (writer->scheduled) {
+            return;
+        }
+        writer->scheduled = true;
+    }
+    diskPool().submit([disk = this->disk, writer]() {
+        runWrites(*writer);
+
+        std::lock_guard<std::mutex> lock(disk->mutex);
+        if (!disk->closed && disk->ready) {
+            disk->ready();
+        }
+    });
+}
+
+void FileTransfer::collectDisk(std::vector<Completion>& completions) {
+    for (auto it = incoming.begin(); it != incoming.end();) {
+        const TransferId id = it->first;
+        Incoming& transfer = it->second;
+
+        uint64_t written;
+        bool finished;
+        bool failed;
+        std::string finalPath;
+        {
+            std::lock_guard<std::mutex> lock(transfer.writer->mutex);
+            written = transfer.writer->written;
+            finished = transfer.writer->finished;
+            failed = transfer.writer->failed;
+            finalPath = transfer.writer->finalPath;
+        }
+
+        if (failed || finished) {
+            if (finished) {
+                sendAck(id, transfer.chunkCount);
+            } else {
+                sendCancel(id);
+            }
+            completions.push_back({false, id, finalPath, finished});
+            closeIncoming(transfer);
+            it = incoming.erase(it);
+            continue;
+        }
+        if (written / kAckInterval > transfer.acked / kAckInterval) {
+            sendAck(id, written);
+            transfer.acked = written;
+        }
+        ++it;
+    }
+}
+
+void FileTransfer::runWrites(DiskWriter& writer) {
+    std::unique_lock<std::mutex> lock(writer.mutex);
+    while (!writer.closed && !writer.failed && !writer.finished) {
+        if (writer.writes.empty()) {
+            if (!writer.finish) {
+                break;
+            }
+            std::string finalPath = writer.finalPath;
+            lock.unlock();
+            const bool finished = finishIncoming(writer, finalPath);
+            lock.lock();
+            writer.finalPath = finalPath;
+            writer.finished = finished;
+            writer.failed = !finished;
+            break;
+        }
+
+        std::pair<uint64_t, PooledBuffer> write = std::move(writer.writes.front());
+        writer.writes.pop_front();
+        lock.unlock();
+        const bool written = writeAll(writer.fd, write.second.data(), write.second.size(), write.first);
+        const int error = errno;
+        write.second.reset();
+        lock.lock();
+
+        if (written) {
+            ++writer.written;
+        } else {
+            CRYPTOLINK_LOG_ERROR("写入接收文件失败: " << writer.partPath << ": " << std::strerror(error));
+            writer.failed = true;
+        }
+    }
+    writer.writes.clear();
+    if (writer.closed && writer.fd >= 0) {
+        ::close(writer.fd);
+        writer.fd = -1;
+    }
+    writer.scheduled = false;
+    writer.idle.notify_all();
+}
+
+void FileTransfer::closeIncoming(Incoming& transfer) {
+    // 丢弃还没写入的块；正在进行的磁盘任务写完手上这一块后看到 closed 就关闭文件
+    DiskWriter& writer = *transfer.writer;
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.closed = true;
+    writer.writes.clear();
+    if (writer.scheduled) {
+        retired[writer.partPath] = transfer.writer;
+    } else if (writer.fd >= 0) {
+        ::close(writer.fd);
+        writer.fd = -1;
+    }
+}
+
+void FileTransfer::waitRetired(const std::string& partPath) {
+    auto it = retired.find(partPath);
+    if (it != retired.end()) {
+        // 最多等一次写块或落盘
+        DiskWriter& writer = *it->second;
+        std::unique_lock<std::mutex> lock(writer.mutex);
+        writer.idle.wait(lock, [&writer]() { return !writer.scheduled; });
+    }
+
+    for (auto retiredIt = retired.begin(); retiredIt != retired.end();) {
+        bool busy;
+        {
+            std::lock_guard<std::mutex> lock(retiredIt->second->mutex);
+            busy = retiredIt->second->scheduled;
+        }
+        retiredIt = busy ? std::next(retiredIt) : retired.erase(retiredIt);
+    }
+}
+
+void FileTransfer::closeAllIncoming() {
+    for (auto& pair : incoming) {
+        closeIncoming(pair.second);
+        if (discardPartial) {
+            ::unlink(pair.second.writer->partPath.c_str());
+        }
+    }
+}
+
+bool FileTransfer::finishIncoming(DiskWriter& writer, std::string& finalPath) {
+    // 先落盘再改名，目标文件出现时内容一定完整
+    if (::fdatasync(writer.fd) != 0) {
+        CRYPTOLINK_LOG_ERROR("接收文件落盘失败: " << writer.partPath << ": " << std::strerror(errno));
+        return false;
+    }
+
+    // 不覆盖接收目录中已有的文件，同名时改用带编号的名字，完成通知里给出实际的路径
+    const std::string directory = finalPath.substr(0, finalPath.size() - writer.name.size());
+    for (unsigned attempt = 0; attempt <= kMaxNameAttempts; ++attempt) {
+        const std::string candidate = candidateName(writer.name, attempt);
+        if (candidate.size() > kMaxNameLength) {
+            break;
+        }
+        if (renameNoReplace(writer.partPath, directory + candidate)) {
+            finalPath = directory + candidate;
+            return true;
+        }
+        if (errno != EEXIST) {
+            break;
+        }
+    }
+    CRYPTOLINK_LOG_ERROR("重命名接收文件失败: " << finalPath << ": " << std::strerror(errno));
+    return false;
+}
@@ -0,0 +1,180 @@
+#include "LatencyProbe.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+void writeInt(char* out, uint64_t value) {
+    for (size_t i = 0; i < 8; ++i) {
+        out[7 - i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t readInt(const char* in) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(in[i]);
+    }
+    return value;
+}
+
+}
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds value) {
+    uint64_t ns = value.count() > 0 ? static_cast<uint64_t>(value.count()) : 0;
+    ++buckets[bucketIndex(ns)];
+    ++total;
+    sum += ns;
+    minimum = std::min(minimum, ns);
+    maximum = std::max(maximum, ns);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        buckets[i] += other.buckets[i];
+    }
+    total += other.total;
+    sum += other.sum;
+    minimum = std::min(minimum, other.minimum);
+    maximum = std::max(maximum, other.maximum);
+}
+
+void LatencyHistogram::reset() {
+    buckets.fill(0);
+    total = 0;
+    sum = 0;
+    minimum = std::numeric_limits<uint64_t>::max();
+    maximum = 0;
+}
+
+std::chrono::nanoseconds LatencyHistogram::min() const {
+    return std::chrono::nanoseconds(total ? minimum : 0);
+}
+
+std::chrono::nanoseconds LatencyHistogram::max() const {
+    return std::chrono::nanoseconds(maximum);
+}
+
+std::chrono::nanoseconds LatencyHistogram::mean() const {
+    return std::chrono::nanoseconds(total ? sum / total : 0);
+}
+
+std::chrono::nanoseconds LatencyHistogram::percentile(double p) const {
+    if (total == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+
+    p = std::min(100.0, std::max(0.0, p));
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100.0 * total + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            // 桶中点可能落在实际观测范围之外
+            uint64_t value = std::min(std::max(bucketMidpoint(i), minimum), maximum);
+            return std::chrono::nanoseconds(value);
+        }
+    }
+    return std::chrono::nanoseconds(maximum);
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t value) {
+    if (value < kSubBuckets) {
+        return static_cast<size_t>(value);
+    }
+
+    // value 位于 [2^k, 2^(k+1))，取最高 5 位中除首位外的 4 位作为子桶
+    int k = 63 - __builtin_clzll(value);
+    size_t magnitude = static_cast<size_t>(k - 3);
+    if (magnitude >= kMagnitudes) {
+        return kBucketCount - 1;
+    }
+    size_t sub = static_cast<size_t>(value >> (k - 4)) - kSubBuckets;
+    return magnitude * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::bucketMidpoint(size_t index) {
+    if (index < kSubBuckets) {
+        return index;
+    }
+
+    int k = static_cast<int>(index / kSubBuckets) + 3;
+    uint64_t width = uint64_t(1) << (k - 4);
+    uint64_t lower = (kSubBuckets + index % kSubBuckets) * width;
+    return lower + width / 2;
+}
+
+LatencyProbe::LatencyProbe() : nextProbeId(1) {
+}
+
+void LatencyProbe::makeProbe(char out[kProbeSize]) {
+    writeInt(out, nextProbeId++);
+    writeInt(out + 8, static_cast<uint64_t>(now()));
+    ++stats.probesSent;
+}
+
+bool LatencyProbe::makeReply(std::string_view probe, int64_t receivedAt, char out[kReplySize]) {
+    if (probe.size() != kProbeSize) {
+        return false;
+    }
+    std::copy(probe.begin(), probe.end(), out);
+    writeInt(out + 16, static_cast<uint64_t>(receivedAt));
+    writeInt(out + 24, static_cast<uint64_t>(now()));
+    return true;
+}
+
+bool LatencyProbe::handleReply(std::string_view reply) {
+    if (reply.size() != kReplySize) {
+        return false;
+    }
+
+    const int64_t t3 = now();
+    uint64_t probeId = readInt(reply.data());
+    int64_t t0 = static_cast<int64_t>(readInt(reply.data() + 8));
+    int64_t t1 = static_cast<int64_t>(readInt(reply.data() + 16));
+    int64_t t2 = static_cast<int64_t>(readInt(reply.data() + 24));
+    if (probeId == 0 || probeId >= nextProbeId) {
+        return false;
+    }
+
+    // 本端时钟在探测期间被调整时结果没有意义，直接丢弃
+    int64_t rtt = (t3 - t0) - (t2 - t1);
+    if (t3 < t0 || t2 < t1 || rtt < 0) {
+        return false;
+    }
+
+    stats.lastRtt = std::chrono::nanoseconds(rtt);
+    stats.clockOffset = std::chrono::nanoseconds(((t1 - t0) + (t2 - t3)) / 2);
+    stats.rtt.record(stats.lastRtt);
+    ++stats.probesAnswered;
+    return true;
+}
+
+void LatencyProbe::writeStamp(char out[kStampSize]) {
+    writeInt(out, static_cast<uint64_t>(now()));
+}
+
+bool LatencyProbe::handleStamped(std::string_view payload, std::string_view& message) {
+    if (payload.size() < kStampSize) {
+        return false;
+    }
+
+    // 把对端时刻换算到本端时钟；还没有完成探测时按两端时钟一致处理
+    int64_t sentAt = static_cast<int64_t>(readInt(payload.data())) - stats.clockOffset.count();
+    std::chrono::nanoseconds delay(std::max<int64_t>(0, now() - sentAt));
+    stats.oneWay.record(delay);
+    stats.queueing.record(std::max(std::chrono::nanoseconds(0), delay - stats.lastRtt / 2));
+
+    message = payload.substr(kStampSize);
+    return true;
+}
+
+int64_t LatencyProbe::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,283 @@
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+std::atomic<uint8_t> Logger::currentLevel{static_cast<uint8_t>(LogLevel::INFO)};
+std::atomic<uint32_t> Logger::rateLimit{20};
+
+namespace {
+
+// 环形缓冲区的槽数，必须是 2 的幂；每槽约 512 字节，共约 2MB
+const size_t kCapacity = 4096;
+
+// 后台线程空闲时最长的休眠时间，漏掉唤醒时日志最多延迟这么久
+const std::chrono::milliseconds kIdleWait(10);
+
+// 有界多生产者单消费者环形缓冲区（Vyukov）的一个槽
+// sequence 等于槽位置时可写，等于位置 + 1 时可读
+struct Slot {
+    std::atomic<size_t> sequence;
+    LogLevel level;
+    uint16_t length;
+    int64_t time;       // 提交时刻，自 1970 年起的微秒数
+    char text[LogLine::kMaxMessageSize];
+};
+
+struct LogState {
+    Slot* slots;
+    alignas(64) std::atomic<size_t> enqueuePosition{0};
+    alignas(64) std::atomic<size_t> dequeuePosition{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> idle{false};
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable drained;
+
+    std::mutex sinkMutex;
+    Logger::Sink sink;
+
+    LogState() : slots(new Slot[kCapacity]) {
+        for (size_t i = 0; i < kCapacity; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(LogLevel level, std::string_view message) {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[position & (kCapacity - 1)];
+            const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        const size_t length = std::min(message.size(), sizeof(slot->text));
+        std::memcpy(slot->text, message.data(), length);
+        slot->length = static_cast<uint16_t>(length);
+        slot->level = level;
+        slot->time = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 只在后台线程调用，写出当前可读的全部日志，返回条数
+    size_t drain(std::string& line) {
+        std::lock_guard<std::mutex> sinkLock(sinkMutex);
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        size_t count = 0;
+        for (;;) {
+            Slot& slot = slots[position & (kCapacity - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+                break;
+            }
+            // 槽位一旦释放就可能被生产者重写，需要的字段都在释放之前取出
+            format(slot, line);
+            const LogLevel level = slot.level;
+            slot.sequence.store(position + kCapacity, std::memory_order_release);
+            ++position;
+            ++count;
+
+            if (sink) {
+                sink(level, line);
+            } else {
+                line.push_back('\n');
+                std::fwrite(line.data(), 1, line.size(), level >= LogLevel::WARNING ? stderr : stdout);
+            }
+        }
+        if (count > 0 && !sink) {
+            std::fflush(stdout);
+            std::fflush(stderr);
+        }
+        dequeuePosition.store(position, std::memory_order_release);
+        return count;
+    }
+
+    // 时间（本地时区，毫秒） [级别] 内容
+    static void format(const Slot& slot, std::string& line) {
+        const time_t seconds = static_cast<time_t>(slot.time / 1000000);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char prefix[64];
+        int length = std::snprintf(prefix, sizeof(prefix), "%04d-%02d-%02d %02d:%02d:%02d.%03d [%s] ",
+                                   local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+                                   local.tm_hour, local.tm_min, local.tm_sec,
+                                   static_cast<int>(slot.time / 1000 % 1000), logLevelName(slot.level));
+        line.assign(prefix, static_cast<size_t>(std::max(length, 0)));
+        line.append(slot.text, slot.length);
+    }
+
+    void run() {
+        std::string line;
+        for (;;) {
+            if (drain(line) > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                drained.notify_all();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.store(true, std::memory_order_release);
+            wake.wait_for(lock, kIdleWait);
+            idle.store(false, std::memory_order_relaxed);
+        }
+    }
+};
+
+// 不在静态析构时销毁：其他静态对象析构时仍可能写日志；后台线程随进程结束
+LogState& state() {
+    static LogState* instance = []() {
+        LogState* created = new LogState();
+        std::thread([created]() {
+            created->run();
+        }).detach();
+        std::atexit([]() {
+            Logger::flush();
+        });
+        return created;
+    }();
+    return *instance;
+}
+
+}
+
+const char* logLevelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::DEBUG: return "DEBUG";
+        case LogLevel::INFO: return "INFO";
+        case LogLevel::WARNING: return "WARNING";
+        case LogLevel::ERROR: return "ERROR";
+        default: return "OFF";
+    }
+}
+
+void Logger::setLevel(LogLevel level) {
+    currentLevel.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+}
+
+LogLevel Logger::getLevel() {
+    return static_cast<LogLevel>(currentLevel.load(std::memory_order_relaxed));
+}
+
+void Logger::setRateLimit(uint32_t perSecond) {
+    rateLimit.store(perSecond, std::memory_order_relaxed);
+}
+
+void Logger::setSink(Sink sink) {
+    LogState& logState = state();
+    std::lock_guard<std::mutex> lock(logState.sinkMutex);
+    logState.sink = std::move(sink);
+}
+
+void Logger::flush() {
+    LogState& logState = state();
+    const size_t target = logState.enqueuePosition.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(logState.mutex);
+    while (logState.dequeuePosition.load(std::memory_order_acquire) < target) {
+        logState.wake.notify_one();
+        logState.drained.wait_for(lock, kIdleWait);
+    }
+}
+
+uint64_t Logger::getDroppedCount() {
+    return state().dropped.load(std::memory_order_relaxed);
+}
+
+void Logger::write(LogLevel level, std::string_view message) {
+    LogState& logState = state();
+    if (!logState.push(level, message)) {
+        logState.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // 后台线程休眠时才需要唤醒，这里不加锁，漏掉的唤醒由休眠超时兜底
+    if (logState.idle.load(std::memory_order_acquire)) {
+        logState.wake.notify_one();
+    }
+}
+
+bool LogSite::admit() {
+    const uint32_t limit = Logger::getRateLimit();
+    if (limit == 0) {
+        return true;
+    }
+
+    // 按秒分窗口计数，多个线程同时进入新窗口时计数可能被多清零一次，只影响限流精度
+    const int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t current = window.load(std::memory_order_relaxed);
+    if (current != second && window.compare_exchange_strong(current, second, std::memory_order_relaxed)) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    if (count.fetch_add(1, std::memory_order_relaxed) < limit) {
+        return true;
+    }
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+LogLine::LogLine(LogLevel level, LogSite& site)
+    : level(level), site(site), buffer(text, text + sizeof(text)), out(&buffer) {
+}
+
+LogLine::~LogLine() {
+    const uint32_t suppressed = site.takeSuppressed();
+    if (suppressed > 0) {
+        out << "（此前抑制 " << suppressed << " 条）";
+    }
+    Logger::write(level, std::string_view(text, buffer.size()));
+}
+
+LogStream::LogStream(LogLevel level) : std::ostream(nullptr), buffer(level) {
+    rdbuf(&buffer);
+}
+
+LogStream::LineBuffer::int_type LogStream::LineBuffer::overflow(int_type ch) {
+    if (traits_type::eq_int_type(ch, traits_type::eof())) {
+        return traits_type::not_eof(ch);
+    }
+    if (traits_type::to_char_type(ch) == '\n') {
+        submit();
+    } else {
+        line.push_back(traits_type::to_char_type(ch));
+    }
+    return ch;
+}
+
+std::streamsize LogStream::LineBuffer::xsputn(const char* data, std::streamsize length) {
+    for (std::streamsize i = 0; i < length; ++i) {
+        overflow(traits_type::to_int_type(data[i]));
+    }
+    return length;
+}
+
+int LogStream::LineBuffer::sync() {
+    submit();
+    return 0;
+}
+
+void LogStream::LineBuffer::submit() {
+    if (line.empty()) {
+        return;
+    }
+    if (Logger::enabled(level) && site.admit()) {
+        LogLine(level, site).stream() << line;
+    }
+    line.clear();
+}
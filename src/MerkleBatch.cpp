@@ -0,0 +1,249 @@
+#include "MerkleBatch.h"
+#include "Logger.h"
+#include <cryptopp/sha.h>
+#include <cstring>
+
+namespace {
+
+const uint8_t kLeafPrefix = 0x00;
+const uint8_t kNodePrefix = 0x01;
+const size_t kFixedHeaderSize = 8 + 4 + 4 + 2;
+
+void writeUint(char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[bytes - 1 - i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t readUint(const char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(in[i]);
+    }
+    return value;
+}
+
+}
+
+namespace MerkleBatch {
+
+Hash hashLeaf(std::string_view message) {
+    Hash hash;
+    CryptoPP::SHA256 sha;
+    sha.Update(&kLeafPrefix, 1);
+    sha.Update(reinterpret_cast<const CryptoPP::byte*>(message.data()), message.size());
+    sha.Final(hash.data());
+    return hash;
+}
+
+Hash hashNode(const Hash& left, const Hash& right) {
+    Hash hash;
+    CryptoPP::SHA256 sha;
+    sha.Update(&kNodePrefix, 1);
+    sha.Update(left.data(), left.size());
+    sha.Update(right.data(), right.size());
+    sha.Final(hash.data());
+    return hash;
+}
+
+bool computeRoot(const Hash& leaf, uint32_t index, uint32_t leafCount,
+                 const std::vector<Hash>& siblings, Hash& root) {
+    if (leafCount == 0 || index >= leafCount) {
+        return false;
+    }
+
+    Hash current = leaf;
+    size_t used = 0;
+    uint32_t width = leafCount;
+    while (width > 1) {
+        if (index % 2 == 1) {
+            if (used == siblings.size()) {
+                return false;
+            }
+            current = hashNode(siblings[used++], current);
+        } else if (index + 1 < width) {
+            if (used == siblings.size()) {
+                return false;
+            }
+            current = hashNode(current, siblings[used++]);
+        }
+        // 奇数层的最后一个节点没有兄弟，直接提升
+        index /= 2;
+        width = (width + 1) / 2;
+    }
+
+    root = current;
+    return used == siblings.size();
+}
+
+std::string rootStatement(uint64_t batchId, uint32_t leafCount, const Hash& root) {
+    std::string statement("CLMB");
+    char header[12];
+    writeUint(header, batchId, 8);
+    writeUint(header + 8, leafCount, 4);
+    statement.append(header, sizeof(header));
+    statement.append(reinterpret_cast<const char*>(root.data()), root.size());
+    return statement;
+}
+
+}
+
+MerkleBatchSigner::MerkleBatchSigner(AsymmetricalEncryptionInterface& key) : key(key), batchId(1) {
+}
+
+size_t MerkleBatchSigner::add(std::string_view message) {
+    leaves.push_back(MerkleBatch::hashLeaf(message));
+    return leaves.size() - 1;
+}
+
+bool MerkleBatchSigner::sign() {
+    if (leaves.empty()) {
+        return false;
+    }
+
+    levels.clear();
+    levels.push_back(leaves);
+    while (levels.back().size() > 1) {
+        const std::vector<MerkleBatch::Hash>& below = levels.back();
+        std::vector<MerkleBatch::Hash> above;
+        above.reserve((below.size() + 1) / 2);
+        for (size_t i = 0; i + 1 < below.size(); i += 2) {
+            above.push_back(MerkleBatch::hashNode(below[i], below[i + 1]));
+        }
+        if (below.size() % 2 == 1) {
+            above.push_back(below.back());
+        }
+        levels.push_back(std::move(above));
+    }
+
+    // 整个批次只做这一次私钥运算
+    rootSignature = key.signWithLocalPrivate(
+        MerkleBatch::rootStatement(batchId, static_cast<uint32_t>(leaves.size()), levels.back().front()));
+    if (rootSignature.empty() || rootSignature.size() > 0xffff) {
+        CRYPTOLINK_LOG_ERROR("Merkle 根签名失败");
+        rootSignature.clear();
+        return false;
+    }
+    return true;
+}
+
+PooledBuffer MerkleBatchSigner::encode(size_t index, std::string_view message, BufferPool& pool) const {
+    if (rootSignature.empty() || index >= leaves.size()) {
+        return PooledBuffer();
+    }
+
+    // 自底向上收集兄弟节点，规则与 computeRoot 一致
+    std::vector<const MerkleBatch::Hash*> siblings;
+    size_t position = index;
+    for (size_t level = 0; level + 1 < levels.size(); ++level) {
+        const std::vector<MerkleBatch::Hash>& nodes = levels[level];
+        if (position % 2 == 1) {
+            siblings.push_back(&nodes[position - 1]);
+        } else if (position + 1 < nodes.size()) {
+            siblings.push_back(&nodes[position + 1]);
+        }
+        position /= 2;
+    }
+
+    size_t length = kFixedHeaderSize + rootSignature.size() + 1 + siblings.size() * 32 + message.size();
+    PooledBuffer payload = pool.acquire(length);
+    if (!payload) {
+        return payload;
+    }
+
+    char header[kFixedHeaderSize];
+    writeUint(header, batchId, 8);
+    writeUint(header + 8, index, 4);
+    writeUint(header + 12, leaves.size(), 4);
+    writeUint(header + 16, rootSignature.size(), 2);
+    payload.append(header, sizeof(header));
+    payload.append(rootSignature.data(), rootSignature.size());
+
+    const char siblingCount = static_cast<char>(siblings.size());
+    payload.append(&siblingCount, 1);
+    for (const MerkleBatch::Hash* sibling : siblings) {
+        payload.append(reinterpret_cast<const char*>(sibling->data()), sibling->size());
+    }
+    payload.append(message.data(), message.size());
+    return payload;
+}
+
+void MerkleBatchSigner::reset() {
+    leaves.clear();
+    levels.clear();
+    rootSignature.clear();
+    ++batchId;
+}
+
+MerkleBatchVerifier::MerkleBatchVerifier(AsymmetricalEncryptionInterface& key, size_t cacheSize)
+    : key(key), cacheSize(cacheSize), signatureVerifications(0) {
+}
+
+bool MerkleBatchVerifier::verify(std::string_view payload, std::string_view& message) {
+    if (payload.size() < kFixedHeaderSize) {
+        return false;
+    }
+
+    const char* in = payload.data();
+    uint64_t batchId = readUint(in, 8);
+    uint32_t index = static_cast<uint32_t>(readUint(in + 8, 4));
+    uint32_t leafCount = static_cast<uint32_t>(readUint(in + 12, 4));
+    size_t signatureLength = readUint(in + 16, 2);
+
+    size_t offset = kFixedHeaderSize;
+    if (payload.size() < offset + signatureLength + 1) {
+        return false;
+    }
+    std::string_view signature = payload.substr(offset, signatureLength);
+    offset += signatureLength;
+
+    size_t siblingCount = static_cast<uint8_t>(payload[offset++]);
+    if (payload.size() < offset + siblingCount * 32) {
+        return false;
+    }
+    std::vector<MerkleBatch::Hash> siblings(siblingCount);
+    for (size_t i = 0; i < siblingCount; ++i) {
+        std::memcpy(siblings[i].data(), in + offset, 32);
+        offset += 32;
+    }
+
+    std::string_view body = payload.substr(offset);
+    MerkleBatch::Hash root;
+    if (!MerkleBatch::computeRoot(MerkleBatch::hashLeaf(body), index, leafCount, siblings, root)) {
+        return false;
+    }
+
+    // 该批次的根已经验证过时只需比较根哈希
+    auto cached = verifiedRoots.find(batchId);
+    if (cached == verifiedRoots.end() || cached->second != root) {
+        ++signatureVerifications;
+        if (!key.verifyWithRemotePublic(MerkleBatch::rootStatement(batchId, leafCount, root), std::string(signature))) {
+            return false;
+        }
+
+        if (cached == verifiedRoots.end()) {
+            verifiedOrder.push_back(batchId);
+            if (verifiedOrder.size() > cacheSize) {
+                verifiedRoots.erase(verifiedOrder.front());
+                verifiedOrder.pop_front();
+            }
+        }
+        verifiedRoots[batchId] = root;
+    }
+
+    message = body;
+    return true;
+}
+
+bool MerkleBatchVerifier::verifyBatch(const std::vector<std::string_view>& payloads, std::vector<std::string_view>& messages) {
+    bool allValid = true;
+    messages.assign(payloads.size(), std::string_view());
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        if (!verify(payloads[i], messages[i])) {
+            messages[i] = std::string_view();
+            allValid = false;
+        }
+    }
+    return allValid;
+}
@@ -0,0 +1,62 @@
+#include "MessageInbox.h"
+
+#ifdef CRYPTOLINK_HAVE_COROUTINES
+
+bool MessageInbox::ReceiveAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> lock(inbox.mutex);
+    if (!inbox.queued.empty()) {
+        inbox.current = std::move(inbox.queued.front());
+        inbox.queued.pop_front();
+        result = std::string_view(inbox.current);
+        return false;
+    }
+    if (inbox.closed) {
+        result.reset();
+        return false;
+    }
+    this->handle = handle;
+    inbox.waiters.push_back(this);
+    return true;
+}
+
+void MessageInbox::deliver(std::string_view message) {
+    ReceiveAwaiter* waiter = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (waiters.empty()) {
+            queued.emplace_back(message);
+            return;
+        }
+        waiter = waiters.front();
+        waiters.pop_front();
+    }
+    // 解锁后再恢复，协程可能立即再次接收
+    waiter->result = message;
+    waiter->handle.resume();
+}
+
+void MessageInbox::close() {
+    std::deque<ReceiveAwaiter*> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        pending.swap(waiters);
+    }
+    for (ReceiveAwaiter* waiter : pending) {
+        waiter->result.reset();
+        waiter->handle.resume();
+    }
+}
+
+void MessageInbox::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    queued.clear();
+    closed = false;
+}
+
+bool MessageInbox::isClosed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return closed;
+}
+
+#endif // CRYPTOLINK_HAVE_COROUTINES
@@ -0,0 +1,550 @@
+#include "PeerRelay.h"
+#include "Logger.h"
+#include <cryptopp/base64.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+#include <cryptopp/xed25519.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace CryptoPP;
+
+namespace {
+
+// 等待查询结果时每个对端最多排队的字节数（发出和收到各自计算）
+const size_t kMaxPendingBytes = 4 * 1024 * 1024;
+
+// 每个对端最多保留几个纪元的接收状态
+const size_t kMaxEpochs = 4;
+
+const size_t kKeySize = 32;
+const size_t kSaltSize = 4;
+const size_t kNonceSize = 12;
+
+// 派生密钥的信息前缀，和双方名字、公钥一起区分两个方向
+const char kKeyInfo[] = "CryptoLink relay v1";
+
+void writeUint(char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[bytes - 1 - i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t readUint(const char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(in[i]);
+    }
+    return value;
+}
+
+void makeNonce(byte* nonce, const SecByteBlock& salt, uint64_t sequence) {
+    std::memcpy(nonce, salt.data(), kSaltSize);
+    writeUint(reinterpret_cast<char*>(nonce) + kSaltSize, sequence, 8);
+}
+
+bool validName(std::string_view name) {
+    return !name.empty() && name.size() <= PeerRelay::kMaxNameLength;
+}
+
+PooledBuffer copyPayload(std::string_view payload) {
+    PooledBuffer buffer = BufferPool::local().acquire(payload.size());
+    if (buffer) {
+        buffer.append(payload.data(), payload.size());
+    }
+    return buffer;
+}
+
+}
+
+PeerRelay::PeerRelay(RecordSender sender)
+    : sender(std::move(sender)), epoch(0), sendSequence(0), online(false) {
+}
+
+PeerRelay::~PeerRelay() = default;
+
+bool PeerRelay::enable(const std::string& name) {
+    if (!validName(name)) {
+        CRYPTOLINK_LOG_ERROR("中继名字长度必须在 1 到 " << kMaxNameLength << " 字节之间");
+        return false;
+    }
+
+    try {
+        AutoSeededRandomPool rng;
+        if (privateKey.size() == 0) {
+            x25519 agreement;
+            SecByteBlock generatedPublic(x25519::PUBLIC_KEYLENGTH);
+            privateKey.New(x25519::SECRET_KEYLENGTH);
+            agreement.GenerateKeyPair(rng, privateKey, generatedPublic);
+            localPublicKey.assign(reinterpret_cast<const char*>(generatedPublic.data()), generatedPublic.size());
+        }
+
+        // 纪元取当前时刻（微秒），同一进程内严格递增，接收端据此拒绝比已收到的更早的纪元；
+        // 新纪元下各方向的密钥都重新派生，序号不回退
+        const auto now = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        epoch = std::max(epoch + 1, static_cast<uint64_t>(now));
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("生成中继密钥失败: " << e.what());
+        return false;
+    }
+
+    localName = name;
+    for (auto& entry : peers) {
+        entry.second.encryption.reset();
+    }
+    return true;
+}
+
+std::string PeerRelay::publicKey() const {
+    std::string encoded;
+    StringSource ss(reinterpret_cast<const byte*>(localPublicKey.data()), localPublicKey.size(), true,
+        new Base64Encoder(
+            new StringSink(encoded),
+            false
+        )
+    );
+    return encoded;
+}
+
+bool PeerRelay::setPeerKey(const std::string& peer, const std::string& publicKey) {
+    std::string decoded;
+    try {
+        StringSource ss(publicKey, true,
+            new Base64Decoder(
+                new StringSink(decoded)
+            )
+        );
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("对端公钥解码失败: " << e.what());
+        return false;
+    }
+    if (!validName(peer) || decoded.size() != kPublicKeySize) {
+        CRYPTOLINK_LOG_ERROR("对端名字或公钥无效: " << peer);
+        return false;
+    }
+
+    Peer& entry = peers[peer];
+    entry.pinned = false;
+    updateKey(peer, entry, decoded);
+    entry.pinned = true;
+    return true;
+}
+
+void PeerRelay::connected() {
+    online = true;
+    if (!enabled()) {
+        return;
+    }
+
+    PooledBuffer record = BufferPool::local().acquire(1 + localName.size() + kPublicKeySize);
+    if (!record) {
+        return;
+    }
+    const char nameLength = static_cast<char>(localName.size());
+    record.append(&nameLength, 1);
+    record.append(localName.data(), localName.size());
+    record.append(localPublicKey.data(), localPublicKey.size());
+    sender(RELAY_REGISTER, SendPriority::CONTROL, std::move(record));
+}
+
+void PeerRelay::disconnect() {
+    online = false;
+    for (auto& entry : peers) {
+        Peer& peer = entry.second;
+        peer.lookupPending = false;
+        fail(entry.first, peer);
+    }
+}
+
+bool PeerRelay::send(std::string_view peer, std::string_view message) {
+    if (!enabled() || !online) {
+        CRYPTOLINK_LOG_WARNING("中继未启用或未连接");
+        return false;
+    }
+    if (!validName(peer) || message.size() > kMaxMessageSize) {
+        CRYPTOLINK_LOG_WARNING("中继对端名字无效或消息过大");
+        return false;
+    }
+
+    const std::string name(peer);
+    Peer& entry = peers[name];
+    if (entry.publicKey.empty()) {
+        if (entry.outgoingBytes + message.size() > kMaxPendingBytes) {
+            CRYPTOLINK_LOG_WARNING("等待查询中继对端的消息过多: " << name);
+            if (failureHandler) {
+                failureHandler(name);
+            }
+            return false;
+        }
+        entry.outgoing.emplace_back(message);
+        entry.outgoingBytes += message.size();
+        lookup(name, entry);
+        return true;
+    }
+    return seal(name, entry, message);
+}
+
+void PeerRelay::handleRecord(uint8_t type, std::string_view payload) {
+    if (type != RELAY_PEER || payload.size() < 2) {
+        return;
+    }
+
+    const PeerStatus status = static_cast<PeerStatus>(static_cast<uint8_t>(payload[0]));
+    const size_t nameLength = static_cast<uint8_t>(payload[1]);
+    if (payload.size() < 2 + nameLength) {
+        return;
+    }
+    const std::string name(payload.substr(2, nameLength));
+    std::string_view key = payload.substr(2 + nameLength);
+
+    switch (status) {
+        case PeerStatus::REGISTERED:
+            CRYPTOLINK_LOG_INFO("中继名字已登记: " << name);
+            return;
+        case PeerStatus::NAME_IN_USE:
+            CRYPTOLINK_LOG_ERROR("中继名字已被其他连接登记: " << name);
+            return;
+        default:
+            break;
+    }
+
+    auto it = peers.find(name);
+    if (it == peers.end()) {
+        return;
+    }
+    Peer& peer = it->second;
+
+    switch (status) {
+        case PeerStatus::FOUND:
+            peer.lookupPending = false;
+            if (key.size() == kPublicKeySize) {
+                updateKey(name, peer, key);
+            }
+            if (!peer.publicKey.empty() && peer.publicKey == key) {
+                flush(name, peer);
+            } else {
+                fail(name, peer);
+            }
+            break;
+        case PeerStatus::KEY_CHANGED:
+            // 用旧公钥加密的消息已被服务端丢弃，之后的消息使用新公钥
+            if (key.size() == kPublicKeySize) {
+                updateKey(name, peer, key);
+            }
+            if (failureHandler) {
+                failureHandler(name);
+            }
+            break;
+        case PeerStatus::NOT_FOUND: {
+            // 没有在途查询时是服务端退回的消息：对端已断开
+            const bool bounced = !peer.lookupPending;
+            peer.lookupPending = false;
+            fail(name, peer);
+            if (bounced && failureHandler) {
+                failureHandler(name);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void PeerRelay::handleFrame(std::string& frame) {
+    std::string_view name;
+    std::string_view sealed;
+    if (!enabled() || !decodeFrame(frame, name, sealed) || sealed.size() < kSealedHeaderSize + kTagSize) {
+        return;
+    }
+    if (keyId(sealed) != std::string_view(localPublicKey).substr(0, kKeyIdSize)) {
+        CRYPTOLINK_LOG_WARNING("中继消息不是用本端当前公钥加密的");
+        return;
+    }
+
+    const std::string peerName(name);
+    Peer& peer = peers[peerName];
+
+    // 对端重启后纪元变化，公钥也可能已经更换：未固定公钥时，第一次收到某个纪元的记录先向服务端确认公钥，
+    // 确认之前收到的记录按顺序排队，之后一起解密
+    const uint64_t frameEpoch = readUint(sealed.data() + kKeyIdSize, 8);
+    bool known = peer.pinned;
+    for (const ReceiveEpoch& state : peer.epochs) {
+        known = known || state.epoch == frameEpoch;
+    }
+    if (!known || !peer.incoming.empty()) {
+        if (peer.incomingBytes + frame.size() <= kMaxPendingBytes) {
+            peer.incoming.push_back(frame);
+            peer.incomingBytes += frame.size();
+        } else {
+            CRYPTOLINK_LOG_WARNING("等待查询中继对端时收到的消息过多，丢弃: " << peerName);
+        }
+        lookup(peerName, peer);
+        return;
+    }
+    open(peerName, peer, frame, frame.size() - sealed.size());
+}
+
+bool PeerRelay::decodeRegister(std::string_view payload, std::string_view& name, std::string_view& publicKey) {
+    if (payload.empty()) {
+        return false;
+    }
+    const size_t nameLength = static_cast<uint8_t>(payload[0]);
+    if (nameLength == 0 || nameLength > kMaxNameLength || payload.size() != 1 + nameLength + kPublicKeySize) {
+        return false;
+    }
+    name = payload.substr(1, nameLength);
+    publicKey = payload.substr(1 + nameLength);
+    return true;
+}
+
+PooledBuffer PeerRelay::encodePeer(PeerStatus status, std::string_view name, std::string_view publicKey) {
+    PooledBuffer record = BufferPool::local().acquire(2 + name.size() + publicKey.size());
+    if (!record) {
+        return record;
+    }
+    const char header[2] = {static_cast<char>(status), static_cast<char>(name.size())};
+    record.append(header, sizeof(header));
+    record.append(name.data(), name.size());
+    record.append(publicKey.data(), publicKey.size());
+    return record;
+}
+
+bool PeerRelay::decodeFrame(std::string_view frame, std::string_view& name, std::string_view& sealed) {
+    if (frame.size() < 2 || static_cast<uint8_t>(frame[0]) != RELAY_DATA) {
+        return false;
+    }
+    const size_t nameLength = static_cast<uint8_t>(frame[1]);
+    if (nameLength == 0 || nameLength > kMaxNameLength || frame.size() < 2 + nameLength) {
+        return false;
+    }
+    name = frame.substr(2, nameLength);
+    sealed = frame.substr(2 + nameLength);
+    return true;
+}
+
+PooledBuffer PeerRelay::encodeFrame(std::string_view name, std::string_view sealed) {
+    PooledBuffer frame = BufferPool::local().acquire(2 + name.size() + sealed.size());
+    if (!frame) {
+        return frame;
+    }
+    const char header[2] = {static_cast<char>(RELAY_DATA), static_cast<char>(name.size())};
+    frame.append(header, sizeof(header));
+    frame.append(name.data(), name.size());
+    frame.append(sealed.data(), sealed.size());
+    return frame;
+}
+
+void PeerRelay::lookup(const std::string& name, Peer& peer) {
+    if (peer.lookupPending) {
+        return;
+    }
+    PooledBuffer record = copyPayload(name);
+    if (record && sender(RELAY_LOOKUP, SendPriority::CONTROL, std::move(record))) {
+        peer.lookupPending = true;
+    }
+}
+
+void PeerRelay::updateKey(const std::string& name, Peer& peer, std::string_view publicKey) {
+    if (peer.publicKey == publicKey) {
+        return;
+    }
+    if (peer.pinned) {
+        CRYPTOLINK_LOG_ERROR("服务端给出的中继公钥与固定的公钥不一致: " << name);
+        return;
+    }
+
+    // 公钥变化后旧的密钥和接收状态都作废
+    peer.publicKey.assign(publicKey.data(), publicKey.size());
+    peer.encryption.reset();
+    peer.epochs.clear();
+}
+
+void PeerRelay::fail(const std::string& name, Peer& peer) {
+    const bool lost = !peer.outgoing.empty();
+    peer.outgoing.clear();
+    peer.incoming.clear();
+    peer.outgoingBytes = 0;
+    peer.incomingBytes = 0;
+    if (lost && failureHandler) {
+        failureHandler(name);
+    }
+}
+
+void PeerRelay::flush(const std::string& name, Peer& peer) {
+    std::vector<std::string> outgoing;
+    std::vector<std::string> incoming;
+    outgoing.swap(peer.outgoing);
+    incoming.swap(peer.incoming);
+    peer.outgoingBytes = 0;
+    peer.incomingBytes = 0;
+
+    for (const std::string& message : outgoing) {
+        seal(name, peer, message);
+    }
+    for (std::string& frame : incoming) {
+        std::string_view routedName;
+        std::string_view sealed;
+        if (decodeFrame(frame, routedName, sealed)) {
+            open(name, peer, frame, frame.size() - sealed.size());
+        }
+    }
+}
+
+bool PeerRelay::seal(const std::string& name, Peer& peer, std::string_view message) {
+    try {
+        if (!peer.encryption) {
+            SecByteBlock key;
+            SecByteBlock salt;
+            if (!deriveKey(name, peer, true, epoch, key, salt)) {
+                return false;
+            }
+            byte nonce[kNonceSize] = {0};
+            peer.encryption = std::make_unique<Encryption>();
+            peer.encryption->SetKeyWithIV(key, key.size(), nonce, kNonceSize);
+            peer.sendSalt = salt;
+        }
+
+        const size_t sealedOffset = 2 + name.size();
+        const size_t length = sealedOffset + kSealedHeaderSize + message.size() + kTagSize;
+        PooledBuffer frame = BufferPool::local().acquire(length);
+        if (!frame) {
+            return false;
+        }
+        frame.resize(length);
+
+        char* out = frame.data();
+        out[0] = static_cast<char>(RELAY_DATA);
+        out[1] = static_cast<char>(name.size());
+        std::memcpy(out + 2, name.data(), name.size());
+
+        const uint64_t sequence = ++sendSequence;
+        char* sealed = out + sealedOffset;
+        std::memcpy(sealed, peer.publicKey.data(), kKeyIdSize);
+        writeUint(sealed + kKeyIdSize, epoch, 8);
+        writeUint(sealed + kKeyIdSize + 8, sequence, 8);
+
+        byte nonce[kNonceSize];
+        makeNonce(nonce, peer.sendSalt, sequence);
+
+        byte* cipher = reinterpret_cast<byte*>(sealed) + kSealedHeaderSize;
+        peer.encryption->EncryptAndAuthenticate(cipher, cipher + message.size(), kTagSize,
+                                                nonce, kNonceSize,
+                                                reinterpret_cast<const byte*>(sealed), kSealedHeaderSize,
+                                                reinterpret_cast<const byte*>(message.data()), message.size());
+        return sender(RELAY_DATA, SendPriority::NORMAL, std::move(frame));
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("中继加密失败: " << e.what());
+        return false;
+    }
+}
+
+bool PeerRelay::open(const std::string& name, Peer& peer, std::string& frame, size_t sealedOffset) {
+    char* sealed = &frame[sealedOffset];
+    const size_t cipherLength = frame.size() - sealedOffset - kSealedHeaderSize - kTagSize;
+    const uint64_t frameEpoch = readUint(sealed + kKeyIdSize, 8);
+    const uint64_t sequence = readUint(sealed + kKeyIdSize + 8, 8);
+
+    try {
+        // 新纪元的接收状态在第一条记录校验通过后才保留，伪造的纪元挤不掉已有的状态
+        ReceiveEpoch fresh;
+        ReceiveEpoch* state = nullptr;
+        for (ReceiveEpoch& known : peer.epochs) {
+            if (known.epoch == frameEpoch) {
+                state = &known;
+                break;
+            }
+        }
+        if (!state) {
+            // 对端的纪元只增不减：比已收到的最新纪元更早、又不在保留的状态里的记录，
+            // 是被挤出的旧纪元或伪造的纪元，重放它们会绕过序号检查
+            if (frameEpoch < peer.newestEpoch) {
+                CRYPTOLINK_LOG_WARNING("中继解密失败: 纪元早于已收到的最新纪元");
+                return false;
+            }
+            SecByteBlock key;
+            if (!deriveKey(name, peer, false, frameEpoch, key, fresh.salt)) {
+                return false;
+            }
+            byte nonce[kNonceSize] = {0};
+            fresh.epoch = frameEpoch;
+            fresh.decryption = std::make_unique<Decryption>();
+            fresh.decryption->SetKeyWithIV(key, key.size(), nonce, kNonceSize);
+            state = &fresh;
+        }
+
+        if (sequence <= state->lastSequence) {
+            CRYPTOLINK_LOG_WARNING("中继解密失败: 记录序号重复或倒退");
+            return false;
+        }
+
+        byte nonce[kNonceSize];
+        makeNonce(nonce, state->salt, sequence);
+
+        byte* cipher = reinterpret_cast<byte*>(sealed) + kSealedHeaderSize;
+        if (!state->decryption->DecryptAndVerify(cipher, cipher + cipherLength, kTagSize,
+                                                 nonce, kNonceSize,
+                                                 reinterpret_cast<const byte*>(sealed), kSealedHeaderSize,
+                                                 cipher, cipherLength)) {
+            CRYPTOLINK_LOG_WARNING("中继解密失败: 认证标签校验失败");
+            return false;
+        }
+        state->lastSequence = sequence;
+
+        if (state == &fresh) {
+            peer.newestEpoch = frameEpoch;
+            peer.epochs.push_front(std::move(fresh));
+            if (peer.epochs.size() > kMaxEpochs) {
+                peer.epochs.pop_back();
+            }
+        }
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_WARNING("中继解密失败: " << e.what());
+        return false;
+    }
+
+    if (messageHandler) {
+        messageHandler(name, std::string_view(reinterpret_cast<const char*>(sealed) + kSealedHeaderSize, cipherLength));
+    }
+    return true;
+}
+
+bool PeerRelay::deriveKey(const std::string& name, const Peer& peer, bool outgoing, uint64_t keyEpoch,
+                          SecByteBlock& key, SecByteBlock& salt) const {
+    SecByteBlock shared(x25519::SHARED_KEYLENGTH);
+    x25519 agreement;
+    if (!agreement.Agree(shared, privateKey, reinterpret_cast<const byte*>(peer.publicKey.data()))) {
+        CRYPTOLINK_LOG_WARNING("中继对端公钥无效: " << name);
+        return false;
+    }
+
+    // 信息包含发送方和接收方的名字与公钥，两个方向、改写过的路由名字都得到不同的密钥
+    const std::string& senderName = outgoing ? localName : name;
+    const std::string& recipientName = outgoing ? name : localName;
+    const std::string& senderKey = outgoing ? localPublicKey : peer.publicKey;
+    const std::string& recipientKey = outgoing ? peer.publicKey : localPublicKey;
+    std::string info(kKeyInfo);
+    info.push_back('\0');
+    info += senderName;
+    info.push_back('\0');
+    info += recipientName;
+    info += senderKey;
+    info += recipientKey;
+
+    char epochBytes[8];
+    writeUint(epochBytes, keyEpoch, 8);
+
+    SecByteBlock derived(kKeySize + kSaltSize);
+    HKDF<SHA256> hkdf;
+    hkdf.DeriveKey(derived, derived.size(),
+                   shared, shared.size(),
+                   reinterpret_cast<const byte*>(epochBytes), sizeof(epochBytes),
+                   reinterpret_cast<const byte*>(info.data()), info.size());
+    key.Assign(derived, kKeySize);
+    salt.Assign(derived + kKeySize, kSaltSize);
+    return true;
+}
@@ -0,0 +1,202 @@
+#include "PriorityLanes.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+
+constexpr PriorityLanes::Weights PriorityLanes::kDefaultWeights;
+
+PriorityLanes::PriorityLanes(RecordSender sender, const Weights& weights)
+    : sender(std::move(sender)),
+      current(0),
+      quantumGranted(false),
+      queuedRecords(0),
+      nextMessageId(1) {
+    setWeights(weights);
+}
+
+void PriorityLanes::setWeights(const Weights& weights) {
+    for (size_t i = 0; i < kLaneCount; ++i) {
+        lanes[i].weight = weights[i];
+    }
+}
+
+void PriorityLanes::enqueue(SendPriority priority, std::string_view header, PooledBuffer payload) {
+    if (header.empty() || header.size() > kHeaderSize) {
+        return;
+    }
+
+    // 没有显式标记的大消息不占用默认通道，避免阻塞其后的普通消息
+    if (priority == SendPriority::NORMAL && payload.size() > kBulkThreshold) {
+        priority = SendPriority::BULK;
+    }
+    Lane& lane = lanes[static_cast<size_t>(priority)];
+
+    PendingRecord record;
+    std::memcpy(record.header, header.data(), header.size());
+    record.headerLength = static_cast<uint8_t>(header.size());
+    record.offset = 0;
+    record.messageId = 0;
+
+    // 只有单字节记录头的记录需要分片，通道记录已经由 ChannelMux 按 kMaxFragment 切好
+    if (header.size() == 1 && payload.size() > kFragmentSize) {
+        record.messageId = nextMessageId++;
+        if (nextMessageId == 0) {
+            nextMessageId = 1;
+        }
+    }
+
+    lane.bytes += payload.size();
+    record.payload = std::move(payload);
+    lane.records.push_back(std::move(record));
+    ++queuedRecords;
+}
+
+bool PriorityLanes::pump(size_t budget) {
+    size_t sent = 0;
+    while (queuedRecords > 0 && (sent < budget || sent == 0)) {
+        // 严格优先的通道每发一个单元都重新检查
+        Lane* strict = nullptr;
+        for (Lane& lane : lanes) {
+            if (lane.weight == 0 && !lane.records.empty()) {
+                strict = &lane;
+                break;
+            }
+        }
+        if (strict) {
+            sent += sendNext(*strict);
+            continue;
+        }
+
+        Lane& lane = lanes[current];
+        if (lane.weight == 0 || lane.records.empty()) {
+            lane.deficit = 0;
+            advance();
+            continue;
+        }
+
+        if (!quantumGranted) {
+            lane.deficit += static_cast<size_t>(lane.weight) * kFragmentSize;
+            quantumGranted = true;
+        }
+
+        // 额度不够发下一个单元时留到下一轮，剩余额度保留
+        size_t unit = nextUnitSize(lane.records.front());
+        if (unit > lane.deficit) {
+            advance();
+            continue;
+        }
+        lane.deficit -= unit;
+        sent += sendNext(lane);
+    }
+    return queuedRecords > 0;
+}
+
+size_t PriorityLanes::pendingBytes(SendPriority priority) const {
+    return lanes[static_cast<size_t>(priority)].bytes;
+}
+
+bool PriorityLanes::reassemble(std::string_view header, std::string_view payload, uint8_t& type, std::string_view& message) {
+    if (header.size() < kHeaderSize) {
+        return false;
+    }
+
+    const uint8_t flags = static_cast<uint8_t>(header[1]);
+    uint32_t messageId = 0;
+    for (size_t i = 2; i < 6; ++i) {
+        messageId = (messageId << 8) | static_cast<uint8_t>(header[i]);
+    }
+    const uint8_t innerType = static_cast<uint8_t>(header[6]);
+    if (isFragmentRecord(innerType)) {
+        return false;
+    }
+
+    auto it = reassembly.find(messageId);
+    if (it == reassembly.end()) {
+        if (reassembly.size() >= kLaneCount) {
+            CRYPTOLINK_LOG_WARNING("未完成的分片消息过多");
+            return false;
+        }
+        it = reassembly.emplace(messageId, Reassembly()).first;
+        it->second.type = innerType;
+    } else if (it->second.type != innerType) {
+        reassembly.erase(it);
+        return false;
+    }
+
+    if (it->second.data.size() + payload.size() > kMaxMessageSize) {
+        CRYPTOLINK_LOG_WARNING("分片消息超过长度上限");
+        reassembly.erase(it);
+        return false;
+    }
+    it->second.data.append(payload.data(), payload.size());
+
+    if (!(flags & kFinalFragment)) {
+        return false;
+    }
+
+    type = it->second.type;
+    completed = std::move(it->second.data);
+    reassembly.erase(it);
+    message = completed;
+    return true;
+}
+
+void PriorityLanes::reset() {
+    for (Lane& lane : lanes) {
+        lane.records.clear();
+        lane.bytes = 0;
+        lane.deficit = 0;
+    }
+    current = 0;
+    quantumGranted = false;
+    queuedRecords = 0;
+    reassembly.clear();
+    completed.clear();
+}
+
+size_t PriorityLanes::sendNext(Lane& lane) {
+    PendingRecord& record = lane.records.front();
+    std::string_view payload = record.payload.view();
+
+    size_t length = payload.size();
+    size_t headerLength = record.headerLength;
+    bool finished = true;
+
+    if (record.messageId == 0) {
+        sender(std::string_view(record.header, record.headerLength), payload);
+    } else {
+        length = std::min(kFragmentSize, payload.size() - record.offset);
+        finished = record.offset + length == payload.size();
+
+        char header[kHeaderSize];
+        header[0] = static_cast<char>(kFragmentRecord);
+        header[1] = static_cast<char>(finished ? kFinalFragment : 0);
+        for (size_t i = 0; i < 4; ++i) {
+            header[5 - i] = static_cast<char>((record.messageId >> (8 * i)) & 0xff);
+        }
+        header[6] = record.header[0];
+        headerLength = kHeaderSize;
+
+        sender(std::string_view(header, kHeaderSize), payload.substr(record.offset, length));
+        record.offset += length;
+    }
+
+    lane.bytes -= length;
+    if (finished) {
+        lane.records.pop_front();
+        --queuedRecords;
+    }
+    return headerLength + length;
+}
+
+size_t PriorityLanes::nextUnitSize(const PendingRecord& record) {
+    if (record.messageId == 0) {
+        return record.headerLength + record.payload.size();
+    }
+    return kHeaderSize + std::min(kFragmentSize, record.payload.size() - record.offset);
+}
+
+void PriorityLanes::advance() {
+    current = (current + 1) % kLaneCount;
+    quantumGranted = false;
+}
@@ -0,0 +1,152 @@
+#include "PskHandshake.h"
+#include "Logger.h"
+#include <cryptopp/base64.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+#include <algorithm>
+#include <iterator>
+
+using namespace CryptoPP;
+
+namespace {
+
+std::string base64Encode(const std::string& data) {
+    std::string encoded;
+    StringSource ss(data, true,
+        new Base64Encoder(
+            new StringSink(encoded), false
+        )
+    );
+    return encoded;
+}
+
+std::string base64Decode(const std::string& data) {
+    std::string decoded;
+    StringSource ss(data, true,
+        new Base64Decoder(
+            new StringSink(decoded)
+        )
+    );
+    return decoded;
+}
+
+// 按冒号拆分字段，字段数必须正好是 count
+bool splitFields(const std::string& data, size_t count, std::vector<std::string>& fields) {
+    fields.clear();
+    size_t start = 0;
+    while (fields.size() + 1 < count) {
+        size_t colon = data.find(':', start);
+        if (colon == std::string::npos) {
+            return false;
+        }
+        fields.push_back(data.substr(start, colon - start));
+        start = colon + 1;
+    }
+    if (data.find(':', start) != std::string::npos) {
+        return false;
+    }
+    fields.push_back(data.substr(start));
+    return true;
+}
+
+}
+
+std::string PskHandshake::makeNonce() {
+    AutoSeededRandomPool rng;
+    std::string nonce(kNonceSize, '\0');
+    rng.GenerateBlock(reinterpret_cast<byte*>(&nonce[0]), nonce.size());
+    return nonce;
+}
+
+bool PskHandshake::derive(const std::string& key, const std::string& identity, const std::string& offer,
+                          CipherSuite suite, const std::string& clientNonce, const std::string& serverNonce,
+                          Derived& derived) {
+    if (key.size() < kMinKeySize || clientNonce.size() != kNonceSize || serverNonce.size() != kNonceSize) {
+        return false;
+    }
+
+    const std::string salt = clientNonce + serverNonce;
+    const std::string info = std::string("CryptoLink PSK|") + identity + "|" + offer + "|" + cipherSuiteName(suite);
+
+    try {
+        SecByteBlock output(kSecretSize + 2 * kConfirmSize);
+        HKDF<SHA256> hkdf;
+        hkdf.DeriveKey(output, output.size(),
+                       reinterpret_cast<const byte*>(key.data()), key.size(),
+                       reinterpret_cast<const byte*>(salt.data()), salt.size(),
+                       reinterpret_cast<const byte*>(info.data()), info.size());
+
+        const char* bytes = reinterpret_cast<const char*>(output.data());
+        derived.secret.Assign(output, kSecretSize);
+        derived.clientConfirm.assign(bytes + kSecretSize, kConfirmSize);
+        derived.serverConfirm.assign(bytes + kSecretSize + kConfirmSize, kConfirmSize);
+        return true;
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("PSK 密钥派生失败: " << e.what());
+        return false;
+    }
+}
+
+bool PskHandshake::confirmEquals(const std::string& received, const std::string& expected) {
+    if (received.size() != expected.size()) {
+        return false;
+    }
+    unsigned char difference = 0;
+    for (size_t i = 0; i < received.size(); ++i) {
+        difference |= static_cast<unsigned char>(received[i] ^ expected[i]);
+    }
+    return difference == 0;
+}
+
+std::vector<CipherSuite> PskHandshake::aeadSuites(const std::vector<CipherSuite>& suites) {
+    std::vector<CipherSuite> result;
+    std::copy_if(suites.begin(), suites.end(), std::back_inserter(result), [](CipherSuite suite) {
+        return suite == CipherSuite::AES_256_GCM || suite == CipherSuite::CHACHA20_POLY1305;
+    });
+    return result;
+}
+
+std::string PskHandshake::encodeHello(const std::string& identity, const std::string& nonce, const std::string& offer) {
+    return base64Encode(identity) + ":" + base64Encode(nonce) + ":" + offer;
+}
+
+bool PskHandshake::parseHello(const std::string& data, std::string& identity, std::string& nonce, std::string& offer) {
+    std::vector<std::string> fields;
+    if (!splitFields(data, 3, fields)) {
+        return false;
+    }
+    identity = base64Decode(fields[0]);
+    nonce = base64Decode(fields[1]);
+    offer = fields[2];
+    return !identity.empty() && nonce.size() == kNonceSize && !offer.empty();
+}
+
+std::string PskHandshake::encodeAccept(const std::string& nonce, CipherSuite suite, const std::string& confirm) {
+    return base64Encode(nonce) + ":" + cipherSuitesToString({suite}) + ":" + base64Encode(confirm);
+}
+
+bool PskHandshake::parseAccept(const std::string& data, std::string& nonce, CipherSuite& suite, std::string& confirm) {
+    std::vector<std::string> fields;
+    if (!splitFields(data, 3, fields)) {
+        return false;
+    }
+    std::vector<CipherSuite> suites = parseCipherSuites(fields[1]);
+    if (suites.size() != 1) {
+        return false;
+    }
+    nonce = base64Decode(fields[0]);
+    suite = suites.front();
+    confirm = base64Decode(fields[2]);
+    return nonce.size() == kNonceSize && confirm.size() == kConfirmSize;
+}
+
+std::string PskHandshake::encodeFinished(const std::string& confirm) {
+    return base64Encode(confirm);
+}
+
+bool PskHandshake::parseFinished(const std::string& data, std::string& confirm) {
+    confirm = base64Decode(data);
+    return confirm.size() == kConfirmSize;
+}
@@ -1,13 +1,13 @@
 #include "RSAKey.h"
+#include "Logger.h"
 #include <cryptopp/rsa.h>
 #include <cryptopp/pssr.h>
 #include <cryptopp/hex.h>
 #include <cryptopp/filters.h>
 #include <cryptopp/files.h>
 #include <cryptopp/queue.h>
-#include <iostream>
 
-RSAKey::RSAKey() {
+RSAKey::RSAKey(unsigned int keySize) : keySize(keySize) {
     localPrivateKey = std::make_unique<RSA::PrivateKey>();
     localPublicKey = std::make_unique<RSA::PublicKey>();
     remotePublicKey = std::make_unique<RSA::PublicKey>();
@@ -18,14 +18,55 @@ RSAKey::~RSAKey() = default;
 bool RSAKey::generateKeyPair() {
     try {
         // 直接使用 RSA 密钥生成
-        localPrivateKey->GenerateRandomWithKeySize(rng, 2048);
+        localPrivateKey->GenerateRandomWithKeySize(rng, keySize);
         
         // 从私钥派生公钥
         *localPublicKey = *localPrivateKey;
+        signer = std::make_unique<RSASS<PSSR, SHA256>::Signer>(*localPrivateKey);
         
         return true;
     } catch (const Exception& e) {
-        std::cerr << "RSA密钥对生成失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("RSA密钥对生成失败: " << e.what());
+        return false;
+    }
+}
+
+std::string RSAKey::getLocalPrivateKey() {
+    if (!signer) {
+        CRYPTOLINK_LOG_ERROR("导出本地私钥失败: 密钥对尚未生成");
+        return "";
+    }
+    
+    try {
+        std::string keyString;
+        StringSink ss(keyString);
+        localPrivateKey->Save(ss);
+        return base64Encode(keyString);
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("导出本地私钥失败: " << e.what());
+        return "";
+    }
+}
+
+bool RSAKey::setLocalPrivateKey(const std::string& privateKey) {
+    try {
+        RSA::PrivateKey key;
+        std::string decoded = base64Decode(privateKey);
+        StringSource ss(decoded, true);
+        key.Load(ss);
+        
+        // 只做低开销的结构检查，完整的素性检查与重新生成密钥一样慢
+        if (!key.Validate(rng, 1)) {
+            CRYPTOLINK_LOG_ERROR("载入本地私钥失败: 私钥无效");
+            return false;
+        }
+        
+        *localPrivateKey = key;
+        *localPublicKey = *localPrivateKey;
+        signer = std::make_unique<RSASS<PSSR, SHA256>::Signer>(*localPrivateKey);
+        return true;
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("载入本地私钥失败: " << e.what());
         return false;
     }
 }
@@ -34,16 +75,20 @@ std::string RSAKey::getLocalPublicKey() {
     try {
         return keyToString(*localPublicKey);
     } catch (const Exception& e) {
-        std::cerr << "获取本地公钥失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("获取本地公钥失败: " << e.what());
         return "";
     }
 }
 
 bool RSAKey::setRemotePublicKey(const std::string& publicKey) {
     try {
-        return stringToPublicKey(publicKey, *remotePublicKey);
+        if (!stringToPublicKey(publicKey, *remotePublicKey)) {
+            return false;
+        }
+        verifier = std::make_unique<RSASS<PSSR, SHA256>::Verifier>(*remotePublicKey);
+        return true;
     } catch (const Exception& e) {
-        std::cerr << "设置远程公钥失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("设置远程公钥失败: " << e.what());
         return false;
     }
 }
@@ -61,7 +106,7 @@ std::string RSAKey::encryptWithLocalPrivate(const std::string& plaintext) {
         
         return base64Encode(ciphertext);
     } catch (const Exception& e) {
-        std::cerr << "使用本地私钥加密失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("使用本地私钥加密失败: " << e.what());
         return "";
     }
 }
@@ -81,7 +126,7 @@ std::string RSAKey::decryptWithLocalPrivate(const std::string& ciphertext) {
         
         return recovered;
     } catch (const Exception& e) {
-        std::cerr << "使用本地私钥解密失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_WARNING("使用本地私钥解密失败: " << e.what());
         return "";
     }
 }
@@ -99,7 +144,7 @@ std::string RSAKey::encryptWithRemotePublic(const std::string& plaintext) {
         
         return base64Encode(ciphertext);
     } catch (const Exception& e) {
-        std::cerr << "使用远程公钥加密失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("使用远程公钥加密失败: " << e.what());
         return "";
     }
 }
@@ -120,44 +165,43 @@ std::string RSAKey::decryptWithRemotePublic(const std::string& ciphertext) {
         
         return recovered;
     } catch (const Exception& e) {
-        std::cerr << "使用远程公钥解密失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_WARNING("使用远程公钥解密失败: " << e.what());
         return "";
     }
 }
 
 std::string RSAKey::signWithLocalPrivate(const std::string& data) {
+    if (!signer) {
+        CRYPTOLINK_LOG_ERROR("使用本地私钥签名失败: 密钥对尚未生成");
+        return "";
+    }
+    
     try {
-        std::string signature;
-        RSASS<PSSR, SHA256>::Signer signer(*localPrivateKey);
-        
-        StringSource ss(data, true,
-            new SignerFilter(rng, signer,
-                new StringSink(signature)
-            )
-        );
+        std::string signature(signer->SignatureLength(), '\0');
+        size_t length = signer->SignMessage(rng, (const byte*)data.data(), data.size(), (byte*)&signature[0]);
+        signature.resize(length);
         
         return base64Encode(signature);
     } catch (const Exception& e) {
-        std::cerr << "使用本地私钥签名失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("使用本地私钥签名失败: " << e.what());
         return "";
     }
 }
 
 bool RSAKey::verifyWithRemotePublic(const std::string& data, const std::string& signature) {
+    if (!verifier) {
+        CRYPTOLINK_LOG_WARNING("使用远程公钥验证签名失败: 尚未设置远程公钥");
+        return false;
+    }
+    
     try {
         std::string decoded = base64Decode(signature);
-        RSASS<PSSR, SHA256>::Verifier verifier(*remotePublicKey);
         
-        StringSource ss(data + decoded, true,
-            new SignatureVerificationFilter(verifier,
-                nullptr,
-                SignatureVerificationFilter::PUT_RESULT
-            )
-        );
-        
-        return true;
+        // 直接取验证结果（PUT_RESULT 没有下游时结果会被丢弃，任何签名都会被当作有效）
+        return verifier->VerifyMessage((const byte*)data.data(), data.size(),
+                                      (const byte*)decoded.data(), decoded.size());
     } catch (const Exception& e) {
-        std::cerr << "使用远程公钥验证签名失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_WARNING("使用远程公钥验证签名失败: " << e.what());
         return false;
     }
 }
@@ -176,7 +220,7 @@ bool RSAKey::stringToPublicKey(const std::string& keyString, RSA::PublicKey& key
         key.Load(ss);
         return true;
     } catch (const Exception& e) {
-        std::cerr << "从字符串恢复公钥失败: " << e.what() << std::endl;
+        CRYPTOLINK_LOG_ERROR("从字符串恢复公钥失败: " << e.what());
         return false;
     }
 }
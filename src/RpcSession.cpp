@@ -0,0 +1,320 @@
+#include "RpcSession.h"
+#include "Logger.h"
+#include <algorithm>
+
+namespace {
+
+// 正在处理的请求表至少积累到这么多条才清理一次已应答的条目
+const size_t kMinServingSweep = 256;
+
+void writeUint(char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[bytes - 1 - i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t readUint(const char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(in[i]);
+    }
+    return value;
+}
+
+const std::chrono::steady_clock::time_point kNoDeadline = std::chrono::steady_clock::time_point::max();
+
+}
+
+struct RpcSession::Responder::State {
+    std::shared_ptr<const RecordSender> sender;
+    CallId id = 0;
+    std::chrono::steady_clock::time_point deadline = kNoDeadline;
+    std::atomic<bool> done{false};
+    std::atomic<bool> cancelled{false};
+
+    bool send(Status status, std::string_view payload) {
+        PooledBuffer record = BufferPool::local().acquire(kResponseHeaderSize + payload.size());
+        if (!record) {
+            return false;
+        }
+        char header[kResponseHeaderSize];
+        writeUint(header, id, 8);
+        header[8] = static_cast<char>(status);
+        record.append(header, sizeof(header));
+        record.append(payload.data(), payload.size());
+        return (*sender)(RPC_RESPONSE, SendPriority::NORMAL, std::move(record));
+    }
+
+    ~State() {
+        // 处理函数丢掉了所有应答句柄却没有应答
+        if (!done.load(std::memory_order_acquire) && !cancelled.load(std::memory_order_acquire) &&
+            std::chrono::steady_clock::now() < deadline) {
+            send(Status::ERROR, "no response");
+        }
+    }
+};
+
+RpcSession::CallId RpcSession::Responder::id() const {
+    return state ? state->id : 0;
+}
+
+std::chrono::steady_clock::time_point RpcSession::Responder::deadline() const {
+    return state ? state->deadline : kNoDeadline;
+}
+
+bool RpcSession::Responder::isCancelled() const {
+    return !state || state->cancelled.load(std::memory_order_acquire) ||
+           std::chrono::steady_clock::now() >= state->deadline;
+}
+
+bool RpcSession::Responder::respond(Status status, std::string_view payload) {
+    if (!state || state->done.exchange(true, std::memory_order_acq_rel)) {
+        return false;
+    }
+    // 调用方已经放弃，应答不再有意义
+    if (isCancelled()) {
+        return false;
+    }
+    return state->send(status, payload);
+}
+
+RpcSession::RpcSession(RecordSender sender)
+    : sender(std::make_shared<const RecordSender>(std::move(sender))), nextCallId(1), servingSweepAt(kMinServingSweep) {
+}
+
+RpcSession::~RpcSession() {
+    disconnect();
+}
+
+RpcSession::CallId RpcSession::call(std::string_view method, std::string_view request, ResponseHandler handler,
+                                    std::chrono::milliseconds timeout, SendPriority priority) {
+    if (method.size() > kMaxMethodLength || !handler) {
+        return 0;
+    }
+
+    auto pendingCall = std::make_shared<PendingCall>();
+    pendingCall->id = nextCallId.fetch_add(1, std::memory_order_relaxed);
+    pendingCall->handler = std::move(handler);
+    pendingCall->deadline = timeout.count() > 0 ? std::chrono::steady_clock::now() + timeout : kNoDeadline;
+
+    PooledBuffer record = BufferPool::local().acquire(kRequestHeaderSize + method.size() + request.size());
+    if (!record) {
+        return 0;
+    }
+    char header[kRequestHeaderSize];
+    writeUint(header, pendingCall->id, 8);
+    writeUint(header + 8, static_cast<uint64_t>(std::min<int64_t>(std::max<int64_t>(timeout.count(), 0), 0xffffffff)), 4);
+    writeUint(header + 12, method.size(), 2);
+    record.append(header, sizeof(header));
+    record.append(method.data(), method.size());
+    record.append(request.data(), request.size());
+
+    // 先登记再发出请求：事件循环处理应答之前一定能取到这条登记
+    commands.push(Command{pendingCall, pendingCall->id});
+    if (!(*sender)(RPC_REQUEST, priority, std::move(record))) {
+        // 没有发出：事件循环还没有结束这个调用时由这里撤回，处理函数不再调用
+        if (!pendingCall->done.exchange(true, std::memory_order_acq_rel)) {
+            return 0;
+        }
+    }
+    return pendingCall->id;
+}
+
+void RpcSession::cancel(CallId id) {
+    commands.push(Command{nullptr, id});
+}
+
+void RpcSession::setRequestHandler(RequestHandler handler) {
+    requestHandler = std::move(handler);
+}
+
+bool RpcSession::handleRecord(uint8_t type, std::string_view payload) {
+    switch (type) {
+        case RPC_REQUEST:
+            handleRequest(payload);
+            return true;
+        case RPC_RESPONSE:
+            handleResponse(payload);
+            return true;
+        case RPC_CANCEL:
+            handleCancel(payload);
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::chrono::steady_clock::time_point RpcSession::poll(std::chrono::steady_clock::time_point now) {
+    absorbCommands();
+
+    // 截止时间堆里可能有已经结束的调用，取到时跳过
+    while (!deadlines.empty()) {
+        const Deadline next = deadlines.top();
+        auto it = pending.find(next.second);
+        if (it == pending.end() || it->second->deadline != next.first) {
+            deadlines.pop();
+            continue;
+        }
+        if (next.first > now) {
+            return next.first;
+        }
+        deadlines.pop();
+        std::shared_ptr<PendingCall> expired = std::move(it->second);
+        pending.erase(it);
+        sendCancel(expired->id);
+        finish(*expired, Status::DEADLINE_EXCEEDED, std::string_view());
+    }
+    return kNoDeadline;
+}
+
+void RpcSession::disconnect() {
+    absorbCommands();
+
+    std::unordered_map<CallId, std::shared_ptr<PendingCall>> failed;
+    failed.swap(pending);
+    deadlines = decltype(deadlines)();
+    for (auto& entry : failed) {
+        finish(*entry.second, Status::DISCONNECTED, std::string_view());
+    }
+
+    for (auto& entry : serving) {
+        if (auto state = entry.second.lock()) {
+            state->cancelled.store(true, std::memory_order_release);
+        }
+    }
+    serving.clear();
+    servingSweepAt = kMinServingSweep;
+}
+
+const char* RpcSession::statusName(Status status) {
+    switch (status) {
+        case Status::OK: return "OK";
+        case Status::ERROR: return "ERROR";
+        case Status::NOT_FOUND: return "NOT_FOUND";
+        case Status::CANCELLED: return "CANCELLED";
+        case Status::DEADLINE_EXCEEDED: return "DEADLINE_EXCEEDED";
+        case Status::DISCONNECTED: return "DISCONNECTED";
+    }
+    return "UNKNOWN";
+}
+
+void RpcSession::absorbCommands() {
+    Command command;
+    while (commands.pop(command)) {
+        if (command.call) {
+            // 发送失败已经撤回的调用不再登记
+            if (command.call->done.load(std::memory_order_acquire)) {
+                continue;
+            }
+            if (command.call->deadline != kNoDeadline) {
+                deadlines.emplace(command.call->deadline, command.id);
+            }
+            pending.emplace(command.id, std::move(command.call));
+            continue;
+        }
+
+        auto it = pending.find(command.id);
+        if (it == pending.end()) {
+            continue;
+        }
+        std::shared_ptr<PendingCall> cancelled = std::move(it->second);
+        pending.erase(it);
+        sendCancel(cancelled->id);
+        finish(*cancelled, Status::CANCELLED, std::string_view());
+    }
+}
+
+void RpcSession::finish(PendingCall& call, Status status, std::string_view payload) {
+    if (!call.done.exchange(true, std::memory_order_acq_rel)) {
+        call.handler(status, payload);
+    }
+}
+
+bool RpcSession::sendCancel(CallId id) {
+    PooledBuffer record = BufferPool::local().acquire(8);
+    if (!record) {
+        return false;
+    }
+    char data[8];
+    writeUint(data, id, 8);
+    record.append(data, sizeof(data));
+    return (*sender)(RPC_CANCEL, SendPriority::CONTROL, std::move(record));
+}
+
+void RpcSession::handleRequest(std::string_view payload) {
+    if (payload.size() < kRequestHeaderSize) {
+        CRYPTOLINK_LOG_WARNING("调用请求格式错误");
+        return;
+    }
+    const CallId id = readUint(payload.data(), 8);
+    const uint64_t timeoutMs = readUint(payload.data() + 8, 4);
+    const size_t methodLength = readUint(payload.data() + 12, 2);
+    if (payload.size() < kRequestHeaderSize + methodLength) {
+        CRYPTOLINK_LOG_WARNING("调用请求格式错误");
+        return;
+    }
+    const std::string_view method = payload.substr(kRequestHeaderSize, methodLength);
+    const std::string_view request = payload.substr(kRequestHeaderSize + methodLength);
+
+    auto state = std::make_shared<Responder::State>();
+    state->sender = sender;
+    state->id = id;
+    if (timeoutMs > 0) {
+        state->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    }
+
+    // 应答在任意线程发生，表里只留弱引用，积累到一定数量时清理已经应答的条目
+    if (serving.size() >= servingSweepAt) {
+        for (auto it = serving.begin(); it != serving.end();) {
+            it = it->second.expired() ? serving.erase(it) : std::next(it);
+        }
+        servingSweepAt = std::max(kMinServingSweep, serving.size() * 2);
+    }
+    serving[id] = state;
+
+    Responder responder(std::move(state));
+    if (!requestHandler) {
+        responder.respond(Status::NOT_FOUND, method);
+        return;
+    }
+    requestHandler(method, request, std::move(responder));
+}
+
+void RpcSession::handleResponse(std::string_view payload) {
+    if (payload.size() < kResponseHeaderSize) {
+        CRYPTOLINK_LOG_WARNING("调用应答格式错误");
+        return;
+    }
+    const CallId id = readUint(payload.data(), 8);
+    const uint8_t status = static_cast<uint8_t>(payload[8]);
+
+    // 请求先于应答登记，应答到达时登记一定已经在队列中
+    auto it = pending.find(id);
+    if (it == pending.end()) {
+        absorbCommands();
+        it = pending.find(id);
+        if (it == pending.end()) {
+            // 已超时或已取消的调用
+            return;
+        }
+    }
+    std::shared_ptr<PendingCall> completed = std::move(it->second);
+    pending.erase(it);
+    const Status result = status <= static_cast<uint8_t>(Status::DISCONNECTED) ? static_cast<Status>(status) : Status::ERROR;
+    finish(*completed, result, payload.substr(kResponseHeaderSize));
+}
+
+void RpcSession::handleCancel(std::string_view payload) {
+    if (payload.size() < 8) {
+        return;
+    }
+    auto it = serving.find(readUint(payload.data(), 8));
+    if (it == serving.end()) {
+        return;
+    }
+    if (auto state = it->second.lock()) {
+        state->cancelled.store(true, std::memory_order_release);
+    }
+    serving.erase(it);
+}
@@ -0,0 +1,461 @@
+#include "SegmentCipher.h"
+#include "Logger.h"
+#include <cryptopp/aes.h>
+#include <cryptopp/chachapoly.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/sha.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+using namespace CryptoPP;
+
+namespace {
+
+const size_t kNonceSize = 12;
+const size_t kKeySize = 32;
+
+// 段长度上限，防止对端声明的段长度让单段拷贝失控
+const uint32_t kMaxSegmentSize = 16 * 1024 * 1024;
+
+const char kMessageKeyInfo[] = "CryptoLink segmented message";
+
+void writeUint(char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[bytes - 1 - i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t readUint(const char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(in[i]);
+    }
+    return value;
+}
+
+// 每条消息的密钥都不同，nonce 只需要区分同一消息内的段
+void makeNonce(byte* nonce, uint32_t index) {
+    std::memset(nonce, 0, kNonceSize);
+    writeUint(reinterpret_cast<char*>(nonce) + kNonceSize - 4, index, 4);
+}
+
+template <class Encryption>
+bool sealWith(const SecByteBlock& key, const char* header, const char* plaintext, size_t length, char* out) {
+    byte nonce[kNonceSize];
+    makeNonce(nonce, static_cast<uint32_t>(readUint(header + 3, 4)));
+
+    Encryption encryption;
+    encryption.SetKeyWithIV(key, key.size(), nonce, kNonceSize);
+    encryption.EncryptAndAuthenticate((byte*)out, (byte*)out + length, SegmentCipher::kTagSize,
+                                      nonce, kNonceSize,
+                                      (const byte*)header, SegmentCipher::kHeaderSize,
+                                      (const byte*)plaintext, length);
+    return true;
+}
+
+template <class Decryption>
+bool openWith(const SecByteBlock& key, const char* header, char* data, size_t length, const char* tag) {
+    byte nonce[kNonceSize];
+    makeNonce(nonce, static_cast<uint32_t>(readUint(header + 3, 4)));
+
+    Decryption decryption;
+    decryption.SetKeyWithIV(key, key.size(), nonce, kNonceSize);
+    return decryption.DecryptAndVerify((byte*)data, (const byte*)tag, SegmentCipher::kTagSize,
+                                       nonce, kNonceSize,
+                                       (const byte*)header, SegmentCipher::kHeaderSize,
+                                       (const byte*)data, length);
+}
+
+}
+
+SegmentCipher::SegmentCipher(CipherSuite suite, const SecByteBlock& sendKey, const SecByteBlock& receiveKey,
+                             ReadyNotifier ready, CryptoWorkerPool& pool)
+    : suite(suite),
+      sendKey(sendKey),
+      receiveKey(receiveKey),
+      pool(pool),
+      shared(std::make_shared<Shared>()),
+      nextMessageId(0),
+      receiveLimit(kDefaultReceiveLimit),
+      incomingBytes(0),
+      completingBytes(0),
+      peerLimit(0) {
+    shared->ready = std::move(ready);
+}
+
+SegmentCipher::~SegmentCipher() {
+    // 任务持有的消息状态由 shared_ptr 保持，这里只需要保证之后不再调用 ready
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->closed = true;
+    shared->done.wait(lock, [this]() {
+        return shared->outstanding == 0;
+    });
+}
+
+bool SegmentCipher::seal(uint8_t type, SendPriority priority, PooledBuffer plaintext) {
+    if (!plaintext || plaintext.empty()) {
+        return false;
+    }
+
+    auto job = std::make_shared<Outgoing>();
+    job->messageId = nextMessageId++;
+
+    byte nonce[kMessageNonceSize];
+    rng.GenerateBlock(nonce, sizeof(nonce));
+    try {
+        job->key = deriveMessageKey(sendKey, nonce);
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("分段加密密钥派生失败: " << e.what());
+        return false;
+    }
+
+    job->sealed.begin = BufferPool::local().acquire(kBeginSize);
+    if (!job->sealed.begin) {
+        return false;
+    }
+    char begin[kBeginSize];
+    std::memcpy(begin, nonce, kMessageNonceSize);
+    writeUint(begin + kMessageNonceSize, job->messageId, 2);
+    begin[kMessageNonceSize + 2] = static_cast<char>(type);
+    writeUint(begin + kMessageNonceSize + 3, plaintext.size(), 8);
+    writeUint(begin + kMessageNonceSize + 11, kSegmentSize, 4);
+    job->sealed.begin.append(begin, sizeof(begin));
+
+    // 与优先级通道的规则一致：未显式标记的大消息归入 BULK，SEGMENT_BEGIN 和各段在同一个通道里保持顺序
+    if (priority == SendPriority::NORMAL && plaintext.size() > PriorityLanes::kBulkThreshold) {
+        priority = SendPriority::BULK;
+    }
+    job->sealed.priority = priority;
+
+    const size_t count = (plaintext.size() + kSegmentSize - 1) / kSegmentSize;
+    job->sealed.segments.resize(count);
+    job->remaining = count;
+    job->plaintext = std::move(plaintext);
+    outgoing.push_back(job);
+
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->outstanding += count;
+    }
+
+    const CipherSuite suite = this->suite;
+    for (size_t i = 0; i < count; ++i) {
+        pool.submit([shared = this->shared, job, i, suite]() {
+            bool closed;
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                closed = shared->closed;
+            }
+
+            bool sealed = false;
+            if (!closed) {
+                const size_t offset = i * kSegmentSize;
+                const size_t length = std::min(kSegmentSize, job->plaintext.size() - offset);
+                PooledBuffer record = BufferPool::local().acquire(kHeaderSize + length + kTagSize);
+                if (record) {
+                    record.resize(kHeaderSize + length + kTagSize);
+                    writeHeader(record.data(), job->messageId, static_cast<uint32_t>(i));
+                    sealed = sealSegment(suite, job->key, record.data(), job->plaintext.data() + offset, length,
+                                         record.data() + kHeaderSize);
+                    job->sealed.segments[i] = std::move(record);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (!sealed) {
+                job->failed = true;
+            }
+            if (--job->remaining == 0) {
+                job->plaintext.reset();
+                if (!shared->closed && shared->ready) {
+                    shared->ready();
+                }
+            }
+            --shared->outstanding;
+            shared->done.notify_all();
+        });
+    }
+    return true;
+}
+
+bool SegmentCipher::collect(SealedMessage& message) {
+    while (!outgoing.empty()) {
+        std::shared_ptr<Outgoing> job = outgoing.front();
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (job->remaining > 0) {
+                return false;
+            }
+        }
+        outgoing.pop_front();
+
+        if (job->failed) {
+            CRYPTOLINK_LOG_ERROR("分段加密失败，丢弃消息");
+            continue;
+        }
+        message = std::move(job->sealed);
+        return true;
+    }
+    return false;
+}
+
+void SegmentCipher::setReceiveLimit(uint64_t bytes) {
+    receiveLimit = std::min(bytes, kMaxMessageSize);
+}
+
+PooledBuffer SegmentCipher::limitPayload() const {
+    PooledBuffer payload = BufferPool::local().acquire(8);
+    if (payload) {
+        char limit[8];
+        writeUint(limit, receiveLimit, 8);
+        payload.append(limit, sizeof(limit));
+    }
+    return payload;
+}
+
+bool SegmentCipher::handleLimit(std::string_view payload) {
+    if (payload.size() != 8) {
+        return false;
+    }
+    peerLimit = std::min(readUint(payload.data(), 8), kMaxMessageSize);
+    return true;
+}
+
+bool SegmentCipher::accepts(size_t bytes) const {
+    return bytes <= peerLimit;
+}
+
+bool SegmentCipher::handleReject(std::string_view payload) {
+    if (payload.size() != 2) {
+        return false;
+    }
+    CRYPTOLINK_LOG_ERROR("对端拒绝了分段消息 #" << readUint(payload.data(), 2) << "，消息已丢弃");
+    return true;
+}
+
+PooledBuffer SegmentCipher::rejectFor(std::string_view begin) {
+    PooledBuffer payload;
+    if (begin.size() == kBeginSize) {
+        payload = BufferPool::local().acquire(2);
+        if (payload) {
+            payload.append(begin.data() + kMessageNonceSize, 2);
+        }
+    }
+    return payload;
+}
+
+bool SegmentCipher::handleBegin(std::string_view payload) {
+    if (payload.size() != kBeginSize) {
+        return false;
+    }
+
+    const byte* nonce = reinterpret_cast<const byte*>(payload.data());
+    const uint16_t messageId = static_cast<uint16_t>(readUint(payload.data() + kMessageNonceSize, 2));
+
+    // 先记为拒绝，成功建立消息后再清除；同一消息号的旧消息不会再完整，一并丢弃
+    eraseIncoming(messageId);
+    rejected.insert(messageId);
+    const uint64_t length = readUint(payload.data() + kMessageNonceSize + 3, 8);
+    const uint32_t segmentSize = static_cast<uint32_t>(readUint(payload.data() + kMessageNonceSize + 11, 4));
+    if (length == 0 || length > kMaxMessageSize || segmentSize == 0 || segmentSize > kMaxSegmentSize) {
+        CRYPTOLINK_LOG_WARNING("无效的分段消息");
+        return false;
+    }
+    if (incoming.size() >= kMaxIncoming) {
+        CRYPTOLINK_LOG_WARNING("未完成的分段消息过多");
+        return false;
+    }
+    if (length > receiveLimit || incomingBytes > receiveLimit - length || completingBytes > receiveLimit) {
+        CRYPTOLINK_LOG_WARNING("分段消息超过接收缓冲区上限: " << length << " 字节");
+        return false;
+    }
+
+    auto message = std::make_shared<Incoming>();
+    message->type = static_cast<uint8_t>(payload[kMessageNonceSize + 2]);
+    message->length = length;
+    message->segmentSize = segmentSize;
+    message->segmentCount = static_cast<uint32_t>((length + segmentSize - 1) / segmentSize);
+    try {
+        message->key = deriveMessageKey(receiveKey, nonce);
+        message->seen.assign(message->segmentCount, false);
+        message->tags.resize(size_t(message->segmentCount) * kTagSize);
+        message->data.resize(length);
+    } catch (const std::bad_alloc&) {
+        CRYPTOLINK_LOG_WARNING("分段消息缓冲区分配失败");
+        return false;
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("分段加密密钥派生失败: " << e.what());
+        return false;
+    }
+
+    incoming[messageId] = std::move(message);
+    incomingBytes += length;
+    rejected.erase(messageId);
+    return true;
+}
+
+bool SegmentCipher::handleSegment(std::string_view record) {
+    if (record.size() < kHeaderSize + kTagSize) {
+        return false;
+    }
+
+    const uint16_t messageId = static_cast<uint16_t>(readUint(record.data() + 1, 2));
+    const uint32_t index = static_cast<uint32_t>(readUint(record.data() + 3, 4));
+    auto it = incoming.find(messageId);
+    if (it == incoming.end()) {
+        if (rejected.count(messageId) == 0) {
+            CRYPTOLINK_LOG_WARNING("收到未声明的消息分段");
+        }
+        return false;
+    }
+    std::shared_ptr<Incoming> state = it->second;
+
+    const uint64_t offset = uint64_t(index) * state->segmentSize;
+    if (index >= state->segmentCount || state->seen[index] ||
+        record.size() != kHeaderSize + std::min<uint64_t>(state->segmentSize, state->length - offset) + kTagSize) {
+        CRYPTOLINK_LOG_WARNING("无效的消息分段，丢弃整条消息");
+        eraseIncoming(messageId);
+        return false;
+    }
+    const size_t length = record.size() - kHeaderSize - kTagSize;
+
+    // 接收帧缓冲区在回调返回后就会被复用，密文先拷到消息缓冲区里原地解密
+    char* slot = &state->data[0] + offset;
+    std::memcpy(slot, record.data() + kHeaderSize, length);
+    std::memcpy(&state->tags[size_t(index) * kTagSize], record.data() + kHeaderSize + length, kTagSize);
+    state->seen[index] = true;
+
+    // 最后一段到达后消息不再接收新段，移到解密队列里，由最后结束的解密任务通知事件循环
+    if (++state->received == state->segmentCount) {
+        incoming.erase(it);
+        incomingBytes -= state->length;
+        completing.push_back(state);
+        completingBytes += state->length;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        ++shared->outstanding;
+        ++state->remaining;
+        state->complete = state->received == state->segmentCount;
+    }
+    const CipherSuite suite = this->suite;
+    pool.submit([shared = this->shared, state, messageId, index, slot, length, suite]() {
+        bool closed;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            closed = shared->closed;
+        }
+
+        bool opened = false;
+        if (!closed) {
+            char header[kHeaderSize];
+            writeHeader(header, messageId, index);
+            opened = openSegment(suite, state->key, header, slot, length, &state->tags[size_t(index) * kTagSize]);
+        }
+
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        if (!opened) {
+            state->failed = true;
+        }
+        if (--state->remaining == 0 && state->complete && !shared->closed && shared->ready) {
+            shared->ready();
+        }
+        --shared->outstanding;
+        shared->done.notify_all();
+    });
+    return true;
+}
+
+bool SegmentCipher::collectIncoming(uint8_t& type, std::string_view& message) {
+    while (!completing.empty()) {
+        std::shared_ptr<Incoming> state = completing.front();
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (state->remaining > 0) {
+                return false;
+            }
+        }
+        completing.pop_front();
+        completingBytes -= state->length;
+
+        if (state->failed) {
+            CRYPTOLINK_LOG_WARNING("分段消息认证失败");
+            continue;
+        }
+        type = state->type;
+        completed = std::move(state->data);
+        message = completed;
+        return true;
+    }
+    return false;
+}
+
+void SegmentCipher::resetIncoming() {
+    incoming.clear();
+    incomingBytes = 0;
+    completing.clear();
+    completingBytes = 0;
+    rejected.clear();
+}
+
+void SegmentCipher::eraseIncoming(uint16_t messageId) {
+    auto it = incoming.find(messageId);
+    if (it != incoming.end()) {
+        incomingBytes -= it->second->length;
+        incoming.erase(it);
+    }
+}
+
+SecByteBlock SegmentCipher::deriveMessageKey(const SecByteBlock& key, const byte* nonce) {
+    SecByteBlock messageKey(kKeySize);
+    HKDF<SHA256> hkdf;
+    hkdf.DeriveKey(messageKey, messageKey.size(),
+                   key, key.size(),
+                   nonce, kMessageNonceSize,
+                   (const byte*)kMessageKeyInfo, sizeof(kMessageKeyInfo) - 1);
+    return messageKey;
+}
+
+void SegmentCipher::writeHeader(char* header, uint16_t messageId, uint32_t index) {
+    header[0] = static_cast<char>(kSegmentRecord);
+    writeUint(header + 1, messageId, 2);
+    writeUint(header + 3, index, 4);
+}
+
+bool SegmentCipher::sealSegment(CipherSuite suite, const SecByteBlock& key, const char* header,
+                                const char* plaintext, size_t length, char* out) {
+    try {
+        switch (suite) {
+            case CipherSuite::AES_256_GCM:
+                return sealWith<GCM<AES>::Encryption>(key, header, plaintext, length, out);
+            case CipherSuite::CHACHA20_POLY1305:
+                return sealWith<ChaCha20Poly1305::Encryption>(key, header, plaintext, length, out);
+            default:
+                return false;
+        }
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("分段加密失败: " << e.what());
+        return false;
+    }
+}
+
+bool SegmentCipher::openSegment(CipherSuite suite, const SecByteBlock& key, const char* header,
+                                char* data, size_t length, const char* tag) {
+    try {
+        switch (suite) {
+            case CipherSuite::AES_256_GCM:
+                return openWith<GCM<AES>::Decryption>(key, header, data, length, tag);
+            case CipherSuite::CHACHA20_POLY1305:
+                return openWith<ChaCha20Poly1305::Decryption>(key, header, data, length, tag);
+            default:
+                return false;
+        }
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_WARNING("分段解密失败: " << e.what());
+        return false;
+    }
+}
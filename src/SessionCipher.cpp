@@ -0,0 +1,108 @@
+#include "SessionCipher.h"
+#include "Logger.h"
+#include <cryptopp/base64.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/sha.h>
+
+namespace {
+
+std::string base64Decode(const std::string& data) {
+    std::string decoded;
+    StringSource ss(data, true,
+        new Base64Decoder(
+            new StringSink(decoded)
+        )
+    );
+    return decoded;
+}
+
+// 从握手密钥材料派生单个方向的密钥和nonce盐值，协商记录（如有）附在 info 末尾
+DirectionalKey deriveDirectionalKey(const SecByteBlock& secret, CipherSuite suite, const std::string& direction,
+                                    const std::string& transcript) {
+    std::string info = std::string("CryptoLink ") + cipherSuiteName(suite) + " " + direction;
+    if (!transcript.empty()) {
+        info += " " + transcript;
+    }
+
+    SecByteBlock derived(32 + 4);
+    HKDF<SHA256> hkdf;
+    hkdf.DeriveKey(derived, derived.size(),
+                   secret, secret.size(),
+                   nullptr, 0,
+                   (const byte*)info.data(), info.size());
+
+    DirectionalKey result;
+    result.key.Assign(derived, 32);
+    result.salt.Assign(derived + 32, 4);
+    return result;
+}
+
+} // namespace
+
+bool SessionCipherSlot::initialize(const std::string& sessionKey, bool isClient) {
+    size_t colonPos = sessionKey.find(':');
+    if (colonPos == std::string::npos) {
+        CRYPTOLINK_LOG_ERROR("会话密钥格式错误");
+        return false;
+    }
+
+    try {
+        std::string key = base64Decode(sessionKey.substr(0, colonPos));
+        std::string iv = base64Decode(sessionKey.substr(colonPos + 1));
+
+        if (suite == CipherSuite::AES_256_CBC) {
+            auto& impl = cipher.emplace<SessionCipher<CipherSuite::AES_256_CBC>>();
+            impl.setKeys(SecByteBlock((const byte*)key.data(), key.size()),
+                         SecByteBlock((const byte*)iv.data(), iv.size()));
+            return true;
+        }
+
+        // 密钥和IV一起作为HKDF的输入密钥材料
+        SecByteBlock secret(key.size() + iv.size());
+        std::memcpy(secret.data(), key.data(), key.size());
+        std::memcpy(secret.data() + key.size(), iv.data(), iv.size());
+        return initialize(secret, isClient);
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("会话加密器初始化失败: " << e.what());
+        reset();
+        return false;
+    }
+}
+
+bool SessionCipherSlot::initialize(const SecByteBlock& secret, bool isClient) {
+    try {
+        DirectionalKey clientToServer = deriveDirectionalKey(secret, suite, "client->server", transcript);
+        DirectionalKey serverToClient = deriveDirectionalKey(secret, suite, "server->client", transcript);
+        const DirectionalKey& sendKey = isClient ? clientToServer : serverToClient;
+        const DirectionalKey& receiveKey = isClient ? serverToClient : clientToServer;
+        
+        // 分段加密的密钥与记录层的密钥分开派生，两者的 nonce 空间互不影响
+        DirectionalKey clientSegments = deriveDirectionalKey(secret, suite, "client->server segments", transcript);
+        DirectionalKey serverSegments = deriveDirectionalKey(secret, suite, "server->client segments", transcript);
+        segmentSendKey = isClient ? clientSegments.key : serverSegments.key;
+        segmentReceiveKey = isClient ? serverSegments.key : clientSegments.key;
+        
+        // 数据报各自独立解密，同样使用单独派生的密钥
+        DirectionalKey clientDatagrams = deriveDirectionalKey(secret, suite, "client->server datagrams", transcript);
+        DirectionalKey serverDatagrams = deriveDirectionalKey(secret, suite, "server->client datagrams", transcript);
+        datagramSendKey = isClient ? clientDatagrams : serverDatagrams;
+        datagramReceiveKey = isClient ? serverDatagrams : clientDatagrams;
+
+        switch (suite) {
+            case CipherSuite::AES_256_GCM:
+                cipher.emplace<SessionCipher<CipherSuite::AES_256_GCM>>().setKeys(sendKey, receiveKey);
+                return true;
+            case CipherSuite::CHACHA20_POLY1305:
+                cipher.emplace<SessionCipher<CipherSuite::CHACHA20_POLY1305>>().setKeys(sendKey, receiveKey);
+                return true;
+            default:
+                CRYPTOLINK_LOG_ERROR("不支持的加密套件");
+                return false;
+        }
+    } catch (const Exception& e) {
+        CRYPTOLINK_LOG_ERROR("会话加密器初始化失败: " << e.what());
+        reset();
+        return false;
+    }
+}
@@ -0,0 +1,250 @@
+#include "SessionRecorder.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// 积压达到这么多字节时立即唤醒后台线程写文件，否则按间隔写
+const size_t kWriteThreshold = 256 * 1024;
+const std::chrono::milliseconds kWriteInterval(100);
+
+void writeUint(char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[bytes - 1 - i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t readUint(const char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(in[i]);
+    }
+    return value;
+}
+
+int64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+}
+
+std::unique_ptr<SessionRecorder> SessionRecorder::open(const std::string& path, bool includePayloads) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        CRYPTOLINK_LOG_ERROR("打开录制文件失败: " << path << ": " << std::strerror(errno));
+        return nullptr;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    int64_t startTime = nowMicros();
+    uint64_t sessionBase = 0;
+    bool appending = false;
+    if (st.st_size == 0) {
+        char header[kFileHeaderSize] = {0};
+        std::memcpy(header, kMagic, sizeof(kMagic));
+        writeUint(header + 8, kVersion, 4);
+        writeUint(header + 12, includePayloads ? kFlagPayloads : 0, 4);
+        writeUint(header + 16, static_cast<uint64_t>(startTime), 8);
+        if (!writeAll(fd, header, sizeof(header))) {
+            CRYPTOLINK_LOG_ERROR("写入录制文件失败: " << path << ": " << std::strerror(errno));
+            ::close(fd);
+            return nullptr;
+        }
+    } else {
+        // 继续写已有的录制：沿用原来的开始时刻，会话号接着已有的最大值，截掉上次异常退出时写了一半的事件
+        Reader reader;
+        if (!reader.open(path) || reader.hasPayloads() != includePayloads) {
+            CRYPTOLINK_LOG_ERROR("录制文件格式不符，不能追加: " << path);
+            ::close(fd);
+            return nullptr;
+        }
+        Event event;
+        while (reader.next(event)) {
+            sessionBase = std::max(sessionBase, event.session);
+        }
+        startTime = reader.getStartTime();
+        if (reader.getPosition() < static_cast<size_t>(st.st_size) &&
+            ::ftruncate(fd, static_cast<off_t>(reader.getPosition())) != 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        appending = true;
+    }
+
+    std::unique_ptr<SessionRecorder> recorder(new SessionRecorder(fd, includePayloads, startTime, sessionBase));
+    if (appending) {
+        recorder->record(SEGMENT, 0);
+    }
+    return recorder;
+}
+
+SessionRecorder::SessionRecorder(int fd, bool includePayloads, int64_t startTime, uint64_t sessionBase)
+    : fd(fd), includePayloads(includePayloads), startTime(startTime), sessionBase(sessionBase),
+      dropped(0), closing(false) {
+    writer = std::thread([this]() {
+        writerLoop();
+    });
+}
+
+SessionRecorder::~SessionRecorder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    wake.notify_one();
+    writer.join();
+    ::close(fd);
+}
+
+void SessionRecorder::record(EventType type, uint64_t session, uint8_t recordType, SendPriority priority,
+                             std::string_view payload) {
+    const uint32_t length = static_cast<uint32_t>(std::min<size_t>(payload.size(), UINT32_MAX));
+    const int64_t time = std::max<int64_t>(nowMicros() - startTime, 0);
+
+    char header[kEventHeaderSize] = {0};
+    writeUint(header, static_cast<uint64_t>(time), 8);
+    writeUint(header + 8, sessionBase + session, 8);
+    header[16] = static_cast<char>(type);
+    header[17] = static_cast<char>(recordType);
+    header[18] = static_cast<char>(priority);
+    writeUint(header + 20, length, 4);
+
+    const size_t needed = sizeof(header) + (includePayloads ? length : 0);
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.size() + needed > kMaxBacklog) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        pending.append(header, sizeof(header));
+        if (includePayloads) {
+            pending.append(payload.data(), length);
+        }
+        full = pending.size() >= kWriteThreshold;
+    }
+    if (full) {
+        wake.notify_one();
+    }
+}
+
+void SessionRecorder::writerLoop() {
+    std::string batch;
+    for (;;) {
+        bool done;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait_for(lock, kWriteInterval, [this]() {
+                return closing || pending.size() >= kWriteThreshold;
+            });
+            batch.swap(pending);
+            done = closing && batch.empty();
+        }
+        if (done) {
+            return;
+        }
+        if (!batch.empty() && !writeAll(fd, batch.data(), batch.size())) {
+            CRYPTOLINK_LOG_ERROR("写入录制文件失败: " << std::strerror(errno));
+        }
+        batch.clear();
+    }
+}
+
+SessionRecorder::Reader::Reader()
+    : data(nullptr), size(0), position(kFileHeaderSize), flags(0), startTime(0) {
+}
+
+SessionRecorder::Reader::~Reader() {
+    if (data) {
+        ::munmap(const_cast<char*>(data), size);
+    }
+}
+
+bool SessionRecorder::Reader::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        CRYPTOLINK_LOG_ERROR("打开录制文件失败: " << path << ": " << std::strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < kFileHeaderSize) {
+        ::close(fd);
+        return false;
+    }
+
+    // 映射建立后文件描述符即可关闭；重放按顺序读取，提示内核提前预读
+    void* mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        CRYPTOLINK_LOG_ERROR("映射录制文件失败: " << path << ": " << std::strerror(errno));
+        return false;
+    }
+    ::madvise(mapping, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    if (data) {
+        ::munmap(const_cast<char*>(data), size);
+    }
+    data = static_cast<const char*>(mapping);
+    size = static_cast<size_t>(st.st_size);
+    position = kFileHeaderSize;
+
+    if (std::memcmp(data, kMagic, sizeof(kMagic)) != 0 || readUint(data + 8, 4) != kVersion) {
+        CRYPTOLINK_LOG_ERROR("不是有效的录制文件: " << path);
+        return false;
+    }
+    flags = static_cast<uint32_t>(readUint(data + 12, 4));
+    startTime = static_cast<int64_t>(readUint(data + 16, 8));
+    return true;
+}
+
+bool SessionRecorder::Reader::next(Event& event) {
+    if (!data || size - position < kEventHeaderSize) {
+        return false;
+    }
+    const char* header = data + position;
+    const uint32_t length = static_cast<uint32_t>(readUint(header + 20, 4));
+    const size_t payloadSize = hasPayloads() ? length : 0;
+    if (size - position - kEventHeaderSize < payloadSize) {
+        return false;
+    }
+
+    event.time = readUint(header, 8);
+    event.session = readUint(header + 8, 8);
+    event.type = static_cast<EventType>(static_cast<uint8_t>(header[16]));
+    event.recordType = static_cast<uint8_t>(header[17]);
+    event.priority = static_cast<SendPriority>(std::min<uint8_t>(static_cast<uint8_t>(header[18]),
+                                                                 static_cast<uint8_t>(SendPriority::BULK)));
+    event.length = length;
+    event.payload = std::string_view(header + kEventHeaderSize, payloadSize);
+    position += kEventHeaderSize + payloadSize;
+    return true;
+}
@@ -0,0 +1,501 @@
+#include "StreamTransport.h"
+#include "Logger.h"
+#include <type_traits>
+#include <vector>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// 一次 writev 合并的最大帧数
+const size_t kMaxGatherFrames = 64;
+
+// 解析地址加上逐个尝试解析结果的总时限
+const std::chrono::seconds kConnectTimeout(10);
+
+// TCP 地址为 port 或 host:port，只有端口时监听全部地址、连接本机
+void splitHostPort(const std::string& address, bool passive, std::string& host, std::string& port) {
+    size_t colonPos = address.rfind(':');
+    host = colonPos == std::string::npos ? (passive ? "0.0.0.0" : "127.0.0.1") : address.substr(0, colonPos);
+    port = colonPos == std::string::npos ? address : address.substr(colonPos + 1);
+}
+
+}
+
+template <typename Protocol>
+StreamTransport<Protocol>::StreamTransport(boost::asio::io_context* loop)
+    : ownedIo(loop ? nullptr : new boost::asio::io_context()), io(loop ? *loop : *ownedIo), acceptor(io),
+      alive(std::make_shared<bool>(true)) {
+}
+
+template <typename Protocol>
+StreamTransport<Protocol>::~StreamTransport() {
+    if (ownedIo) {
+        stop();
+    } else {
+        // 共享事件循环继续运行：在循环线程上关闭套接字，已排队的完成回调发现传输已销毁后直接返回
+        closeAll();
+    }
+    if (!listenPath.empty()) {
+        ::unlink(listenPath.c_str());
+    }
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::setHandlers(Handlers handlers) {
+    this->handlers = std::move(handlers);
+}
+
+template <typename Protocol>
+bool StreamTransport<Protocol>::listen(const std::string& address) {
+    typename Protocol::endpoint endpoint;
+    if (!resolve(address, true, endpoint)) {
+        return false;
+    }
+
+    boost::system::error_code ec;
+    acceptor.open(endpoint.protocol(), ec);
+    if (!ec) {
+        if constexpr (std::is_same_v<Protocol, boost::asio::ip::tcp>) {
+            acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
+        } else {
+            // 清理上次运行遗留的套接字文件
+            ::unlink(address.c_str());
+            listenPath = address;
+        }
+    }
+    if (!ec) {
+        acceptor.bind(endpoint, ec);
+    }
+    if (!ec) {
+        acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+    }
+    if (ec) {
+        CRYPTOLINK_LOG_ERROR("监听 " << address << " 失败: " << ec.message());
+        return false;
+    }
+
+    startAccept();
+    return true;
+}
+
+template <typename Protocol>
+bool StreamTransport<Protocol>::connect(const std::string& address) {
+    typename Protocol::endpoint endpoint;
+    if constexpr (!std::is_same_v<Protocol, boost::asio::ip::tcp>) {
+        if (!resolve(address, false, endpoint)) {
+            return false;
+        }
+    }
+
+    // 解析和连接都在事件循环上异步进行，不阻塞共享的事件循环；失败和超时经 onFail 通知
+    ConnectionPtr connection = std::make_shared<Connection>(io);
+    boost::asio::dispatch(io, [this, guard = Guard(alive), connection, address, endpoint]() {
+        if (guard.expired()) {
+            return;
+        }
+        connections.insert(connection);
+
+        std::shared_ptr<boost::asio::ip::tcp::resolver> resolver;
+        if constexpr (std::is_same_v<Protocol, boost::asio::ip::tcp>) {
+            resolver = std::make_shared<boost::asio::ip::tcp::resolver>(io);
+        }
+        connection->connectTimer.expires_after(kConnectTimeout);
+        connection->connectTimer.async_wait([this, guard, connection, resolver, address](const boost::system::error_code& ec) {
+            if (ec || guard.expired() || connection->closed || connection->open) {
+                return;
+            }
+            CRYPTOLINK_LOG_WARNING("连接 " << address << " 超时");
+            if (resolver) {
+                resolver->cancel();
+            }
+            finish(connection);
+        });
+
+        if constexpr (std::is_same_v<Protocol, boost::asio::ip::tcp>) {
+            std::string host;
+            std::string port;
+            splitHostPort(address, false, host, port);
+            resolver->async_resolve(host, port, [this, guard, connection, resolver, address](
+                    const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results) {
+                if (guard.expired() || connection->closed) {
+                    return;
+                }
+                if (ec || results.empty()) {
+                    CRYPTOLINK_LOG_ERROR("无法解析地址 " << address << ": " << ec.message());
+                    connection->connectTimer.cancel();
+                    finish(connection);
+                    return;
+                }
+                // 按解析结果的顺序逐个尝试，直到有一个连上
+                boost::asio::async_connect(connection->socket, results, [this, guard, connection](
+                        const boost::system::error_code& ec, const boost::asio::ip::tcp::endpoint&) {
+                    if (!guard.expired()) {
+                        completeConnect(connection, ec);
+                    }
+                });
+            });
+        } else {
+            connection->socket.async_connect(endpoint, [this, guard, connection](const boost::system::error_code& ec) {
+                if (!guard.expired()) {
+                    completeConnect(connection, ec);
+                }
+            });
+        }
+    });
+    return true;
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::completeConnect(const ConnectionPtr& connection, const boost::system::error_code& ec) {
+    // 已经超时放弃的连接不再处理
+    if (connection->closed) {
+        return;
+    }
+    connection->connectTimer.cancel();
+    if (ec) {
+        CRYPTOLINK_LOG_WARNING("连接失败: " << ec.message());
+        finish(connection);
+        return;
+    }
+    configureSocket(connection->socket);
+    startSession(connection);
+}
+
+template <typename Protocol>
+bool StreamTransport<Protocol>::send(Handle hdl, const char* data, size_t length, FrameType type) {
+    return sendFrame(hdl, static_cast<uint8_t>(type), data, length);
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::close(Handle hdl, uint16_t, const std::string&) {
+    ConnectionPtr connection = std::static_pointer_cast<Connection>(hdl.lock());
+    if (!connection) {
+        return;
+    }
+
+    // 先把已排队的帧写完再断开
+    boost::asio::dispatch(io, [this, guard = Guard(alive), connection]() {
+        if (guard.expired() || connection->closed) {
+            return;
+        }
+        connection->closing = true;
+        if (connection->writeQueue.empty()) {
+            shutdown(connection);
+        }
+    });
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::ping(Handle hdl) {
+    sendFrame(hdl, WIRE_PING, nullptr, 0);
+}
+
+template <typename Protocol>
+size_t StreamTransport<Protocol>::bufferedAmount(Handle hdl) {
+    ConnectionPtr connection = std::static_pointer_cast<Connection>(hdl.lock());
+    return connection ? connection->queuedBytes : 0;
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::setTimer(std::chrono::milliseconds delay, std::function<void()> callback) {
+    auto timer = std::make_shared<boost::asio::steady_timer>(io, delay);
+    timer->async_wait([timer, guard = Guard(alive), callback](const boost::system::error_code& ec) {
+        if (!ec && !guard.expired()) {
+            callback();
+        }
+    });
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::post(std::function<void()> task) {
+    boost::asio::post(io, [guard = Guard(alive), task = std::move(task)]() {
+        if (!guard.expired()) {
+            task();
+        }
+    });
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::run() {
+    if (ownedIo) {
+        io.run();
+    }
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::stop() {
+    if (ownedIo) {
+        io.stop();
+        return;
+    }
+    boost::asio::dispatch(io, [this, guard = Guard(alive)]() {
+        if (!guard.expired()) {
+            closeAll();
+        }
+    });
+}
+
+template <typename Protocol>
+bool StreamTransport<Protocol>::resolve(const std::string& address, bool passive, typename Protocol::endpoint& endpoint) {
+    if constexpr (std::is_same_v<Protocol, boost::asio::ip::tcp>) {
+        std::string host;
+        std::string port;
+        splitHostPort(address, passive, host, port);
+
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::resolver resolver(io);
+        auto results = resolver.resolve(host, port, ec);
+        if (ec || results.empty()) {
+            CRYPTOLINK_LOG_ERROR("无法解析地址 " << address << ": " << ec.message());
+            return false;
+        }
+        endpoint = *results.begin();
+        return true;
+    } else {
+        (void)passive;
+        if (address.empty() || address.size() >= sizeof(sockaddr_un::sun_path)) {
+            CRYPTOLINK_LOG_WARNING("无效的套接字路径: " << address);
+            return false;
+        }
+        endpoint = typename Protocol::endpoint(address);
+        return true;
+    }
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::configureSocket(typename Protocol::socket& socket) {
+    if constexpr (std::is_same_v<Protocol, boost::asio::ip::tcp>) {
+        // 记录已经在应用层组好，不需要 Nagle 合并
+        boost::system::error_code ec;
+        socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+    } else {
+        (void)socket;
+    }
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::startAccept() {
+    ConnectionPtr connection = std::make_shared<Connection>(io);
+
+    acceptor.async_accept(connection->socket, [this, guard = Guard(alive), connection](const boost::system::error_code& ec) {
+        if (guard.expired() || ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        if (!ec) {
+            configureSocket(connection->socket);
+            connections.insert(connection);
+            startSession(connection);
+        }
+        startAccept();
+    });
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::startSession(const ConnectionPtr& connection) {
+    connection->open = true;
+    if (handlers.onOpen) {
+        handlers.onOpen(connection);
+    }
+    readHeader(connection);
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::readHeader(const ConnectionPtr& connection) {
+    boost::asio::async_read(connection->socket, boost::asio::buffer(connection->header, kFrameHeaderSize),
+        [this, guard = Guard(alive), connection](const boost::system::error_code& ec, size_t) {
+            if (guard.expired()) {
+                return;
+            }
+            if (ec) {
+                finish(connection);
+                return;
+            }
+
+            const uint8_t type = static_cast<uint8_t>(connection->header[0]);
+            size_t length = 0;
+            for (size_t i = 1; i < kFrameHeaderSize; ++i) {
+                length = (length << 8) | static_cast<uint8_t>(connection->header[i]);
+            }
+
+            if (length > kMaxMessageSize) {
+                CRYPTOLINK_LOG_WARNING("帧长度超出限制: " << length);
+                shutdown(connection);
+                return;
+            }
+            readPayload(connection, type, length);
+        });
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::readPayload(const ConnectionPtr& connection, uint8_t type, size_t length) {
+    // 接收缓冲区在连接内复用，记录层在其中原地解密
+    connection->payload.resize(length);
+    if (length == 0) {
+        dispatchFrame(connection, type);
+        return;
+    }
+
+    boost::asio::async_read(connection->socket, boost::asio::buffer(&connection->payload[0], length),
+        [this, guard = Guard(alive), connection, type](const boost::system::error_code& ec, size_t) {
+            if (guard.expired()) {
+                return;
+            }
+            if (ec) {
+                finish(connection);
+                return;
+            }
+            dispatchFrame(connection, type);
+        });
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::dispatchFrame(const ConnectionPtr& connection, uint8_t type) {
+    switch (type) {
+        case WIRE_TEXT:
+        case WIRE_BINARY:
+            if (handlers.onMessage) {
+                handlers.onMessage(connection, static_cast<FrameType>(type), connection->payload);
+            }
+            break;
+        case WIRE_PING:
+            sendFrame(connection, WIRE_PONG, nullptr, 0);
+            break;
+        case WIRE_PONG:
+            if (handlers.onPong) {
+                handlers.onPong(connection);
+            }
+            break;
+        default:
+            CRYPTOLINK_LOG_WARNING("未知的帧类型: " << static_cast<int>(type));
+            break;
+    }
+
+    if (!connection->closed) {
+        readHeader(connection);
+    }
+}
+
+template <typename Protocol>
+bool StreamTransport<Protocol>::sendFrame(Handle hdl, uint8_t type, const char* data, size_t length) {
+    ConnectionPtr connection = std::static_pointer_cast<Connection>(hdl.lock());
+    if (!connection || !connection->open || length > kMaxMessageSize) {
+        return false;
+    }
+
+    PooledBuffer frame = BufferPool::local().acquire(kFrameHeaderSize + length);
+    if (!frame) {
+        return false;
+    }
+    const char header[kFrameHeaderSize] = {
+        static_cast<char>(type),
+        static_cast<char>((length >> 24) & 0xff),
+        static_cast<char>((length >> 16) & 0xff),
+        static_cast<char>((length >> 8) & 0xff),
+        static_cast<char>(length & 0xff)
+    };
+    frame.append(header, kFrameHeaderSize);
+    if (length > 0) {
+        frame.append(data, length);
+    }
+
+    enqueue(connection, std::move(frame));
+    return true;
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::enqueue(const ConnectionPtr& connection, PooledBuffer frame) {
+    // 在事件循环线程上直接入队，其他线程投递到事件循环
+    boost::asio::dispatch(io, [this, guard = Guard(alive), connection, frame = std::move(frame)]() mutable {
+        if (guard.expired() || connection->closed || connection->closing) {
+            return;
+        }
+        bool idle = connection->writeQueue.empty();
+        connection->queuedBytes += frame.size();
+        connection->writeQueue.push_back(std::move(frame));
+        if (idle) {
+            startWrite(connection);
+        }
+    });
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::startWrite(const ConnectionPtr& connection) {
+    // 把排队的帧合并成一次 writev
+    std::vector<boost::asio::const_buffer> buffers;
+    size_t count = std::min(connection->writeQueue.size(), kMaxGatherFrames);
+    buffers.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const PooledBuffer& frame = connection->writeQueue[i];
+        buffers.emplace_back(frame.data(), frame.size());
+    }
+
+    boost::asio::async_write(connection->socket, buffers,
+        [this, guard = Guard(alive), connection, count](const boost::system::error_code& ec, size_t) {
+            if (guard.expired()) {
+                return;
+            }
+            if (ec) {
+                finish(connection);
+                return;
+            }
+
+            for (size_t i = 0; i < count; ++i) {
+                connection->queuedBytes -= connection->writeQueue[i].size();
+            }
+            connection->writeQueue.erase(connection->writeQueue.begin(), connection->writeQueue.begin() + count);
+            if (!connection->writeQueue.empty()) {
+                startWrite(connection);
+            } else if (connection->closing) {
+                shutdown(connection);
+            }
+        });
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::shutdown(const ConnectionPtr& connection) {
+    boost::system::error_code ec;
+    connection->socket.shutdown(Protocol::socket::shutdown_both, ec);
+    finish(connection);
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::finish(const ConnectionPtr& connection) {
+    if (connection->closed) {
+        return;
+    }
+    connection->closed = true;
+
+    bool wasOpen = connection->open.exchange(false);
+
+    boost::system::error_code ec;
+    connection->socket.close(ec);
+    connections.erase(connection);
+
+    if (wasOpen) {
+        if (handlers.onClose) {
+            handlers.onClose(connection);
+        }
+    } else if (handlers.onFail) {
+        handlers.onFail(connection);
+    }
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::closeAll() {
+    // 之前投递的任务、定时器和异步操作的回调一律不再执行，与独占事件循环时 stop 的效果一致
+    alive = std::make_shared<bool>(true);
+
+    boost::system::error_code ec;
+    acceptor.close(ec);
+    for (const ConnectionPtr& connection : connections) {
+        connection->closed = true;
+        connection->open = false;
+        connection->connectTimer.cancel();
+        connection->socket.close(ec);
+    }
+    connections.clear();
+}
+
+template class StreamTransport<boost::asio::ip::tcp>;
+template class StreamTransport<boost::asio::local::stream_protocol>;
@@ -0,0 +1,116 @@
+#include "TimerWheel.h"
+#include <algorithm>
+#include <vector>
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tickInterval)
+    : tickInterval(std::max(tickInterval, std::chrono::milliseconds(1))),
+      startTime(std::chrono::steady_clock::now()),
+      currentTick(0),
+      nextTimerId(1) {
+}
+
+TimerWheel::TimerId TimerWheel::schedule(std::chrono::milliseconds delay, Callback callback) {
+    // 向上取整到刻度，至少一个刻度；超过时间轮范围的延迟截断到最大值
+    const uint64_t maxTicks = (uint64_t(1) << (kSlotBits * kLevels)) - 1;
+    uint64_t ticks = delay.count() <= 0 ? 1 : (delay.count() + tickInterval.count() - 1) / tickInterval.count();
+    ticks = std::min(std::max<uint64_t>(ticks, 1), maxTicks);
+
+    TimerId id = nextTimerId++;
+    Timer& timer = timers[id];
+    timer.expiry = currentTick + ticks;
+    timer.callback = std::move(callback);
+    place(id, timer);
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    auto it = timers.find(id);
+    if (it == timers.end()) {
+        return false;
+    }
+
+    it->second.slot->erase(it->second.position);
+    timers.erase(it);
+    return true;
+}
+
+size_t TimerWheel::advance(std::chrono::steady_clock::time_point now) {
+    if (now < startTime) {
+        return 0;
+    }
+
+    uint64_t targetTick = std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count() / tickInterval.count();
+    size_t fired = 0;
+
+    while (currentTick < targetTick) {
+        // 没有挂起的定时器时直接跳到目标刻度
+        if (timers.empty()) {
+            currentTick = targetTick;
+            break;
+        }
+
+        ++currentTick;
+
+        // 从高层到低层依次把进入当前窗口的定时器降级
+        for (int level = kLevels - 1; level > 0; --level) {
+            uint64_t mask = (uint64_t(1) << (kSlotBits * level)) - 1;
+            if ((currentTick & mask) == 0) {
+                cascade(level);
+            }
+        }
+
+        fired += fireCurrentSlot();
+    }
+    return fired;
+}
+
+void TimerWheel::place(TimerId id, Timer& timer) {
+    uint64_t delta = timer.expiry > currentTick ? timer.expiry - currentTick : 0;
+
+    int level = 0;
+    while (level < kLevels - 1 && delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+        ++level;
+    }
+
+    size_t index = (timer.expiry >> (kSlotBits * level)) & (kSlotsPerLevel - 1);
+    std::list<TimerId>& slot = slots[level][index];
+    timer.slot = &slot;
+    timer.position = slot.insert(slot.end(), id);
+}
+
+void TimerWheel::cascade(int level) {
+    size_t index = (currentTick >> (kSlotBits * level)) & (kSlotsPerLevel - 1);
+
+    std::list<TimerId> pending;
+    pending.swap(slots[level][index]);
+
+    for (TimerId id : pending) {
+        auto it = timers.find(id);
+        if (it != timers.end()) {
+            place(id, it->second);
+        }
+    }
+}
+
+size_t TimerWheel::fireCurrentSlot() {
+    std::list<TimerId>& slot = slots[0][currentTick & (kSlotsPerLevel - 1)];
+    if (slot.empty()) {
+        return 0;
+    }
+
+    // 先把到期的回调取出来再执行，回调里可以安全地添加或取消定时器
+    std::vector<Callback> expired;
+    for (TimerId id : slot) {
+        auto it = timers.find(id);
+        if (it != timers.end()) {
+            expired.push_back(std::move(it->second.callback));
+            timers.erase(it);
+        }
+    }
+    slot.clear();
+
+    for (auto& callback : expired) {
+        callback();
+    }
+    return expired.size();
+}
@@ -0,0 +1,268 @@
+#include "TopicIndex.h"
+#include <algorithm>
+
+TopicIndex::TopicIndex() : wildcardRoot(std::make_unique<Node>()), totalSubscriptions(0) {
+}
+
+TopicIndex::~TopicIndex() = default;
+
+bool TopicIndex::subscribe(SubscriberId subscriber, const std::string& pattern) {
+    if (!isValidPattern(pattern)) {
+        return false;
+    }
+
+    std::vector<SubscriberId>* slot = hasWildcard(pattern)
+        ? wildcardSlot(pattern, true)
+        : &exactSubscriptions[pattern];
+
+    if (std::find(slot->begin(), slot->end(), subscriber) != slot->end()) {
+        return false;
+    }
+
+    slot->push_back(subscriber);
+    subscriptionsBySubscriber[subscriber].push_back(pattern);
+    ++totalSubscriptions;
+    return true;
+}
+
+bool TopicIndex::unsubscribe(SubscriberId subscriber, const std::string& pattern) {
+    // 非法模式不可能被订阅过，不能按分段去查前缀树（"a/#/x" 会落到 "a/#" 上）
+    if (!isValidPattern(pattern)) {
+        return false;
+    }
+
+    bool wildcard = hasWildcard(pattern);
+    std::vector<SubscriberId>* slot = nullptr;
+
+    if (wildcard) {
+        slot = wildcardSlot(pattern, false);
+    } else {
+        auto it = exactSubscriptions.find(pattern);
+        if (it != exactSubscriptions.end()) {
+            slot = &it->second;
+        }
+    }
+
+    if (!slot) {
+        return false;
+    }
+
+    auto found = std::find(slot->begin(), slot->end(), subscriber);
+    if (found == slot->end()) {
+        return false;
+    }
+
+    // 订阅者列表很短，用末尾元素覆盖即可
+    *found = slot->back();
+    slot->pop_back();
+    --totalSubscriptions;
+
+    if (slot->empty()) {
+        if (wildcard) {
+            prunePath(wildcardRoot.get(), splitSegments(pattern), 0);
+        } else {
+            exactSubscriptions.erase(pattern);
+        }
+    }
+
+    auto subscriberIt = subscriptionsBySubscriber.find(subscriber);
+    if (subscriberIt != subscriptionsBySubscriber.end()) {
+        auto& patterns = subscriberIt->second;
+        auto patternIt = std::find(patterns.begin(), patterns.end(), pattern);
+        if (patternIt != patterns.end()) {
+            patterns.erase(patternIt);
+        }
+        if (patterns.empty()) {
+            subscriptionsBySubscriber.erase(subscriberIt);
+        }
+    }
+    return true;
+}
+
+void TopicIndex::removeSubscriber(SubscriberId subscriber) {
+    auto it = subscriptionsBySubscriber.find(subscriber);
+    if (it == subscriptionsBySubscriber.end()) {
+        return;
+    }
+
+    // 拷贝一份，unsubscribe 会修改原列表
+    std::vector<std::string> patterns = it->second;
+    for (const auto& pattern : patterns) {
+        unsubscribe(subscriber, pattern);
+    }
+}
+
+void TopicIndex::match(std::string_view topic, std::vector<SubscriberId>& subscribers) const {
+    auto exactIt = exactSubscriptions.find(std::string(topic));
+    if (exactIt != exactSubscriptions.end()) {
+        subscribers.insert(subscribers.end(), exactIt->second.begin(), exactIt->second.end());
+    }
+
+    const Node* root = wildcardRoot.get();
+    if (root->children.empty() && !root->singleLevel && root->multiLevel.empty()) {
+        return;
+    }
+
+    size_t before = subscribers.size();
+    collectMatches(root, splitSegments(topic), 0, subscribers);
+
+    // 同一订阅者可能通过多个模式匹配，只有通配符命中时才需要去重
+    if (subscribers.size() != before) {
+        std::sort(subscribers.begin(), subscribers.end());
+        subscribers.erase(std::unique(subscribers.begin(), subscribers.end()), subscribers.end());
+    }
+}
+
+std::vector<std::string> TopicIndex::getSubscriptions(SubscriberId subscriber) const {
+    auto it = subscriptionsBySubscriber.find(subscriber);
+    if (it == subscriptionsBySubscriber.end()) {
+        return {};
+    }
+    return it->second;
+}
+
+bool TopicIndex::isValidPattern(const std::string& pattern) {
+    if (pattern.empty()) {
+        return false;
+    }
+
+    std::vector<std::string_view> segments = splitSegments(pattern);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        std::string_view segment = segments[i];
+        if (segment == "#") {
+            if (i != segments.size() - 1) {
+                return false;
+            }
+        } else if (segment != "+" &&
+                   (segment.find('+') != std::string_view::npos || segment.find('#') != std::string_view::npos)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TopicIndex::isValidTopic(std::string_view topic) {
+    return !topic.empty() && topic.find_first_of("+#") == std::string_view::npos;
+}
+
+PooledBuffer TopicIndex::encodePublication(std::string_view topic, std::string_view message, BufferPool& pool) {
+    if (topic.size() > 0xffff) {
+        return PooledBuffer();
+    }
+
+    PooledBuffer payload = pool.acquire(2 + topic.size() + message.size());
+    const char lengthBytes[2] = {
+        static_cast<char>((topic.size() >> 8) & 0xff),
+        static_cast<char>(topic.size() & 0xff)
+    };
+    payload.append(lengthBytes, 2);
+    payload.append(topic.data(), topic.size());
+    payload.append(message.data(), message.size());
+    return payload;
+}
+
+bool TopicIndex::decodePublication(std::string_view payload, std::string_view& topic, std::string_view& message) {
+    if (payload.size() < 2) {
+        return false;
+    }
+
+    size_t topicLength = (static_cast<uint8_t>(payload[0]) << 8) | static_cast<uint8_t>(payload[1]);
+    if (payload.size() < 2 + topicLength) {
+        return false;
+    }
+
+    topic = payload.substr(2, topicLength);
+    message = payload.substr(2 + topicLength);
+    return true;
+}
+
+bool TopicIndex::hasWildcard(const std::string& pattern) {
+    return pattern.find_first_of("+#") != std::string::npos;
+}
+
+std::vector<std::string_view> TopicIndex::splitSegments(std::string_view text) {
+    std::vector<std::string_view> segments;
+    size_t start = 0;
+
+    while (true) {
+        size_t slash = text.find('/', start);
+        if (slash == std::string_view::npos) {
+            segments.push_back(text.substr(start));
+            break;
+        }
+        segments.push_back(text.substr(start, slash - start));
+        start = slash + 1;
+    }
+    return segments;
+}
+
+std::vector<TopicIndex::SubscriberId>* TopicIndex::wildcardSlot(const std::string& pattern, bool create) {
+    Node* node = wildcardRoot.get();
+
+    for (std::string_view segment : splitSegments(pattern)) {
+        if (segment == "#") {
+            return &node->multiLevel;
+        }
+
+        std::unique_ptr<Node>* next = nullptr;
+        if (segment == "+") {
+            next = &node->singleLevel;
+        } else {
+            auto it = node->children.find(segment);
+            if (it != node->children.end()) {
+                next = &it->second;
+            } else if (create) {
+                next = &node->children[std::string(segment)];
+            } else {
+                return nullptr;
+            }
+        }
+
+        if (!*next) {
+            if (!create) {
+                return nullptr;
+            }
+            *next = std::make_unique<Node>();
+        }
+        node = next->get();
+    }
+    return &node->subscribers;
+}
+
+void TopicIndex::collectMatches(const Node* node, const std::vector<std::string_view>& segments, size_t depth,
+                                std::vector<SubscriberId>& subscribers) const {
+    // '#' 匹配剩余的全部分段（包括零个）
+    subscribers.insert(subscribers.end(), node->multiLevel.begin(), node->multiLevel.end());
+
+    if (depth == segments.size()) {
+        subscribers.insert(subscribers.end(), node->subscribers.begin(), node->subscribers.end());
+        return;
+    }
+
+    auto it = node->children.find(segments[depth]);
+    if (it != node->children.end()) {
+        collectMatches(it->second.get(), segments, depth + 1, subscribers);
+    }
+    if (node->singleLevel) {
+        collectMatches(node->singleLevel.get(), segments, depth + 1, subscribers);
+    }
+}
+
+bool TopicIndex::prunePath(Node* node, const std::vector<std::string_view>& segments, size_t depth) {
+    // 只沿着被取消的模式路径回收空节点
+    if (depth < segments.size() && segments[depth] != "#") {
+        if (segments[depth] == "+") {
+            if (node->singleLevel && prunePath(node->singleLevel.get(), segments, depth + 1)) {
+                node->singleLevel.reset();
+            }
+        } else {
+            auto it = node->children.find(segments[depth]);
+            if (it != node->children.end() && prunePath(it->second.get(), segments, depth + 1)) {
+                node->children.erase(it);
+            }
+        }
+    }
+
+    return node->children.empty() && !node->singleLevel &&
+           node->multiLevel.empty() && node->subscribers.empty();
+}
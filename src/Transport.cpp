@@ -0,0 +1,57 @@
+#include "Transport.h"
+#include "Logger.h"
+#include "StreamTransport.h"
+#include "UringTransport.h"
+#include "WebSocketTransport.h"
+
+std::unique_ptr<Transport> Transport::create(const std::string& uri, bool server, std::string& address,
+                                             boost::asio::io_context* loop) {
+    size_t schemeEnd = uri.find("://");
+    std::string scheme = schemeEnd == std::string::npos ? "ws" : uri.substr(0, schemeEnd);
+    std::string rest = schemeEnd == std::string::npos ? uri : uri.substr(schemeEnd + 3);
+
+    if (scheme == "tcp") {
+        address = rest;
+        return std::make_unique<TcpTransport>(loop);
+    }
+    if (scheme == "unix") {
+        address = rest;
+        return std::make_unique<UnixSocketTransport>(loop);
+    }
+    if (scheme == "uring+tcp" || scheme == "uring+unix") {
+        address = rest;
+        bool unixSocket = scheme == "uring+unix";
+#ifdef CRYPTOLINK_HAVE_IO_URING
+        // io_uring 后端有自己的事件循环，不能运行在共享的 asio 循环上
+        if (!loop) {
+            std::unique_ptr<Transport> transport =
+                UringTransport::create(unixSocket ? UringTransport::Family::UNIX : UringTransport::Family::TCP);
+            if (transport) {
+                return transport;
+            }
+        }
+#endif
+        // 内核或编译环境不支持 io_uring（或使用共享事件循环）时使用基于 epoll 的实现，帧格式相同
+        if (loop) {
+            CRYPTOLINK_LOG_INFO("共享事件循环不支持 io_uring，使用 epoll");
+        } else {
+            CRYPTOLINK_LOG_WARNING("io_uring 不可用，回退到 epoll");
+        }
+        if (unixSocket) {
+            return std::make_unique<UnixSocketTransport>(loop);
+        }
+        return std::make_unique<TcpTransport>(loop);
+    }
+    if (scheme == "ws") {
+        if (server) {
+            // 服务端只需要监听地址，去掉路径部分
+            address = rest.substr(0, rest.find('/'));
+            return std::make_unique<WebSocketServerTransport>(loop);
+        }
+        address = "ws://" + rest;
+        return std::make_unique<WebSocketClientTransport>(loop);
+    }
+
+    CRYPTOLINK_LOG_ERROR("不支持的传输协议: " << scheme);
+    return nullptr;
+}
@@ -0,0 +1,864 @@
+#include "UringTransport.h"
+#include "Logger.h"
+
+#ifdef CRYPTOLINK_HAVE_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace {
+
+const unsigned kQueueDepth = 4096;
+
+// 多发 recv 的缓冲区环：数量必须是 2 的幂
+const int kRecvBufferGroup = 0;
+const unsigned kRecvBufferCount = 1024;
+const size_t kRecvBufferSize = 16 * 1024;
+
+// 固定发送缓冲区：小帧合并到一个槽里用一次 send 发出
+const size_t kSendSlotCount = 64;
+const size_t kSendSlotSize = 64 * 1024;
+
+const size_t kMaxGatherFrames = 64;
+
+// 半帧缓冲区消费超过这个量才整理，避免每次都搬移
+const size_t kCompactThreshold = 64 * 1024;
+
+// multishot recv 和缓冲区环需要 Linux 6.0 及以上
+bool kernelSupportsMultishotRecv() {
+    utsname info;
+    if (uname(&info) != 0) {
+        return false;
+    }
+    int major = 0;
+    int minor = 0;
+    if (std::sscanf(info.release, "%d.%d", &major, &minor) != 2) {
+        return false;
+    }
+    return major >= 6;
+}
+
+}
+
+std::unique_ptr<UringTransport> UringTransport::create(Family family) {
+    if (!kernelSupportsMultishotRecv()) {
+        return nullptr;
+    }
+
+    std::unique_ptr<UringTransport> transport(new UringTransport(family));
+    if (!transport->initialize()) {
+        return nullptr;
+    }
+    return transport;
+}
+
+UringTransport::UringTransport(Family family)
+    : family(family),
+      ringReady(false),
+      recvRing(nullptr),
+      sendArenaRegistered(false),
+      fixedSendSupported(false),
+      listenFd(-1),
+      wakeFd(-1),
+      wakeValue(0),
+      nextConnectionId(1),
+      nextTimerSequence(0),
+      wakeRequested(false),
+      running(false) {
+    std::memset(&ring, 0, sizeof(ring));
+}
+
+UringTransport::~UringTransport() {
+    for (auto& pair : connections) {
+        if (pair.second->fd >= 0) {
+            ::close(pair.second->fd);
+        }
+    }
+    connections.clear();
+
+    if (listenFd >= 0) {
+        ::close(listenFd);
+    }
+    if (!listenPath.empty()) {
+        ::unlink(listenPath.c_str());
+    }
+    if (recvRing) {
+        io_uring_free_buf_ring(&ring, recvRing, kRecvBufferCount, kRecvBufferGroup);
+    }
+    if (sendArenaRegistered) {
+        io_uring_unregister_buffers(&ring);
+    }
+    if (ringReady) {
+        io_uring_queue_exit(&ring);
+    }
+    if (wakeFd >= 0) {
+        ::close(wakeFd);
+    }
+}
+
+bool UringTransport::initialize() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+
+    int ret = io_uring_queue_init_params(kQueueDepth, &ring, &params);
+    if (ret == -EINVAL) {
+        std::memset(&params, 0, sizeof(params));
+        ret = io_uring_queue_init_params(kQueueDepth, &ring, &params);
+    }
+    if (ret < 0) {
+        CRYPTOLINK_LOG_ERROR("io_uring 初始化失败: " << std::strerror(-ret));
+        return false;
+    }
+    ringReady = true;
+
+    // 接收缓冲区交给内核管理，多发 recv 每次完成时从环里取一个
+    recvBuffers.resize(kRecvBufferCount * kRecvBufferSize);
+    int error = 0;
+    recvRing = io_uring_setup_buf_ring(&ring, kRecvBufferCount, kRecvBufferGroup, 0, &error);
+    if (!recvRing) {
+        CRYPTOLINK_LOG_ERROR("io_uring 缓冲区环注册失败: " << std::strerror(-error));
+        return false;
+    }
+    const int mask = io_uring_buf_ring_mask(kRecvBufferCount);
+    for (unsigned i = 0; i < kRecvBufferCount; ++i) {
+        io_uring_buf_ring_add(recvRing, &recvBuffers[i * kRecvBufferSize], kRecvBufferSize, i, mask, i);
+    }
+    io_uring_buf_ring_advance(recvRing, kRecvBufferCount);
+
+    // 发送缓冲区注册失败（例如 RLIMIT_MEMLOCK 不够）时退化为普通 sendmsg
+    sendArena.resize(kSendSlotCount * kSendSlotSize);
+    iovec arena = {sendArena.data(), sendArena.size()};
+    sendArenaRegistered = io_uring_register_buffers(&ring, &arena, 1) == 0;
+    fixedSendSupported = sendArenaRegistered;
+    for (size_t i = 0; i < kSendSlotCount; ++i) {
+        freeSendSlots.push_back(static_cast<int>(kSendSlotCount - 1 - i));
+    }
+
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        CRYPTOLINK_LOG_ERROR("eventfd 创建失败: " << std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void UringTransport::setHandlers(Handlers handlers) {
+    this->handlers = std::move(handlers);
+}
+
+bool UringTransport::listen(const std::string& address) {
+    sockaddr_storage storage;
+    socklen_t length = 0;
+    if (!resolve(address, true, storage, length)) {
+        return false;
+    }
+
+    int fd = ::socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        CRYPTOLINK_LOG_ERROR("创建套接字失败: " << std::strerror(errno));
+        return false;
+    }
+
+    if (family == Family::TCP) {
+        int one = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    } else {
+        // 清理上次运行遗留的套接字文件
+        ::unlink(address.c_str());
+        listenPath = address;
+    }
+
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&storage), length) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        CRYPTOLINK_LOG_ERROR("监听 " << address << " 失败: " << std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    listenFd = fd;
+    armAccept();
+    return true;
+}
+
+bool UringTransport::connect(const std::string& address) {
+    ConnectionPtr connection = std::make_shared<Connection>();
+    if (!resolve(address, false, connection->peer, connection->peerLength)) {
+        return false;
+    }
+
+    connection->fd = ::socket(connection->peer.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection->fd < 0) {
+        CRYPTOLINK_LOG_ERROR("创建套接字失败: " << std::strerror(errno));
+        return false;
+    }
+    connection->id = nextConnectionId++;
+    connections[connection->id] = connection;
+
+    io_uring_sqe* sqe = getSqe();
+    io_uring_prep_connect(sqe, connection->fd, reinterpret_cast<sockaddr*>(&connection->peer), connection->peerLength);
+    io_uring_sqe_set_data64(sqe, userData(OP_CONNECT, connection->id));
+    ++connection->pendingOps;
+    return true;
+}
+
+bool UringTransport::send(Handle hdl, const char* data, size_t length, FrameType type) {
+    return sendFrame(hdl, static_cast<uint8_t>(type), data, length);
+}
+
+void UringTransport::close(Handle hdl, uint16_t, const std::string&) {
+    ConnectionPtr connection = std::static_pointer_cast<Connection>(hdl.lock());
+    if (!connection) {
+        return;
+    }
+
+    if (std::this_thread::get_id() == loopThread.load()) {
+        beginClose(connection);
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(inboxMutex);
+            pendingCloses.push_back(connection);
+        }
+        wake();
+    }
+}
+
+void UringTransport::ping(Handle hdl) {
+    sendFrame(hdl, WIRE_PING, nullptr, 0);
+}
+
+size_t UringTransport::bufferedAmount(Handle hdl) {
+    ConnectionPtr connection = std::static_pointer_cast<Connection>(hdl.lock());
+    return connection ? connection->queuedBytes : 0;
+}
+
+void UringTransport::setTimer(std::chrono::milliseconds delay, std::function<void()> callback) {
+    {
+        std::lock_guard<std::mutex> lock(inboxMutex);
+        timers.push({std::chrono::steady_clock::now() + delay, nextTimerSequence++, std::move(callback)});
+    }
+    if (std::this_thread::get_id() != loopThread.load()) {
+        wake();
+    }
+}
+
+void UringTransport::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(inboxMutex);
+        pendingTasks.push_back(std::move(task));
+    }
+    wake();
+}
+
+void UringTransport::run() {
+    loopThread = std::this_thread::get_id();
+    running = true;
+    armWake();
+
+    while (running) {
+        drainInbox();
+        int timeoutMs = runTimers();
+
+        // 一次系统调用同时提交本轮积累的全部请求并等待完成事件
+        __kernel_timespec timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+
+        io_uring_cqe* cqe = nullptr;
+        int ret = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, timeoutMs >= 0 ? &timeout : nullptr, nullptr);
+        if (ret < 0 && ret != -ETIME && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            CRYPTOLINK_LOG_ERROR("io_uring 等待失败: " << std::strerror(-ret));
+            break;
+        }
+
+        unsigned head;
+        unsigned count = 0;
+        io_uring_for_each_cqe(&ring, head, cqe) {
+            handleCompletion(cqe);
+            ++count;
+        }
+        io_uring_cq_advance(&ring, count);
+    }
+
+    loopThread = std::thread::id();
+}
+
+void UringTransport::stop() {
+    running = false;
+    wake();
+}
+
+io_uring_sqe* UringTransport::getSqe() {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    if (!sqe) {
+        // 提交队列满了，先把已有的请求交给内核
+        io_uring_submit(&ring);
+        sqe = io_uring_get_sqe(&ring);
+    }
+    return sqe;
+}
+
+bool UringTransport::resolve(const std::string& address, bool passive, sockaddr_storage& storage, socklen_t& length) {
+    std::memset(&storage, 0, sizeof(storage));
+
+    if (family == Family::UNIX) {
+        sockaddr_un* unixAddress = reinterpret_cast<sockaddr_un*>(&storage);
+        if (address.empty() || address.size() >= sizeof(unixAddress->sun_path)) {
+            CRYPTOLINK_LOG_WARNING("无效的套接字路径: " << address);
+            return false;
+        }
+        unixAddress->sun_family = AF_UNIX;
+        std::memcpy(unixAddress->sun_path, address.c_str(), address.size() + 1);
+        length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + address.size() + 1);
+        return true;
+    }
+
+    // 地址为 port 或 host:port
+    size_t colonPos = address.rfind(':');
+    std::string host = colonPos == std::string::npos ? (passive ? "0.0.0.0" : "127.0.0.1") : address.substr(0, colonPos);
+    std::string port = colonPos == std::string::npos ? address : address.substr(colonPos + 1);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    addrinfo* results = nullptr;
+    int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &results);
+    if (ret != 0 || !results) {
+        CRYPTOLINK_LOG_ERROR("无法解析地址 " << address << ": " << gai_strerror(ret));
+        return false;
+    }
+    std::memcpy(&storage, results->ai_addr, results->ai_addrlen);
+    length = results->ai_addrlen;
+    freeaddrinfo(results);
+    return true;
+}
+
+void UringTransport::configureSocket(int fd) {
+    if (family == Family::TCP) {
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+}
+
+void UringTransport::armAccept() {
+    io_uring_sqe* sqe = getSqe();
+    io_uring_prep_multishot_accept(sqe, listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(sqe, userData(OP_ACCEPT, 0));
+}
+
+void UringTransport::armRecv(const ConnectionPtr& connection) {
+    io_uring_sqe* sqe = getSqe();
+    io_uring_prep_recv_multishot(sqe, connection->fd, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kRecvBufferGroup;
+    io_uring_sqe_set_data64(sqe, userData(OP_RECV, connection->id));
+    ++connection->pendingOps;
+}
+
+void UringTransport::armWake() {
+    io_uring_sqe* sqe = getSqe();
+    io_uring_prep_read(sqe, wakeFd, &wakeValue, sizeof(wakeValue), 0);
+    io_uring_sqe_set_data64(sqe, userData(OP_WAKE, 0));
+}
+
+void UringTransport::wake() {
+    // 事件循环处理前只写一次 eventfd
+    if (!wakeRequested.exchange(true)) {
+        uint64_t one = 1;
+        ssize_t written = ::write(wakeFd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void UringTransport::recycleBuffer(unsigned bufferId) {
+    io_uring_buf_ring_add(recvRing, &recvBuffers[bufferId * kRecvBufferSize], kRecvBufferSize, bufferId,
+                          io_uring_buf_ring_mask(kRecvBufferCount), 0);
+    io_uring_buf_ring_advance(recvRing, 1);
+}
+
+void UringTransport::handleCompletion(io_uring_cqe* cqe) {
+    const uint64_t data = io_uring_cqe_get_data64(cqe);
+    const Operation op = static_cast<Operation>(data >> 56);
+    const uint64_t id = data & ((uint64_t(1) << 56) - 1);
+
+    if (op == OP_WAKE) {
+        wakeRequested = false;
+        if (running) {
+            armWake();
+        }
+        return;
+    }
+    if (op == OP_ACCEPT) {
+        handleAccept(cqe);
+        return;
+    }
+
+    auto it = connections.find(id);
+    if (it == connections.end()) {
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            recycleBuffer(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        return;
+    }
+    ConnectionPtr connection = it->second;
+
+    switch (op) {
+        case OP_CONNECT:
+            --connection->pendingOps;
+            if (cqe->res < 0) {
+                CRYPTOLINK_LOG_WARNING("连接失败: " << std::strerror(-cqe->res));
+                finish(connection);
+            } else {
+                configureSocket(connection->fd);
+                startSession(connection);
+            }
+            break;
+        case OP_RECV:
+            handleRecv(connection, cqe);
+            break;
+        case OP_SEND:
+            --connection->pendingOps;
+            handleSend(connection, cqe->res);
+            break;
+        default:
+            break;
+    }
+
+    // 连接关闭后等所有在途请求完成才释放描述符
+    if (connection->closed && connection->pendingOps == 0) {
+        release(connection);
+    }
+}
+
+void UringTransport::handleAccept(io_uring_cqe* cqe) {
+    if (cqe->res >= 0) {
+        ConnectionPtr connection = std::make_shared<Connection>();
+        connection->id = nextConnectionId++;
+        connection->fd = cqe->res;
+        connections[connection->id] = connection;
+        configureSocket(connection->fd);
+        startSession(connection);
+    } else if (cqe->res != -ECANCELED) {
+        CRYPTOLINK_LOG_WARNING("接受连接失败: " << std::strerror(-cqe->res));
+    }
+
+    // 多发 accept 被内核终止时重新投递
+    if (!(cqe->flags & IORING_CQE_F_MORE) && listenFd >= 0 && running) {
+        armAccept();
+    }
+}
+
+void UringTransport::handleRecv(const ConnectionPtr& connection, io_uring_cqe* cqe) {
+    const bool more = cqe->flags & IORING_CQE_F_MORE;
+    if (!more) {
+        --connection->pendingOps;
+    }
+
+    const int result = cqe->res;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned bufferId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (result > 0 && !connection->closed) {
+            consume(connection, &recvBuffers[bufferId * kRecvBufferSize], static_cast<size_t>(result));
+        }
+        recycleBuffer(bufferId);
+    }
+
+    if (connection->closed) {
+        return;
+    }
+    if (result == 0) {
+        finish(connection);
+        return;
+    }
+    if (result < 0 && result != -ENOBUFS) {
+        finish(connection);
+        return;
+    }
+    if (!more) {
+        armRecv(connection);
+    }
+}
+
+void UringTransport::startSession(const ConnectionPtr& connection) {
+    connection->open = true;
+    if (handlers.onOpen) {
+        handlers.onOpen(connection);
+    }
+    if (!connection->closed) {
+        armRecv(connection);
+    }
+}
+
+void UringTransport::consume(const ConnectionPtr& connection, const char* data, size_t length) {
+    // 没有残留半帧时直接在接收缓冲区里切帧，只把尾部的半帧拷出来
+    if (connection->inboundOffset == connection->inbound.size()) {
+        connection->inbound.clear();
+        connection->inboundOffset = 0;
+
+        size_t used = parseFrames(connection, data, length);
+        if (!connection->closed && used < length) {
+            connection->inbound.append(data + used, length - used);
+        }
+        return;
+    }
+
+    connection->inbound.append(data, length);
+    connection->inboundOffset += parseFrames(connection,
+                                             connection->inbound.data() + connection->inboundOffset,
+                                             connection->inbound.size() - connection->inboundOffset);
+
+    if (connection->inboundOffset == connection->inbound.size()) {
+        connection->inbound.clear();
+        connection->inboundOffset = 0;
+    } else if (connection->inboundOffset > kCompactThreshold) {
+        connection->inbound.erase(0, connection->inboundOffset);
+        connection->inboundOffset = 0;
+    }
+}
+
+size_t UringTransport::parseFrames(const ConnectionPtr& connection, const char* data, size_t length) {
+    size_t offset = 0;
+    while (!connection->closed && length - offset >= kFrameHeaderSize) {
+        const uint8_t type = static_cast<uint8_t>(data[offset]);
+        size_t frameLength = 0;
+        for (size_t i = 1; i < kFrameHeaderSize; ++i) {
+            frameLength = (frameLength << 8) | static_cast<uint8_t>(data[offset + i]);
+        }
+
+        if (frameLength > kMaxMessageSize) {
+            CRYPTOLINK_LOG_WARNING("帧长度超出限制: " << frameLength);
+            shutdown(connection);
+            return length;
+        }
+        if (length - offset - kFrameHeaderSize < frameLength) {
+            break;
+        }
+
+        // 负载拷到连接自己的缓冲区，接收缓冲区可以马上还给内核
+        connection->payload.assign(data + offset + kFrameHeaderSize, frameLength);
+        offset += kFrameHeaderSize + frameLength;
+        dispatchFrame(connection, type);
+    }
+    return offset;
+}
+
+void UringTransport::dispatchFrame(const ConnectionPtr& connection, uint8_t type) {
+    switch (type) {
+        case WIRE_TEXT:
+        case WIRE_BINARY:
+            if (handlers.onMessage) {
+                handlers.onMessage(connection, static_cast<FrameType>(type), connection->payload);
+            }
+            break;
+        case WIRE_PING:
+            sendFrame(connection, WIRE_PONG, nullptr, 0);
+            break;
+        case WIRE_PONG:
+            if (handlers.onPong) {
+                handlers.onPong(connection);
+            }
+            break;
+        default:
+            CRYPTOLINK_LOG_WARNING("未知的帧类型: " << static_cast<int>(type));
+            break;
+    }
+}
+
+bool UringTransport::sendFrame(Handle hdl, uint8_t type, const char* data, size_t length) {
+    ConnectionPtr connection = std::static_pointer_cast<Connection>(hdl.lock());
+    if (!connection || !connection->open || length > kMaxMessageSize) {
+        return false;
+    }
+
+    PooledBuffer frame = BufferPool::local().acquire(kFrameHeaderSize + length);
+    if (!frame) {
+        return false;
+    }
+    const char header[kFrameHeaderSize] = {
+        static_cast<char>(type),
+        static_cast<char>((length >> 24) & 0xff),
+        static_cast<char>((length >> 16) & 0xff),
+        static_cast<char>((length >> 8) & 0xff),
+        static_cast<char>(length & 0xff)
+    };
+    frame.append(header, kFrameHeaderSize);
+    if (length > 0) {
+        frame.append(data, length);
+    }
+
+    enqueue(connection, std::move(frame));
+    return true;
+}
+
+void UringTransport::enqueue(const ConnectionPtr& connection, PooledBuffer frame) {
+    if (std::this_thread::get_id() == loopThread.load()) {
+        if (connection->closed || connection->closing) {
+            return;
+        }
+        connection->queuedBytes += frame.size();
+        connection->writeQueue.push_back(std::move(frame));
+        startWrite(connection);
+        return;
+    }
+
+    // 其他线程的发送先放进收件箱，由事件循环在下一轮一起提交
+    {
+        std::lock_guard<std::mutex> lock(inboxMutex);
+        pendingSends.emplace_back(connection, std::move(frame));
+    }
+    wake();
+}
+
+void UringTransport::startWrite(const ConnectionPtr& connection) {
+    if (connection->writing || connection->closed || connection->writeQueue.empty()) {
+        return;
+    }
+
+    connection->writtenBytes = 0;
+    connection->inflightFrames = 0;
+    connection->inflightBytes = 0;
+
+    const PooledBuffer& first = connection->writeQueue.front();
+    if (first.size() <= kSendSlotSize && !freeSendSlots.empty()) {
+        // 小帧合并拷贝到固定缓冲区
+        connection->sendSlot = freeSendSlots.back();
+        freeSendSlots.pop_back();
+
+        char* base = &sendArena[connection->sendSlot * kSendSlotSize];
+        for (const PooledBuffer& frame : connection->writeQueue) {
+            if (connection->inflightBytes + frame.size() > kSendSlotSize) {
+                break;
+            }
+            std::memcpy(base + connection->inflightBytes, frame.data(), frame.size());
+            connection->inflightBytes += frame.size();
+            ++connection->inflightFrames;
+        }
+    } else {
+        // 大帧直接从池化缓冲区聚集发送，不再拷贝
+        connection->sendSlot = -1;
+        connection->writeVectors.clear();
+        for (const PooledBuffer& frame : connection->writeQueue) {
+            if (connection->inflightFrames == kMaxGatherFrames) {
+                break;
+            }
+            connection->writeVectors.push_back({const_cast<char*>(frame.data()), frame.size()});
+            connection->inflightBytes += frame.size();
+            ++connection->inflightFrames;
+        }
+    }
+
+    connection->writing = true;
+    submitWrite(connection);
+}
+
+void UringTransport::submitWrite(const ConnectionPtr& connection) {
+    io_uring_sqe* sqe = getSqe();
+
+    if (connection->sendSlot >= 0) {
+        const char* base = &sendArena[connection->sendSlot * kSendSlotSize] + connection->writtenBytes;
+        unsigned remaining = static_cast<unsigned>(connection->inflightBytes - connection->writtenBytes);
+        // write_fixed 不能带 MSG_NOSIGNAL，固定缓冲区改由 send 的 IORING_RECVSEND_FIXED_BUF 使用
+        io_uring_prep_send(sqe, connection->fd, base, remaining, MSG_NOSIGNAL);
+        connection->sendFixed = fixedSendSupported;
+        if (connection->sendFixed) {
+            sqe->ioprio |= IORING_RECVSEND_FIXED_BUF;
+            sqe->buf_index = 0;
+        }
+    } else {
+        connection->sendFixed = false;
+        std::memset(&connection->writeMessage, 0, sizeof(connection->writeMessage));
+        connection->writeMessage.msg_iov = connection->writeVectors.data();
+        connection->writeMessage.msg_iovlen = connection->writeVectors.size();
+        io_uring_prep_sendmsg(sqe, connection->fd, &connection->writeMessage, MSG_NOSIGNAL);
+    }
+
+    io_uring_sqe_set_data64(sqe, userData(OP_SEND, connection->id));
+    ++connection->pendingOps;
+}
+
+void UringTransport::handleSend(const ConnectionPtr& connection, int result) {
+    // 较旧的内核只允许零拷贝发送使用固定缓冲区，普通 send 会返回 EINVAL，之后改为普通 send 重试；
+    // 按这次发送是否用了固定缓冲区判断，其他连接已经关掉这个特性时在途的 send 同样要重试
+    if (result == -EINVAL && connection->sendFixed) {
+        if (fixedSendSupported) {
+            CRYPTOLINK_LOG_INFO("内核不支持 send 使用固定缓冲区，改用普通发送");
+            fixedSendSupported = false;
+        }
+        if (!connection->closed) {
+            submitWrite(connection);
+            return;
+        }
+    }
+
+    if (result < 0) {
+        releaseSendSlot(connection);
+        connection->writing = false;
+        finish(connection);
+        return;
+    }
+
+    connection->writtenBytes += static_cast<size_t>(result);
+    if (connection->writtenBytes < connection->inflightBytes && !connection->closed) {
+        // 部分写入：聚集发送时跳过已经写完的部分，固定缓冲区直接按偏移续写
+        if (connection->sendSlot < 0) {
+            size_t advance = static_cast<size_t>(result);
+            while (advance > 0 && !connection->writeVectors.empty()) {
+                iovec& front = connection->writeVectors.front();
+                if (advance >= front.iov_len) {
+                    advance -= front.iov_len;
+                    connection->writeVectors.erase(connection->writeVectors.begin());
+                } else {
+                    front.iov_base = static_cast<char*>(front.iov_base) + advance;
+                    front.iov_len -= advance;
+                    advance = 0;
+                }
+            }
+        }
+        submitWrite(connection);
+        return;
+    }
+
+    releaseSendSlot(connection);
+    connection->writing = false;
+    if (connection->closed) {
+        return;
+    }
+
+    for (size_t i = 0; i < connection->inflightFrames; ++i) {
+        connection->queuedBytes -= connection->writeQueue[i].size();
+    }
+    connection->writeQueue.erase(connection->writeQueue.begin(),
+                                 connection->writeQueue.begin() + connection->inflightFrames);
+    if (!connection->writeQueue.empty()) {
+        startWrite(connection);
+    } else if (connection->closing) {
+        shutdown(connection);
+    }
+}
+
+void UringTransport::releaseSendSlot(const ConnectionPtr& connection) {
+    if (connection->sendSlot >= 0) {
+        freeSendSlots.push_back(connection->sendSlot);
+        connection->sendSlot = -1;
+    }
+}
+
+void UringTransport::drainInbox() {
+    std::vector<std::pair<ConnectionPtr, PooledBuffer>> sends;
+    std::vector<ConnectionPtr> closes;
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(inboxMutex);
+        sends.swap(pendingSends);
+        closes.swap(pendingCloses);
+        tasks.swap(pendingTasks);
+    }
+
+    // 投递的任务先执行，它们发出的帧和收件箱里的帧一起提交
+    for (auto& task : tasks) {
+        task();
+    }
+
+    // 先把同一连接的帧全部入队，再统一发起写，尽量合并到一次提交
+    for (auto& pending : sends) {
+        if (!pending.first->closed && !pending.first->closing) {
+            pending.first->queuedBytes += pending.second.size();
+            pending.first->writeQueue.push_back(std::move(pending.second));
+        }
+    }
+    for (auto& pending : sends) {
+        startWrite(pending.first);
+    }
+    for (auto& connection : closes) {
+        beginClose(connection);
+    }
+}
+
+int UringTransport::runTimers() {
+    std::vector<std::function<void()>> expired;
+    {
+        std::lock_guard<std::mutex> lock(inboxMutex);
+        auto now = std::chrono::steady_clock::now();
+        while (!timers.empty() && timers.top().deadline <= now) {
+            expired.push_back(timers.top().callback);
+            timers.pop();
+        }
+    }
+
+    for (auto& callback : expired) {
+        callback();
+    }
+
+    // 返回距下一个定时器的毫秒数，没有定时器时返回 -1
+    std::lock_guard<std::mutex> lock(inboxMutex);
+    if (timers.empty()) {
+        return -1;
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        timers.top().deadline - std::chrono::steady_clock::now()).count();
+    return static_cast<int>(std::max<int64_t>(remaining, 0));
+}
+
+void UringTransport::beginClose(const ConnectionPtr& connection) {
+    if (connection->closed) {
+        return;
+    }
+
+    // 先把已排队的帧写完再断开
+    connection->closing = true;
+    if (!connection->writing && connection->writeQueue.empty()) {
+        shutdown(connection);
+    }
+}
+
+void UringTransport::shutdown(const ConnectionPtr& connection) {
+    finish(connection);
+}
+
+void UringTransport::finish(const ConnectionPtr& connection) {
+    if (connection->closed) {
+        return;
+    }
+    connection->closed = true;
+    bool wasOpen = connection->open.exchange(false);
+
+    // shutdown 让在途的 recv/send 尽快完成，描述符等它们都完成后再关闭
+    if (connection->fd >= 0) {
+        ::shutdown(connection->fd, SHUT_RDWR);
+    }
+
+    if (wasOpen) {
+        if (handlers.onClose) {
+            handlers.onClose(connection);
+        }
+    } else if (handlers.onFail) {
+        handlers.onFail(connection);
+    }
+
+    if (connection->pendingOps == 0) {
+        release(connection);
+    }
+}
+
+void UringTransport::release(const ConnectionPtr& connection) {
+    if (connection->fd >= 0) {
+        ::close(connection->fd);
+        connection->fd = -1;
+    }
+    connections.erase(connection->id);
+}
+
+#endif // CRYPTOLINK_HAVE_IO_URING
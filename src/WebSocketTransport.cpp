@@ -0,0 +1,250 @@
+#include "WebSocketTransport.h"
+#include <type_traits>
+
+namespace {
+
+// 共享事件循环上各传输共用的 websocketpp 日志流，作为 asio 服务随事件循环存在
+// 共享的事件循环只在一个线程上运行，写入不会并发
+class LoopLogStreams : public boost::asio::io_context::service {
+public:
+    static boost::asio::io_context::id id;
+
+    explicit LoopLogStreams(boost::asio::io_context& io)
+        : boost::asio::io_context::service(io), accessLog(LogLevel::INFO), errorLog(LogLevel::WARNING) {}
+
+    LogStream accessLog;
+    LogStream errorLog;
+
+private:
+    void shutdown() override {}
+};
+
+boost::asio::io_context::id LoopLogStreams::id;
+
+}
+
+template <typename Endpoint>
+WebSocketTransport<Endpoint>::WebSocketTransport(boost::asio::io_context* loop)
+    : accessLog(LogLevel::INFO), errorLog(LogLevel::WARNING), sharedLoop(loop != nullptr),
+      alive(std::make_shared<bool>(true)) {
+    if (loop) {
+        LoopLogStreams& streams = boost::asio::use_service<LoopLogStreams>(*loop);
+        endpoint.get_alog().set_ostream(&streams.accessLog);
+        endpoint.get_elog().set_ostream(&streams.errorLog);
+    } else {
+        endpoint.get_alog().set_ostream(&accessLog);
+        endpoint.get_elog().set_ostream(&errorLog);
+    }
+    
+    // 生产环境只记录连接失败和错误；逐连接、逐帧的访问日志只在 DEBUG 级别打开
+    endpoint.clear_access_channels(websocketpp::log::alevel::all);
+    endpoint.clear_error_channels(websocketpp::log::elevel::all);
+    if (Logger::enabled(LogLevel::DEBUG)) {
+        endpoint.set_access_channels(websocketpp::log::alevel::all);
+        endpoint.clear_access_channels(websocketpp::log::alevel::frame_payload);
+        endpoint.set_error_channels(websocketpp::log::elevel::all);
+    } else {
+        endpoint.set_access_channels(websocketpp::log::alevel::fail);
+        endpoint.set_error_channels(websocketpp::log::elevel::warn | websocketpp::log::elevel::rerror |
+                                    websocketpp::log::elevel::fatal);
+    }
+    if (loop) {
+        endpoint.init_asio(loop);
+    } else {
+        endpoint.init_asio();
+    }
+
+    if constexpr (std::is_same_v<Endpoint, websocketpp::server<websocketpp::config::asio>>) {
+        endpoint.set_reuse_addr(true);
+    }
+}
+
+template <typename Endpoint>
+WebSocketTransport<Endpoint>::~WebSocketTransport() {
+    if (sharedLoop) {
+        // 共享事件循环继续运行，连接的收尾回调发现传输已销毁后直接返回
+        closeAll();
+    }
+}
+
+template <typename Endpoint>
+void WebSocketTransport<Endpoint>::setHandlers(Handlers handlers) {
+    this->handlers = std::move(handlers);
+
+    // 连接对象复制这些回调，可能比传输活得久，回调先检查传输是否还在
+    endpoint.set_open_handler([this, guard = Guard(alive)](websocketpp::connection_hdl hdl) {
+        if (guard.expired()) {
+            return;
+        }
+        if (sharedLoop) {
+            openHandles.insert(hdl);
+        }
+        if (this->handlers.onOpen) {
+            this->handlers.onOpen(hdl);
+        }
+    });
+
+    endpoint.set_close_handler([this, guard = Guard(alive)](websocketpp::connection_hdl hdl) {
+        if (guard.expired()) {
+            return;
+        }
+        openHandles.erase(hdl);
+        if (this->handlers.onClose) {
+            this->handlers.onClose(hdl);
+        }
+    });
+
+    endpoint.set_fail_handler([this, guard = Guard(alive)](websocketpp::connection_hdl hdl) {
+        if (guard.expired()) {
+            return;
+        }
+        if (this->handlers.onFail) {
+            this->handlers.onFail(hdl);
+        }
+    });
+
+    endpoint.set_message_handler([this, guard = Guard(alive)](websocketpp::connection_hdl hdl, typename Endpoint::message_ptr msg) {
+        if (!guard.expired() && this->handlers.onMessage) {
+            FrameType type = msg->get_opcode() == websocketpp::frame::opcode::binary ? FrameType::BINARY : FrameType::TEXT;
+            this->handlers.onMessage(hdl, type, msg->get_raw_payload());
+        }
+    });
+
+    endpoint.set_pong_handler([this, guard = Guard(alive)](websocketpp::connection_hdl hdl, std::string) {
+        if (!guard.expired() && this->handlers.onPong) {
+            this->handlers.onPong(hdl);
+        }
+    });
+}
+
+template <typename Endpoint>
+bool WebSocketTransport<Endpoint>::listen(const std::string& address) {
+    if constexpr (std::is_same_v<Endpoint, websocketpp::server<websocketpp::config::asio>>) {
+        try {
+            // 地址可以是端口，也可以是 host:port
+            size_t colonPos = address.rfind(':');
+            if (colonPos == std::string::npos) {
+                endpoint.listen(static_cast<uint16_t>(std::stoi(address)));
+            } else {
+                endpoint.listen(address.substr(0, colonPos), address.substr(colonPos + 1));
+            }
+            endpoint.start_accept();
+            return true;
+        } catch (const std::exception& e) {
+            CRYPTOLINK_LOG_ERROR("WebSocket监听失败: " << e.what());
+            return false;
+        }
+    } else {
+        (void)address;
+        return false;
+    }
+}
+
+template <typename Endpoint>
+bool WebSocketTransport<Endpoint>::connect(const std::string& address) {
+    if constexpr (std::is_same_v<Endpoint, websocketpp::client<websocketpp::config::asio_client>>) {
+        try {
+            websocketpp::lib::error_code ec;
+            typename Endpoint::connection_ptr con = endpoint.get_connection(address, ec);
+            if (ec) {
+                CRYPTOLINK_LOG_ERROR("连接创建失败: " << ec.message());
+                return false;
+            }
+            endpoint.connect(con);
+            return true;
+        } catch (const std::exception& e) {
+            CRYPTOLINK_LOG_ERROR("连接异常: " << e.what());
+            return false;
+        }
+    } else {
+        (void)address;
+        return false;
+    }
+}
+
+template <typename Endpoint>
+bool WebSocketTransport<Endpoint>::send(Handle hdl, const char* data, size_t length, FrameType type) {
+    websocketpp::lib::error_code ec;
+    endpoint.send(hdl, data, length,
+                  type == FrameType::BINARY ? websocketpp::frame::opcode::binary : websocketpp::frame::opcode::text, ec);
+    if (ec) {
+        CRYPTOLINK_LOG_ERROR("发送消息失败: " << ec.message());
+        return false;
+    }
+    return true;
+}
+
+template <typename Endpoint>
+void WebSocketTransport<Endpoint>::close(Handle hdl, uint16_t code, const std::string& reason) {
+    websocketpp::lib::error_code ec;
+    endpoint.close(hdl, code, reason, ec);
+}
+
+template <typename Endpoint>
+void WebSocketTransport<Endpoint>::ping(Handle hdl) {
+    websocketpp::lib::error_code ec;
+    endpoint.ping(hdl, "", ec);
+}
+
+template <typename Endpoint>
+size_t WebSocketTransport<Endpoint>::bufferedAmount(Handle hdl) {
+    websocketpp::lib::error_code ec;
+    typename Endpoint::connection_ptr con = endpoint.get_con_from_hdl(hdl, ec);
+    return (ec || !con) ? 0 : con->get_buffered_amount();
+}
+
+template <typename Endpoint>
+void WebSocketTransport<Endpoint>::setTimer(std::chrono::milliseconds delay, std::function<void()> callback) {
+    endpoint.set_timer(delay.count(), [guard = Guard(alive), callback](const websocketpp::lib::error_code& ec) {
+        if (!ec && !guard.expired()) {
+            callback();
+        }
+    });
+}
+
+template <typename Endpoint>
+void WebSocketTransport<Endpoint>::post(std::function<void()> task) {
+    boost::asio::post(endpoint.get_io_service(), [guard = Guard(alive), task = std::move(task)]() {
+        if (!guard.expired()) {
+            task();
+        }
+    });
+}
+
+template <typename Endpoint>
+void WebSocketTransport<Endpoint>::run() {
+    if (!sharedLoop) {
+        endpoint.run();
+    }
+}
+
+template <typename Endpoint>
+void WebSocketTransport<Endpoint>::stop() {
+    if (!sharedLoop) {
+        endpoint.stop();
+        return;
+    }
+    boost::asio::dispatch(endpoint.get_io_service(), [this, guard = Guard(alive)]() {
+        if (!guard.expired()) {
+            closeAll();
+        }
+    });
+}
+
+template <typename Endpoint>
+void WebSocketTransport<Endpoint>::closeAll() {
+    // 之后的回调一律不再执行，与独占事件循环时 stop 的效果一致
+    alive = std::make_shared<bool>(true);
+    
+    websocketpp::lib::error_code ec;
+    if constexpr (std::is_same_v<Endpoint, websocketpp::server<websocketpp::config::asio>>) {
+        endpoint.stop_listening(ec);
+    }
+    for (const Handle& hdl : openHandles) {
+        endpoint.close(hdl, websocketpp::close::status::going_away, "", ec);
+    }
+    openHandles.clear();
+}
+
+template class WebSocketTransport<websocketpp::server<websocketpp::config::asio>>;
+template class WebSocketTransport<websocketpp::client<websocketpp::config::asio_client>>;